@@ -0,0 +1,22 @@
+#ifndef _AUDIO_MIDI_SCHEDULER_H
+#define _AUDIO_MIDI_SCHEDULER_H
+
+#include <Audio.h>
+#include <midi_scheduler.h>
+
+/*
+ * Hands the queued MIDI events to their handler at the start of every audio block.
+ * Like AudioSeqClock it must be created before the objects the events play.
+ */
+class AudioMidiScheduler : public AudioStream, public MidiScheduler {
+    public:
+    AudioMidiScheduler() : AudioStream(0, NULL), MidiScheduler(AUDIO_SAMPLE_RATE_EXACT, AUDIO_BLOCK_SAMPLES) {
+        active = true; // no connections, so the Audio library would not update it otherwise
+    }
+
+    virtual void update(void) {
+        process_block(micros());
+    }
+};
+
+#endif
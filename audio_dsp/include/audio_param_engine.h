@@ -0,0 +1,65 @@
+#ifndef _AUDIO_PARAM_ENGINE_H
+#define _AUDIO_PARAM_ENGINE_H
+
+#include <Audio.h>
+#include <param_engine.h>
+
+/*
+ * Runs a ParamEngine once per audio block.
+ * Like AudioSeqClock it has to be created before the objects it controls, so they use
+ * the new values within the same block. Created after the AudioSeqClock, parameter changes
+ * of the sequencer apply in the block of their step.
+ */
+class AudioParamEngine : public AudioStream, public ParamEngine {
+    public:
+    typedef void (*block_handler_t)();
+
+    AudioParamEngine(ParamStore &params, ModMatrix &mod) : AudioStream(0, NULL), ParamEngine(params, mod), block_handler(NULL) {
+        active = true; // no connections, so the Audio library would not update it otherwise
+    }
+
+    // Called from the audio interrupt at the start of every block, before its parameter changes are applied
+    void set_block_handler(block_handler_t handler) { block_handler = handler; }
+
+    virtual void update(void) {
+        if (block_handler) block_handler();
+        process(AUDIO_BLOCK_SAMPLES / AUDIO_SAMPLE_RATE_EXACT);
+    }
+
+    private:
+    block_handler_t block_handler;
+};
+
+/*
+ * Gain taken from a parameter of an AudioParamEngine, ramped per sample
+ * from the value of the previous block to the current one.
+ */
+class AudioParamGain : public AudioStream {
+    public:
+    AudioParamGain(const ParamEngine &engine, uint8_t id) : AudioStream(1, inputQueueArray), engine(engine), id(id) {
+    }
+
+    virtual void update(void) {
+        audio_block_t *block = receiveWritable(0);
+        if (!block) return;
+
+        // Gain in Q16, 1.0 = 65536
+        const int32_t start = (int32_t)(engine.get_previous(id) * 65536.0f);
+        const int32_t end = (int32_t)(engine.get(id) * 65536.0f);
+        const int32_t step = (end - start) / AUDIO_BLOCK_SAMPLES;
+        int32_t gain = start;
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            gain += step;
+            block->data[i] = (int16_t)((block->data[i] * gain) >> 16);
+        }
+        transmit(block);
+        release(block);
+    }
+
+    private:
+    const ParamEngine &engine;
+    const uint8_t id;
+    audio_block_t *inputQueueArray[1];
+};
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef _AUDIO_PLAY_OPS_H
+#define _AUDIO_PLAY_OPS_H
+
+#include <Audio.h>
+#include <ops_player.h>
+
+/*
+ * OpsPlayer as an Audio library source, all voices mixed into one output.
+ */
+class AudioPlayOps : public AudioStream, public OpsPlayer {
+    public:
+    AudioPlayOps() : AudioStream(0, NULL) {}
+
+    virtual void update(void) {
+        if (!is_playing()) return;
+        audio_block_t *block = allocate();
+        if (!block) return;
+        memset(block->data, 0, sizeof (block->data));
+        render(block->data, AUDIO_BLOCK_SAMPLES);
+        transmit(block);
+        release(block);
+    }
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef _AUDIO_PROFILER_H
+#define _AUDIO_PROFILER_H
+
+#include <Audio.h>
+#include <mcu_proto.h>
+
+/*
+ * Collects the CPU usage of the audio nodes and the time spent in the sections of loop().
+ * Every node is registered with a name and a McuStatGroup, so the load can be shown per group
+ * on the output MCU and per node on the serial console. Peaks are kept until reset_peaks().
+ * The Audio library only measures single nodes, so the load of a group is the sum of the peaks
+ * of its nodes. They may come from different blocks: the sum is an upper bound of the group's
+ * peak, and can exceed 100% although no block overran.
+ */
+class AudioProfiler {
+    public:
+    static const int MAX_NODES = 96;
+
+    enum Section {
+        SECTION_USB = 0,
+        SECTION_MIDI,
+        SECTION_INPUT,
+        SECTION_SAMPLER,
+        NUM_SECTIONS
+    };
+
+    AudioProfiler();
+
+    void add_node(AudioStream &node, const char *name, uint8_t group);
+
+    void begin_loop();
+    void end_loop();
+    void begin_section(Section s) { section_start[s] = micros(); } // sections may nest
+    void end_section(Section s);
+
+    float get_group_cpu_max(uint8_t group); // sum of the node peaks, percent of one audio block
+    uint32_t get_loop_max_us() const { return loop_max_us; }
+    uint32_t get_section_max_us(Section s) const { return section_max_us[s]; }
+    void reset_peaks(); // also resets the peaks of all registered nodes and AudioProcessorUsageMax()
+
+    // Prints every group with the sum of its node peaks, and every node with its peak, highest first
+    void print_nodes(Print &out);
+
+    private:
+    struct Node {
+        AudioStream *node;
+        const char *name;
+        uint8_t group;
+    };
+
+    Node nodes[MAX_NODES];
+    int num_nodes;
+    uint32_t loop_start;
+    uint32_t loop_max_us;
+    uint32_t section_start[NUM_SECTIONS];
+    uint32_t section_max_us[NUM_SECTIONS];
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _AUDIO_SAMPLE_STREAMER_H
+#define _AUDIO_SAMPLE_STREAMER_H
+
+#include <Audio.h>
+#include <sample_streamer.h>
+
+/*
+ * SampleStreamer as an Audio library source, all streaming voices mixed into one output.
+ * service() must be called from loop() as often as possible.
+ */
+class AudioSampleStreamer : public AudioStream, public SampleStreamer {
+    public:
+    AudioSampleStreamer(SampleStorage &storage, int16_t *stream_memory, int16_t *head_memory) :
+        AudioStream(0, NULL), SampleStreamer(storage, stream_memory, head_memory) {
+    }
+
+    virtual void update(void) {
+        if (!is_playing()) return;
+        audio_block_t *block = allocate();
+        if (!block) return;
+        memset(block->data, 0, sizeof (block->data));
+        render(block->data, AUDIO_BLOCK_SAMPLES);
+        transmit(block);
+        release(block);
+    }
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _AUDIO_SEQ_CLOCK_H
+#define _AUDIO_SEQ_CLOCK_H
+
+#include <Audio.h>
+#include <seq_clock.h>
+
+/*
+ * Drives a SeqClock from the audio block interrupt.
+ * The Audio library updates objects in construction order, so this object must be
+ * created before the nodes it triggers to have them react within the same block.
+ */
+class AudioSeqClock : public AudioStream, public SeqClock {
+    public:
+    AudioSeqClock() : AudioStream(0, NULL), SeqClock(AUDIO_SAMPLE_RATE_EXACT) {
+        active = true; // no connections, so the Audio library would not update it otherwise
+    }
+
+    virtual void update(void) {
+        advance(AUDIO_BLOCK_SAMPLES);
+    }
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef _AUDIO_VOICE_POOL_H
+#define _AUDIO_VOICE_POOL_H
+
+#include <Audio.h>
+#include <voice_pool.h>
+#include <audio_wavetable_osc.h>
+#include <audio_profiler.h>
+#include <param_engine.h>
+
+/*
+ * One synth voice: two oscillators -> mixer -> state variable lowpass -> envelope.
+ */
+class SynthVoice {
+    public:
+    SynthVoice();
+
+    AudioWavetableOsc osc1;
+    AudioWavetableOsc osc2;
+    AudioMixer4 osc_mix;
+    AudioFilterStateVariable filter;
+    AudioEffectEnvelope envelope;
+
+    void add_to_profiler(AudioProfiler &profiler, uint8_t group);
+    float get_cpu_usage_max(); // percent of one audio block, summed over the voice's objects
+    void reset_cpu_usage_max();
+
+    private:
+    AudioConnection cord_osc1;
+    AudioConnection cord_osc2;
+    AudioConnection cord_filter;
+    AudioConnection cord_envelope;
+};
+
+/*
+ * NUM_VOICES voices built at startup, mixed into output().
+ * Note on/off may come from loop() (MIDI) and from the audio interrupt (sequencer),
+ * so calls from loop() have to be wrapped in AudioNoInterrupts()/AudioInterrupts().
+ */
+class AudioVoicePool : public VoicePool {
+    public:
+    static const uint8_t NUM_VOICES = 8;
+
+    AudioVoicePool();
+    void begin();
+
+    AudioMixer4 &output() { return out_mix; }
+    void add_to_profiler(AudioProfiler &profiler, uint8_t group);
+
+    void set_osc_tune(int osc, float semitones); // 0 = osc1, 1 = osc2
+    void set_osc_shape(int osc, OscShape shape);
+    void set_osc_pulse_width(int osc, float width);
+    void set_filter(float cutoff_hz, float resonance);
+    void set_filter_cutoff(float cutoff_hz);
+    void set_filter_resonance(float resonance);
+    void set_envelope(float attack_ms, float decay_ms, float sustain, float release_ms);
+    void apply_param(const ParamEngine &engine, uint8_t id, float value); // sets the objects behind a ParamId
+
+    float get_voice_cpu_max(); // worst case of a single voice in percent of one audio block
+    uint32_t get_osc_block_cycles_max(); // worst oscillator, cycles per AUDIO_BLOCK_SAMPLES block
+    void reset_cpu_usage_max();
+
+    protected:
+    virtual void start_voice(uint8_t v, uint8_t note, uint8_t velocity, float detune_cents, bool retrigger);
+    virtual void release_voice(uint8_t v);
+    virtual bool is_voice_sounding(uint8_t v);
+
+    private:
+    void update_frequency(uint8_t v);
+
+    SynthVoice voices[NUM_VOICES];
+    AudioMixer4 sub_mix[2];
+    AudioMixer4 out_mix;
+    AudioConnection *cords[NUM_VOICES + 2];
+
+    float osc_tune[2];               // semitones
+    float voice_detune[NUM_VOICES];  // cents, from unison
+};
+
+#endif
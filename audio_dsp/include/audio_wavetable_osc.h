@@ -0,0 +1,39 @@
+#ifndef _AUDIO_WAVETABLE_OSC_H
+#define _AUDIO_WAVETABLE_OSC_H
+
+#include <Audio.h>
+#include <wavetable_osc.h>
+
+/*
+ * WavetableOsc as an Audio library source.
+ * Every update() is timed with the cycle counter, so the cost of one AUDIO_BLOCK_SAMPLES block
+ * can be read back with get_block_cycles() and get_block_cycles_max().
+ */
+class AudioWavetableOsc : public AudioStream, public WavetableOsc {
+    public:
+    AudioWavetableOsc() : AudioStream(0, NULL), WavetableOsc(AUDIO_SAMPLE_RATE_EXACT) {
+        block_cycles = block_cycles_max = 0;
+    }
+
+    virtual void update(void) {
+        const uint32_t start = ARM_DWT_CYCCNT;
+        audio_block_t *block = allocate();
+        if (!block) return;
+        render(block->data, AUDIO_BLOCK_SAMPLES);
+        transmit(block);
+        release(block);
+
+        block_cycles = ARM_DWT_CYCCNT - start;
+        if (block_cycles > block_cycles_max) block_cycles_max = block_cycles;
+    }
+
+    uint32_t get_block_cycles() const { return block_cycles; }
+    uint32_t get_block_cycles_max() const { return block_cycles_max; }
+    void reset_block_cycles_max() { block_cycles_max = 0; }
+
+    private:
+    volatile uint32_t block_cycles;
+    volatile uint32_t block_cycles_max;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef _MIDI_CLOCK_H
+#define _MIDI_CLOCK_H
+
+#include <stdint.h>
+
+#define MIDI_CLOCK 0xF8
+#define MIDI_START 0xFA
+#define MIDI_CONTINUE 0xFB
+#define MIDI_STOP 0xFC
+
+/*
+ * MIDI clock (24 per quarter note) in both directions.
+ *
+ * Master: the sequencer reports its ticks from the audio interrupt, loop() sends the clocks
+ * and start message that are due.
+ *
+ * Slave: clock() gets the arrival time of every incoming clock. The arrival times jitter by a
+ * millisecond or more (USB frames, loop() latency), so the clock period is tracked with a second
+ * order delay locked loop (F. Adriaensen, "Using a DLL to filter time"), which follows tempo
+ * changes within about a second but averages the jitter out.
+ */
+class MidiClock {
+    public:
+    enum Mode {
+        MODE_MASTER = 0,
+        MODE_SLAVE
+    };
+
+    static const uint32_t CLOCKS_PER_BEAT = 24;
+
+    MidiClock();
+    void set_mode(Mode mode) { this->mode = mode; }
+    Mode get_mode() const { return mode; }
+    void set_bandwidth(float hz); // of the DLL, lower follows tempo changes slower but filters more
+
+    // Master
+    void on_seq_tick(uint32_t tick, uint32_t ppqn); // audio interrupt
+    uint32_t take_clocks_due();                     // loop(): number of clocks to send now
+    bool take_start_due();                          // loop(): true once after the sequencer (re)started
+
+    // Slave, loop()
+    void clock(uint32_t now_us);
+    void start();
+    void resume();
+    bool is_locked(uint32_t now_us) const; // regular clocks arrive
+    float get_tempo() const;               // filtered, bpm
+    float get_follow_tempo(uint32_t seq_tick, uint32_t ppqn) const; // tempo that also pulls the sequencer into phase
+    float get_jitter_us() const { return jitter_us; } // average deviation of the arrivals from the filtered clock
+    uint32_t get_clock_count() const { return clock_count; }
+
+    private:
+    static const uint32_t LOCK_CLOCKS = 8;
+    static const uint32_t TIMEOUT_US = 500000;
+
+    Mode mode;
+
+    // Master
+    volatile uint32_t clocks_due;
+    volatile bool start_due;
+    uint32_t clocks_sent;
+
+    // Slave
+    float bandwidth;
+    double b, c;         // DLL coefficients
+    uint32_t base_us;    // t1 is relative to this, the arrival of the last clock
+    double t1;           // predicted time of the next clock
+    double period;       // filtered clock period, us
+    uint32_t last_us;
+    uint32_t clock_count; // clocks since start
+    uint32_t run_clocks;  // clocks since the DLL was (re)initialised
+    float jitter_us;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef _MIDI_SCHEDULER_H
+#define _MIDI_SCHEDULER_H
+
+#include <stdint.h>
+#include <spsc_queue.h>
+
+enum MidiEventType {
+    MIDI_EVENT_NOTE_OFF = 0,
+    MIDI_EVENT_NOTE_ON,
+    MIDI_EVENT_CONTROL
+};
+
+struct MidiEvent {
+    uint32_t time; // sample position
+    uint8_t type;
+    uint8_t channel;
+    uint8_t data1;
+    uint8_t data2;
+};
+
+/*
+ * Moves MIDI events from loop() to the audio interrupt.
+ *
+ * push() stamps every event with the sample position it arrived at, estimated from the
+ * micros() time of the last block start, plus a fixed delay of one block. process_block()
+ * hands out the events of the block together with their sample offset, so the time between
+ * two events is kept no matter when loop() got around to reading them; only the fixed delay
+ * is added. An event can only miss its block if the audio interrupt itself was late.
+ */
+class MidiScheduler {
+    public:
+    static const uint32_t QUEUE_SIZE = 64;
+
+    typedef void (*event_handler_t)(const MidiEvent &event, uint16_t offset);
+
+    MidiScheduler(double sample_rate, uint16_t block_samples);
+    void set_event_handler(event_handler_t handler) { event_handler = handler; }
+
+    // loop()
+    bool push(uint8_t type, uint8_t channel, uint8_t data1, uint8_t data2, uint32_t now_us);
+    uint32_t get_dropped() const { return dropped; }
+
+    // Audio interrupt, once per block
+    void process_block(uint32_t now_us);
+    uint32_t get_late() const { return late; }
+    uint32_t get_sample_pos() const { return sample_pos; }
+
+    private:
+    uint32_t timestamp(uint32_t now_us) const;
+
+    float samples_per_us;
+    uint16_t block_samples;
+    event_handler_t event_handler;
+    SpscQueue<MidiEvent, QUEUE_SIZE> queue;
+    uint32_t dropped;
+
+    // Start of the current block, written by the interrupt. Odd stamp_seq while it is being written.
+    volatile uint32_t stamp_seq;
+    volatile uint32_t stamp_sample;
+    volatile uint32_t stamp_us;
+
+    uint32_t sample_pos; // start of the next block
+    volatile uint32_t late;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef _MOD_MATRIX_H
+#define _MOD_MATRIX_H
+
+#include <stdint.h>
+#include <param_store.h>
+
+enum ModSource {
+    MOD_LFO1 = 0,   // sine, -1 .. 1, rate PARAM_LFO1_RATE
+    MOD_LFO2,       // triangle, -1 .. 1, rate PARAM_LFO2_RATE
+    MOD_ENV,        // attack/decay envelope, 0 .. 1, restarted by trigger_envelope()
+    MOD_WHEEL,      // 0 .. 1, set_wheel()
+    NUM_MOD_SOURCES
+};
+
+/*
+ * Control rate modulation: every slot adds source * depth * (range of the parameter) to one parameter.
+ * process() runs once per audio block and evaluates all sources first, then all slots in one pass.
+ *
+ * Slots are packed into a single word each, so set_slot() from loop() never leaves a half written
+ * slot for the audio interrupt; the wheel and envelope triggers are single words as well.
+ */
+class ModMatrix {
+    public:
+    static const int MAX_SLOTS = 8;
+
+    ModMatrix();
+
+    void set_slot(int slot, uint8_t source, uint8_t dest, float depth); // depth -1 .. 1
+    void clear_slot(int slot);
+    uint32_t get_packed_slot(int slot) const { return slots[slot]; } // as stored in presets
+    void set_packed_slot(int slot, uint32_t packed);
+    void set_wheel(float value);
+    void trigger_envelope();
+
+    // Audio side, once per block: offsets[NUM_PARAMS] in the units of each parameter
+    void process(const ParamStore &params, float block_seconds, float *offsets);
+    float get_source(uint8_t source) const { return sources[source]; }
+
+    private:
+    static const uint8_t NO_SOURCE = 0xff;
+
+    volatile uint32_t slots[MAX_SLOTS]; // depth (Q15) << 16 | source << 8 | dest
+    volatile float wheel;
+    volatile uint32_t env_triggers;
+
+    // Audio side only
+    uint32_t env_seen;
+    bool env_attack;
+    float env_level;
+    float lfo_phase[2];
+    float sources[NUM_MOD_SOURCES];
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _OPS_PLAYER_H
+#define _OPS_PLAYER_H
+
+#include <stdint.h>
+#include <sample_format.h>
+
+/*
+ * One-shot and slice playback of OPS samples straight from memory (see sample_format.h).
+ * Samples play at their original rate. A looping sample repeats its loop while the voice is held.
+ */
+class OpsPlayer {
+    public:
+    static const uint8_t MAX_VOICES = 4;
+
+    OpsPlayer();
+
+    // slice < 0 plays the whole sample, offset delays the start within the next render() call.
+    // Returns the voice, which can be stopped or released.
+    int play(const OpsHeader *sample, int slice, float gain, uint16_t offset = 0);
+    void release_voice(uint8_t v); // leaves the loop and plays to the end
+    void stop_voice(uint8_t v);
+    bool is_playing() const;
+
+    void render(int16_t *out, int num_samples); // adds all voices to out
+
+    private:
+    struct Voice {
+        const int16_t *data; // NULL when idle
+        uint32_t pos;
+        uint32_t end;
+        uint32_t loop_start, loop_end; // loop_end = 0 if not looping
+        int16_t gain; // Q15
+        uint16_t delay; // samples of silence before pos
+        uint32_t started;
+    };
+
+    Voice voices[MAX_VOICES];
+    uint32_t start_counter;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef _PARAM_ENGINE_H
+#define _PARAM_ENGINE_H
+
+#include <param_store.h>
+#include <mod_matrix.h>
+
+/*
+ * Called with the new value of a parameter, from the audio interrupt
+ */
+typedef void (*ParamHandler)(uint8_t id, float value);
+
+/*
+ * Once per audio block: takes the new parameter targets, ramps them, adds the modulation
+ * and calls the handler for every parameter whose final value changed.
+ * Nothing else touches the synth objects, so the control code never waits for the audio interrupt.
+ */
+class ParamEngine {
+    public:
+    ParamEngine(ParamStore &params, ModMatrix &mod);
+
+    void set_handler(ParamHandler handler) { this->handler = handler; }
+    void process(float block_seconds);
+
+    // Final values with modulation, of this and of the previous block (for per sample ramps)
+    float get(uint8_t id) const { return value[id]; }
+    float get_previous(uint8_t id) const { return previous[id]; }
+
+    private:
+    ParamStore &params;
+    ModMatrix &mod;
+    ParamHandler handler;
+    bool first_block;
+
+    float value[NUM_PARAMS];
+    float previous[NUM_PARAMS];
+    float applied[NUM_PARAMS];
+    float offsets[NUM_PARAMS];
+};
+
+#endif
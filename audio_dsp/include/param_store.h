@@ -0,0 +1,45 @@
+#ifndef _PARAM_STORE_H
+#define _PARAM_STORE_H
+
+#include <stdint.h>
+#include <param_desc.h>
+
+int param_for_cc(uint8_t control); // parameter controlled by a MIDI CC, or -1
+int param_for_name(const char *name); // or -1
+
+/*
+ * Parameter values (see param_desc.h for their ranges) shared between the control code and the audio interrupt.
+ *
+ * set() may be called from anywhere (loop(), MIDI handlers, the sequencer in the audio interrupt):
+ * it stores the new target and then marks it in an atomic bit mask. The audio side calls latch()
+ * once per block, which takes all marked targets at once, and advance(), which ramps every value
+ * towards its target over smooth_blocks blocks, so parameter jumps do not cause zipper noise.
+ * A longer ramp can be given per set(), e.g. to glide from one preset to the next.
+ */
+class ParamStore {
+    public:
+    ParamStore();
+
+    void set(uint8_t id, float value, uint16_t ramp_blocks = 0); // clamped to the range, ramp 0 = smooth_blocks
+    void set_normalized(uint8_t id, float value); // 0 .. 1 over the range, e.g. from a MIDI CC
+    float get_target(uint8_t id) const { return target[id]; }
+
+    // Audio side, once per block
+    void latch();
+    void advance();
+    float get(uint8_t id) const { return current[id]; }
+    bool is_ramping(uint8_t id) const { return remaining[id] > 0; }
+
+    private:
+    volatile float target[NUM_PARAMS];
+    volatile uint16_t ramp[NUM_PARAMS];
+    volatile uint32_t pending; // bit per parameter with a new target
+
+    // Audio side only
+    float current[NUM_PARAMS];
+    float step[NUM_PARAMS];
+    uint16_t remaining[NUM_PARAMS];
+    float latched[NUM_PARAMS];
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef _PARAM_SYNC_H
+#define _PARAM_SYNC_H
+
+#include <stdint.h>
+#include <mcu_proto.h>
+#include <param_store.h>
+
+/*
+ * Sends the parameter state to the output MCU and takes its parameter changes (see McuStateId).
+ *
+ * write_frame() compares the parameter targets with what was sent last, so every change is seen,
+ * whether it came from MIDI, a preset, the sequencer or the output MCU itself. Calling it at a fixed
+ * interval coalesces everything in between to the latest value per parameter: an encoder sweep or
+ * a burst of MIDI CCs costs at most one frame per interval.
+ * Only for loop(), not for the audio interrupt.
+ */
+class ParamSync {
+    public:
+    static const int PARAMS_PER_FRAME = MCU_MAX_MSGS_PER_FRAME - 2; // room for the header and STATE_SNAPSHOT_END
+
+    ParamSync();
+    void request_snapshot(); // all parameters with the next frames, done at startup
+
+    // Writes the next state frame into an empty frame, call until it returns false
+    bool write_frame(const ParamStore &params, McuFrameWriter &frame);
+    void handle_msg(const McuMsg &msg, ParamStore &params); // received from the output MCU
+    uint16_t get_version() const { return version; }
+
+    // Diagnostics
+    uint32_t get_frames() const { return frames; }
+    uint32_t get_snapshots() const { return snapshots; }
+
+    private:
+    void collect_changes(const ParamStore &params);
+
+    float seen[NUM_PARAMS];    // targets at the last check
+    int16_t values[NUM_PARAMS]; // position of each target, as sent
+    uint32_t dirty;             // bit per parameter to send
+    bool snapshot_pending;
+    bool in_snapshot;
+    uint16_t version;           // of the last state frame
+    uint32_t frames;
+    uint32_t snapshots;
+};
+
+#endif
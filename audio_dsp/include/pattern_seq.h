@@ -0,0 +1,159 @@
+#ifndef _PATTERN_SEQ_H
+#define _PATTERN_SEQ_H
+
+#include <stdint.h>
+#include <param_store.h>
+#include <seq_clock.h>
+
+#if defined(__IMXRT1062__)
+#include <AudioStream.h>
+#define SEQ_LOCK() AudioNoInterrupts()
+#define SEQ_UNLOCK() AudioInterrupts()
+#else
+#define SEQ_LOCK()
+#define SEQ_UNLOCK()
+#endif
+
+enum TrigCondition {
+    TRIG_ALWAYS = 0,
+    TRIG_PROBABILITY, // arg = percent
+    TRIG_RATIO,       // arg = a << 4 | b: plays in loop a of every b loops of the track, e.g. 1:2, 4:4
+    TRIG_FILL,        // only while fill is on
+    TRIG_NOT_FILL,
+    TRIG_FIRST,       // only in the first loop of the track after the pattern started
+    TRIG_NOT_FIRST,
+    TRIG_PRE,         // if the last conditional trig of this track played
+    TRIG_NOT_PRE,
+    TRIG_NEI,         // if the last conditional trig of the track before played
+    TRIG_NOT_NEI,
+    NUM_TRIG_CONDITIONS
+};
+
+/*
+ * One pattern: NUM_TRACKS tracks of up to NUM_STEPS 16th steps, each with its own length.
+ *
+ * Stored as a struct of arrays: every step attribute is one array over all cells, cell = step * NUM_TRACKS
+ * + track, so the attributes of all tracks at the same step share a cache line. Parameter locks are
+ * a pool sorted by cell: the locks of a cell are lock_start[cell] .. lock_start[cell + 1] - 1.
+ * sizeof (Pattern) is ~5.4 KB; 16 patterns take 86 KB of the Teensy 4's 512 KB DMAMEM (OCRAM).
+ *
+ * The editing functions may be called from loop() while the pattern plays.
+ */
+struct Pattern {
+    static const uint8_t NUM_TRACKS = 8;
+    static const uint8_t NUM_STEPS = 64;
+    static const int NUM_CELLS = NUM_TRACKS * NUM_STEPS;
+    static const int MAX_LOCKS = 256;
+    static const uint32_t STEP_TICKS = SeqClock::TICKS_PER_16TH;
+    static const int8_t MICRO_MIN = -(int8_t)(STEP_TICKS / 2 - 1); // micro-timing in ticks, about +-half a step
+    static const int8_t MICRO_MAX = STEP_TICKS / 2;
+
+    uint64_t trigs[NUM_TRACKS]; // bit per step
+    uint8_t length[NUM_TRACKS]; // steps, 1 .. NUM_STEPS
+    uint8_t master_length;      // steps, 1 .. NUM_STEPS: a chained or cued pattern takes over at its end
+
+    uint8_t note[NUM_CELLS];
+    uint8_t velocity[NUM_CELLS];
+    uint8_t gate[NUM_CELLS];    // ticks until the note off
+    int8_t micro[NUM_CELLS];    // ticks, MICRO_MIN .. MICRO_MAX
+    uint8_t condition[NUM_CELLS];
+    uint8_t condition_arg[NUM_CELLS];
+
+    uint16_t lock_start[NUM_CELLS + 1];
+    uint8_t lock_param[MAX_LOCKS];
+    float lock_value[MAX_LOCKS];
+
+    static int cell(uint8_t track, uint8_t step) { return step * NUM_TRACKS + track; }
+
+    void clear(); // no trigs, all tracks 16 steps
+    void set_length(uint8_t track, uint8_t steps);
+    void set_trig(uint8_t track, uint8_t step, uint8_t note, uint8_t velocity, uint8_t gate_ticks);
+    void clear_trig(uint8_t track, uint8_t step); // and its locks
+    void set_micro(uint8_t track, uint8_t step, int8_t ticks);
+    void set_condition(uint8_t track, uint8_t step, uint8_t condition, uint8_t arg = 0);
+    bool set_lock(uint8_t track, uint8_t step, uint8_t param, float value); // false if the pool is full
+    void clear_lock(uint8_t track, uint8_t step, uint8_t param);
+    int get_num_locks() const { return lock_start[NUM_CELLS]; }
+
+    private:
+    void insert_lock(int c, int pos, uint8_t param, float value);
+    void remove_lock(int c, int pos);
+};
+
+struct SongRow {
+    uint8_t pattern;
+    uint8_t repeats; // times the pattern plays, at least 1
+};
+
+/*
+ * Plays patterns from the sequencer clock (see SeqClock), in the audio interrupt.
+ *
+ * tick() does constant work per tick: the micro-timing range is one step wide, so for every track
+ * only the step nearest to the tick can be due, and it plays if it has a trig whose micro-timing
+ * lands exactly on this tick and whose condition is met. Nothing is scanned or allocated.
+ * A trig's locked parameters are set through ParamStore::set() when it plays and return to the
+ * values from before the lock at the next trig of the track which does not lock them.
+ *
+ * Tracks loop over their own length, independent of each other, and TRIG_RATIO counts those loops.
+ * Patterns change at the end of their master length, to a cued pattern or along the song, and
+ * then all tracks start over. With negative micro-timing, step 0 of a new pattern plays on its first tick.
+ */
+class PatternSeq {
+    public:
+    static const int MAX_SONG_ROWS = 64;
+
+    typedef void (*note_handler_t)(uint8_t track, uint8_t note, uint8_t velocity, uint16_t offset); // velocity 0: note off
+
+    PatternSeq(Pattern *patterns, uint8_t num_patterns, ParamStore &params);
+    void set_note_handler(note_handler_t handler) { note_handler = handler; }
+
+    // Control, from loop()
+    void cue_pattern(uint8_t pattern); // plays next, then keeps looping
+    void set_song(const SongRow *rows, uint8_t num_rows, bool loop); // from the next start, 0 rows = no song
+    void set_fill(bool on) { fill = on; }
+    void set_mute(uint8_t track, bool mute);
+
+    // Audio side
+    void tick(uint32_t tick, uint16_t offset); // every clock tick in order, tick 0 restarts
+    void release_notes(); // note offs for all sounding notes, e.g. after the clock stopped
+    uint8_t get_pattern() const { return current; }
+    uint8_t get_song_row() const { return song_row; }
+
+    private:
+    void restart();
+    bool changes_pattern() const;
+    void next_pattern();
+    bool condition_met(const Pattern &p, int c, uint8_t track, uint32_t loop_index);
+    void apply_locks(const Pattern &p, int c, uint8_t track);
+    void play(const Pattern &p, int c, uint8_t track, uint16_t offset);
+    uint32_t random();
+
+    Pattern *patterns;
+    uint8_t num_patterns;
+    ParamStore &params;
+    note_handler_t note_handler;
+
+    // Written from loop()
+    volatile int16_t cued; // -1 if none
+    volatile bool fill;
+    volatile uint8_t mutes; // bit per track
+    SongRow song[MAX_SONG_ROWS];
+    uint8_t song_rows;
+    bool song_loop;
+
+    // Audio side only
+    uint8_t current;
+    uint8_t song_row;
+    uint8_t song_repeat;
+    uint32_t pattern_tick;  // ticks since the current pattern started, it may have looped
+    uint32_t ticks;         // ticks since the last restart, for the note offs
+    uint8_t sounding;       // bit per track with a note to turn off
+    uint8_t off_note[Pattern::NUM_TRACKS];
+    uint32_t off_tick[Pattern::NUM_TRACKS];
+    uint8_t last_result;    // bit per track: last conditional trig played
+    uint32_t locked[Pattern::NUM_TRACKS]; // bit per parameter locked by the last trig
+    float unlocked_value[Pattern::NUM_TRACKS][NUM_PARAMS];
+    uint32_t random_state;
+};
+
+#endif
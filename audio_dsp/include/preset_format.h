@@ -0,0 +1,59 @@
+#ifndef _PRESET_FORMAT_H
+#define _PRESET_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <mcu_proto.h>
+
+/*
+ * Preset record as stored in flash: one fixed 256 byte layout, little-endian, so a record is
+ * checked and applied straight from the read buffer without parsing.
+ *
+ * Values are stored by ParamId, which is append-only. A record written by an older firmware with
+ * fewer parameters has a smaller num_params, and the missing ones take their init values.
+ * Changing the meaning of existing fields needs a new PRESET_VERSION.
+ * The CRC (the same as in MCU frames) covers everything before it, so a record torn by a power
+ * loss while it was written is recognised and skipped.
+ */
+
+#define PRESET_MAGIC "OPP1"
+#define PRESET_VERSION 1
+#define PRESET_RECORD_SIZE 256
+#define PRESET_MAX_PARAMS 48
+#define PRESET_MAX_MOD_SLOTS 8
+#define PRESET_NAME_SIZE 16
+
+struct PresetRecord {
+    char magic[4];
+    uint16_t version;
+    uint8_t num_params;
+    uint8_t num_mod_slots;
+    uint32_t generation;  // counts the saves of a slot
+    char name[PRESET_NAME_SIZE]; // not necessarily terminated
+    float values[PRESET_MAX_PARAMS];
+    uint32_t mod_slots[PRESET_MAX_MOD_SLOTS]; // packed like ModMatrix slots
+    uint16_t reserved;    // 0
+    uint16_t crc;
+};
+
+// Only works if the layout is identical everywhere (little-endian, no padding)
+static_assert(sizeof (PresetRecord) == PRESET_RECORD_SIZE, "PresetRecord must not be padded");
+
+inline uint16_t preset_record_crc(const PresetRecord &r) {
+    return mcu_crc16((const uint8_t *)&r, offsetof(PresetRecord, crc));
+}
+
+// True for every record which has been started, erased flash reads 0xff
+inline bool preset_record_written(const PresetRecord &r) {
+    return (uint8_t)r.magic[0] != 0xff || (uint8_t)r.magic[1] != 0xff
+        || (uint8_t)r.magic[2] != 0xff || (uint8_t)r.magic[3] != 0xff;
+}
+
+inline bool preset_record_valid(const PresetRecord &r) {
+    return memcmp(r.magic, PRESET_MAGIC, 4) == 0 && r.version == PRESET_VERSION
+        && r.num_params <= PRESET_MAX_PARAMS && r.num_mod_slots <= PRESET_MAX_MOD_SLOTS
+        && r.crc == preset_record_crc(r);
+}
+
+#endif
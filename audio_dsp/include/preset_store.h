@@ -0,0 +1,88 @@
+#ifndef _PRESET_STORE_H
+#define _PRESET_STORE_H
+
+#include <stdint.h>
+#include <preset_format.h>
+#include <param_store.h>
+#include <mod_matrix.h>
+
+/*
+ * Raw access to the flash area of the presets, addresses relative to its start.
+ * SerialFlash on the Teensy (serial_flash_preset_storage.h), RAM on a PC.
+ */
+class PresetStorage {
+    public:
+    virtual ~PresetStorage() {}
+    virtual bool read(uint32_t addr, void *buf, uint32_t len) = 0;
+    virtual bool write(uint32_t addr, const void *buf, uint32_t len) = 0; // only into erased flash
+    virtual bool erase_block(uint32_t addr) = 0; // PresetStore::BLOCK_SIZE bytes, aligned
+};
+
+/*
+ * A synth sound: every parameter and the modulation slots.
+ */
+struct Preset {
+    char name[PRESET_NAME_SIZE + 1];
+    float values[NUM_PARAMS];
+    uint32_t mod_slots[ModMatrix::MAX_SLOTS];
+
+    void init(); // init values of all parameters, no modulation
+    void capture(const ParamStore &params, const ModMatrix &mod); // targets, not the ramping values
+    // Parameters glide over ramp_blocks (0 = their usual smoothing), discrete ones switch at once
+    void apply(ParamStore &params, ModMatrix &mod, uint16_t ramp_blocks = 0) const;
+};
+
+/*
+ * Sets params to a mix of two presets, amount 0 = a .. 1 = b, e.g. from a controller.
+ * Frequencies mix in equal ratios; discrete parameters and the modulation slots switch halfway.
+ * The parameter smoothing turns every step of amount into a ramp, so morphing does not glitch.
+ */
+void preset_morph(const Preset &a, const Preset &b, float amount, ParamStore &params, ModMatrix &mod);
+
+/*
+ * Presets in flash. Each slot owns one erase block, which is a log of PresetRecords: a save
+ * appends the next record and only every RECORDS_PER_SLOT-th save erases the block, so flash
+ * endurance lasts 256 times longer than overwriting in place. A save which fails or is torn by
+ * a power loss leaves the previous record of the slot in place, except for the save which has
+ * to erase the full block first.
+ *
+ * begin() finds the newest record of every slot (a binary search for the end of each log),
+ * so load() is a single read of one record plus applying it, well below one audio block.
+ * A slot whose log cannot be read is empty, and save() refuses it until a new scan succeeds.
+ * Saving blocks loop() while the flash writes; the erase of a full block can take up to a second.
+ * Not for the audio interrupt, flash access may have to wait for the SPI bus.
+ */
+class PresetStore {
+    public:
+    static const uint8_t NUM_SLOTS = 16;
+    static const uint32_t BLOCK_SIZE = 65536;
+    static const int RECORDS_PER_SLOT = BLOCK_SIZE / PRESET_RECORD_SIZE;
+    static const uint32_t AREA_SIZE = NUM_SLOTS * BLOCK_SIZE;
+
+    PresetStore(PresetStorage &storage);
+    void begin();
+
+    bool save(uint8_t slot, const Preset &preset);
+    bool load(uint8_t slot, Preset &preset);
+    bool is_used(uint8_t slot) const { return slot < NUM_SLOTS && newest[slot] >= 0; }
+
+    // Diagnostics
+    uint32_t get_erases() const { return erases; }
+    uint32_t get_errors() const { return errors; }
+
+    private:
+    static const int16_t UNREADABLE = -1; // next_free of a slot which could not be scanned
+
+    uint32_t record_addr(uint8_t slot, int record) const { return slot * BLOCK_SIZE + record * PRESET_RECORD_SIZE; }
+    bool read_record(uint8_t slot, int record, PresetRecord &r);
+    void scan_slot(uint8_t slot);
+
+    PresetStorage &storage;
+    int16_t newest[NUM_SLOTS];    // record index, -1 if the slot is empty
+    int16_t next_free[NUM_SLOTS]; // RECORDS_PER_SLOT if the block is full, UNREADABLE if unknown
+    uint32_t generation[NUM_SLOTS];
+    uint32_t erases;
+    uint32_t errors;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _SAMPLE_ARENA_H
+#define _SAMPLE_ARENA_H
+
+#include <stdint.h>
+
+/*
+ * Fixed-size memory pool for sample data, carved into PAGE_SIZE pages.
+ * An allocation is a run of contiguous pages found first-fit, and freeing returns exactly those
+ * pages, so loading and unloading samples for a whole session never touches the heap and the
+ * free space can only split at page boundaries. Allocation is O(pages), meant for loop() only.
+ */
+class SampleArena {
+    public:
+    static const uint32_t PAGE_SIZE = 4096;
+    static const uint32_t MAX_PAGES = 2048; // 8 MB, enough for the PSRAM of a Teensy 4.1
+
+    SampleArena(void *memory, uint32_t size);
+
+    void *alloc(uint32_t size);
+    void free(void *p);
+    void reset(); // frees everything
+
+    uint32_t get_size() const { return num_pages * PAGE_SIZE; }
+    uint32_t get_free() const { return free_pages * PAGE_SIZE; }
+    uint32_t get_largest_free() const; // biggest block alloc() can currently return
+
+    private:
+    bool is_used(uint32_t page) const { return used[page / 32] & (1UL << (page % 32)); }
+    void mark(uint32_t first, uint32_t count, bool use);
+
+    uint8_t *base; // first page, aligned to 32 bytes for the cache
+    uint32_t num_pages;
+    uint32_t free_pages;
+    uint32_t used[MAX_PAGES / 32];    // one bit per page
+    uint16_t run_length[MAX_PAGES];   // pages of the allocation starting at a page, 0 elsewhere
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef _SAMPLE_FORMAT_H
+#define _SAMPLE_FORMAT_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * OPS sample container: a fixed header followed by 16 bit mono PCM, both little-endian.
+ * Everything a player needs (length, loop points, root note, slices) is in the header at a fixed
+ * offset, so a sample is played straight from wherever it is stored (RAM arena, program flash)
+ * without parsing or decoding. Files are made from WAV files by tools/wav2ops.cpp.
+ */
+
+#define OPS_MAGIC "OPS1"
+#define OPS_VERSION 1
+#define OPS_MAX_SLICES 32
+#define OPS_FLAG_LOOP 0x01 // loop_start .. loop_end repeats while the note is held
+
+struct OpsHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t header_size;  // offset of the PCM data, sizeof (OpsHeader)
+    uint32_t sample_rate;
+    uint32_t length;       // samples
+    uint32_t loop_start;   // samples
+    uint32_t loop_end;     // samples, exclusive
+    uint8_t root_note;     // MIDI note which plays at the original pitch
+    uint8_t flags;
+    uint16_t num_slices;
+    uint32_t slices[OPS_MAX_SLICES]; // slice start positions in samples, ascending; slice i ends at slice i + 1 or length
+};
+
+// Only works if the layout is identical on the PC and the Teensy (both little-endian, no padding)
+static_assert(sizeof (OpsHeader) == 28 + 4 * OPS_MAX_SLICES, "OpsHeader must not be padded");
+
+/*
+ * Returns the header if data holds a complete OPS sample of size bytes, else NULL.
+ */
+inline const OpsHeader *ops_validate(const void *data, uint32_t size) {
+    const OpsHeader *h = (const OpsHeader *)data;
+    if (size < sizeof (OpsHeader) || memcmp(h->magic, OPS_MAGIC, 4) != 0 || h->version != OPS_VERSION) return 0;
+    if (h->header_size != sizeof (OpsHeader) || h->num_slices > OPS_MAX_SLICES) return 0;
+    if ((size - sizeof (OpsHeader)) / 2 < h->length) return 0;
+    if (h->loop_start > h->loop_end || h->loop_end > h->length) return 0;
+    for (uint16_t i = 0; i < h->num_slices; i++) {
+        if (h->slices[i] >= h->length || (i > 0 && h->slices[i] <= h->slices[i - 1])) return 0;
+    }
+    return h;
+}
+
+inline const int16_t *ops_data(const OpsHeader *h) {
+    return (const int16_t *)((const uint8_t *)h + h->header_size);
+}
+
+// Range of a slice, the whole sample for slice < 0 or a sample without slices
+inline void ops_slice_range(const OpsHeader *h, int slice, uint32_t &start, uint32_t &end) {
+    if (slice < 0 || slice >= h->num_slices) {
+        start = 0;
+        end = h->length;
+        return;
+    }
+    start = h->slices[slice];
+    end = slice + 1 < h->num_slices ? h->slices[slice + 1] : h->length;
+}
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef _SAMPLE_STREAMER_H
+#define _SAMPLE_STREAMER_H
+
+#include <stdint.h>
+
+#if defined(__IMXRT1062__)
+#include <AudioStream.h>
+#define STREAMER_LOCK() AudioNoInterrupts()
+#define STREAMER_UNLOCK() AudioInterrupts()
+#else
+#define STREAMER_LOCK()
+#define STREAMER_UNLOCK()
+#endif
+
+/*
+ * File access used by SampleStreamer, one open file per handle.
+ * SD card on the Teensy (sd_sample_storage.h), anything else on a PC.
+ */
+class SampleStorage {
+    public:
+    virtual ~SampleStorage() {}
+    virtual bool open(uint8_t handle, const char *path) = 0;
+    virtual int read(uint8_t handle, uint32_t pos, void *buf, int len) = 0; // bytes read, < 0 on error
+    virtual void close(uint8_t handle) = 0;
+};
+
+/*
+ * Plays several 16 bit mono WAV files at once while they are streamed from storage.
+ *
+ * The audio interrupt never touches storage: add_sample() keeps the first HEAD_SAMPLES of every
+ * sample in RAM, so a voice starts immediately (also from the audio interrupt), and each voice has
+ * two buffers which service() refills from loop() ahead of the play position. service() always
+ * serves the voice closest to running dry first. A voice whose next buffer is not ready plays
+ * silence for that block and counts an underrun.
+ */
+class SampleStreamer {
+    public:
+    static const uint8_t MAX_SAMPLES = 16;
+    static const uint8_t MAX_VOICES = 8;
+    static const int BUFFER_SAMPLES = 4096; // per buffer, ~93 ms at 44.1 kHz
+    static const int HEAD_SAMPLES = BUFFER_SAMPLES;
+    static const int MAX_PATH = 32;
+    static const uint8_t HEADER_HANDLE = MAX_VOICES; // storage handle used by add_sample()
+
+    // stream_memory: MAX_VOICES * 2 * BUFFER_SAMPLES, head_memory: MAX_SAMPLES * HEAD_SAMPLES
+    SampleStreamer(SampleStorage &storage, int16_t *stream_memory, int16_t *head_memory);
+
+    int add_sample(const char *path); // reads the header and the head, returns the sample index or -1
+    int play(uint8_t sample, float gain); // starts sample on an idle (or the oldest) voice, returns the voice
+    void start_voice(uint8_t v, uint8_t sample, float gain);
+    void stop_voice(uint8_t v);
+
+    void render(int16_t *out, int num_samples); // adds all voices to out, audio interrupt
+    bool service(); // refills one buffer from storage, loop(); false if nothing needed reading
+
+    bool is_playing() const;
+    uint8_t get_num_samples() const { return num_samples; }
+    uint32_t get_underruns() const { return underruns; }
+    uint32_t get_voice_underruns(uint8_t v) const { return voices[v].underruns; }
+    uint32_t get_read_errors() const { return read_errors; }
+    uint32_t get_reads() const { return reads; }
+    int get_min_buffered() const { return min_buffered; } // lowest read-ahead (samples) seen by service()
+    void reset_min_buffered() { min_buffered = 2 * BUFFER_SAMPLES; }
+
+    private:
+    struct Sample {
+        char path[MAX_PATH];
+        uint32_t data_offset; // of the PCM data in the file
+        uint32_t length;      // samples
+        uint32_t head_length;
+        int16_t *head;
+    };
+
+    struct Buffer {
+        const int16_t *data;
+        uint32_t start; // sample position of data[0]
+        uint32_t length;
+        volatile bool ready; // true: owned by render(), false: free for service()
+    };
+
+    struct Voice {
+        volatile bool playing;
+        volatile uint32_t generation; // changes with every start, so service() can drop stale reads
+        uint8_t sample;
+        int16_t gain; // Q15
+        uint32_t pos; // next sample to play
+        uint32_t started;
+        uint8_t current; // buffer being played
+        Buffer buffers[2];
+        uint32_t underruns;
+        uint8_t open_sample; // file open on the voice's storage handle, loop() side
+    };
+
+    bool parse_wav(uint8_t handle, Sample &s);
+    void render_voice(Voice &voice, int16_t *out, int num_samples);
+
+    SampleStorage &storage;
+    int16_t *stream_memory;
+    int16_t *head_memory;
+    Sample samples[MAX_SAMPLES];
+    uint8_t num_samples;
+    Voice voices[MAX_VOICES];
+    uint32_t start_counter;
+    volatile uint32_t underruns;
+    uint32_t read_errors;
+    uint32_t reads;
+    int min_buffered;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef _SD_SAMPLE_STORAGE_H
+#define _SD_SAMPLE_STORAGE_H
+
+#include <SD.h>
+#include <sample_streamer.h>
+
+/*
+ * SampleStorage on the SD card of the audio board, one File per handle.
+ */
+class SdSampleStorage : public SampleStorage {
+    public:
+    virtual bool open(uint8_t handle, const char *path) {
+        if (handle >= NUM_HANDLES) return false;
+        files[handle] = SD.open(path);
+        return files[handle];
+    }
+
+    virtual int read(uint8_t handle, uint32_t pos, void *buf, int len) {
+        File &f = files[handle];
+        if (f.position() != pos && !f.seek(pos)) return -1;
+        return f.read(buf, len);
+    }
+
+    virtual void close(uint8_t handle) {
+        if (handle < NUM_HANDLES) files[handle].close();
+    }
+
+    private:
+    static const int NUM_HANDLES = SampleStreamer::MAX_VOICES + 1;
+    File files[NUM_HANDLES];
+};
+
+#endif
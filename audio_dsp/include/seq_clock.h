@@ -0,0 +1,54 @@
+#ifndef _SEQ_CLOCK_H
+#define _SEQ_CLOCK_H
+
+#include <stdint.h>
+
+/*
+ * Sample-accurate sequencer clock.
+ * It is advanced by the audio engine once per block (never by wall-clock time) and
+ * converts tempo and swing into PPQN ticks. Tick positions are kept in 32.32 fixed point
+ * samples, so rounding never accumulates into audible drift, and every tick is reported
+ * together with its sample offset inside the current block.
+ */
+class SeqClock {
+    public:
+    static const uint32_t PPQN = 96;
+    static const uint32_t TICKS_PER_16TH = PPQN / 4;
+
+    typedef void (*tick_handler_t)(uint32_t tick, uint16_t offset);
+
+    SeqClock(double sample_rate);
+    void set_tempo(float bpm);
+    void set_swing(uint8_t percent); // 50 = straight, up to 75 = hard shuffle
+    void set_tick_handler(tick_handler_t handler);
+    void start();
+    void stop();
+    void resume(); // continues from the current tick
+    void advance(uint16_t num_samples); // called once per audio block
+
+    bool is_running() const { return running; }
+    float get_tempo() const { return bpm; }
+    uint8_t get_swing() const { return swing; }
+    uint32_t get_tick() const { return next_tick; }
+    uint64_t get_sample_pos() const { return sample_pos; }
+
+    private:
+    void update_tick_length();
+
+    double sample_rate;
+
+    // Written from loop(), picked up by advance() at the next block boundary
+    volatile float bpm;
+    volatile uint8_t swing;
+    volatile bool tempo_changed;
+    volatile bool restart;
+    volatile bool running;
+    tick_handler_t tick_handler;
+
+    uint64_t sample_pos;    // samples elapsed since start()
+    uint64_t next_tick_pos; // 32.32 fixed point offset of next_tick from the current block start
+    uint32_t next_tick;
+    uint64_t tick_len[2];   // 32.32 fixed point tick length for the first and second 16th of a swing pair
+};
+
+#endif
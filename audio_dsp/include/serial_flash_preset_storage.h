@@ -0,0 +1,49 @@
+#ifndef _SERIAL_FLASH_PRESET_STORAGE_H
+#define _SERIAL_FLASH_PRESET_STORAGE_H
+
+#include <SerialFlash.h>
+#include <preset_store.h>
+
+/*
+ * PresetStorage in an erasable file on the audio board's flash chip, created on first use.
+ * Erasable files are aligned to the chip's 64 KB erase blocks, which PresetStore relies on.
+ * SerialFlash.begin() must have been called.
+ */
+class SerialFlashPresetStorage : public PresetStorage {
+    public:
+    SerialFlashPresetStorage() : base(0), size(0) {}
+
+    bool begin(const char *filename = "PRESETS.BIN") {
+        if (!SerialFlash.exists(filename) && !SerialFlash.createErasable(filename, PresetStore::AREA_SIZE)) return false;
+        SerialFlashFile f = SerialFlash.open(filename);
+        if (!f || f.size() < PresetStore::AREA_SIZE) return false;
+        base = f.getFlashAddress();
+        size = f.size();
+        f.close();
+        return true;
+    }
+
+    virtual bool read(uint32_t addr, void *buf, uint32_t len) {
+        if (size == 0 || addr + len > size) return false;
+        SerialFlash.read(base + addr, buf, len);
+        return true;
+    }
+
+    virtual bool write(uint32_t addr, const void *buf, uint32_t len) {
+        if (size == 0 || addr + len > size) return false;
+        SerialFlash.write(base + addr, buf, len);
+        return true;
+    }
+
+    virtual bool erase_block(uint32_t addr) {
+        if (size == 0 || addr + PresetStore::BLOCK_SIZE > size) return false;
+        SerialFlash.eraseBlock(base + addr);
+        return true;
+    }
+
+    private:
+    uint32_t base;
+    uint32_t size;
+};
+
+#endif
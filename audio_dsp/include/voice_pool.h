@@ -0,0 +1,81 @@
+#ifndef _VOICE_POOL_H
+#define _VOICE_POOL_H
+
+#include <stdint.h>
+
+/*
+ * Polyphonic voice allocation for a fixed number of identical voices.
+ * Only decides which voice plays which note; the voices themselves are driven through the
+ * start_voice()/release_voice() hooks, so the allocation can be run on a PC without the Audio library.
+ *
+ * - Poly mode: every note gets unison voices. A note which is played again reuses its voices.
+ *   When all voices are busy, one is stolen: STEAL_OLDEST takes the voice started first,
+ *   STEAL_QUIETEST the voice released longest ago (its envelope has decayed most),
+ *   then the held voice with the lowest velocity.
+ * - Legato mode: mono with a stack of held notes. Overlapping notes only change the pitch,
+ *   the envelope is retriggered when a note starts after all notes were released.
+ */
+class VoicePool {
+    public:
+    static const uint8_t MAX_VOICES = 16;
+    static const uint8_t MAX_HELD_NOTES = 16;
+    static const uint8_t NO_NOTE = 0xff;
+
+    enum StealMode {
+        STEAL_OLDEST = 0,
+        STEAL_QUIETEST
+    };
+
+    VoicePool(uint8_t num_voices);
+    virtual ~VoicePool() {}
+
+    void note_on(uint8_t note, uint8_t velocity);
+    void note_off(uint8_t note);
+    void all_notes_off();
+
+    void set_steal_mode(StealMode mode) { steal_mode = mode; }
+    void set_legato(bool legato);
+    void set_unison(uint8_t voices, float detune_cents); // voices per note, spread over +-detune_cents
+
+    uint8_t get_num_voices() const { return num_voices; }
+    uint8_t get_active_voices();        // voices which are still sounding
+    uint8_t get_voice_note(uint8_t v) const { return voices[v].note; }
+    uint32_t get_steal_count() const { return steal_count; }
+
+    protected:
+    // Implemented by the audio side. retrigger = false only changes the pitch of a sounding voice.
+    virtual void start_voice(uint8_t v, uint8_t note, uint8_t velocity, float detune_cents, bool retrigger) = 0;
+    virtual void release_voice(uint8_t v) = 0;
+    virtual bool is_voice_sounding(uint8_t v) = 0; // false once the release has finished
+
+    private:
+    struct Voice {
+        uint8_t note;     // NO_NOTE if never used
+        uint8_t velocity;
+        bool gate;        // key held
+        uint32_t started; // counter value at note on
+        uint32_t released;
+    };
+
+    uint8_t find_voice();
+    void start(uint8_t v, uint8_t note, uint8_t velocity, uint8_t unison_index, bool retrigger);
+    float unison_detune(uint8_t unison_index) const;
+    void push_held(uint8_t note, uint8_t velocity);
+    void remove_held(uint8_t note);
+
+    Voice voices[MAX_VOICES];
+    uint8_t num_voices;
+    uint32_t counter;
+    uint32_t steal_count;
+    StealMode steal_mode;
+    bool legato;
+    uint8_t unison;
+    float unison_detune_cents;
+
+    // Legato note stack, most recent last
+    uint8_t held_notes[MAX_HELD_NOTES];
+    uint8_t held_velocities[MAX_HELD_NOTES];
+    uint8_t num_held;
+};
+
+#endif
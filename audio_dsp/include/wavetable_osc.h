@@ -0,0 +1,74 @@
+#ifndef _WAVETABLE_OSC_H
+#define _WAVETABLE_OSC_H
+
+#include <stdint.h>
+
+#if defined(__IMXRT1062__)
+#include <dspinst.h>
+#else
+// Plain C versions of the Cortex-M7 DSP instructions used by render(), for host builds
+static inline int32_t multiply_16tx16t_add_16bx16b(uint32_t a, uint32_t b) { // SMUAD
+    return (int16_t)(a >> 16) * (int16_t)(b >> 16) + (int16_t)a * (int16_t)b;
+}
+static inline uint32_t pack_16b_16b(int32_t a, int32_t b) { // PKHBT: a in the top, b in the bottom half
+    return ((uint32_t)a << 16) | ((uint32_t)b & 0xffff);
+}
+static inline int16_t saturate_16(int32_t v) {
+    return v > 32767 ? 32767 : (v < -32768 ? -32768 : v);
+}
+static inline uint32_t signed_subtract_16_and_16(uint32_t a, uint32_t b) { // QSUB16
+    return pack_16b_16b(saturate_16((int16_t)(a >> 16) - (int16_t)(b >> 16)), saturate_16((int16_t)a - (int16_t)b));
+}
+#endif
+
+enum OscShape {
+    OSC_SINE = 0,
+    OSC_TRIANGLE,
+    OSC_SAW,
+    OSC_PULSE, // square at 50% pulse width
+    OSC_NUM_SHAPES
+};
+
+/*
+ * Band-limited wavetable oscillator.
+ * Triangle and saw are stored as mip-maps with one table per octave, each holding only the
+ * harmonics which stay below Nyquist in that octave, so nothing aliases. Pulse is the difference
+ * of two phase shifted saws, which gives PWM without extra tables.
+ *
+ * render() processes two samples per step: linear interpolation is one SMUAD per sample on a
+ * packed pair of table values, and the pulse subtraction is a single QSUB16 for both samples.
+ * Frequency, shape and pulse width are picked up at the next render() call.
+ */
+class WavetableOsc {
+    public:
+    static const int TABLE_BITS = 11;
+    static const int TABLE_SIZE = 1 << TABLE_BITS;
+    static const int MAX_HARMONICS = TABLE_SIZE / 4; // 2x oversampled, so linear interpolation stays clean
+    static const int NUM_LEVELS = TABLE_BITS - 1;    // 512, 256, ... 1 harmonics
+
+    WavetableOsc(float sample_rate);
+    static void init_tables(); // once before the first render(), takes a few ms
+
+    void set_frequency(float hz);
+    void set_shape(OscShape shape) { this->shape = shape; }
+    void set_pulse_width(float width); // 0.05 .. 0.95, 0.5 = square
+    void set_amplitude(float level);   // 0 .. 1
+    void reset_phase() { phase = 0; }
+
+    void render(int16_t *out, int num_samples); // num_samples must be even
+
+    // Table of the given level, TABLE_SIZE + 1 values (the last one repeats the first for interpolation)
+    static const int16_t *get_table(OscShape shape, int level);
+    static int get_level(float hz, float sample_rate);
+
+    private:
+    float sample_rate;
+    uint32_t phase;
+    volatile uint32_t phase_inc;
+    volatile uint8_t level;
+    volatile OscShape shape;
+    volatile uint32_t pulse_offset; // phase distance of the second saw
+    volatile int16_t amplitude;     // Q15
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include <string.h>
+#include <audio_profiler.h>
+
+AudioProfiler::AudioProfiler() {
+    num_nodes = 0;
+    loop_start = 0;
+    memset(section_start, 0, sizeof (section_start));
+    reset_peaks();
+}
+
+void AudioProfiler::add_node(AudioStream &node, const char *name, uint8_t group) {
+    if (num_nodes == MAX_NODES) return;
+    nodes[num_nodes].node = &node;
+    nodes[num_nodes].name = name;
+    nodes[num_nodes].group = group;
+    num_nodes++;
+}
+
+void AudioProfiler::begin_loop() {
+    loop_start = micros();
+}
+
+void AudioProfiler::end_loop() {
+    const uint32_t us = micros() - loop_start;
+    if (us > loop_max_us) loop_max_us = us;
+}
+
+void AudioProfiler::end_section(Section s) {
+    const uint32_t us = micros() - section_start[s];
+    if (us > section_max_us[s]) section_max_us[s] = us;
+}
+
+float AudioProfiler::get_group_cpu_max(uint8_t group) {
+    float sum = 0.0f;
+    for (int i = 0; i < num_nodes; i++) {
+        if (nodes[i].group == group) sum += nodes[i].node->processorUsageMax();
+    }
+    return sum;
+}
+
+void AudioProfiler::reset_peaks() {
+    for (int i = 0; i < num_nodes; i++) {
+        nodes[i].node->processorUsageMaxReset();
+    }
+    AudioProcessorUsageMaxReset();
+    loop_max_us = 0;
+    for (int s = 0; s < NUM_SECTIONS; s++) {
+        section_max_us[s] = 0;
+    }
+}
+
+/*
+ * Nodes registered under the same name (e.g. the oscillators of all voices) are summed up.
+ */
+void AudioProfiler::print_nodes(Print &out) {
+    const char *names[MAX_NODES];
+    float usage[MAX_NODES];
+    int count[MAX_NODES];
+
+    for (int g = 0; g < STAT_NUM_GROUPS; g++) {
+        int n = 0;
+        for (int i = 0; i < num_nodes; i++) {
+            if (nodes[i].group != g) continue;
+            int j = 0;
+            while (j < n && strcmp(names[j], nodes[i].name) != 0) j++;
+            if (j == n) {
+                names[n] = nodes[i].name;
+                usage[n] = 0.0f;
+                count[n] = 0;
+                n++;
+            }
+            usage[j] += nodes[i].node->processorUsageMax();
+            count[j]++;
+        }
+
+        // Highest load first
+        for (int i = 1; i < n; i++) {
+            for (int j = i; j > 0 && usage[j] > usage[j - 1]; j--) {
+                const char *name = names[j]; names[j] = names[j - 1]; names[j - 1] = name;
+                const float u = usage[j]; usage[j] = usage[j - 1]; usage[j - 1] = u;
+                const int c = count[j]; count[j] = count[j - 1]; count[j - 1] = c;
+            }
+        }
+
+        out.printf("%s %.2f%% peak sum:", mcu_stat_group_name(g), get_group_cpu_max(g));
+        for (int i = 0; i < n; i++) {
+            if (count[i] > 1) out.printf(" %s %.2f (x%d)", names[i], usage[i], count[i]);
+            else out.printf(" %s %.2f", names[i], usage[i]);
+        }
+        out.println();
+    }
+}
@@ -0,0 +1,211 @@
+#include <math.h>
+#include <audio_voice_pool.h>
+
+SynthVoice::SynthVoice() :
+    cord_osc1(osc1, 0, osc_mix, 0),
+    cord_osc2(osc2, 0, osc_mix, 1),
+    cord_filter(osc_mix, 0, filter, 0),
+    cord_envelope(filter, 0, envelope, 0) {
+}
+
+void SynthVoice::add_to_profiler(AudioProfiler &profiler, uint8_t group) {
+    profiler.add_node(osc1, "osc1", group);
+    profiler.add_node(osc2, "osc2", group);
+    profiler.add_node(osc_mix, "osc mix", group);
+    profiler.add_node(filter, "filter", group);
+    profiler.add_node(envelope, "envelope", group);
+}
+
+float SynthVoice::get_cpu_usage_max() {
+    return osc1.processorUsageMax() + osc2.processorUsageMax() + osc_mix.processorUsageMax()
+        + filter.processorUsageMax() + envelope.processorUsageMax();
+}
+
+void SynthVoice::reset_cpu_usage_max() {
+    osc1.processorUsageMaxReset();
+    osc2.processorUsageMaxReset();
+    osc1.reset_block_cycles_max();
+    osc2.reset_block_cycles_max();
+    osc_mix.processorUsageMaxReset();
+    filter.processorUsageMaxReset();
+    envelope.processorUsageMaxReset();
+}
+
+AudioVoicePool::AudioVoicePool() : VoicePool(NUM_VOICES) {
+    // Connections are only made once at startup, there is no other dynamic allocation
+    for (int v = 0; v < NUM_VOICES; v++) {
+        cords[v] = new AudioConnection(voices[v].envelope, 0, sub_mix[v / 4], v % 4);
+    }
+    cords[NUM_VOICES] = new AudioConnection(sub_mix[0], 0, out_mix, 0);
+    cords[NUM_VOICES + 1] = new AudioConnection(sub_mix[1], 0, out_mix, 1);
+
+    osc_tune[0] = osc_tune[1] = 0.0f;
+    for (int v = 0; v < NUM_VOICES; v++) {
+        voice_detune[v] = 0.0f;
+    }
+}
+
+void AudioVoicePool::begin() {
+    WavetableOsc::init_tables();
+
+    for (int v = 0; v < NUM_VOICES; v++) {
+        SynthVoice &voice = voices[v];
+        voice.osc1.set_shape(OSC_SAW);
+        voice.osc2.set_shape(OSC_PULSE);
+        voice.osc_mix.gain(0, 0.5f);
+        voice.osc_mix.gain(1, 0.5f);
+        sub_mix[v / 4].gain(v % 4, 0.25f);
+    }
+    out_mix.gain(0, 1.0f);
+    out_mix.gain(1, 1.0f);
+
+    set_filter(2000.0f, 0.7f);
+    set_envelope(5.0f, 100.0f, 0.7f, 300.0f);
+}
+
+void AudioVoicePool::add_to_profiler(AudioProfiler &profiler, uint8_t group) {
+    for (int v = 0; v < NUM_VOICES; v++) {
+        voices[v].add_to_profiler(profiler, group);
+    }
+    profiler.add_node(sub_mix[0], "voice mix", group);
+    profiler.add_node(sub_mix[1], "voice mix", group);
+    profiler.add_node(out_mix, "voice out", group);
+}
+
+void AudioVoicePool::set_osc_tune(int osc, float semitones) {
+    if (osc < 0 || osc > 1) return;
+    osc_tune[osc] = semitones;
+    for (uint8_t v = 0; v < NUM_VOICES; v++) {
+        if (get_voice_note(v) != NO_NOTE) update_frequency(v);
+    }
+}
+
+void AudioVoicePool::set_osc_shape(int osc, OscShape shape) {
+    for (int v = 0; v < NUM_VOICES; v++) {
+        (osc == 0 ? voices[v].osc1 : voices[v].osc2).set_shape(shape);
+    }
+}
+
+void AudioVoicePool::set_osc_pulse_width(int osc, float width) {
+    for (int v = 0; v < NUM_VOICES; v++) {
+        (osc == 0 ? voices[v].osc1 : voices[v].osc2).set_pulse_width(width);
+    }
+}
+
+void AudioVoicePool::set_filter(float cutoff_hz, float resonance) {
+    set_filter_cutoff(cutoff_hz);
+    set_filter_resonance(resonance);
+}
+
+void AudioVoicePool::set_filter_cutoff(float cutoff_hz) {
+    for (int v = 0; v < NUM_VOICES; v++) {
+        voices[v].filter.frequency(cutoff_hz);
+    }
+}
+
+void AudioVoicePool::set_filter_resonance(float resonance) {
+    for (int v = 0; v < NUM_VOICES; v++) {
+        voices[v].filter.resonance(resonance);
+    }
+}
+
+void AudioVoicePool::set_envelope(float attack_ms, float decay_ms, float sustain, float release_ms) {
+    for (int v = 0; v < NUM_VOICES; v++) {
+        AudioEffectEnvelope &env = voices[v].envelope;
+        env.attack(attack_ms);
+        env.decay(decay_ms);
+        env.sustain(sustain);
+        env.release(release_ms);
+    }
+}
+
+/*
+ * Called from the ParamHandler of the engine, so from the audio interrupt, with the new value of id.
+ * Parameters set together (the envelope) read the others from the engine.
+ */
+void AudioVoicePool::apply_param(const ParamEngine &engine, uint8_t id, float value) {
+    switch (id) {
+    case PARAM_OSC1_TUNE:
+    case PARAM_OSC2_TUNE:
+        set_osc_tune(id - PARAM_OSC1_TUNE, value);
+        break;
+    case PARAM_OSC1_SHAPE:
+    case PARAM_OSC2_SHAPE:
+        set_osc_shape(id - PARAM_OSC1_SHAPE, (OscShape)(int)(value + 0.5f));
+        break;
+    case PARAM_PULSE_WIDTH:
+        set_osc_pulse_width(0, value);
+        set_osc_pulse_width(1, value);
+        break;
+    case PARAM_FILTER_CUTOFF:
+        set_filter_cutoff(value);
+        break;
+    case PARAM_FILTER_RESONANCE:
+        set_filter_resonance(value);
+        break;
+    case PARAM_ENV_ATTACK:
+    case PARAM_ENV_DECAY:
+    case PARAM_ENV_SUSTAIN:
+    case PARAM_ENV_RELEASE:
+        set_envelope(engine.get(PARAM_ENV_ATTACK), engine.get(PARAM_ENV_DECAY),
+            engine.get(PARAM_ENV_SUSTAIN), engine.get(PARAM_ENV_RELEASE));
+        break;
+    default: // volume, LFO and modulation envelope settings are not voice parameters
+        break;
+    }
+}
+
+/*
+ * All voices are identical and update() runs for idle voices too,
+ * so the worst voice is a good estimate for the cost of every additional voice.
+ */
+float AudioVoicePool::get_voice_cpu_max() {
+    float max = 0.0f;
+    for (int v = 0; v < NUM_VOICES; v++) {
+        const float usage = voices[v].get_cpu_usage_max();
+        if (usage > max) max = usage;
+    }
+    return max;
+}
+
+uint32_t AudioVoicePool::get_osc_block_cycles_max() {
+    uint32_t max = 0;
+    for (int v = 0; v < NUM_VOICES; v++) {
+        if (voices[v].osc1.get_block_cycles_max() > max) max = voices[v].osc1.get_block_cycles_max();
+        if (voices[v].osc2.get_block_cycles_max() > max) max = voices[v].osc2.get_block_cycles_max();
+    }
+    return max;
+}
+
+void AudioVoicePool::reset_cpu_usage_max() {
+    for (int v = 0; v < NUM_VOICES; v++) {
+        voices[v].reset_cpu_usage_max();
+    }
+}
+
+void AudioVoicePool::start_voice(uint8_t v, uint8_t note, uint8_t velocity, float detune_cents, bool retrigger) {
+    SynthVoice &voice = voices[v];
+    voice_detune[v] = detune_cents;
+    update_frequency(v);
+
+    if (retrigger) {
+        const float level = velocity / 127.0f;
+        voice.osc1.set_amplitude(level);
+        voice.osc2.set_amplitude(level);
+        voice.envelope.noteOn();
+    }
+}
+
+void AudioVoicePool::release_voice(uint8_t v) {
+    voices[v].envelope.noteOff();
+}
+
+bool AudioVoicePool::is_voice_sounding(uint8_t v) {
+    return voices[v].envelope.isActive();
+}
+
+void AudioVoicePool::update_frequency(uint8_t v) {
+    const float note = get_voice_note(v) + voice_detune[v] / 100.0f;
+    voices[v].osc1.set_frequency(440.0f * powf(2.0f, (note + osc_tune[0] - 69.0f) / 12.0f));
+    voices[v].osc2.set_frequency(440.0f * powf(2.0f, (note + osc_tune[1] - 69.0f) / 12.0f));
+}
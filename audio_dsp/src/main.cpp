@@ -4,6 +4,29 @@
 #include <SD.h>
 #include <SerialFlash.h>
 #include "USBHost_t36.h"
+#include <audio_seq_clock.h>
+#include <pattern_seq.h>
+#include <audio_midi_scheduler.h>
+#include <midi_clock.h>
+#include <audio_voice_pool.h>
+#include <audio_param_engine.h>
+#include <audio_sample_streamer.h>
+#include <sd_sample_storage.h>
+#include <audio_play_ops.h>
+#include <sample_arena.h>
+#include <audio_profiler.h>
+#include <preset_store.h>
+#include <param_sync.h>
+#include <serial_flash_preset_storage.h>
+#include <mcu_proto.h>
+#include <enc_events.h>
+#include <trace.h>
+#include <latency_hist.h>
+
+// Trace records of loop() and of the audio interrupt, drained to Serial by loop(), see trace.h
+#define TRACE_BUFFER_SIZE 256
+TraceBuffer<TRACE_BUFFER_SIZE> trace_loop(TRACE_CTX_LOOP);
+TraceBuffer<TRACE_BUFFER_SIZE> trace_audio(TRACE_CTX_AUDIO);
 
 USBHost myusb;
 USBHub hub1(myusb);
@@ -13,122 +36,468 @@ KeyboardController keyboard1(myusb);
 KeyboardController keyboard2(myusb);
 MIDIDevice midi1(myusb);
 
+// Constructed before the synth objects so that sequencer events trigger in the same audio block
+AudioSeqClock seq_clock;
+
+// Patterns with parameter locks, played by seq_clock; kept in DMAMEM (OCRAM), see pattern_seq.h for the sizes
+#define NUM_PATTERNS 16
+DMAMEM Pattern patterns[NUM_PATTERNS];
+
+// MIDI notes and controllers are queued by the USB host callbacks and played from the audio interrupt
+AudioMidiScheduler midi_in;
+
+// MODE_SLAVE follows the clock, start and stop of an external MIDI device
+#define MIDI_CLOCK_MODE MidiClock::MODE_MASTER
+MidiClock midi_clock;
+
+// Synth parameters: encoders, MIDI CC and the sequencer only set targets, the engine applies them
+// once per block with smoothing and modulation. Constructed before the objects it controls,
+// except the output gain, which has to come after mixer1 like any other node in the signal chain.
+ParamStore params;
+ModMatrix mod_matrix;
+AudioParamEngine param_engine(params, mod_matrix);
+PatternSeq pattern_seq(patterns, NUM_PATTERNS, params);
+
+// Polyphonic synth voices, see audio_voice_pool.h
+AudioVoicePool voice_pool;
+
+// Samples streamed from SD card, the buffers are too big for the tightly coupled RAM
+DMAMEM int16_t sample_stream_memory[SampleStreamer::MAX_VOICES * 2 * SampleStreamer::BUFFER_SAMPLES];
+DMAMEM int16_t sample_head_memory[SampleStreamer::MAX_SAMPLES * SampleStreamer::HEAD_SAMPLES];
+SdSampleStorage sd_storage;
+AudioSampleStreamer sampler(sd_storage, sample_stream_memory, sample_head_memory);
+
+// OPS samples (see sample_format.h) copied from the audio board's flash into an arena, played from RAM
+#if defined(ARDUINO_TEENSY41)
+#define SAMPLE_ARENA_SIZE (8 * 1024 * 1024)
+EXTMEM uint8_t sample_arena_memory[SAMPLE_ARENA_SIZE];
+#else
+#define SAMPLE_ARENA_SIZE (96 * 1024)
+DMAMEM uint8_t sample_arena_memory[SAMPLE_ARENA_SIZE];
+#endif
+SampleArena sample_arena(sample_arena_memory, SAMPLE_ARENA_SIZE);
+AudioPlayOps ops_player;
+#define MAX_RAM_SAMPLES 8
+const OpsHeader *ram_samples[MAX_RAM_SAMPLES];
+int num_ram_samples = 0;
+
 // GUItool: begin automatically generated code
-AudioSynthWaveformSine   sine1;          //xy=86,329
-AudioSynthWaveformSine   sine2;          //xy=88,401
 AudioSynthSimpleDrum     drum1;          //xy=90,472
 AudioMixer4              mixer1;         //xy=310,404
-AudioFilterStateVariable filter1;        //xy=475,399
-AudioEffectEnvelope      envelope1;      //xy=660,398
+AudioParamGain           out_gain(param_engine, PARAM_VOLUME); //xy=560,400
 AudioOutputI2S           i2s1;           //xy=828,397
-AudioConnection          patchCord1(sine1, 0, mixer1, 0);
-AudioConnection          patchCord2(sine2, 0, mixer1, 1);
+AudioConnection          patchCord1(voice_pool.output(), 0, mixer1, 0);
+AudioConnection          patchCord2(sampler, 0, mixer1, 1);
 AudioConnection          patchCord3(drum1, 0, mixer1, 2);
-AudioConnection          patchCord4(mixer1, 0, filter1, 0);
-AudioConnection          patchCord5(filter1, 0, envelope1, 0);
-AudioConnection          patchCord6(envelope1, 0, i2s1, 0);
-AudioConnection          patchCord7(envelope1, 0, i2s1, 1);
+AudioConnection          patchCord4(ops_player, 0, mixer1, 3);
+AudioConnection          patchCord5(mixer1, 0, out_gain, 0);
+AudioConnection          patchCord6(out_gain, 0, i2s1, 0);
+AudioConnection          patchCord7(out_gain, 0, i2s1, 1);
 AudioControlSGTL5000     sgtl5000_1;     //xy=155,215
 // GUItool: end automatically generated code
 
+AudioProfiler profiler; // CPU usage of every node above and timing of loop()
+
+// Presets in the audio board's flash, see preset_store.h. current_preset is the last one recalled or saved,
+// morph_preset the other end of PRESET_MORPH_CC. Both are read by the audio interrupt.
+SerialFlashPresetStorage preset_storage;
+PresetStore presets(preset_storage);
+Preset current_preset, morph_preset;
+bool morph_ready = false;
+
+// Right-size with the peak usage shown on the diagnostics page of the output MCU
+#define AUDIO_MEMORY_BLOCKS 512
+
 
 void OnPress(int key)
 {
-  Serial.print("key '");
-  Serial.print((char)key);
-  Serial.print("'  ");
-  Serial.println(key);
-  //Serial.print("key ");
-  //Serial.print((char)keyboard1.getKey());
-  //Serial.print("  ");
-  //Serial.print((char)keyboard2.getKey());
-  //Serial.println();
+  TRACE_DEBUG(trace_loop, TRACE_KEY_PRESS, key, 0);
 }
 
 void OnRawPress(uint8_t keycode)
 {
-  Serial.print("raw key press: ");
-  Serial.println((int)keycode);
+  TRACE_DEBUG(trace_loop, TRACE_KEY_RAW, keycode, 1);
 }
 
 void OnRawRelease(uint8_t keycode)
 {
-  Serial.print("raw key release: ");
-  Serial.println((int)keycode);
+  TRACE_DEBUG(trace_loop, TRACE_KEY_RAW, keycode, 0);
 }
 
+#define SAMPLER_MIDI_CHANNEL 10
+#define SAMPLER_FIRST_NOTE 36 // C2 plays the first sample
+#define SLICER_MIDI_CHANNEL 11 // plays the slices of the first RAM sample, starting at SAMPLER_FIRST_NOTE
+
+/*
+ * The USB host callbacks run in loop() and only queue the events with their arrival time
+ */
 void OnNoteOn(byte channel, byte note, byte velocity)
 {
-  Serial.print("Note On, ch=");
-  Serial.print(channel);
-  Serial.print(", note=");
-  Serial.print(note);
-  Serial.print(", velocity=");
-  Serial.print(velocity);
-  Serial.println();
+  midi_in.push(MIDI_EVENT_NOTE_ON, channel, note, velocity, micros());
 }
 
 void OnNoteOff(byte channel, byte note, byte velocity)
 {
-  Serial.print("Note Off, ch=");
-  Serial.print(channel);
-  Serial.print(", note=");
-  Serial.print(note);
-  //Serial.print(", velocity=");
-  //Serial.print(velocity);
-  Serial.println();
+  midi_in.push(MIDI_EVENT_NOTE_OFF, channel, note, velocity, micros());
 }
 
+#define MOD_WHEEL_CC 1
+#define PRESET_SAVE_CC 85       // value = slot to store the current sound in
+#define PRESET_MORPH_SLOT_CC 86 // value = slot to morph towards
+#define PRESET_MORPH_CC 87      // 0 = current preset .. 127 = morph slot
+#define PRESET_GLIDE_BLOCKS 35  // ~100 ms glide from one preset to the next on a program change
+
+void save_preset(uint8_t slot);
+void load_morph_preset(uint8_t slot);
+void recall_preset(uint8_t slot, uint16_t glide_blocks);
+
 void OnControlChange(byte channel, byte control, byte value)
 {
-  Serial.print("Control Change, ch=");
-  Serial.print(channel);
-  Serial.print(", control=");
-  Serial.print(control);
-  Serial.print(", value=");
-  Serial.print(value);
-  Serial.println();
+  // Flash access stays in loop(), only the other controllers are queued for the audio interrupt
+  if (control == PRESET_SAVE_CC) save_preset(value);
+  else if (control == PRESET_MORPH_SLOT_CC) load_morph_preset(value);
+  else midi_in.push(MIDI_EVENT_CONTROL, channel, control, value, micros());
+}
+
+void OnProgramChange(byte channel, byte program)
+{
+  TRACE_INFO(trace_loop, TRACE_MIDI_PROGRAM, program, 0);
+  recall_preset(program, PRESET_GLIDE_BLOCKS);
+}
+
+void play_control_change(byte control, byte value)
+{
+  if (control == MOD_WHEEL_CC) {
+    mod_matrix.set_wheel(value / 127.0f);
+    return;
+  }
+  if (control == PRESET_MORPH_CC) {
+    if (morph_ready) preset_morph(current_preset, morph_preset, value / 127.0f, params, mod_matrix);
+    return;
+  }
+  const int id = param_for_cc(control); // the full CC range covers the parameter's range
+  if (id >= 0) params.set_normalized(id, value / 127.0f);
+}
+
+/*
+ * Queued MIDI events, from the audio interrupt at the start of the block they belong to.
+ * The stock Audio library objects can only start at a block boundary, the OPS player starts at offset.
+ */
+void play_midi_event(const MidiEvent &e, uint16_t offset)
+{
+  const bool note_on = e.type == MIDI_EVENT_NOTE_ON && e.data2 > 0; // velocity 0 is a running status note off
+
+  TRACE_DEBUG(trace_audio, e.type == MIDI_EVENT_CONTROL ? TRACE_MIDI_CC : note_on ? TRACE_MIDI_NOTE_ON : TRACE_MIDI_NOTE_OFF,
+    e.channel << 8 | e.data1, e.data2);
+
+  if (e.type == MIDI_EVENT_CONTROL) {
+    play_control_change(e.data1, e.data2);
+  } else if (e.channel == SAMPLER_MIDI_CHANNEL) {
+    if (note_on && e.data1 >= SAMPLER_FIRST_NOTE && e.data1 < SAMPLER_FIRST_NOTE + sampler.get_num_samples()) {
+      sampler.play(e.data1 - SAMPLER_FIRST_NOTE, e.data2 / 127.0f);
+    }
+  } else if (e.channel == SLICER_MIDI_CHANNEL) {
+    if (note_on && num_ram_samples > 0 && e.data1 >= SAMPLER_FIRST_NOTE) {
+      ops_player.play(ram_samples[0], e.data1 - SAMPLER_FIRST_NOTE, e.data2 / 127.0f, offset);
+    }
+  } else if (note_on) {
+    voice_pool.note_on(e.data1, e.data2);
+    mod_matrix.trigger_envelope();
+  } else {
+    voice_pool.note_off(e.data1);
+  }
+}
+
+/*
+ * MIDI clock. In slave mode the sequencer follows the filtered tempo of the incoming clocks.
+ */
+void OnClock()
+{
+  const uint32_t now = micros();
+  midi_clock.clock(now);
+  if (midi_clock.is_locked(now)) {
+    seq_clock.set_tempo(midi_clock.get_follow_tempo(seq_clock.get_tick(), SeqClock::PPQN));
+  }
+}
+
+void OnStart()
+{
+  if (midi_clock.get_mode() != MidiClock::MODE_SLAVE) return;
+  midi_clock.start();
+  seq_clock.start();
+}
+
+void OnContinue()
+{
+  if (midi_clock.get_mode() != MidiClock::MODE_SLAVE) return;
+  midi_clock.resume();
+  seq_clock.resume();
+}
+
+void OnStop()
+{
+  if (midi_clock.get_mode() != MidiClock::MODE_SLAVE) return;
+  seq_clock.stop();
+  AudioNoInterrupts();
+  pattern_seq.release_notes();
+  AudioInterrupts();
+}
+
+// Master mode: clocks counted by the sequencer in the audio interrupt are sent from loop()
+void send_midi_clock()
+{
+  if (midi_clock.take_start_due()) midi1.sendRealTime(MIDI_START);
+  for (uint32_t n = midi_clock.take_clocks_due(); n > 0; n--) {
+    midi1.sendRealTime(MIDI_CLOCK);
+  }
+}
+
+// Called by the param engine from the audio interrupt
+void apply_param(uint8_t id, float value)
+{
+  voice_pool.apply_param(param_engine, id, value);
+}
+
+// Latency of encoder input (see latency_hist.h), the origin comes with the parameter change from the output MCU
+LatencyHistogram uart_latency;  // LATENCY_ENC_UART, written by loop()
+LatencyHistogram audio_latency; // LATENCY_ENC_AUDIO, written by the audio interrupt
+volatile bool input_origin_pending = false;
+volatile uint32_t input_origin_us = 0;
+
+// Called by the param engine from the audio interrupt, at the start of the block that applies a change
+void on_param_block()
+{
+  if (!input_origin_pending) return;
+  audio_latency.add(micros() - input_origin_us);
+  input_origin_pending = false;
+}
+
+#define ENC_DATA_READY_PIN 2 // low while the encoder board has queued events
+
+// SD card slot of the audio board (rev D, Teensy 4)
+#define SDCARD_CS_PIN 10
+#define SDCARD_MOSI_PIN 11
+#define SDCARD_SCK_PIN 13
+#define FLASH_CS_PIN 6
+
+bool read_encoder_board(uint8_t reg, uint8_t *buf, int len)
+{
+  Wire.beginTransmission(ENC_BOARD_I2C_ADDR);
+  Wire.write(reg);
+  if (Wire.endTransmission(false) != 0) return false;
+  if (Wire.requestFrom(ENC_BOARD_I2C_ADDR, len) != len) return false;
+
+  for (int i = 0; i < len; i++) {
+    buf[i] = Wire.read();
+  }
+  return true;
 }
 
+/*
+ * Only one master may consume the encoder board's events, the output MCU currently does.
+ * Positions and buttons are updated from the pending events (see enc_events.h).
+ */
 void request_receive_i2c(int *pos, uint8_t *buttons)
 {
-  Wire.requestFrom(0x08, 9);
+  static bool synced = false;
+  static uint8_t next_seq = 0;
+
+  if (!synced) {
+    uint8_t b[ENC_SNAPSHOT_SIZE];
+    if (read_encoder_board(ENC_REG_SNAPSHOT, b, sizeof (b))) {
+      for (int i = 0; i < ENC_NUM_ENCODERS; i++) {
+        pos[i] = (int16_t)((b[2 * i] << 8) | b[2 * i + 1]);
+        buttons[i] = (b[8] >> (3 - i)) & 1;
+      }
+      synced = true;
+    }
+  }
+
+  if (digitalReadFast(ENC_DATA_READY_PIN) == HIGH) return;
 
-  byte b[9] = {};
-  int i = 0;
+  uint8_t n = 0;
+  if (!read_encoder_board(ENC_REG_COUNT, &n, 1) || n == 0 || n > ENC_MAX_BURST) return;
 
-  while (Wire.available()) {
-    b[i++] = Wire.read();
+  uint8_t b[ENC_MAX_BURST * ENC_EVENT_SIZE + ENC_TIME_SIZE];
+  if (!read_encoder_board(ENC_REG_EVENTS, b, n * ENC_EVENT_SIZE + ENC_TIME_SIZE)) return;
+
+  for (int i = 0; i < n; i++) {
+    EncEvent e;
+    enc_event_decode(b + i * ENC_EVENT_SIZE, e);
+    if (e.seq != next_seq) {
+      TRACE_WARN(trace_loop, TRACE_ENC_RESYNC, next_seq, e.seq);
+      synced = false; // dropped events, resync from a snapshot next time
+    }
+    next_seq = e.seq + 1;
+
+    if (e.index >= 8) continue;
+    if (e.type == ENC_EVENT_ENCODER) {
+      pos[e.index] = e.value;
+    } else if (e.type == ENC_EVENT_BUTTON) {
+      buttons[e.index] = e.value != ENC_BUTTON_RELEASED;
+    }
   }
+}
 
-  pos[0] = (b[0] << 8) | b[1];
-  pos[1] = (b[2] << 8) | b[3];
-  pos[2] = (b[4] << 8) | b[5];
-  pos[3] = (b[6] << 8) | b[7];
-  pos[4] = pos[5] = pos[6] = pos[7] = 0;
+void on_seq_tick(uint32_t tick, uint16_t offset);
+void play_track_note(uint8_t track, uint8_t note, uint8_t velocity, uint16_t offset);
 
-  buttons[0] = (b[8] & 8) >> 3;
-  buttons[1] = (b[8] & 4) >> 2;
-  buttons[2] = (b[8] & 2) >> 1;
-  buttons[3] = b[8] & 1;
-  buttons[4] = buttons[5] = buttons[6] = buttons[7] = 1; // HIGH = not pressed
+/*
+ * Copies all *.OPS files from the audio board's flash into the sample arena.
+ * OPS samples need no decoding, so loading is a single read per sample.
+ */
+void load_flash_samples()
+{
+  if (!SerialFlash.begin(FLASH_CS_PIN)) return;
+
+  SerialFlash.opendir();
+  char name[64];
+  uint32_t size;
+  while (num_ram_samples < MAX_RAM_SAMPLES && SerialFlash.readdir(name, sizeof (name), size)) {
+    const int len = strlen(name);
+    if (len < 4 || strcasecmp(name + len - 4, ".OPS") != 0) continue;
+
+    void *p = sample_arena.alloc(size);
+    if (!p) {
+      Serial.printf("%s: %lu bytes do not fit, %lu free\n", name, size, sample_arena.get_largest_free());
+      continue;
+    }
+    SerialFlashFile f = SerialFlash.open(name);
+    const OpsHeader *h = f && f.read(p, size) == size ? ops_validate(p, size) : NULL;
+    f.close();
+    if (!h) {
+      sample_arena.free(p);
+      continue;
+    }
+    ram_samples[num_ram_samples++] = h;
+  }
+  Serial.printf("%d flash samples loaded, %lu of %lu arena bytes free\n", num_ram_samples,
+    sample_arena.get_free(), sample_arena.get_size());
+}
+
+/*
+ * Presets. A recall reads one record from flash and only sets parameter targets, so it takes less
+ * than an audio block; the parameters then glide to the new values in the audio interrupt.
+ */
+void recall_preset(uint8_t slot, uint16_t glide_blocks)
+{
+  Preset p;
+  if (!presets.load(slot, p)) return;
+  p.apply(params, mod_matrix, glide_blocks);
+  AudioNoInterrupts();
+  current_preset = p;
+  AudioInterrupts();
+}
+
+void save_preset(uint8_t slot)
+{
+  Preset p;
+  p.capture(params, mod_matrix);
+  snprintf(p.name, sizeof (p.name), "Preset %d", slot + 1);
+  if (!presets.save(slot, p)) {
+    TRACE_ERROR(trace_loop, TRACE_PRESET_SAVE_FAILED, slot, 0);
+    return;
+  }
+  AudioNoInterrupts();
+  current_preset = p;
+  AudioInterrupts();
+}
+
+void load_morph_preset(uint8_t slot)
+{
+  Preset p;
+  if (!presets.load(slot, p)) return;
+  AudioNoInterrupts();
+  morph_preset = p;
+  morph_ready = true;
+  AudioInterrupts();
+}
+
+void setup_presets()
+{
+  current_preset.capture(params, mod_matrix);
+  if (!SerialFlash.begin(FLASH_CS_PIN) || !preset_storage.begin()) {
+    Serial.println("No preset storage");
+    return;
+  }
+  presets.begin();
+  recall_preset(0, 0);
+}
+
+#define TRACK_DRUM 0
+#define TRACK_SYNTH 1 // tracks from TRACK_SLICER on play the slices of the first RAM sample
+#define TRACK_SLICER 2
+
+/*
+ * DMAMEM is not initialised at startup. The first pattern is the demo rhythm:
+ * drum on quarters plus an eighth, A4 held for the second half of the bar.
+ */
+void setup_patterns()
+{
+  for (int i = 0; i < NUM_PATTERNS; i++) {
+    patterns[i].clear();
+  }
+  Pattern &p = patterns[0];
+  for (int step = 0; step < 16; step += 4) {
+    p.set_trig(TRACK_DRUM, step, 0, 100, 1);
+  }
+  p.set_trig(TRACK_DRUM, 14, 0, 100, 1);
+  p.set_trig(TRACK_SYNTH, 8, 69, 100, 8 * Pattern::STEP_TICKS);
 }
 
+void setup_profiler()
+{
+  profiler.add_node(seq_clock, "seq clock", STAT_GROUP_CLOCK);
+  profiler.add_node(midi_in, "midi in", STAT_GROUP_CLOCK);
+  profiler.add_node(param_engine, "params", STAT_GROUP_CLOCK);
+  voice_pool.add_to_profiler(profiler, STAT_GROUP_VOICES);
+  profiler.add_node(sampler, "sd streamer", STAT_GROUP_SAMPLER);
+  profiler.add_node(ops_player, "ops player", STAT_GROUP_SLICER);
+  profiler.add_node(drum1, "drum", STAT_GROUP_DRUMS);
+  profiler.add_node(mixer1, "mixer", STAT_GROUP_OUTPUT);
+  profiler.add_node(out_gain, "volume", STAT_GROUP_OUTPUT);
+  profiler.add_node(i2s1, "i2s", STAT_GROUP_OUTPUT);
+}
+
+uint8_t serial4_tx_buf[4 * MCU_MAX_WIRE_FRAME]; // lets send_output_mcu_frame() return without waiting for the UART
+
 void setup() {
   Serial.begin(9600);
-  Serial4.begin(9600); // bi-directional communication with ESP32
+  Serial4.begin(MCU_PROTO_BAUD); // bi-directional communication with ESP32
+  Serial4.addMemoryForWrite(serial4_tx_buf, sizeof (serial4_tx_buf));
+  Wire.begin();
+  pinMode(ENC_DATA_READY_PIN, INPUT_PULLUP);
 
   // Audio board setup
-  AudioMemory(512);
+  AudioMemory(AUDIO_MEMORY_BLOCKS);
   sgtl5000_1.enable();
   sgtl5000_1.volume(0.5);
 
+  // Samples S1.WAV, S2.WAV, ... from the SD card of the audio board
+  SPI.setMOSI(SDCARD_MOSI_PIN);
+  SPI.setSCK(SDCARD_SCK_PIN);
+  if (SD.begin(SDCARD_CS_PIN)) {
+    char path[SampleStreamer::MAX_PATH];
+    for (int i = 0; i < SampleStreamer::MAX_SAMPLES; i++) {
+      snprintf(path, sizeof (path), "S%d.WAV", i + 1);
+      if (sampler.add_sample(path) < 0) break;
+    }
+  }
+  Serial.printf("%d samples loaded\n", sampler.get_num_samples());
+  mixer1.gain(1, 0.8);
+  load_flash_samples();
+  mixer1.gain(3, 0.8);
+
   // Synth setup
   drum1.frequency(110);
-  sine1.frequency(440);
-  sine1.amplitude(0.6);
-  sine2.frequency(440);
-  sine2.amplitude(0.4);
+  voice_pool.begin();
+  voice_pool.set_steal_mode(VoicePool::STEAL_QUIETEST);
+  mixer1.gain(0, 0.6);
+  mod_matrix.set_slot(0, MOD_ENV, PARAM_FILTER_CUTOFF, 0.2f);
+  mod_matrix.set_slot(1, MOD_WHEEL, PARAM_FILTER_CUTOFF, 0.4f);
+  param_engine.set_handler(apply_param);
+  param_engine.set_block_handler(on_param_block);
+  setup_presets();
 
   // USB host shield setup
   myusb.begin();
@@ -139,27 +508,121 @@ void setup() {
   midi1.setHandleNoteOff(OnNoteOff);
   midi1.setHandleNoteOn(OnNoteOn);
   midi1.setHandleControlChange(OnControlChange);
+  midi1.setHandleProgramChange(OnProgramChange);
+  midi1.setHandleClock(OnClock);
+  midi1.setHandleStart(OnStart);
+  midi1.setHandleContinue(OnContinue);
+  midi1.setHandleStop(OnStop);
+  midi_in.set_event_handler(play_midi_event);
+  midi_clock.set_mode(MIDI_CLOCK_MODE);
+
+  // Sequencer
+  setup_patterns();
+  pattern_seq.set_note_handler(play_track_note);
+  seq_clock.set_tick_handler(on_seq_tick);
+  seq_clock.set_tempo(120);
+  if (MIDI_CLOCK_MODE == MidiClock::MODE_MASTER) seq_clock.start(); // otherwise on MIDI start
+
+  setup_profiler();
+  TRACE_INFO(trace_loop, TRACE_BOOT, TRACE_SOURCE_AUDIO, TRACE_LEVEL);
 }
 
 int pos[8], prev_pos[8];
 uint8_t buttons[8], prev_buttons[8];
 bool pos_update[8], button_update[8];
+McuFrameWriter output_mcu_frame; // batches all updates of one loop() pass into a single UART frame
+
+void send_output_mcu_frame() {
+  if (output_mcu_frame.is_empty()) return;
+  uint8_t buf[MCU_MAX_WIRE_FRAME];
+  const int len = output_mcu_frame.encode(buf);
+  Serial4.write(buf, len);
+}
 
-void set_osc_freq(int i) {
-  static AudioSynthWaveformSine *sine_ptr[2] = { &sine1, &sine2 };
-  const int freq = 200 + (pos[i] * 10);
-  Serial.println("Setting freq to "); Serial.println(freq);
-  sine_ptr[i]->frequency(freq); 
+void queue_output_mcu_msg(uint8_t type, uint8_t id, int16_t value) {
+  if (!output_mcu_frame.add(type, id, value)) {
+    send_output_mcu_frame();
+    output_mcu_frame.add(type, id, value);
+  }
+}
+
+// The output MCU mirrors the parameters, see McuStateId. Changes are coalesced over one interval.
+#define PARAM_SYNC_INTERVAL_MS 10
+ParamSync param_sync;
+McuFrameReader output_mcu_reader;
+
+// Clock sync, see McuTimeId: the answer goes out at once, in a frame of its own
+void answer_ping(int16_t seq, uint32_t rx_us) {
+  send_output_mcu_frame();
+  output_mcu_frame.add(MSG_TIME, TIME_PONG, seq);
+  output_mcu_frame.add(MSG_TIME, TIME_RX_LO, (int16_t)(rx_us & 0xffff));
+  output_mcu_frame.add(MSG_TIME, TIME_RX_HI, (int16_t)(rx_us >> 16));
+  const uint32_t reply_delay_us = micros() - rx_us;
+  output_mcu_frame.add(MSG_TIME, TIME_REPLY_DELAY, reply_delay_us > 32767 ? 32767 : reply_delay_us);
+  send_output_mcu_frame();
+}
+
+void receive_output_mcu() {
+  McuMsg msgs[MCU_MAX_MSGS_PER_FRAME];
+  while (Serial4.available() > 0) {
+    const int len = output_mcu_reader.feed(Serial4.read());
+    if (len <= 0) continue;
+    const uint32_t rx_us = micros();
+    const int n = mcu_decode_frame(output_mcu_reader.get_frame(), len, msgs, MCU_MAX_MSGS_PER_FRAME);
+
+    bool timed = false;
+    uint32_t origin_us = 0;
+    for (int i = 0; i < n; i++) {
+      if (msgs[i].type != MSG_TIME) continue;
+      if (msgs[i].id == TIME_PING) {
+        answer_ping(msgs[i].value, rx_us);
+      } else if (msgs[i].id == TIME_ORIGIN_LO) {
+        origin_us = (origin_us & 0xffff0000) | (uint16_t)msgs[i].value;
+      } else if (msgs[i].id == TIME_ORIGIN_HI) {
+        origin_us = (origin_us & 0xffff) | ((uint32_t)(uint16_t)msgs[i].value << 16);
+        timed = true;
+      }
+    }
+    if (timed) {
+      uart_latency.add(rx_us - origin_us);
+      AudioNoInterrupts(); // the changes and their origin reach the same audio block
+    }
+    for (int i = 0; i < n; i++) {
+      param_sync.handle_msg(msgs[i], params);
+    }
+    if (timed) {
+      input_origin_us = origin_us;
+      input_origin_pending = true;
+      AudioInterrupts();
+    }
+  }
+}
+
+void send_param_state() {
+  static elapsedMillis since_sync;
+  if (since_sync < PARAM_SYNC_INTERVAL_MS) return;
+  since_sync = 0;
+
+  send_output_mcu_frame(); // a state frame carries nothing else
+  while (param_sync.write_frame(params, output_mcu_frame)) {
+    send_output_mcu_frame();
+  }
+}
+
+// Encoders 1 and 2 tune the two oscillators of all voices in semitones
+void set_osc_tune(int i) {
+  TRACE_DEBUG(trace_loop, TRACE_OSC_TUNE, i, pos[i]);
+  params.set(PARAM_OSC1_TUNE + i, pos[i]);
 }
 
 void on_pos_update(int i) {
-  Serial.println(pos[0]);
+  set_osc_tune(i);
 
-  set_osc_freq(i);
+  queue_output_mcu_msg(MSG_ENCODER, i, pos[i]);
+}
 
-  char buf[8];
-  sprintf(buf, "e%d:%d;\r\n", i, pos[i]);
-  Serial4.print(buf);
+void on_button_update(int i) {
+  queue_output_mcu_msg(MSG_BUTTON, i, buttons[i]);
 }
 
 void update_inputs() {
@@ -178,54 +641,153 @@ void update_inputs() {
 
   if (pos_update[0]) on_pos_update(0);
   if (pos_update[1]) on_pos_update(1);
+  for (i = 0; i < 8; i++) {
+    if (button_update[i]) on_button_update(i);
+  }
+  send_output_mcu_frame();
 
   memset(pos_update, 0, sizeof (pos_update));
   memset(button_update, 0, sizeof (button_update));
 }
 
-uint32_t current_beat = 0;
-uint32_t cur_seq_step = 0;
-uint32_t last_note = 0;
-bool note_on_sent = false;
+/*
+ * Sequencer callbacks run from the audio block interrupt (see AudioSeqClock),
+ * so they must not block or print. Parameter changes go through params.set() like everywhere else.
+ */
+void play_track_note(uint8_t track, uint8_t note, uint8_t velocity, uint16_t offset) {
+  if (track == TRACK_DRUM) {
+    if (velocity > 0) drum1.noteOn();
+  } else if (track == TRACK_SYNTH) {
+    if (velocity > 0) {
+      voice_pool.note_on(note, velocity);
+      mod_matrix.trigger_envelope();
+    } else {
+      voice_pool.note_off(note);
+    }
+  } else if (velocity > 0 && num_ram_samples > 0 && note >= SAMPLER_FIRST_NOTE) {
+    ops_player.play(ram_samples[0], note - SAMPLER_FIRST_NOTE, velocity / 127.0f, offset);
+  }
+}
+
+// The stock Audio library objects can only start at a block boundary, offset is for sample-accurate voices
+void on_seq_tick(uint32_t tick, uint16_t offset) {
+  midi_clock.on_seq_tick(tick, SeqClock::PPQN);
+  pattern_seq.tick(tick, offset);
+}
+
+void queue_stat(uint8_t id, float value) {
+  queue_output_mcu_msg(MSG_STAT, id, value > 32767.0f ? 32767 : (int16_t)value);
+}
 
-void play_notes_sequence() {
-  uint32_t t = millis();
-  if (t - last_note > 1200) {
-    envelope1.noteOff();
-    Serial.println("Note off");
-    last_note = millis();
-    note_on_sent = false;
-  } else if (t - last_note > 700 && !note_on_sent) {
-    envelope1.noteOn();
-    note_on_sent = true;
-    Serial.println("Note on");
+/*
+ * Sends the profiling figures to the output MCU (diagnostics page), see McuStatId,
+ * and the version of the parameter state, so it notices a lost state frame
+ */
+void send_stats() {
+  queue_stat(STAT_CPU, AudioProcessorUsage() * 10.0f);
+  queue_stat(STAT_CPU_MAX, AudioProcessorUsageMax() * 10.0f);
+  queue_stat(STAT_MEM_USED, AudioMemoryUsage());
+  queue_stat(STAT_MEM_MAX, AudioMemoryUsageMax());
+  queue_stat(STAT_MEM_TOTAL, AUDIO_MEMORY_BLOCKS);
+  queue_stat(STAT_LOOP_MAX_US, profiler.get_loop_max_us());
+  queue_stat(STAT_LOOP_USB_US, profiler.get_section_max_us(AudioProfiler::SECTION_USB));
+  queue_stat(STAT_LOOP_MIDI_US, profiler.get_section_max_us(AudioProfiler::SECTION_MIDI));
+  queue_stat(STAT_LOOP_INPUT_US, profiler.get_section_max_us(AudioProfiler::SECTION_INPUT));
+  queue_stat(STAT_LOOP_SAMPLER_US, profiler.get_section_max_us(AudioProfiler::SECTION_SAMPLER));
+  queue_stat(STAT_UNDERRUNS, sampler.get_underruns());
+  for (int g = 0; g < STAT_NUM_GROUPS; g++) {
+    queue_stat(STAT_GROUP_CPU + g, profiler.get_group_cpu_max(g) * 10.0f);
   }
+  queue_output_mcu_msg(MSG_STAT, STAT_LATENCY_P50 + LATENCY_ENC_UART, mcu_latency_stat(uart_latency.get_percentile_us(50)));
+  queue_output_mcu_msg(MSG_STAT, STAT_LATENCY_P99 + LATENCY_ENC_UART, mcu_latency_stat(uart_latency.get_percentile_us(99)));
+  queue_output_mcu_msg(MSG_STAT, STAT_LATENCY_P50 + LATENCY_ENC_AUDIO, mcu_latency_stat(audio_latency.get_percentile_us(50)));
+  queue_output_mcu_msg(MSG_STAT, STAT_LATENCY_P99 + LATENCY_ENC_AUDIO, mcu_latency_stat(audio_latency.get_percentile_us(99)));
+  queue_output_mcu_msg(MSG_STATE, STATE_VERSION, param_sync.get_version());
+  send_output_mcu_frame();
 }
 
-void play_drum_sequence() {
-  const int beat = 500;
-  const int beat8 = beat / 2;
+/*
+ * Reports the audio CPU load once per second, to the output MCU and with more detail on the serial console,
+ * including an estimate of how many voices would fit:
+ * everything except the voices is fixed cost, every further voice costs as much as the worst one.
+ */
+#define CPU_BUDGET_PERCENT 80.0f
+
+void report_cpu_usage() {
+  static elapsedMillis since_report;
+  if (since_report < 1000) return;
+  since_report = 0;
+
+  send_stats();
+
+  const float total = AudioProcessorUsageMax();
+  const float voice = voice_pool.get_voice_cpu_max();
+  const float fixed = total - voice * AudioVoicePool::NUM_VOICES;
+  const int fit = voice > 0.0f ? (int)((CPU_BUDGET_PERCENT - fixed) / voice) : 0;
+  Serial.printf("CPU %.1f%% (max %.1f%%), voice %.2f%%, %d/%d voices active, ~%d voices fit in %.0f%%, mem %d blocks, steals %lu, osc %lu cycles/block\n",
+    AudioProcessorUsage(), total, voice, voice_pool.get_active_voices(), AudioVoicePool::NUM_VOICES,
+    fit, CPU_BUDGET_PERCENT, AudioMemoryUsageMax(), voice_pool.get_steal_count(), voice_pool.get_osc_block_cycles_max());
+
+  Serial.printf("Sampler: %lu underruns, %lu reads, %lu read errors, min read-ahead %d samples\n",
+    sampler.get_underruns(), sampler.get_reads(), sampler.get_read_errors(), sampler.get_min_buffered());
+  Serial.printf("loop max %lu us: usb %lu, midi %lu, input %lu, sampler %lu\n", profiler.get_loop_max_us(),
+    profiler.get_section_max_us(AudioProfiler::SECTION_USB), profiler.get_section_max_us(AudioProfiler::SECTION_MIDI),
+    profiler.get_section_max_us(AudioProfiler::SECTION_INPUT), profiler.get_section_max_us(AudioProfiler::SECTION_SAMPLER));
+  Serial.printf("MIDI: %lu late, %lu dropped events", midi_in.get_late(), midi_in.get_dropped());
+  if (midi_clock.get_mode() == MidiClock::MODE_SLAVE) {
+    Serial.printf(", clock %s %.2f bpm, jitter %.0f us", midi_clock.is_locked(micros()) ? "locked" : "lost",
+      midi_clock.get_tempo(), midi_clock.get_jitter_us());
+  }
+  Serial.println();
+  Serial.printf("Param sync: version %u, %lu frames, %lu snapshots\n", param_sync.get_version(),
+    param_sync.get_frames(), param_sync.get_snapshots());
+  // Cumulative since startup; the I2S output adds 2 blocks to the audio stage
+  Serial.printf("Input latency us p50/p90/p99/max (count): uart %lu/%lu/%lu/%lu (%lu), audio %lu/%lu/%lu/%lu (%lu)\n",
+    uart_latency.get_percentile_us(50), uart_latency.get_percentile_us(90), uart_latency.get_percentile_us(99),
+    uart_latency.get_max_us(), uart_latency.get_count(), audio_latency.get_percentile_us(50),
+    audio_latency.get_percentile_us(90), audio_latency.get_percentile_us(99), audio_latency.get_max_us(),
+    audio_latency.get_count());
+  profiler.print_nodes(Serial);
+
+  profiler.reset_peaks();
+  voice_pool.reset_cpu_usage_max();
+  sampler.reset_min_buffered();
+}
 
-  drum1.noteOn();
-  delay(beat);
-  drum1.noteOn();
-  delay(beat);
-  drum1.noteOn();
-  delay(beat);
-  drum1.noteOn();
-  delay(beat8);
-  drum1.noteOn();
-  delay(beat8);
+// Sends trace records while the USB serial has room for them, so loop() never waits for the host
+void drain_trace() {
+  static TraceBuffer<TRACE_BUFFER_SIZE> *const buffers[] = { &trace_loop, &trace_audio };
+  uint8_t frame[TRACE_WIRE_FRAME];
+  TraceRecord r;
+  while (Serial.availableForWrite() >= TRACE_WIRE_FRAME && trace_take(buffers, 2, r)) {
+    Serial.write(frame, trace_frame_encode(r, frame));
+  }
 }
 
 void loop() {
+  profiler.begin_loop();
+
+  profiler.begin_section(AudioProfiler::SECTION_USB);
   myusb.Task();
+  profiler.end_section(AudioProfiler::SECTION_USB);
+
+  profiler.begin_section(AudioProfiler::SECTION_MIDI);
   midi1.read();
-  
+  send_midi_clock();
+  profiler.end_section(AudioProfiler::SECTION_MIDI);
+
+  profiler.begin_section(AudioProfiler::SECTION_SAMPLER);
+  sampler.service(); // one SD read per pass, so MIDI is still handled in between
+  profiler.end_section(AudioProfiler::SECTION_SAMPLER);
+
+  profiler.begin_section(AudioProfiler::SECTION_INPUT);
+  receive_output_mcu();
+  send_param_state();
   //request_receive_i2c(pos, buttons);
   //update_inputs(); // TODO: from received UART message instead of I2C request
-  
-  play_notes_sequence();
-}
-
+  profiler.end_section(AudioProfiler::SECTION_INPUT);
 
+  profiler.end_loop();
+  report_cpu_usage(); // not timed, it prints
+  drain_trace();
+}
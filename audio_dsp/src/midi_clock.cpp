@@ -0,0 +1,113 @@
+#include <math.h>
+#include <midi_clock.h>
+
+MidiClock::MidiClock() {
+    mode = MODE_MASTER;
+    clocks_due = 0;
+    start_due = false;
+    clocks_sent = 0;
+    base_us = 0;
+    t1 = 0.0;
+    period = 60000000.0 / (120.0 * CLOCKS_PER_BEAT);
+    last_us = 0;
+    clock_count = 0;
+    run_clocks = 0;
+    jitter_us = 0.0f;
+    set_bandwidth(1.0f);
+}
+
+void MidiClock::set_bandwidth(float hz) {
+    bandwidth = hz;
+    // Critically damped loop; the loop runs once per clock, so omega depends on the tempo
+    const double omega = 2.0 * M_PI * hz * period / 1000000.0;
+    b = sqrt(2.0) * omega;
+    c = omega * omega;
+}
+
+void MidiClock::on_seq_tick(uint32_t tick, uint32_t ppqn) {
+    if (mode != MODE_MASTER) return;
+    if (tick == 0) start_due = true;
+    if (tick % (ppqn / CLOCKS_PER_BEAT) == 0) clocks_due++;
+}
+
+uint32_t MidiClock::take_clocks_due() {
+    const uint32_t due = clocks_due;
+    const uint32_t n = due - clocks_sent;
+    clocks_sent = due;
+    return n;
+}
+
+bool MidiClock::take_start_due() {
+    if (!start_due) return false;
+    start_due = false;
+    return true;
+}
+
+void MidiClock::clock(uint32_t now_us) {
+    if (mode != MODE_SLAVE) return;
+    clock_count++;
+
+    // After a pause the old estimate of the period is the best guess, the phase starts anew
+    if (run_clocks == 0 || now_us - last_us > TIMEOUT_US) {
+        base_us = now_us;
+        t1 = period;
+        run_clocks = 1;
+        last_us = now_us;
+        return;
+    }
+    last_us = now_us;
+
+    if (run_clocks == 1) {
+        // The first interval gives the DLL a starting period close enough to lock quickly
+        period = (double)(now_us - base_us);
+        set_bandwidth(bandwidth);
+        base_us = now_us;
+        t1 = period;
+        run_clocks++;
+        return;
+    }
+
+    const double t = (double)(int32_t)(now_us - base_us);
+    const double e = t - t1;
+    t1 += b * e + period;
+    period += c * e;
+    run_clocks++;
+    jitter_us += 0.05f * ((float)fabs(e) - jitter_us);
+
+    // Rebase to this clock, so t1 stays a small number
+    base_us = now_us;
+    t1 -= t;
+
+    if (run_clocks % CLOCKS_PER_BEAT == 0) set_bandwidth(bandwidth); // follow the tempo
+}
+
+void MidiClock::start() {
+    clock_count = 0;
+    run_clocks = 0;
+}
+
+void MidiClock::resume() {
+    run_clocks = 0;
+}
+
+bool MidiClock::is_locked(uint32_t now_us) const {
+    return mode == MODE_SLAVE && run_clocks >= LOCK_CLOCKS && now_us - last_us < TIMEOUT_US;
+}
+
+float MidiClock::get_tempo() const {
+    return (float)(60000000.0 / (period * CLOCKS_PER_BEAT));
+}
+
+/*
+ * The sequencer runs on its own sample clock at the filtered tempo. Any phase difference to the
+ * incoming clocks is removed by running it up to 5% faster or slower until it has caught up.
+ */
+float MidiClock::get_follow_tempo(uint32_t seq_tick, uint32_t ppqn) const {
+    const float ticks_per_clock = (float)ppqn / CLOCKS_PER_BEAT;
+    // The first clock after start marks tick 0
+    const float error = (clock_count > 0 ? (clock_count - 1) * ticks_per_clock : 0.0f) - (float)seq_tick;
+    float correction = 0.01f * error / ticks_per_clock;
+    if (correction > 0.05f) correction = 0.05f;
+    else if (correction < -0.05f) correction = -0.05f;
+    return get_tempo() * (1.0f + correction);
+}
@@ -0,0 +1,67 @@
+#include <midi_scheduler.h>
+
+MidiScheduler::MidiScheduler(double sample_rate, uint16_t block_samples) {
+    samples_per_us = (float)(sample_rate / 1000000.0);
+    this->block_samples = block_samples;
+    event_handler = 0;
+    dropped = 0;
+    stamp_seq = 0;
+    stamp_sample = 0;
+    stamp_us = 0;
+    sample_pos = 0;
+    late = 0;
+}
+
+/*
+ * The interrupt may update the block stamp while loop() reads it, then the read is repeated
+ */
+uint32_t MidiScheduler::timestamp(uint32_t now_us) const {
+    uint32_t seq, sample, us;
+    do {
+        seq = __atomic_load_n(&stamp_seq, __ATOMIC_ACQUIRE);
+        sample = stamp_sample;
+        us = stamp_us;
+        __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    } while ((seq & 1) || seq != __atomic_load_n(&stamp_seq, __ATOMIC_ACQUIRE));
+
+    // Beyond two blocks the interrupt is stalled anyway, and the event is simply late
+    uint32_t elapsed = (uint32_t)((now_us - us) * samples_per_us);
+    if (elapsed > 2u * block_samples) elapsed = 2u * block_samples;
+    return sample + elapsed + block_samples;
+}
+
+bool MidiScheduler::push(uint8_t type, uint8_t channel, uint8_t data1, uint8_t data2, uint32_t now_us) {
+    MidiEvent e;
+    e.time = timestamp(now_us);
+    e.type = type;
+    e.channel = channel;
+    e.data1 = data1;
+    e.data2 = data2;
+    if (!queue.push(e)) {
+        dropped++;
+        return false;
+    }
+    return true;
+}
+
+void MidiScheduler::process_block(uint32_t now_us) {
+    __atomic_store_n(&stamp_seq, stamp_seq + 1, __ATOMIC_RELEASE);
+    stamp_sample = sample_pos;
+    stamp_us = now_us;
+    __atomic_store_n(&stamp_seq, stamp_seq + 1, __ATOMIC_RELEASE);
+
+    const uint32_t block_end = sample_pos + block_samples;
+    const MidiEvent *e;
+    while ((e = queue.peek()) && (int32_t)(e->time - block_end) < 0) {
+        MidiEvent event;
+        queue.pop(event);
+
+        int32_t offset = (int32_t)(event.time - sample_pos);
+        if (offset < 0) {
+            late++;
+            offset = 0;
+        }
+        if (event_handler) event_handler(event, (uint16_t)offset);
+    }
+    sample_pos = block_end;
+}
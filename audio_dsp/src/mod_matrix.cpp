@@ -0,0 +1,90 @@
+#include <math.h>
+#include <mod_matrix.h>
+
+ModMatrix::ModMatrix() {
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        clear_slot(i);
+    }
+    wheel = 0.0f;
+    env_triggers = env_seen = 0;
+    env_attack = false;
+    env_level = 0.0f;
+    lfo_phase[0] = lfo_phase[1] = 0.0f;
+    for (int s = 0; s < NUM_MOD_SOURCES; s++) {
+        sources[s] = 0.0f;
+    }
+}
+
+void ModMatrix::set_slot(int slot, uint8_t source, uint8_t dest, float depth) {
+    if (slot < 0 || slot >= MAX_SLOTS || source >= NUM_MOD_SOURCES || dest >= NUM_PARAMS) return;
+    if (depth < -1.0f) depth = -1.0f;
+    else if (depth > 1.0f) depth = 1.0f;
+
+    const int16_t q15 = (int16_t)(depth * 32767.0f);
+    slots[slot] = ((uint32_t)(uint16_t)q15 << 16) | (source << 8) | dest;
+}
+
+void ModMatrix::clear_slot(int slot) {
+    if (slot < 0 || slot >= MAX_SLOTS) return;
+    slots[slot] = NO_SOURCE << 8;
+}
+
+void ModMatrix::set_packed_slot(int slot, uint32_t packed) {
+    const uint8_t source = (packed >> 8) & 0xff;
+    const uint8_t dest = packed & 0xff;
+    if (source >= NUM_MOD_SOURCES || dest >= NUM_PARAMS) clear_slot(slot);
+    else if (slot >= 0 && slot < MAX_SLOTS) slots[slot] = packed;
+}
+
+void ModMatrix::set_wheel(float value) {
+    wheel = value;
+}
+
+void ModMatrix::trigger_envelope() {
+    __atomic_fetch_add(&env_triggers, 1, __ATOMIC_RELAXED);
+}
+
+void ModMatrix::process(const ParamStore &params, float block_seconds, float *offsets) {
+    // LFOs
+    for (int i = 0; i < 2; i++) {
+        float phase = lfo_phase[i] + params.get(PARAM_LFO1_RATE + i) * block_seconds;
+        if (phase >= 1.0f) phase -= floorf(phase);
+        lfo_phase[i] = phase;
+    }
+    sources[MOD_LFO1] = sinf(2.0f * (float)M_PI * lfo_phase[0]);
+    sources[MOD_LFO2] = 4.0f * fabsf(lfo_phase[1] - 0.5f) - 1.0f;
+
+    // Envelope: linear attack from the current level, so a retrigger does not click, then linear decay
+    const uint32_t triggers = env_triggers;
+    if (triggers != env_seen) {
+        env_seen = triggers;
+        env_attack = true;
+    }
+    const float block_ms = block_seconds * 1000.0f;
+    if (env_attack) {
+        const float attack = params.get(PARAM_MOD_ATTACK);
+        env_level = attack > block_ms ? env_level + block_ms / attack : 1.0f;
+        if (env_level >= 1.0f) {
+            env_level = 1.0f;
+            env_attack = false;
+        }
+    } else if (env_level > 0.0f) {
+        const float decay = params.get(PARAM_MOD_DECAY);
+        env_level = decay > block_ms ? env_level - block_ms / decay : 0.0f;
+        if (env_level < 0.0f) env_level = 0.0f;
+    }
+    sources[MOD_ENV] = env_level;
+    sources[MOD_WHEEL] = wheel;
+
+    for (int id = 0; id < NUM_PARAMS; id++) {
+        offsets[id] = 0.0f;
+    }
+    for (int i = 0; i < MAX_SLOTS; i++) {
+        const uint32_t slot = slots[i];
+        const uint8_t source = (slot >> 8) & 0xff;
+        if (source == NO_SOURCE) continue;
+        const uint8_t dest = slot & 0xff;
+        const float depth = (int16_t)(slot >> 16) * (1.0f / 32767.0f);
+        offsets[dest] += sources[source] * depth * (param_desc(dest).max - param_desc(dest).min);
+    }
+}
@@ -0,0 +1,72 @@
+#include <ops_player.h>
+
+OpsPlayer::OpsPlayer() {
+    start_counter = 0;
+    for (uint8_t v = 0; v < MAX_VOICES; v++) {
+        voices[v].data = 0;
+        voices[v].started = 0;
+    }
+}
+
+int OpsPlayer::play(const OpsHeader *sample, int slice, float gain, uint16_t offset) {
+    int best = 0;
+    for (uint8_t v = 0; v < MAX_VOICES; v++) {
+        if (!voices[v].data) {
+            best = v;
+            break;
+        }
+        if (voices[v].started < voices[best].started) best = v;
+    }
+
+    Voice &voice = voices[best];
+    uint32_t start, end;
+    ops_slice_range(sample, slice, start, end);
+    voice.pos = start;
+    voice.end = end;
+    // Only a whole sample loops, slices are one-shots
+    const bool loop = slice < 0 && (sample->flags & OPS_FLAG_LOOP) && sample->loop_end > sample->loop_start;
+    voice.loop_start = sample->loop_start;
+    voice.loop_end = loop ? sample->loop_end : 0;
+    voice.gain = gain >= 1.0f ? 32767 : (gain <= 0.0f ? 0 : (int16_t)(gain * 32767.0f));
+    voice.delay = offset;
+    voice.started = ++start_counter;
+    voice.data = ops_data(sample);
+    return best;
+}
+
+void OpsPlayer::release_voice(uint8_t v) {
+    if (v < MAX_VOICES) voices[v].loop_end = 0;
+}
+
+void OpsPlayer::stop_voice(uint8_t v) {
+    if (v < MAX_VOICES) voices[v].data = 0;
+}
+
+bool OpsPlayer::is_playing() const {
+    for (uint8_t v = 0; v < MAX_VOICES; v++) {
+        if (voices[v].data) return true;
+    }
+    return false;
+}
+
+void OpsPlayer::render(int16_t *out, int num_samples) {
+    for (uint8_t v = 0; v < MAX_VOICES; v++) {
+        Voice &voice = voices[v];
+        if (!voice.data) continue;
+
+        int i = 0;
+        if (voice.delay) {
+            i = voice.delay < num_samples ? voice.delay : num_samples;
+            voice.delay -= i;
+        }
+        for (; i < num_samples; i++) {
+            if (voice.loop_end && voice.pos >= voice.loop_end) voice.pos = voice.loop_start;
+            if (voice.pos >= voice.end) {
+                voice.data = 0;
+                break;
+            }
+            const int32_t s = out[i] + ((voice.data[voice.pos++] * voice.gain) >> 15);
+            out[i] = s > 32767 ? 32767 : (s < -32768 ? -32768 : s);
+        }
+    }
+}
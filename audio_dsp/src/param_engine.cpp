@@ -0,0 +1,35 @@
+#include <param_engine.h>
+
+ParamEngine::ParamEngine(ParamStore &params, ModMatrix &mod) : params(params), mod(mod) {
+    handler = 0;
+    first_block = true;
+    for (int id = 0; id < NUM_PARAMS; id++) {
+        value[id] = previous[id] = applied[id] = params.get(id);
+    }
+}
+
+void ParamEngine::process(float block_seconds) {
+    params.latch();
+    params.advance();
+    mod.process(params, block_seconds, offsets);
+
+    for (int id = 0; id < NUM_PARAMS; id++) {
+        const ParamDesc &info = param_desc(id);
+        float v = params.get(id) + offsets[id];
+        if (v < info.min) v = info.min;
+        else if (v > info.max) v = info.max;
+
+        previous[id] = value[id];
+        value[id] = v;
+
+        // Changes below the resolution of the parameter are not worth a handler call,
+        // slow ramps still get through because they are compared to the last value handed out
+        const float delta = v - applied[id];
+        const float resolution = (info.max - info.min) * 1e-4f;
+        if (handler && (first_block || delta > resolution || delta < -resolution)) {
+            applied[id] = v;
+            handler(id, v);
+        }
+    }
+    first_block = false;
+}
@@ -0,0 +1,73 @@
+#include <string.h>
+#include <param_store.h>
+
+static_assert(NUM_PARAMS <= 32, "pending has one bit per parameter");
+
+int param_for_cc(uint8_t control) {
+    for (int id = 0; id < NUM_PARAMS; id++) {
+        if (control != 0 && param_desc(id).cc == control) return id;
+    }
+    return -1;
+}
+
+int param_for_name(const char *name) {
+    for (int id = 0; id < NUM_PARAMS; id++) {
+        if (strcmp(param_desc(id).name, name) == 0) return id;
+    }
+    return -1;
+}
+
+ParamStore::ParamStore() {
+    pending = 0;
+    for (int i = 0; i < NUM_PARAMS; i++) {
+        target[i] = current[i] = latched[i] = param_desc(i).init;
+        step[i] = 0.0f;
+        remaining[i] = ramp[i] = 0;
+    }
+}
+
+void ParamStore::set(uint8_t id, float value, uint16_t ramp_blocks) {
+    if (id >= NUM_PARAMS) return;
+    const ParamDesc &info = param_desc(id);
+    if (value < info.min) value = info.min;
+    else if (value > info.max) value = info.max;
+
+    target[id] = value;
+    ramp[id] = ramp_blocks;
+    // Release: the audio side sees the bit only after the new target
+    __atomic_fetch_or(&pending, 1UL << id, __ATOMIC_RELEASE);
+}
+
+// A lookup of the precomputed curve, cheap enough for MIDI CCs in the audio interrupt
+void ParamStore::set_normalized(uint8_t id, float value) {
+    if (id >= NUM_PARAMS) return;
+    set(id, param_denormalize(id, value));
+}
+
+void ParamStore::latch() {
+    uint32_t bits = __atomic_exchange_n(&pending, 0, __ATOMIC_ACQUIRE);
+    while (bits) {
+        const int id = __builtin_ctz(bits);
+        bits &= bits - 1;
+
+        latched[id] = target[id];
+        // Discrete parameters always jump
+        const uint8_t smooth_blocks = param_desc(id).smooth_blocks;
+        const uint16_t blocks = smooth_blocks == 0 ? 0 : (ramp[id] ? ramp[id] : smooth_blocks);
+        if (blocks == 0) {
+            current[id] = latched[id];
+            remaining[id] = 0;
+        } else {
+            step[id] = (latched[id] - current[id]) / blocks;
+            remaining[id] = blocks;
+        }
+    }
+}
+
+void ParamStore::advance() {
+    for (int id = 0; id < NUM_PARAMS; id++) {
+        if (remaining[id] == 0) continue;
+        // The last step lands exactly on the target
+        current[id] = --remaining[id] == 0 ? latched[id] : current[id] + step[id];
+    }
+}
@@ -0,0 +1,68 @@
+#include <param_sync.h>
+
+ParamSync::ParamSync() {
+    for (int i = 0; i < NUM_PARAMS; i++) {
+        seen[i] = param_desc(i).init;
+        values[i] = param_to_position(i, seen[i]);
+    }
+    dirty = 0;
+    in_snapshot = false;
+    version = 0;
+    frames = 0;
+    snapshots = 0;
+    request_snapshot();
+}
+
+void ParamSync::request_snapshot() {
+    snapshot_pending = true;
+}
+
+// Only parameters whose position changed are sent, a ramp below one step costs nothing
+void ParamSync::collect_changes(const ParamStore &params) {
+    for (int id = 0; id < NUM_PARAMS; id++) {
+        const float target = params.get_target(id);
+        if (target == seen[id]) continue;
+        seen[id] = target;
+
+        const int16_t value = param_to_position(id, target);
+        if (value == values[id]) continue;
+        values[id] = value;
+        dirty |= 1UL << id;
+    }
+}
+
+bool ParamSync::write_frame(const ParamStore &params, McuFrameWriter &frame) {
+    collect_changes(params);
+
+    bool first_of_snapshot = false;
+    if (snapshot_pending) {
+        snapshot_pending = false;
+        dirty = 0xffffffffUL >> (32 - NUM_PARAMS);
+        in_snapshot = first_of_snapshot = true;
+        snapshots++;
+    }
+    if (dirty == 0) return false;
+
+    frame.add(MSG_STATE, first_of_snapshot ? STATE_SNAPSHOT : STATE_DELTA, ++version);
+    for (int n = 0; n < PARAMS_PER_FRAME && dirty; n++) {
+        const int id = __builtin_ctz(dirty);
+        dirty &= dirty - 1;
+        frame.add(MSG_PARAM, id, values[id]);
+    }
+    if (in_snapshot && dirty == 0) {
+        frame.add(MSG_STATE, STATE_SNAPSHOT_END, version);
+        in_snapshot = false;
+    }
+    frames++;
+    return true;
+}
+
+void ParamSync::handle_msg(const McuMsg &msg, ParamStore &params) {
+    if (msg.type == MSG_PARAM) {
+        if (msg.id < NUM_PARAMS && msg.value >= 0 && msg.value <= MCU_PARAM_MAX) {
+            params.set(msg.id, param_from_position(msg.id, msg.value));
+        }
+    } else if (msg.type == MSG_STATE && msg.id == STATE_SYNC_REQUEST) {
+        request_snapshot();
+    }
+}
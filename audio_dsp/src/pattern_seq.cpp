@@ -0,0 +1,300 @@
+#include <string.h>
+#include <pattern_seq.h>
+
+static_assert(NUM_PARAMS <= 32, "locked has one bit per parameter");
+static_assert(Pattern::MAX_LOCKS <= 65535 && Pattern::MAX_LOCKS <= 256 * 256, "lock_start is 16 bit");
+static_assert(Pattern::NUM_STEPS <= 64, "trigs has one bit per step");
+static_assert(sizeof (Pattern) <= 5500, "update the memory figures in pattern_seq.h");
+
+void Pattern::clear() {
+    SEQ_LOCK();
+    memset(this, 0, sizeof (*this));
+    for (int t = 0; t < NUM_TRACKS; t++) {
+        length[t] = 16;
+    }
+    master_length = 16;
+    SEQ_UNLOCK();
+}
+
+void Pattern::set_length(uint8_t track, uint8_t steps) {
+    if (track >= NUM_TRACKS || steps == 0 || steps > NUM_STEPS) return;
+    length[track] = steps;
+}
+
+void Pattern::set_trig(uint8_t track, uint8_t step, uint8_t note, uint8_t velocity, uint8_t gate_ticks) {
+    if (track >= NUM_TRACKS || step >= NUM_STEPS) return;
+    const int c = cell(track, step);
+    SEQ_LOCK();
+    this->note[c] = note;
+    this->velocity[c] = velocity;
+    gate[c] = gate_ticks > 0 ? gate_ticks : 1;
+    trigs[track] |= 1ULL << step;
+    SEQ_UNLOCK();
+}
+
+void Pattern::clear_trig(uint8_t track, uint8_t step) {
+    if (track >= NUM_TRACKS || step >= NUM_STEPS) return;
+    const int c = cell(track, step);
+    SEQ_LOCK();
+    trigs[track] &= ~(1ULL << step);
+    micro[c] = 0;
+    condition[c] = TRIG_ALWAYS;
+    while (lock_start[c + 1] > lock_start[c]) {
+        remove_lock(c, lock_start[c]);
+    }
+    SEQ_UNLOCK();
+}
+
+void Pattern::set_micro(uint8_t track, uint8_t step, int8_t ticks) {
+    if (track >= NUM_TRACKS || step >= NUM_STEPS) return;
+    if (ticks < MICRO_MIN) ticks = MICRO_MIN;
+    else if (ticks > MICRO_MAX) ticks = MICRO_MAX;
+    micro[cell(track, step)] = ticks;
+}
+
+void Pattern::set_condition(uint8_t track, uint8_t step, uint8_t condition, uint8_t arg) {
+    if (track >= NUM_TRACKS || step >= NUM_STEPS || condition >= NUM_TRIG_CONDITIONS) return;
+    const int c = cell(track, step);
+    SEQ_LOCK();
+    this->condition[c] = condition;
+    condition_arg[c] = arg;
+    SEQ_UNLOCK();
+}
+
+bool Pattern::set_lock(uint8_t track, uint8_t step, uint8_t param, float value) {
+    if (track >= NUM_TRACKS || step >= NUM_STEPS || param >= NUM_PARAMS) return false;
+    const int c = cell(track, step);
+    bool ok = true;
+    SEQ_LOCK();
+    int i = lock_start[c];
+    while (i < lock_start[c + 1] && lock_param[i] < param) i++;
+    if (i < lock_start[c + 1] && lock_param[i] == param) lock_value[i] = value;
+    else if (get_num_locks() < MAX_LOCKS) insert_lock(c, i, param, value);
+    else ok = false;
+    SEQ_UNLOCK();
+    return ok;
+}
+
+void Pattern::clear_lock(uint8_t track, uint8_t step, uint8_t param) {
+    if (track >= NUM_TRACKS || step >= NUM_STEPS) return;
+    const int c = cell(track, step);
+    SEQ_LOCK();
+    for (int i = lock_start[c]; i < lock_start[c + 1]; i++) {
+        if (lock_param[i] == param) {
+            remove_lock(c, i);
+            break;
+        }
+    }
+    SEQ_UNLOCK();
+}
+
+// Both keep the pool sorted by cell, so the locks of the following cells move by one
+void Pattern::insert_lock(int c, int pos, uint8_t param, float value) {
+    const int n = get_num_locks();
+    memmove(lock_param + pos + 1, lock_param + pos, n - pos);
+    memmove(lock_value + pos + 1, lock_value + pos, (n - pos) * sizeof (float));
+    lock_param[pos] = param;
+    lock_value[pos] = value;
+    for (int i = c + 1; i <= NUM_CELLS; i++) {
+        lock_start[i]++;
+    }
+}
+
+void Pattern::remove_lock(int c, int pos) {
+    const int n = get_num_locks();
+    memmove(lock_param + pos, lock_param + pos + 1, n - pos - 1);
+    memmove(lock_value + pos, lock_value + pos + 1, (n - pos - 1) * sizeof (float));
+    for (int i = c + 1; i <= NUM_CELLS; i++) {
+        lock_start[i]--;
+    }
+}
+
+PatternSeq::PatternSeq(Pattern *patterns, uint8_t num_patterns, ParamStore &params)
+    : patterns(patterns), num_patterns(num_patterns), params(params) {
+    note_handler = NULL;
+    cued = -1;
+    fill = false;
+    mutes = 0;
+    song_rows = 0;
+    song_loop = false;
+    current = 0;
+    song_row = song_repeat = 0;
+    pattern_tick = ticks = 0;
+    sounding = 0;
+    last_result = 0;
+    memset(locked, 0, sizeof (locked));
+    random_state = 0x2545f491;
+}
+
+void PatternSeq::cue_pattern(uint8_t pattern) {
+    if (pattern < num_patterns) cued = pattern;
+}
+
+void PatternSeq::set_song(const SongRow *rows, uint8_t num_rows, bool loop) {
+    if (num_rows > MAX_SONG_ROWS) num_rows = MAX_SONG_ROWS;
+    SEQ_LOCK();
+    song_rows = 0;
+    for (int i = 0; i < num_rows; i++) {
+        if (rows[i].pattern >= num_patterns) break;
+        song[song_rows] = rows[i];
+        if (song[song_rows].repeats == 0) song[song_rows].repeats = 1;
+        song_rows++;
+    }
+    song_loop = loop;
+    SEQ_UNLOCK();
+}
+
+void PatternSeq::set_mute(uint8_t track, bool mute) {
+    if (track >= Pattern::NUM_TRACKS) return;
+    if (mute) __atomic_fetch_or(&mutes, 1 << track, __ATOMIC_RELAXED);
+    else __atomic_fetch_and(&mutes, ~(1 << track), __ATOMIC_RELAXED);
+}
+
+void PatternSeq::restart() {
+    release_notes();
+    pattern_tick = ticks = 0;
+    last_result = 0;
+    song_row = song_repeat = 0;
+    if (song_rows > 0) current = song[0].pattern;
+    if (cued >= 0) {
+        current = cued;
+        cued = -1;
+    }
+}
+
+bool PatternSeq::changes_pattern() const {
+    if (cued >= 0) return true;
+    if (song_rows == 0 || song_repeat + 1 < song[song_row].repeats) return false;
+    return song_row + 1 < song_rows || song_loop;
+}
+
+// At the end of the master length: the pattern either changes and starts over, or keeps running
+void PatternSeq::next_pattern() {
+    const bool change = changes_pattern();
+    if (cued >= 0) {
+        current = cued;
+        cued = -1;
+        song_rows = 0; // a cue leaves the song
+    } else if (song_rows > 0 && ++song_repeat >= song[song_row].repeats) {
+        song_repeat = 0;
+        if (++song_row >= song_rows) {
+            if (song_loop) song_row = 0;
+            else song_rows = 0; // the last pattern keeps looping
+        }
+        if (song_rows > 0) current = song[song_row].pattern;
+    }
+    if (change) {
+        pattern_tick = 0;
+        last_result = 0;
+    }
+}
+
+void PatternSeq::release_notes() {
+    for (uint8_t t = 0; t < Pattern::NUM_TRACKS; t++) {
+        if ((sounding >> t) & 1 && note_handler) note_handler(t, off_note[t], 0, 0);
+    }
+    sounding = 0;
+}
+
+// xorshift32, for TRIG_PROBABILITY
+uint32_t PatternSeq::random() {
+    uint32_t x = random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return random_state = x;
+}
+
+bool PatternSeq::condition_met(const Pattern &p, int c, uint8_t track, uint32_t loop_index) {
+    const uint8_t arg = p.condition_arg[c];
+    const bool pre = (last_result >> track) & 1;
+    const bool nei = track > 0 && (last_result >> (track - 1)) & 1;
+    bool result;
+    switch (p.condition[c]) {
+    case TRIG_PROBABILITY: result = random() % 100 < arg; break;
+    case TRIG_RATIO: result = (arg & 15) > 0 && loop_index % (arg & 15) == (uint32_t)(arg >> 4) - 1; break;
+    case TRIG_FILL: result = fill; break;
+    case TRIG_NOT_FILL: result = !fill; break;
+    case TRIG_FIRST: result = loop_index == 0; break;
+    case TRIG_NOT_FIRST: result = loop_index > 0; break;
+    case TRIG_PRE: return pre;
+    case TRIG_NOT_PRE: return !pre;
+    case TRIG_NEI: return nei;
+    case TRIG_NOT_NEI: return !nei;
+    default: return true;
+    }
+    // Only conditions of their own count for PRE and NEI
+    if (result) last_result |= 1 << track;
+    else last_result &= ~(1 << track);
+    return result;
+}
+
+void PatternSeq::apply_locks(const Pattern &p, int c, uint8_t track) {
+    uint32_t now_locked = 0;
+    for (int i = p.lock_start[c]; i < p.lock_start[c + 1]; i++) {
+        const uint8_t id = p.lock_param[i];
+        if (!((locked[track] >> id) & 1)) unlocked_value[track][id] = params.get_target(id);
+        params.set(id, p.lock_value[i]);
+        now_locked |= 1UL << id;
+    }
+
+    uint32_t released = locked[track] & ~now_locked;
+    while (released) {
+        const int id = __builtin_ctz(released);
+        released &= released - 1;
+        params.set(id, unlocked_value[track][id]);
+    }
+    locked[track] = now_locked;
+}
+
+void PatternSeq::play(const Pattern &p, int c, uint8_t track, uint16_t offset) {
+    apply_locks(p, c, track);
+    if (!note_handler) return;
+
+    // One note per track: the previous one ends where the next begins
+    if ((sounding >> track) & 1) note_handler(track, off_note[track], 0, offset);
+    note_handler(track, p.note[c], p.velocity[c], offset);
+    sounding |= 1 << track;
+    off_note[track] = p.note[c];
+    off_tick[track] = ticks + p.gate[c];
+}
+
+void PatternSeq::tick(uint32_t tick, uint16_t offset) {
+    if (num_patterns == 0) return;
+    if (tick == 0) restart();
+
+    for (uint8_t t = 0; t < Pattern::NUM_TRACKS; t++) {
+        if ((sounding >> t) & 1 && off_tick[t] == ticks) {
+            sounding &= ~(1 << t);
+            if (note_handler) note_handler(t, off_note[t], 0, offset);
+        }
+    }
+
+    if (pattern_tick > 0 && pattern_tick % (patterns[current].master_length * Pattern::STEP_TICKS) == 0) next_pattern();
+    const Pattern &p = patterns[current];
+    const uint32_t master_ticks = p.master_length * Pattern::STEP_TICKS;
+
+    for (uint8_t t = 0; t < Pattern::NUM_TRACKS; t++) {
+        // The only step which can be due: the one whose micro-timing window contains this tick
+        const uint32_t track_ticks = p.length[t] * Pattern::STEP_TICKS;
+        uint32_t loop_index = pattern_tick / track_ticks;
+        uint32_t step = (pattern_tick - loop_index * track_ticks - Pattern::MICRO_MIN) / Pattern::STEP_TICKS;
+        if (step >= p.length[t]) {
+            // Early step 0 of the track's next loop, unless that is already the next pattern
+            step = 0;
+            loop_index++;
+            if ((loop_index * track_ticks) % master_ticks == 0 && changes_pattern()) continue;
+        }
+        if (!((p.trigs[t] >> step) & 1)) continue;
+
+        const int c = Pattern::cell(t, step);
+        int32_t due = (int32_t)(loop_index * track_ticks + step * Pattern::STEP_TICKS) + p.micro[c];
+        if (due < 0) due = 0;
+        if ((uint32_t)due != pattern_tick || !condition_met(p, c, t, loop_index)) continue;
+        if ((mutes >> t) & 1) continue;
+        play(p, c, t, offset);
+    }
+
+    pattern_tick++;
+    ticks++;
+}
@@ -0,0 +1,173 @@
+#include <string.h>
+#include <preset_store.h>
+
+static_assert(NUM_PARAMS <= PRESET_MAX_PARAMS, "presets store every parameter");
+static_assert(ModMatrix::MAX_SLOTS <= PRESET_MAX_MOD_SLOTS, "presets store every modulation slot");
+
+void Preset::init() {
+    memset(name, 0, sizeof (name));
+    for (int id = 0; id < NUM_PARAMS; id++) {
+        values[id] = param_desc(id).init;
+    }
+    ModMatrix empty;
+    for (int i = 0; i < ModMatrix::MAX_SLOTS; i++) {
+        mod_slots[i] = empty.get_packed_slot(i);
+    }
+}
+
+void Preset::capture(const ParamStore &params, const ModMatrix &mod) {
+    for (int id = 0; id < NUM_PARAMS; id++) {
+        values[id] = params.get_target(id);
+    }
+    for (int i = 0; i < ModMatrix::MAX_SLOTS; i++) {
+        mod_slots[i] = mod.get_packed_slot(i);
+    }
+}
+
+void Preset::apply(ParamStore &params, ModMatrix &mod, uint16_t ramp_blocks) const {
+    for (int id = 0; id < NUM_PARAMS; id++) {
+        params.set(id, values[id], ramp_blocks);
+    }
+    for (int i = 0; i < ModMatrix::MAX_SLOTS; i++) {
+        mod.set_packed_slot(i, mod_slots[i]);
+    }
+}
+
+void preset_morph(const Preset &a, const Preset &b, float amount, ParamStore &params, ModMatrix &mod) {
+    if (amount < 0.0f) amount = 0.0f;
+    else if (amount > 1.0f) amount = 1.0f;
+
+    for (int id = 0; id < NUM_PARAMS; id++) {
+        const ParamDesc &info = param_desc(id);
+        float value;
+        if (info.smooth_blocks == 0) {
+            value = amount < 0.5f ? a.values[id] : b.values[id];
+        } else if (info.curve == CURVE_EXP) {
+            // Equal steps along the curve are equal ratios
+            const float from = param_normalize(id, a.values[id]);
+            value = param_denormalize(id, from + amount * (param_normalize(id, b.values[id]) - from));
+        } else {
+            value = a.values[id] + amount * (b.values[id] - a.values[id]);
+        }
+        params.set(id, value);
+    }
+    const Preset &nearest = amount < 0.5f ? a : b;
+    for (int i = 0; i < ModMatrix::MAX_SLOTS; i++) {
+        mod.set_packed_slot(i, nearest.mod_slots[i]);
+    }
+}
+
+PresetStore::PresetStore(PresetStorage &storage) : storage(storage) {
+    for (int slot = 0; slot < NUM_SLOTS; slot++) {
+        newest[slot] = -1;
+        next_free[slot] = UNREADABLE; // until begin() has scanned it
+        generation[slot] = 0;
+    }
+    erases = 0;
+    errors = 0;
+}
+
+void PresetStore::begin() {
+    for (int slot = 0; slot < NUM_SLOTS; slot++) {
+        scan_slot(slot);
+    }
+}
+
+bool PresetStore::read_record(uint8_t slot, int record, PresetRecord &r) {
+    if (storage.read(record_addr(slot, record), &r, sizeof (r))) return true;
+    errors++;
+    return false;
+}
+
+/*
+ * Records are only ever appended, so the written ones are a prefix of the block.
+ * The newest valid record is the last one of that prefix which passes the checks.
+ * A failed read leaves the end of the log unknown, and the slot unreadable until a scan succeeds.
+ */
+void PresetStore::scan_slot(uint8_t slot) {
+    newest[slot] = -1;
+    next_free[slot] = UNREADABLE;
+
+    PresetRecord r;
+    int lo = 0, hi = RECORDS_PER_SLOT; // first unwritten record is in lo .. hi
+    while (lo < hi) {
+        const int mid = (lo + hi) / 2;
+        if (!read_record(slot, mid, r)) return;
+        if (preset_record_written(r)) lo = mid + 1;
+        else hi = mid;
+    }
+    next_free[slot] = lo;
+
+    for (int i = lo - 1; i >= 0; i--) {
+        if (read_record(slot, i, r) && preset_record_valid(r)) {
+            newest[slot] = i;
+            generation[slot] = r.generation;
+            return;
+        }
+    }
+}
+
+bool PresetStore::save(uint8_t slot, const Preset &preset) {
+    if (slot >= NUM_SLOTS) return false;
+    // Writing without knowing the end of the log could program over a written record
+    if (next_free[slot] == UNREADABLE) scan_slot(slot);
+    if (next_free[slot] == UNREADABLE) return false;
+
+    PresetRecord r;
+    memset(&r, 0, sizeof (r));
+    memcpy(r.magic, PRESET_MAGIC, 4);
+    r.version = PRESET_VERSION;
+    r.num_params = NUM_PARAMS;
+    r.num_mod_slots = ModMatrix::MAX_SLOTS;
+    r.generation = generation[slot] + 1;
+    for (int i = 0; i < PRESET_NAME_SIZE && preset.name[i]; i++) {
+        r.name[i] = preset.name[i];
+    }
+    memcpy(r.values, preset.values, sizeof (preset.values));
+    memcpy(r.mod_slots, preset.mod_slots, sizeof (preset.mod_slots));
+    r.crc = preset_record_crc(r);
+
+    // A record which does not read back correctly is skipped, its successor gets the next try
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (next_free[slot] >= RECORDS_PER_SLOT) {
+            if (!storage.erase_block(record_addr(slot, 0))) {
+                errors++;
+                return false;
+            }
+            erases++;
+            newest[slot] = -1;
+            next_free[slot] = 0;
+        }
+
+        const int record = next_free[slot]++;
+        PresetRecord check;
+        if (storage.write(record_addr(slot, record), &r, sizeof (r))
+            && read_record(slot, record, check) && memcmp(&check, &r, sizeof (r)) == 0) {
+            newest[slot] = record;
+            generation[slot] = r.generation;
+            return true;
+        }
+        errors++;
+    }
+    return false;
+}
+
+bool PresetStore::load(uint8_t slot, Preset &preset) {
+    if (!is_used(slot)) return false;
+
+    PresetRecord r;
+    if (!read_record(slot, newest[slot], r)) return false;
+    if (!preset_record_valid(r)) {
+        errors++;
+        return false;
+    }
+    preset.init();
+    memcpy(preset.name, r.name, PRESET_NAME_SIZE);
+    for (int id = 0; id < NUM_PARAMS && id < r.num_params; id++) {
+        preset.values[id] = r.values[id];
+    }
+    for (int i = 0; i < ModMatrix::MAX_SLOTS && i < r.num_mod_slots; i++) {
+        preset.mod_slots[i] = r.mod_slots[i];
+    }
+    return true;
+}
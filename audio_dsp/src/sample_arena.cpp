@@ -0,0 +1,68 @@
+#include <string.h>
+#include <sample_arena.h>
+
+SampleArena::SampleArena(void *memory, uint32_t size) {
+    const uintptr_t addr = (uintptr_t)memory;
+    const uintptr_t aligned = (addr + 31) & ~(uintptr_t)31;
+    base = (uint8_t *)aligned;
+    size -= aligned - addr;
+    num_pages = size / PAGE_SIZE;
+    if (num_pages > MAX_PAGES) num_pages = MAX_PAGES;
+    reset();
+}
+
+void SampleArena::reset() {
+    memset(used, 0, sizeof (used));
+    memset(run_length, 0, sizeof (run_length));
+    free_pages = num_pages;
+}
+
+void SampleArena::mark(uint32_t first, uint32_t count, bool use) {
+    for (uint32_t p = first; p < first + count; p++) {
+        if (use) used[p / 32] |= 1UL << (p % 32);
+        else used[p / 32] &= ~(1UL << (p % 32));
+    }
+}
+
+void *SampleArena::alloc(uint32_t size) {
+    if (size == 0) return 0;
+    const uint32_t count = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (count > free_pages) return 0;
+
+    uint32_t run = 0;
+    for (uint32_t p = 0; p < num_pages; p++) {
+        if (is_used(p)) {
+            run = 0;
+            continue;
+        }
+        if (++run == count) {
+            const uint32_t first = p + 1 - count;
+            mark(first, count, true);
+            run_length[first] = count;
+            free_pages -= count;
+            return base + first * PAGE_SIZE;
+        }
+    }
+    return 0;
+}
+
+void SampleArena::free(void *p) {
+    if (!p) return;
+    const uint32_t offset = (uint8_t *)p - base;
+    const uint32_t first = offset / PAGE_SIZE;
+    if (offset % PAGE_SIZE != 0 || first >= num_pages || run_length[first] == 0) return; // not from alloc()
+
+    mark(first, run_length[first], false);
+    free_pages += run_length[first];
+    run_length[first] = 0;
+}
+
+uint32_t SampleArena::get_largest_free() const {
+    uint32_t largest = 0;
+    uint32_t run = 0;
+    for (uint32_t p = 0; p < num_pages; p++) {
+        run = is_used(p) ? 0 : run + 1;
+        if (run > largest) largest = run;
+    }
+    return largest * PAGE_SIZE;
+}
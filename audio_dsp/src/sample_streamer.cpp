@@ -0,0 +1,260 @@
+#include <string.h>
+#include <sample_streamer.h>
+
+static const uint8_t NO_SAMPLE = 0xff;
+
+SampleStreamer::SampleStreamer(SampleStorage &storage, int16_t *stream_memory, int16_t *head_memory) :
+    storage(storage) {
+    this->stream_memory = stream_memory;
+    this->head_memory = head_memory;
+    num_samples = 0;
+    start_counter = 0;
+    underruns = 0;
+    read_errors = 0;
+    reads = 0;
+    reset_min_buffered();
+
+    for (uint8_t v = 0; v < MAX_VOICES; v++) {
+        Voice &voice = voices[v];
+        voice.playing = false;
+        voice.generation = 0;
+        voice.sample = 0;
+        voice.gain = 0;
+        voice.pos = 0;
+        voice.started = 0;
+        voice.current = 0;
+        voice.buffers[0].ready = voice.buffers[1].ready = false;
+        voice.underruns = 0;
+        voice.open_sample = NO_SAMPLE;
+    }
+}
+
+static uint32_t read_le32(const uint8_t *b) {
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static uint16_t read_le16(const uint8_t *b) {
+    return b[0] | (b[1] << 8);
+}
+
+/*
+ * Walks the RIFF chunks for "fmt " (must be 16 bit mono PCM) and "data".
+ */
+bool SampleStreamer::parse_wav(uint8_t handle, Sample &s) {
+    uint8_t b[16];
+    if (storage.read(handle, 0, b, 12) != 12 || memcmp(b, "RIFF", 4) != 0 || memcmp(b + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+
+    bool format_ok = false;
+    uint32_t pos = 12;
+    while (storage.read(handle, pos, b, 8) == 8) {
+        const uint32_t chunk_len = read_le32(b + 4);
+        if (memcmp(b, "fmt ", 4) == 0) {
+            if (storage.read(handle, pos + 8, b, 16) != 16) return false;
+            format_ok = read_le16(b) == 1 && read_le16(b + 2) == 1 && read_le16(b + 14) == 16;
+        } else if (memcmp(b, "data", 4) == 0) {
+            s.data_offset = pos + 8;
+            s.length = chunk_len / 2;
+            return format_ok;
+        }
+        pos += 8 + chunk_len + (chunk_len & 1); // chunks are padded to even sizes
+    }
+    return false;
+}
+
+int SampleStreamer::add_sample(const char *path) {
+    if (num_samples == MAX_SAMPLES || strlen(path) >= MAX_PATH) return -1;
+
+    Sample &s = samples[num_samples];
+    strcpy(s.path, path);
+    if (!storage.open(HEADER_HANDLE, path)) return -1;
+
+    bool ok = parse_wav(HEADER_HANDLE, s);
+    if (ok) {
+        s.head = head_memory + num_samples * HEAD_SAMPLES;
+        s.head_length = s.length < (uint32_t)HEAD_SAMPLES ? s.length : HEAD_SAMPLES;
+        const int bytes = s.head_length * sizeof (int16_t);
+        ok = storage.read(HEADER_HANDLE, s.data_offset, s.head, bytes) == bytes;
+    }
+    storage.close(HEADER_HANDLE);
+
+    if (!ok) return -1;
+    return num_samples++;
+}
+
+int SampleStreamer::play(uint8_t sample, float gain) {
+    int best = 0;
+    for (uint8_t v = 0; v < MAX_VOICES; v++) {
+        if (!voices[v].playing) {
+            best = v;
+            break;
+        }
+        if (voices[v].started < voices[best].started) best = v;
+    }
+    start_voice(best, sample, gain);
+    return best;
+}
+
+void SampleStreamer::start_voice(uint8_t v, uint8_t sample, float gain) {
+    if (v >= MAX_VOICES || sample >= num_samples) return;
+    const Sample &s = samples[sample];
+
+    STREAMER_LOCK();
+    Voice &voice = voices[v];
+    voice.generation++;
+    voice.sample = sample;
+    voice.gain = gain >= 1.0f ? 32767 : (gain <= 0.0f ? 0 : (int16_t)(gain * 32767.0f));
+    voice.pos = 0;
+    voice.started = ++start_counter;
+    voice.current = 0;
+
+    // The head is always in RAM, streaming continues after it
+    Buffer &head = voice.buffers[0];
+    head.data = s.head;
+    head.start = 0;
+    head.length = s.head_length;
+    head.ready = true;
+    voice.buffers[1].ready = false;
+    voice.playing = true;
+    STREAMER_UNLOCK();
+}
+
+void SampleStreamer::stop_voice(uint8_t v) {
+    if (v >= MAX_VOICES) return;
+    STREAMER_LOCK();
+    voices[v].generation++;
+    voices[v].playing = false;
+    STREAMER_UNLOCK();
+}
+
+bool SampleStreamer::is_playing() const {
+    for (uint8_t v = 0; v < MAX_VOICES; v++) {
+        if (voices[v].playing) return true;
+    }
+    return false;
+}
+
+void SampleStreamer::render(int16_t *out, int num_samples) {
+    for (uint8_t v = 0; v < MAX_VOICES; v++) {
+        if (voices[v].playing) render_voice(voices[v], out, num_samples);
+    }
+}
+
+void SampleStreamer::render_voice(Voice &voice, int16_t *out, int num_samples) {
+    const uint32_t length = samples[voice.sample].length;
+    int done = 0;
+
+    while (done < num_samples && voice.pos < length) {
+        Buffer *b = &voice.buffers[voice.current];
+        if (!b->ready || voice.pos < b->start || voice.pos >= b->start + b->length) {
+            b = &voice.buffers[voice.current ^ 1];
+            if (!b->ready || voice.pos < b->start || voice.pos >= b->start + b->length) {
+                // Not loaded in time: skip the rest of the block to stay in time
+                voice.underruns++;
+                underruns++;
+                voice.pos += num_samples - done;
+                for (int i = 0; i < 2; i++) {
+                    Buffer &old = voice.buffers[i];
+                    if (old.ready && old.start + old.length <= voice.pos) old.ready = false;
+                }
+                break;
+            }
+            voice.current ^= 1;
+        }
+
+        uint32_t n = b->start + b->length - voice.pos;
+        if (n > (uint32_t)(num_samples - done)) n = num_samples - done;
+        if (n > length - voice.pos) n = length - voice.pos;
+
+        const int16_t *src = b->data + (voice.pos - b->start);
+        for (uint32_t i = 0; i < n; i++) {
+            const int32_t s = out[done + i] + ((src[i] * voice.gain) >> 15);
+            out[done + i] = s > 32767 ? 32767 : (s < -32768 ? -32768 : s);
+        }
+        done += n;
+        voice.pos += n;
+
+        if (voice.pos >= b->start + b->length) {
+            b->ready = false; // hand the buffer back to service()
+        }
+    }
+
+    if (voice.pos >= length) voice.playing = false;
+}
+
+bool SampleStreamer::service() {
+    // Pick the voice with the fewest samples read ahead of its play position
+    int best = -1;
+    int best_buffered = 0;
+    uint8_t best_buffer = 0;
+    uint32_t best_start = 0;
+    uint32_t best_generation = 0;
+    uint8_t best_sample = 0;
+
+    for (uint8_t v = 0; v < MAX_VOICES; v++) {
+        Voice &voice = voices[v];
+
+        STREAMER_LOCK();
+        const bool playing = voice.playing;
+        const uint32_t pos = voice.pos;
+        const uint32_t generation = voice.generation;
+        const uint8_t sample = voice.sample;
+        const Buffer b0 = voice.buffers[0];
+        const Buffer b1 = voice.buffers[1];
+        STREAMER_UNLOCK();
+
+        if (!playing || (b0.ready && b1.ready)) continue;
+
+        // Continue after the buffer still held by render(), or at the play position after an underrun
+        const Buffer &held = b0.ready ? b0 : b1;
+        const bool held_ahead = held.ready && held.start + held.length > pos;
+        const uint32_t next = held_ahead ? held.start + held.length : pos;
+        if (next >= samples[sample].length) continue;
+
+        const int buffered = held_ahead ? held.start + held.length - pos : 0;
+        if (best < 0 || buffered < best_buffered) {
+            best = v;
+            best_buffered = buffered;
+            best_buffer = b0.ready ? 1 : 0;
+            best_start = next;
+            best_generation = generation;
+            best_sample = sample;
+        }
+    }
+
+    if (best < 0) return false;
+    if (best_buffered < min_buffered) min_buffered = best_buffered;
+
+    Voice &voice = voices[best];
+    const Sample &s = samples[best_sample];
+    if (voice.open_sample != best_sample) {
+        if (voice.open_sample != NO_SAMPLE) storage.close(best);
+        voice.open_sample = storage.open(best, s.path) ? best_sample : NO_SAMPLE;
+    }
+
+    int16_t *dst = stream_memory + (best * 2 + best_buffer) * BUFFER_SAMPLES;
+    uint32_t n = s.length - best_start;
+    if (n > (uint32_t)BUFFER_SAMPLES) n = BUFFER_SAMPLES;
+    const int bytes = n * sizeof (int16_t);
+    reads++;
+    if (voice.open_sample == NO_SAMPLE || storage.read(best, s.data_offset + best_start * 2, dst, bytes) != bytes) {
+        read_errors++;
+        STREAMER_LOCK();
+        if (voice.generation == best_generation) voice.playing = false;
+        STREAMER_UNLOCK();
+        return true;
+    }
+
+    // Only publish if the voice was not restarted while reading
+    STREAMER_LOCK();
+    Buffer &b = voice.buffers[best_buffer];
+    if (voice.generation == best_generation && !b.ready) {
+        b.data = dst;
+        b.start = best_start;
+        b.length = n;
+        b.ready = true;
+    }
+    STREAMER_UNLOCK();
+    return true;
+}
@@ -0,0 +1,84 @@
+#include <seq_clock.h>
+
+SeqClock::SeqClock(double sample_rate) {
+    this->sample_rate = sample_rate;
+    bpm = 120.0f;
+    swing = 50;
+    tempo_changed = false;
+    restart = false;
+    running = false;
+    tick_handler = 0;
+    sample_pos = 0;
+    next_tick_pos = 0;
+    next_tick = 0;
+    update_tick_length();
+}
+
+void SeqClock::set_tempo(float bpm) {
+    if (bpm < 20.0f) bpm = 20.0f;
+    else if (bpm > 300.0f) bpm = 300.0f;
+    this->bpm = bpm;
+    tempo_changed = true;
+}
+
+void SeqClock::set_swing(uint8_t percent) {
+    if (percent < 50) percent = 50;
+    else if (percent > 75) percent = 75;
+    swing = percent;
+    tempo_changed = true;
+}
+
+void SeqClock::set_tick_handler(tick_handler_t handler) {
+    tick_handler = handler;
+}
+
+void SeqClock::start() {
+    restart = true;
+    running = true;
+}
+
+void SeqClock::stop() {
+    running = false;
+}
+
+void SeqClock::resume() {
+    running = true;
+}
+
+/*
+ * A swing pair is two 16th notes. The first one is stretched to swing% of the 8th note,
+ * the second one gets the remainder, so every pair still ends exactly on the straight grid.
+ */
+void SeqClock::update_tick_length() {
+    const double straight = sample_rate * 60.0 / ((double)bpm * PPQN);
+    const uint64_t straight_fp = (uint64_t)(straight * 4294967296.0);
+    tick_len[0] = (uint64_t)(straight * 4294967296.0 * swing / 50.0);
+    tick_len[1] = 2 * straight_fp - tick_len[0];
+    tempo_changed = false;
+}
+
+void SeqClock::advance(uint16_t num_samples) {
+    if (tempo_changed) update_tick_length();
+
+    if (restart) {
+        restart = false;
+        sample_pos = 0;
+        next_tick_pos = 0;
+        next_tick = 0;
+    }
+
+    if (!running) return;
+
+    const uint64_t block_len = (uint64_t)num_samples << 32;
+    while (next_tick_pos < block_len) {
+        if (tick_handler) tick_handler(next_tick, (uint16_t)(next_tick_pos >> 32));
+
+        const int half = (next_tick / TICKS_PER_16TH) & 1;
+        next_tick_pos += tick_len[half];
+        next_tick++;
+    }
+
+    // Keep the next tick relative to the block start, so the fixed point value never overflows
+    next_tick_pos -= block_len;
+    sample_pos += num_samples;
+}
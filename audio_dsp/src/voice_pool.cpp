@@ -0,0 +1,181 @@
+#include <voice_pool.h>
+
+VoicePool::VoicePool(uint8_t num_voices) {
+    this->num_voices = num_voices < MAX_VOICES ? num_voices : MAX_VOICES;
+    counter = 0;
+    steal_count = 0;
+    steal_mode = STEAL_OLDEST;
+    legato = false;
+    unison = 1;
+    unison_detune_cents = 0.0f;
+    num_held = 0;
+    for (uint8_t v = 0; v < MAX_VOICES; v++) {
+        voices[v].note = NO_NOTE;
+        voices[v].velocity = 0;
+        voices[v].gate = false;
+        voices[v].started = 0;
+        voices[v].released = 0;
+    }
+}
+
+void VoicePool::set_legato(bool legato) {
+    if (legato == this->legato) return;
+    all_notes_off();
+    this->legato = legato;
+}
+
+void VoicePool::set_unison(uint8_t voices, float detune_cents) {
+    if (voices < 1) voices = 1;
+    else if (voices > num_voices) voices = num_voices;
+    if (voices != unison) all_notes_off();
+    unison = voices;
+    unison_detune_cents = detune_cents;
+}
+
+void VoicePool::note_on(uint8_t note, uint8_t velocity) {
+    counter++;
+
+    if (legato) {
+        const bool retrigger = num_held == 0;
+        push_held(note, velocity);
+        for (uint8_t u = 0; u < unison; u++) {
+            start(u, note, velocity, u, retrigger);
+        }
+        return;
+    }
+
+    // Play the note again on the voices which still have it, so repeated notes do not pile up
+    uint8_t reused = 0;
+    for (uint8_t v = 0; v < num_voices && reused < unison; v++) {
+        if (voices[v].note == note && is_voice_sounding(v)) {
+            start(v, note, velocity, reused++, true);
+        }
+    }
+
+    for (uint8_t u = reused; u < unison; u++) {
+        start(find_voice(), note, velocity, u, true);
+    }
+}
+
+void VoicePool::note_off(uint8_t note) {
+    counter++;
+
+    if (legato) {
+        const bool was_playing = num_held > 0 && held_notes[num_held - 1] == note;
+        remove_held(note);
+        if (!was_playing) return;
+
+        if (num_held > 0) {
+            // Fall back to the previous held note without retriggering
+            for (uint8_t u = 0; u < unison; u++) {
+                start(u, held_notes[num_held - 1], held_velocities[num_held - 1], u, false);
+            }
+            return;
+        }
+    }
+
+    for (uint8_t v = 0; v < num_voices; v++) {
+        Voice &voice = voices[v];
+        if (voice.gate && voice.note == note) {
+            voice.gate = false;
+            voice.released = counter;
+            release_voice(v);
+        }
+    }
+}
+
+void VoicePool::all_notes_off() {
+    counter++;
+    num_held = 0;
+    for (uint8_t v = 0; v < num_voices; v++) {
+        if (voices[v].gate) {
+            voices[v].gate = false;
+            voices[v].released = counter;
+            release_voice(v);
+        }
+    }
+}
+
+uint8_t VoicePool::get_active_voices() {
+    uint8_t n = 0;
+    for (uint8_t v = 0; v < num_voices; v++) {
+        if (voices[v].gate || is_voice_sounding(v)) n++;
+    }
+    return n;
+}
+
+/*
+ * Returns an idle voice, preferring the one idle longest, or steals a voice.
+ * Voices started by the current note on are never stolen, so its unison voices stay distinct.
+ */
+uint8_t VoicePool::find_voice() {
+    int best = -1;
+    for (uint8_t v = 0; v < num_voices; v++) {
+        const Voice &voice = voices[v];
+        if (voice.gate || is_voice_sounding(v)) continue;
+        if (best < 0 || voice.released < voices[best].released) best = v;
+    }
+    if (best >= 0) return best;
+
+    steal_count++;
+
+    // Released voices are always stolen before held ones
+    for (uint8_t v = 0; v < num_voices; v++) {
+        const Voice &voice = voices[v];
+        if (voice.gate || voice.started == counter) continue;
+        const uint32_t age = steal_mode == STEAL_OLDEST ? voice.started : voice.released;
+        const uint32_t best_age = best < 0 ? 0 : (steal_mode == STEAL_OLDEST ? voices[best].started : voices[best].released);
+        if (best < 0 || age < best_age) best = v;
+    }
+    if (best >= 0) return best;
+
+    for (uint8_t v = 0; v < num_voices; v++) {
+        const Voice &voice = voices[v];
+        if (voice.started == counter) continue;
+        if (best < 0) {
+            best = v;
+        } else if (steal_mode == STEAL_QUIETEST && voice.velocity != voices[best].velocity) {
+            if (voice.velocity < voices[best].velocity) best = v;
+        } else if (voice.started < voices[best].started) {
+            best = v;
+        }
+    }
+    return best;
+}
+
+void VoicePool::start(uint8_t v, uint8_t note, uint8_t velocity, uint8_t unison_index, bool retrigger) {
+    Voice &voice = voices[v];
+    voice.note = note;
+    voice.velocity = velocity;
+    voice.gate = true;
+    if (retrigger) voice.started = counter;
+    start_voice(v, note, velocity, unison_detune(unison_index), retrigger);
+}
+
+float VoicePool::unison_detune(uint8_t unison_index) const {
+    if (unison < 2) return 0.0f;
+    // Spread evenly from -detune to +detune
+    return unison_detune_cents * (2.0f * unison_index / (unison - 1) - 1.0f);
+}
+
+void VoicePool::push_held(uint8_t note, uint8_t velocity) {
+    remove_held(note);
+    if (num_held == MAX_HELD_NOTES) {
+        // Forget the oldest note
+        remove_held(held_notes[0]);
+    }
+    held_notes[num_held] = note;
+    held_velocities[num_held] = velocity;
+    num_held++;
+}
+
+void VoicePool::remove_held(uint8_t note) {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < num_held; i++) {
+        if (held_notes[i] == note) continue;
+        held_notes[n] = held_notes[i];
+        held_velocities[n] = held_velocities[i];
+        n++;
+    }
+    num_held = n;
+}
@@ -0,0 +1,179 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wavetable_osc.h>
+
+static const int TABLE_LEN = WavetableOsc::TABLE_SIZE + 1;
+static int16_t sine_table[TABLE_LEN];
+static int16_t triangle_tables[WavetableOsc::NUM_LEVELS][TABLE_LEN];
+static int16_t saw_tables[WavetableOsc::NUM_LEVELS][TABLE_LEN];
+static bool tables_ready = false;
+
+/*
+ * Sums sine harmonics into table, amp(h) = 0 skips a harmonic.
+ * Harmonic h at position i is sin_ref[(h * i) mod N], so no sinf() is needed per point.
+ */
+static void sum_harmonics(float *table, const float *sin_ref, int harmonics, float (*amp)(int h)) {
+    const int mask = WavetableOsc::TABLE_SIZE - 1;
+    memset(table, 0, WavetableOsc::TABLE_SIZE * sizeof (float));
+    for (int h = 1; h <= harmonics; h++) {
+        const float a = amp(h);
+        if (a == 0.0f) continue;
+        for (int i = 0; i < WavetableOsc::TABLE_SIZE; i++) {
+            table[i] += a * sin_ref[(h * i) & mask];
+        }
+    }
+}
+
+static float triangle_amp(int h) {
+    if (h % 2 == 0) return 0.0f;
+    return ((h / 2) % 2 ? -1.0f : 1.0f) * 8.0f / (M_PI * M_PI * h * h);
+}
+
+static float saw_amp(int h) {
+    return (h % 2 ? 2.0f : -2.0f) / (M_PI * h);
+}
+
+static void store_table(int16_t *dst, const float *src, float scale) {
+    for (int i = 0; i < WavetableOsc::TABLE_SIZE; i++) {
+        const float v = src[i] * scale;
+        dst[i] = v > 32767.0f ? 32767 : (v < -32768.0f ? -32768 : (int16_t)lrintf(v));
+    }
+    dst[WavetableOsc::TABLE_SIZE] = dst[0];
+}
+
+/*
+ * All levels of a shape share one scale factor, set by the Gibbs overshoot of the fullest table,
+ * so the loudness does not jump between octaves.
+ */
+static void build_mipmap(int16_t tables[][TABLE_LEN], float *level, const float *sin_ref, float (*amp)(int h)) {
+    float scale = 0.0f;
+    for (int l = 0; l < WavetableOsc::NUM_LEVELS; l++) {
+        sum_harmonics(level, sin_ref, WavetableOsc::MAX_HARMONICS >> l, amp);
+        if (l == 0) {
+            float peak = 0.0f;
+            for (int i = 0; i < WavetableOsc::TABLE_SIZE; i++) {
+                if (fabsf(level[i]) > peak) peak = fabsf(level[i]);
+            }
+            scale = 32000.0f / peak;
+        }
+        store_table(tables[l], level, scale);
+    }
+}
+
+void WavetableOsc::init_tables() {
+    if (tables_ready) return;
+
+    // Only needed while building the tables
+    float *sin_ref = (float *)malloc(TABLE_SIZE * sizeof (float));
+    float *level = (float *)malloc(TABLE_SIZE * sizeof (float));
+    if (!sin_ref || !level) {
+        free(sin_ref);
+        free(level);
+        return;
+    }
+
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        sin_ref[i] = sin(2.0 * M_PI * i / TABLE_SIZE);
+    }
+    store_table(sine_table, sin_ref, 32000.0f);
+    build_mipmap(triangle_tables, level, sin_ref, triangle_amp);
+    build_mipmap(saw_tables, level, sin_ref, saw_amp);
+
+    free(sin_ref);
+    free(level);
+    tables_ready = true;
+}
+
+const int16_t *WavetableOsc::get_table(OscShape shape, int level) {
+    switch (shape) {
+        case OSC_TRIANGLE: return triangle_tables[level];
+        case OSC_SAW:
+        case OSC_PULSE: return saw_tables[level];
+        default: return sine_table;
+    }
+}
+
+/*
+ * Lowest level (most harmonics) whose highest harmonic is still below Nyquist at this frequency.
+ */
+int WavetableOsc::get_level(float hz, float sample_rate) {
+    const float nyquist = sample_rate / 2.0f;
+    int level = 0;
+    while (level < NUM_LEVELS - 1 && (MAX_HARMONICS >> level) * hz >= nyquist) {
+        level++;
+    }
+    return level;
+}
+
+WavetableOsc::WavetableOsc(float sample_rate) {
+    this->sample_rate = sample_rate;
+    phase = 0;
+    phase_inc = 0;
+    level = NUM_LEVELS - 1;
+    shape = OSC_SINE;
+    pulse_offset = 0x80000000;
+    amplitude = 0;
+}
+
+void WavetableOsc::set_frequency(float hz) {
+    if (hz < 0.0f) hz = 0.0f;
+    else if (hz > sample_rate / 2.0f) hz = sample_rate / 2.0f;
+    phase_inc = (uint32_t)(hz / sample_rate * 4294967296.0f);
+    level = get_level(hz, sample_rate);
+}
+
+void WavetableOsc::set_pulse_width(float width) {
+    if (width < 0.05f) width = 0.05f;
+    else if (width > 0.95f) width = 0.95f;
+    pulse_offset = (uint32_t)(width * 4294967296.0f);
+}
+
+void WavetableOsc::set_amplitude(float level) {
+    if (level < 0.0f) level = 0.0f;
+    else if (level > 1.0f) level = 1.0f;
+    amplitude = (int16_t)(level * 32767.0f);
+}
+
+/*
+ * Interpolates table at phase: the 32 bit load gets table[i] (bottom) and table[i + 1] (top),
+ * the weights are packed as (frac, 32767 - frac) in Q15. Returns Q15 scaled by 2^shift.
+ */
+static inline int32_t interpolate(const int16_t *table, uint32_t phase, int shift) {
+    const uint32_t index = phase >> (32 - WavetableOsc::TABLE_BITS);
+    const int32_t frac = (phase >> (32 - WavetableOsc::TABLE_BITS - 15)) & 0x7fff;
+    uint32_t pair;
+    memcpy(&pair, table + index, sizeof (pair)); // unaligned loads are fine on the M7
+    return multiply_16tx16t_add_16bx16b(pair, pack_16b_16b(frac, 32767 - frac)) >> (15 + shift);
+}
+
+void WavetableOsc::render(int16_t *out, int num_samples) {
+    // Parameters are latched once per block
+    const OscShape shape = this->shape;
+    const int16_t *table = get_table(shape, level);
+    const uint32_t inc = phase_inc;
+    const int32_t amp = amplitude;
+    uint32_t p = phase;
+    uint32_t *out32 = (uint32_t *)out;
+
+    if (shape == OSC_PULSE) {
+        // Half the difference of two saws keeps the pulse within range for any width
+        const uint32_t offset = pulse_offset;
+        for (int i = 0; i < num_samples; i += 2) {
+            const uint32_t a = pack_16b_16b(interpolate(table, p + inc, 1), interpolate(table, p, 1));
+            const uint32_t b = pack_16b_16b(interpolate(table, p + inc + offset, 1), interpolate(table, p + offset, 1));
+            const uint32_t d = signed_subtract_16_and_16(a, b);
+            *out32++ = pack_16b_16b(((int16_t)(d >> 16) * amp) >> 15, ((int16_t)d * amp) >> 15);
+            p += 2 * inc;
+        }
+    } else {
+        for (int i = 0; i < num_samples; i += 2) {
+            const int32_t s0 = interpolate(table, p, 0);
+            const int32_t s1 = interpolate(table, p + inc, 0);
+            *out32++ = pack_16b_16b((s1 * amp) >> 15, (s0 * amp) >> 15);
+            p += 2 * inc;
+        }
+    }
+
+    phase = p;
+}
@@ -0,0 +1,36 @@
+#ifndef _AUDIO_TIMING_H
+#define _AUDIO_TIMING_H
+
+#include <stdint.h>
+
+/*
+ * Audio settings and random delays of the simulated audio interrupt and loop(), shared by the
+ * MIDI timing tests (test_midi_scheduler, test_midi_clock). Included by path, e.g. "../audio_timing.h".
+ */
+
+static const double SAMPLE_RATE = 44100.0;
+static const uint16_t BLOCK_SAMPLES = 128;
+
+// micros() starts shortly before it wraps, which the code under test must not notice
+static const uint32_t START_US = 0xfff00000u;
+
+// xorshift32, so every run and platform sees the same delays; setUp() calls rng_reset()
+static uint32_t rng_state;
+
+inline void rng_reset(void) {
+    rng_state = 0x2545f491;
+}
+
+inline uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// 0 .. max
+inline double random_us(double max) {
+    return max * (rng() % 1000001) / 1000000.0;
+}
+
+#endif
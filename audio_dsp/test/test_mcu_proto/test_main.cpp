@@ -0,0 +1,251 @@
+/*
+ * Loopback of the MCU protocol (common/mcu_proto.h): frames written by McuFrameWriter go byte
+ * by byte through McuFrameReader into mcu_decode_frame(), intact or damaged on the way.
+ */
+
+#include <unity.h>
+#include <stdlib.h>
+#include <mcu_proto.h>
+
+// A received frame, or -1 for a dropped one
+struct Received {
+    int n;
+    McuMsg msgs[MCU_MAX_MSGS_PER_FRAME];
+};
+
+static McuFrameReader reader;
+
+// Feeds the bytes to the reader and decodes every frame they complete
+static int receive(const uint8_t *bytes, int len, Received *frames, int max_frames) {
+    int num_frames = 0;
+    for (int i = 0; i < len; i++) {
+        const int frame_len = reader.feed(bytes[i]);
+        if (frame_len == 0) continue;
+        TEST_ASSERT_LESS_THAN_INT(max_frames, num_frames);
+        Received &r = frames[num_frames++];
+        r.n = frame_len < 0 ? -1 : mcu_decode_frame(reader.get_frame(), frame_len, r.msgs, MCU_MAX_MSGS_PER_FRAME);
+    }
+    return num_frames;
+}
+
+// A frame of n messages with values that contain zero bytes, which COBS has to stuff
+static int make_frame(int n, int seed, uint8_t *out, McuMsg *msgs) {
+    static const int16_t values[] = { 0, 1, -1, 0x00ff, (int16_t)0xff00, 0x0100, MCU_PARAM_MAX, -32768 };
+    McuFrameWriter writer;
+    for (int i = 0; i < n; i++) {
+        msgs[i].type = (seed + i) % (MSG_TIME + 1);
+        msgs[i].id = i; // distinct, so nothing is coalesced
+        msgs[i].value = values[(seed * 3 + i) % 8] ^ (int16_t)(seed & 0x0f00);
+        TEST_ASSERT_TRUE(writer.add(msgs[i].type, msgs[i].id, msgs[i].value));
+    }
+    return writer.encode(out);
+}
+
+static void assert_frame(const McuMsg *expected, int n, const Received &r) {
+    TEST_ASSERT_EQUAL_INT(n, r.n);
+    for (int i = 0; i < n; i++) {
+        TEST_ASSERT_EQUAL_UINT8(expected[i].type, r.msgs[i].type);
+        TEST_ASSERT_EQUAL_UINT8(expected[i].id, r.msgs[i].id);
+        TEST_ASSERT_EQUAL_INT16(expected[i].value, r.msgs[i].value);
+    }
+}
+
+static void test_round_trip(void) {
+    for (int seed = 0; seed < 200; seed++) {
+        for (int n = 1; n <= MCU_MAX_MSGS_PER_FRAME; n++) {
+            uint8_t wire[MCU_MAX_WIRE_FRAME];
+            McuMsg msgs[MCU_MAX_MSGS_PER_FRAME];
+            const int len = make_frame(n, seed, wire, msgs);
+            TEST_ASSERT_LESS_OR_EQUAL_INT(MCU_MAX_WIRE_FRAME, len);
+            TEST_ASSERT_EQUAL_UINT8(0, wire[len - 1]);
+            for (int i = 0; i < len - 1; i++) {
+                TEST_ASSERT_TRUE(wire[i] != 0); // the delimiter only ends the frame
+            }
+
+            Received r[1];
+            TEST_ASSERT_EQUAL_INT(1, receive(wire, len, r, 1));
+            assert_frame(msgs, n, r[0]);
+        }
+    }
+}
+
+// Several frames back to back in one stream, as the UART delivers them
+static void test_stream(void) {
+    uint8_t stream[8 * MCU_MAX_WIRE_FRAME];
+    McuMsg msgs[8][MCU_MAX_MSGS_PER_FRAME];
+    int len = 0;
+    for (int f = 0; f < 8; f++) {
+        len += make_frame(f * 2 + 1, f, stream + len, msgs[f]);
+    }
+    Received r[8];
+    TEST_ASSERT_EQUAL_INT(8, receive(stream, len, r, 8));
+    for (int f = 0; f < 8; f++) {
+        assert_frame(msgs[f], f * 2 + 1, r[f]);
+    }
+}
+
+// Every single bit error is caught, by COBS or by the CRC; a flipped delimiter splits the frame
+static void test_corrupted_byte(void) {
+    uint8_t wire[MCU_MAX_WIRE_FRAME];
+    McuMsg msgs[MCU_MAX_MSGS_PER_FRAME];
+    const int len = make_frame(6, 7, wire, msgs);
+
+    for (int i = 0; i < len - 1; i++) {
+        for (int bit = 0; bit < 8; bit++) {
+            uint8_t bad[MCU_MAX_WIRE_FRAME];
+            memcpy(bad, wire, len);
+            bad[i] ^= 1 << bit;
+
+            Received r[2];
+            const int num = receive(bad, len, r, 2);
+            TEST_ASSERT_TRUE(num >= 1);
+            for (int f = 0; f < num; f++) {
+                TEST_ASSERT_EQUAL_INT(-1, r[f].n);
+            }
+        }
+    }
+
+    // Any other value of a byte, too
+    for (int i = 0; i < len - 1; i++) {
+        for (int v = 1; v < 256; v++) {
+            if (v == wire[i]) continue;
+            uint8_t bad[MCU_MAX_WIRE_FRAME];
+            memcpy(bad, wire, len);
+            bad[i] = v;
+            Received r[1];
+            TEST_ASSERT_EQUAL_INT(1, receive(bad, len, r, 1));
+            TEST_ASSERT_EQUAL_INT(-1, r[0].n);
+        }
+    }
+}
+
+static void test_truncated_frame(void) {
+    uint8_t wire[MCU_MAX_WIRE_FRAME];
+    McuMsg msgs[MCU_MAX_MSGS_PER_FRAME];
+    const int len = make_frame(MCU_MAX_MSGS_PER_FRAME, 3, wire, msgs);
+
+    for (int cut = 1; cut < len - 1; cut++) {
+        uint8_t bad[MCU_MAX_WIRE_FRAME];
+        memcpy(bad, wire, len - 1 - cut);
+        bad[len - 1 - cut] = 0;
+        Received r[1];
+        TEST_ASSERT_EQUAL_INT(1, receive(bad, len - cut, r, 1));
+        TEST_ASSERT_EQUAL_INT(-1, r[0].n);
+    }
+
+    // Neither the CRC alone nor a frame without whole messages pass
+    TEST_ASSERT_EQUAL_INT(-1, mcu_decode_frame(wire, 0, NULL, 0));
+    uint8_t raw[3] = { 1, 2, 3 };
+    uint8_t cobs[8];
+    TEST_ASSERT_EQUAL_INT(-1, mcu_decode_frame(cobs, mcu_cobs_encode(raw, 3, cobs), NULL, 0));
+}
+
+// A frame longer than any valid one is dropped without overrunning the reader, the next one is fine
+static void test_too_long_frame(void) {
+    uint8_t noise[3 * MCU_MAX_WIRE_FRAME];
+    for (int i = 0; i < (int)sizeof (noise); i++) {
+        noise[i] = 1 + i % 255;
+    }
+    noise[sizeof (noise) - 1] = 0;
+    Received r[2];
+    TEST_ASSERT_EQUAL_INT(1, receive(noise, sizeof (noise), r, 2));
+    TEST_ASSERT_EQUAL_INT(-1, r[0].n);
+
+    // Exactly one byte too long for mcu_decode_frame()
+    TEST_ASSERT_EQUAL_INT(-1, mcu_decode_frame(noise, MCU_MAX_WIRE_FRAME, r[0].msgs, MCU_MAX_MSGS_PER_FRAME));
+
+    uint8_t wire[MCU_MAX_WIRE_FRAME];
+    McuMsg msgs[MCU_MAX_MSGS_PER_FRAME];
+    const int len = make_frame(4, 11, wire, msgs);
+    TEST_ASSERT_EQUAL_INT(1, receive(wire, len, r, 2));
+    assert_frame(msgs, 4, r[0]);
+}
+
+// Without its delimiter a frame runs into the next one; both are lost, the one after is received
+static void test_resync_after_lost_delimiter(void) {
+    for (int seed = 0; seed < 50; seed++) {
+        uint8_t stream[3 * MCU_MAX_WIRE_FRAME];
+        McuMsg msgs[3][MCU_MAX_MSGS_PER_FRAME];
+        int len = make_frame(1 + seed % MCU_MAX_MSGS_PER_FRAME, seed, stream, msgs[0]) - 1;
+        len += make_frame(1 + (seed * 7) % MCU_MAX_MSGS_PER_FRAME, seed + 1, stream + len, msgs[1]);
+        const int n = 1 + (seed * 5) % MCU_MAX_MSGS_PER_FRAME;
+        len += make_frame(n, seed + 2, stream + len, msgs[2]);
+
+        Received r[2];
+        TEST_ASSERT_EQUAL_INT(2, receive(stream, len, r, 2));
+        TEST_ASSERT_EQUAL_INT(-1, r[0].n);
+        assert_frame(msgs[2], n, r[1]);
+    }
+}
+
+// Runs of 254 and more non-zero bytes need extra COBS code bytes
+static void test_cobs_long_runs(void) {
+    static const int lengths[] = { 0, 1, 253, 254, 255, 256, 508, 600 };
+    for (unsigned l = 0; l < sizeof (lengths) / sizeof (lengths[0]); l++) {
+        for (int zeros = 0; zeros < 3; zeros++) {
+            const int len = lengths[l];
+            uint8_t raw[600], enc[610], dec[610];
+            for (int i = 0; i < len; i++) {
+                raw[i] = 1 + i % 255;
+            }
+            if (zeros > 0 && len > 0) raw[len / 2] = 0;
+            if (zeros > 1 && len > 0) raw[len - 1] = 0;
+
+            const int enc_len = mcu_cobs_encode(raw, len, enc);
+            TEST_ASSERT_LESS_OR_EQUAL_INT(len + len / 254 + 1, enc_len);
+            for (int i = 0; i < enc_len; i++) {
+                TEST_ASSERT_TRUE(enc[i] != 0);
+            }
+            TEST_ASSERT_EQUAL_INT(len, mcu_cobs_decode(enc, enc_len, dec));
+            TEST_ASSERT_EQUAL_MEMORY(raw, dec, len);
+        }
+    }
+}
+
+// Values are coalesced per type and id, events are all sent in order
+static void test_coalescing(void) {
+    McuFrameWriter writer;
+    TEST_ASSERT_TRUE(writer.add(MSG_PARAM, 3, 100));
+    TEST_ASSERT_TRUE(writer.add(MSG_BUTTON, 2, 1));
+    TEST_ASSERT_TRUE(writer.add(MSG_ENCODER, 0, 5));
+    TEST_ASSERT_TRUE(writer.add(MSG_PARAM, 3, 200));
+    TEST_ASSERT_TRUE(writer.add(MSG_BUTTON, 2, 0));
+    TEST_ASSERT_TRUE(writer.add(MSG_STAT, STAT_CPU, 10));
+    TEST_ASSERT_TRUE(writer.add(MSG_ENCODER, 0, 6));
+    TEST_ASSERT_TRUE(writer.add(MSG_TIME, TIME_ORIGIN_LO, 1));
+    TEST_ASSERT_TRUE(writer.add(MSG_STAT, STAT_CPU, 20));
+    TEST_ASSERT_TRUE(writer.add(MSG_TIME, TIME_ORIGIN_LO, 2));
+    TEST_ASSERT_TRUE(writer.add(MSG_STATE, STATE_SYNC_REQUEST, 0));
+    TEST_ASSERT_TRUE(writer.add(MSG_STATE, STATE_SYNC_REQUEST, 0));
+
+    uint8_t wire[MCU_MAX_WIRE_FRAME];
+    const int len = writer.encode(wire);
+    const McuMsg expected[] = {
+        { MSG_PARAM, 3, 200 }, { MSG_BUTTON, 2, 1 }, { MSG_ENCODER, 0, 6 }, { MSG_BUTTON, 2, 0 },
+        { MSG_STAT, STAT_CPU, 20 }, { MSG_TIME, TIME_ORIGIN_LO, 1 }, { MSG_TIME, TIME_ORIGIN_LO, 2 },
+        { MSG_STATE, STATE_SYNC_REQUEST, 0 }, { MSG_STATE, STATE_SYNC_REQUEST, 0 }
+    };
+    Received r[1];
+    TEST_ASSERT_EQUAL_INT(1, receive(wire, len, r, 1));
+    assert_frame(expected, 9, r[0]);
+}
+
+void setUp(void) {
+    reader = McuFrameReader();
+}
+
+void tearDown(void) {
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_stream);
+    RUN_TEST(test_corrupted_byte);
+    RUN_TEST(test_truncated_frame);
+    RUN_TEST(test_too_long_frame);
+    RUN_TEST(test_resync_after_lost_delimiter);
+    RUN_TEST(test_cobs_long_runs);
+    RUN_TEST(test_coalescing);
+    return UNITY_END();
+}
@@ -0,0 +1,194 @@
+/*
+ * MidiClock in slave mode with synthetic clock streams: clocks of a steady tempo that arrive late
+ * by a random delay (USB frames, loop() latency). Checks when the DLL locks and stays locked,
+ * how well the filtered tempo and jitter estimate match, and where the sequencer's ticks land
+ * when it follows the clocks like main.cpp does.
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <midi_clock.h>
+#include <seq_clock.h>
+#include "../audio_timing.h"
+
+static const uint32_t LOCK_CLOCKS = 8;
+
+static const double tempos[] = { 60.0, 90.0, 120.0, 174.0, 240.0 };
+static const double jitters_us[] = { 0.0, 500.0, 1000.0, 2000.0 };
+
+static double clock_period_us(double bpm) {
+    return 60000000.0 / (bpm * MidiClock::CLOCKS_PER_BEAT);
+}
+
+// Arrival of clock n (n = 0 is the first clock after start) at us since START_US, up to jitter_us late
+static uint32_t arrival_us(double start_us, double bpm, uint32_t n, double jitter_us) {
+    return START_US + (uint32_t)(start_us + (n + 1) * clock_period_us(bpm) + random_us(jitter_us));
+}
+
+static void start_slave(MidiClock &clock) {
+    clock.set_mode(MidiClock::MODE_SLAVE);
+    clock.start();
+}
+
+// Locked from the LOCK_CLOCKS-th clock on, and then never unlocked by jitter
+static void test_lock(void) {
+    for (int t = 0; t < 5; t++) {
+        for (int j = 0; j < 4; j++) {
+            MidiClock clock;
+            start_slave(clock);
+            const uint32_t num_clocks = (uint32_t)(tempos[t] * MidiClock::CLOCKS_PER_BEAT); // one minute
+            for (uint32_t n = 0; n < num_clocks; n++) {
+                const uint32_t now = arrival_us(0.0, tempos[t], n, jitters_us[j]);
+                clock.clock(now);
+                TEST_ASSERT_EQUAL(n + 1 >= LOCK_CLOCKS, clock.is_locked(now));
+            }
+            TEST_ASSERT_EQUAL_UINT32(num_clocks, clock.get_clock_count());
+        }
+    }
+}
+
+/*
+ * After 5 s the filtered tempo stays within 0.3% per ms of jitter of the real one, and the
+ * jitter estimate is near the average deviation of a uniform delay, a quarter of its range.
+ */
+static void test_tempo_under_jitter(void) {
+    for (int t = 0; t < 5; t++) {
+        for (int j = 0; j < 4; j++) {
+            MidiClock clock;
+            start_slave(clock);
+            const double bpm = tempos[t];
+            const double max_error = 0.01 + bpm * 0.003 * jitters_us[j] / 1000.0;
+            for (uint32_t n = 0; n < bpm * MidiClock::CLOCKS_PER_BEAT; n++) {
+                clock.clock(arrival_us(0.0, bpm, n, jitters_us[j]));
+                if (n * clock_period_us(bpm) > 5000000.0) {
+                    TEST_ASSERT_FLOAT_WITHIN(max_error, bpm, clock.get_tempo());
+                }
+            }
+            if (jitters_us[j] == 0.0) {
+                TEST_ASSERT_LESS_THAN_FLOAT(1.0, clock.get_jitter_us());
+            } else {
+                TEST_ASSERT_FLOAT_WITHIN(0.4 * jitters_us[j] / 4, jitters_us[j] / 4, clock.get_jitter_us());
+            }
+        }
+    }
+}
+
+// A tempo change is followed within about a second, jitter or not
+static void test_tempo_change(void) {
+    for (int j = 0; j < 4; j++) {
+        MidiClock clock;
+        start_slave(clock);
+        double t_us = 0.0;
+        for (int n = 0; n < 24 * 20; n++, t_us += clock_period_us(120.0)) {
+            clock.clock(START_US + (uint32_t)(t_us + random_us(jitters_us[j])));
+        }
+        for (int n = 0; n < 24 * 20; n++, t_us += clock_period_us(140.0)) {
+            clock.clock(START_US + (uint32_t)(t_us + random_us(jitters_us[j])));
+            if (n == 24 * 3) TEST_ASSERT_FLOAT_WITHIN(1.0, 140.0, clock.get_tempo());
+        }
+        TEST_ASSERT_FLOAT_WITHIN(0.01 + 140.0 * 0.003 * jitters_us[j] / 1000.0, 140.0, clock.get_tempo());
+    }
+}
+
+// Without clocks for half a second the lock is lost; the next clocks lock again, from the old tempo
+static void test_dropout(void) {
+    MidiClock clock;
+    start_slave(clock);
+    uint32_t now = 0;
+    for (uint32_t n = 0; n < 24 * 8; n++) {
+        now = arrival_us(0.0, 120.0, n, 1000.0);
+        clock.clock(now);
+    }
+    TEST_ASSERT_TRUE(clock.is_locked(now));
+    TEST_ASSERT_TRUE(clock.is_locked(now + 400000));
+    TEST_ASSERT_FALSE(clock.is_locked(now + 600000));
+
+    const double resume_us = now - START_US + 1000000.0;
+    for (uint32_t n = 0; n < LOCK_CLOCKS; n++) {
+        now = arrival_us(resume_us, 120.0, n, 1000.0);
+        clock.clock(now);
+        TEST_ASSERT_EQUAL(n + 1 >= LOCK_CLOCKS, clock.is_locked(now));
+        TEST_ASSERT_FLOAT_WITHIN(2.0, 120.0, clock.get_tempo());
+    }
+}
+
+/*
+ * The sequencer follows like in main.cpp: every clock sets its tempo from get_follow_tempo().
+ * Tick 0 is due with the first clock after start, every 4th tick with the next clock, and like
+ * MIDI notes (see MidiScheduler) a block later. The phase is only compared in whole ticks,
+ * so a tick lands within a tick length of that, later by up to the random delay of the clocks.
+ */
+static uint64_t block_start; // samples since the start of the test, not of the sequencer
+static bool measuring;
+static double first_clock_sample;
+static double clock_period_samples;
+static double min_error, max_error; // samples
+
+static void on_tick(uint32_t tick, uint16_t offset) {
+    const uint32_t ticks_per_clock = SeqClock::PPQN / MidiClock::CLOCKS_PER_BEAT;
+    if (!measuring || tick % ticks_per_clock != 0) return;
+    const double due = first_clock_sample + tick / ticks_per_clock * clock_period_samples + BLOCK_SAMPLES;
+    const double error = (double)(block_start + offset) - due;
+    if (error < min_error) min_error = error;
+    if (error > max_error) max_error = error;
+}
+
+static void test_sequencer_follows(void) {
+    for (int t = 0; t < 5; t++) {
+        for (int j = 0; j < 4; j++) {
+            const double bpm = tempos[t];
+            const double start_us = 1000.0;
+            MidiClock clock;
+            SeqClock seq(SAMPLE_RATE);
+            seq.set_tick_handler(on_tick);
+            start_slave(clock);
+            first_clock_sample = (start_us + clock_period_us(bpm)) * SAMPLE_RATE / 1000000.0;
+            clock_period_samples = clock_period_us(bpm) * SAMPLE_RATE / 1000000.0;
+            min_error = 1e9;
+            max_error = -1e9;
+
+            // Before each block loop() handles the start and the clocks that have arrived
+            bool started = false;
+            uint32_t n = 0;
+            uint32_t arrival = arrival_us(start_us, bpm, n, jitters_us[j]);
+            for (uint64_t k = 0; k < (uint64_t)(60 * SAMPLE_RATE / BLOCK_SAMPLES); k++) {
+                const double block_us = k * BLOCK_SAMPLES * 1000000.0 / SAMPLE_RATE;
+                if (!started && start_us < block_us) {
+                    seq.start();
+                    started = true;
+                }
+                for (; arrival - START_US < block_us; arrival = arrival_us(start_us, bpm, ++n, jitters_us[j])) {
+                    clock.clock(arrival);
+                    if (clock.is_locked(arrival)) seq.set_tempo(clock.get_follow_tempo(seq.get_tick(), SeqClock::PPQN));
+                }
+
+                // The sequencer starts at its own tempo, and catches up by at most 5% once locked
+                measuring = block_us > 30000000.0;
+                block_start = k * BLOCK_SAMPLES;
+                seq.advance(BLOCK_SAMPLES);
+            }
+
+            const double jitter_samples = jitters_us[j] * SAMPLE_RATE / 1000000.0;
+            const double tick_samples = clock_period_samples * MidiClock::CLOCKS_PER_BEAT / SeqClock::PPQN;
+            TEST_ASSERT_GREATER_THAN_FLOAT(-tick_samples, min_error);
+            TEST_ASSERT_LESS_THAN_FLOAT(tick_samples + jitter_samples, max_error);
+        }
+    }
+}
+
+void setUp(void) {
+    rng_reset();
+}
+
+void tearDown(void) {
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_lock);
+    RUN_TEST(test_tempo_under_jitter);
+    RUN_TEST(test_tempo_change);
+    RUN_TEST(test_dropout);
+    RUN_TEST(test_sequencer_follows);
+    return UNITY_END();
+}
@@ -0,0 +1,160 @@
+/*
+ * MidiScheduler with synthetic event streams: loop() pushes events at arbitrary times between the
+ * audio interrupts, which arrive late by a random interrupt latency. Every event must be played
+ * at the sample of its push time plus the fixed delay of one block, within a few samples.
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+#include <midi_scheduler.h>
+#include "../audio_timing.h"
+
+static const double BLOCK_US = BLOCK_SAMPLES * 1000000.0 / SAMPLE_RATE;
+
+static std::vector<double> push_times; // us since START_US, by event number (see push_event())
+static uint32_t block_start;           // sample position of the block being processed
+static uint32_t handled;
+static uint32_t last_event;
+static bool in_order;
+static double max_error;               // samples
+
+// The event number goes into data1, data2 and the channel
+static void push_event(MidiScheduler &s, uint32_t n, uint32_t now_us) {
+    TEST_ASSERT_TRUE(s.push(MIDI_EVENT_NOTE_ON, n >> 14, n & 0x7f, (n >> 7) & 0x7f, now_us));
+}
+
+static void on_event(const MidiEvent &event, uint16_t offset) {
+    const uint32_t n = event.data1 | (event.data2 << 7) | (event.channel << 14);
+    if (handled > 0 && n != last_event + 1) in_order = false;
+    last_event = n;
+    handled++;
+
+    const double expected = push_times[n] * SAMPLE_RATE / 1000000.0 + BLOCK_SAMPLES;
+    const double error = fabs((double)block_start + offset - expected);
+    if (error > max_error) max_error = error;
+}
+
+/*
+ * Runs the audio interrupts and the pushes at the given times (us since START_US, ascending)
+ * in time order. Interrupt k is due at k * BLOCK_US and runs up to irq_latency_us later.
+ */
+static void run(const std::vector<double> &times, double irq_latency_us) {
+    MidiScheduler s(SAMPLE_RATE, BLOCK_SAMPLES);
+    s.set_event_handler(on_event);
+    push_times = times;
+    handled = 0;
+    in_order = true;
+    max_error = 0.0;
+
+    // Until a few blocks after the last push
+    size_t next = 0;
+    for (uint32_t k = 0; k * BLOCK_US < times.back() + 4 * BLOCK_US; k++) {
+        const double irq_us = k * BLOCK_US + random_us(irq_latency_us);
+        for (; next < times.size() && times[next] < irq_us; next++) {
+            push_event(s, next, START_US + (uint32_t)times[next]);
+        }
+        block_start = s.get_sample_pos();
+        s.process_block(START_US + (uint32_t)irq_us);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(times.size(), handled);
+    TEST_ASSERT_TRUE(in_order);
+    TEST_ASSERT_EQUAL_UINT32(0, s.get_late());
+    TEST_ASSERT_EQUAL_UINT32(0, s.get_dropped());
+}
+
+// 16ths at 120 bpm with a random loop() delay of up to a block before each push
+static std::vector<double> sixteenths(int n) {
+    std::vector<double> times;
+    for (int i = 0; i < n; i++) {
+        times.push_back(i * 125000.0 + random_us(BLOCK_US));
+    }
+    return times;
+}
+
+// Exponential gaps of the given mean, chords of up to 6 notes at the same time
+static std::vector<double> random_stream(int n, double mean_gap_us) {
+    std::vector<double> times;
+    double t = 1000.0;
+    while ((int)times.size() < n) {
+        t += -mean_gap_us * log((rng() % 1000000 + 1) / 1000001.0);
+        const int chord = 1 + rng() % 6;
+        for (int c = 0; c < chord && (int)times.size() < n; c++) {
+            times.push_back(t);
+        }
+    }
+    return times;
+}
+
+/*
+ * The error comes from the stamp of the block start: micros() of the interrupt, which is late
+ * by its latency, and the 1 us resolution of micros().
+ */
+static double max_error_samples(double irq_latency_us) {
+    return (irq_latency_us + 2.0) * SAMPLE_RATE / 1000000.0 + 1.0;
+}
+
+static void test_punctual_interrupts(void) {
+    run(sixteenths(2000), 0.0);
+    TEST_ASSERT_LESS_THAN_FLOAT(max_error_samples(0.0), max_error);
+    run(random_stream(5000, 3000.0), 0.0);
+    TEST_ASSERT_LESS_THAN_FLOAT(max_error_samples(0.0), max_error);
+}
+
+static void test_interrupt_latency(void) {
+    static const double latencies_us[] = { 10.0, 50.0, 200.0 };
+    for (int l = 0; l < 3; l++) {
+        run(sixteenths(2000), latencies_us[l]);
+        TEST_ASSERT_LESS_THAN_FLOAT(max_error_samples(latencies_us[l]), max_error);
+        run(random_stream(5000, 3000.0), latencies_us[l]);
+        TEST_ASSERT_LESS_THAN_FLOAT(max_error_samples(latencies_us[l]), max_error);
+    }
+}
+
+// About 10 events per block, so the queue holds up to a few dozen at a time
+static void test_dense_stream(void) {
+    run(random_stream(20000, 1000.0), 50.0);
+    TEST_ASSERT_LESS_THAN_FLOAT(max_error_samples(50.0), max_error);
+}
+
+// A burst beyond the queue: the events that fit are played on time, the rest are counted as dropped
+static void test_full_queue(void) {
+    MidiScheduler s(SAMPLE_RATE, BLOCK_SAMPLES);
+    s.set_event_handler(on_event);
+    push_times.assign(100, 1000.0);
+    handled = 0;
+    in_order = true;
+    max_error = 0.0;
+
+    block_start = s.get_sample_pos();
+    s.process_block(START_US);
+    for (uint32_t n = 0; n < 100; n++) {
+        TEST_ASSERT_EQUAL(n < MidiScheduler::QUEUE_SIZE, s.push(MIDI_EVENT_NOTE_ON, 0, n, 0, START_US + 1000));
+    }
+    TEST_ASSERT_EQUAL_UINT32(100 - MidiScheduler::QUEUE_SIZE, s.get_dropped());
+    for (int k = 1; k < 4; k++) {
+        block_start = s.get_sample_pos();
+        s.process_block(START_US + (uint32_t)(k * BLOCK_US));
+    }
+    TEST_ASSERT_EQUAL_UINT32(MidiScheduler::QUEUE_SIZE, handled);
+    TEST_ASSERT_TRUE(in_order);
+    TEST_ASSERT_LESS_THAN_FLOAT(max_error_samples(0.0), max_error);
+}
+
+void setUp(void) {
+    rng_reset();
+}
+
+void tearDown(void) {
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_punctual_interrupts);
+    RUN_TEST(test_interrupt_latency);
+    RUN_TEST(test_dense_stream);
+    RUN_TEST(test_full_queue);
+    return UNITY_END();
+}
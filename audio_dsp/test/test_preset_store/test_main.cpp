@@ -0,0 +1,188 @@
+/*
+ * PresetStore on a RAM flash: saves are appended to the log of a slot, a full log is erased and
+ * starts over, and a power loss or a failing read never costs more than the save in progress.
+ * Like NOR flash, a write can only clear bits, so writing over a programmed record corrupts it.
+ */
+
+#include <unity.h>
+#include <string.h>
+#include <vector>
+#include <preset_store.h>
+
+class RamPresetStorage : public PresetStorage {
+    public:
+    RamPresetStorage() : memory(PresetStore::AREA_SIZE, 0xff), fail_block(-1), write_limit(-1), erases(0) {}
+
+    virtual bool read(uint32_t addr, void *buf, uint32_t len) {
+        if ((int)(addr / PresetStore::BLOCK_SIZE) == fail_block) return false;
+        memcpy(buf, &memory[addr], len);
+        return true;
+    }
+
+    // A power loss after write_limit bytes: those reach the flash, nothing after them does
+    virtual bool write(uint32_t addr, const void *buf, uint32_t len) {
+        for (uint32_t i = 0; i < len; i++) {
+            if (write_limit == 0) return false;
+            if (write_limit > 0) write_limit--;
+            memory[addr + i] &= ((const uint8_t *)buf)[i];
+        }
+        return true;
+    }
+
+    virtual bool erase_block(uint32_t addr) {
+        memset(&memory[addr], 0xff, PresetStore::BLOCK_SIZE);
+        erases++;
+        return true;
+    }
+
+    std::vector<uint8_t> memory;
+    int fail_block;  // reads of the block of this slot fail, -1 none
+    int write_limit; // bytes until the power is lost, -1 never
+    int erases;
+};
+
+static RamPresetStorage *storage;
+
+static void make_preset(Preset &p, int n) {
+    p.init();
+    p.values[PARAM_FILTER_CUTOFF] = 100.0f + n;
+    p.values[PARAM_VOLUME] = (n % 100) / 100.0f;
+    p.mod_slots[0] = n;
+    p.name[0] = 'A' + n % 26;
+}
+
+static void assert_loads(PresetStore &store, uint8_t slot, int n) {
+    Preset expected, p;
+    make_preset(expected, n);
+    TEST_ASSERT_TRUE(store.load(slot, p));
+    TEST_ASSERT_EQUAL_MEMORY(expected.values, p.values, sizeof (p.values));
+    TEST_ASSERT_EQUAL_MEMORY(expected.mod_slots, p.mod_slots, sizeof (p.mod_slots));
+    TEST_ASSERT_EQUAL_STRING(expected.name, p.name);
+}
+
+static void test_save_load(void) {
+    PresetStore store(*storage);
+    store.begin();
+    Preset p;
+    TEST_ASSERT_FALSE(store.is_used(3));
+    TEST_ASSERT_FALSE(store.load(3, p));
+    for (int n = 0; n < 5; n++) {
+        make_preset(p, n);
+        TEST_ASSERT_TRUE(store.save(3, p));
+        assert_loads(store, 3, n);
+    }
+    make_preset(p, 100);
+    TEST_ASSERT_TRUE(store.save(4, p));
+
+    // After a restart, from the flash alone
+    PresetStore restarted(*storage);
+    restarted.begin();
+    assert_loads(restarted, 3, 4);
+    assert_loads(restarted, 4, 100);
+    TEST_ASSERT_FALSE(restarted.is_used(0));
+    TEST_ASSERT_EQUAL_UINT32(0, restarted.get_errors());
+}
+
+// The save after a full log erases the block once, and the slot goes on from there, also after a restart
+static void test_wrap(void) {
+    PresetStore store(*storage);
+    store.begin();
+    Preset p;
+    const int saves = 2 * PresetStore::RECORDS_PER_SLOT + 10;
+    for (int n = 0; n < saves; n++) {
+        make_preset(p, n);
+        TEST_ASSERT_TRUE(store.save(7, p));
+        if (n == PresetStore::RECORDS_PER_SLOT - 1) TEST_ASSERT_EQUAL_INT(0, storage->erases);
+        if (n == PresetStore::RECORDS_PER_SLOT) TEST_ASSERT_EQUAL_INT(1, storage->erases);
+    }
+    TEST_ASSERT_EQUAL_INT(2, storage->erases);
+    TEST_ASSERT_EQUAL_UINT32(2, store.get_erases());
+    assert_loads(store, 7, saves - 1);
+
+    PresetStore restarted(*storage);
+    restarted.begin();
+    assert_loads(restarted, 7, saves - 1);
+    make_preset(p, saves);
+    TEST_ASSERT_TRUE(restarted.save(7, p));
+    assert_loads(restarted, 7, saves);
+    TEST_ASSERT_EQUAL_UINT32(0, restarted.get_errors());
+}
+
+// A save torn anywhere in the record leaves the previous one, and the next save works
+static void test_torn_write(void) {
+    static const int limits[] = { 1, 4, 100, PRESET_RECORD_SIZE - 1 };
+    for (int l = 0; l < 4; l++) {
+        setUp();
+        PresetStore store(*storage);
+        store.begin();
+        Preset p;
+        for (int n = 0; n < 3; n++) {
+            make_preset(p, n);
+            TEST_ASSERT_TRUE(store.save(2, p));
+        }
+        storage->write_limit = limits[l];
+        make_preset(p, 3);
+        TEST_ASSERT_FALSE(store.save(2, p));
+        storage->write_limit = -1;
+
+        PresetStore restarted(*storage);
+        restarted.begin();
+        assert_loads(restarted, 2, 2);
+        make_preset(p, 4);
+        TEST_ASSERT_TRUE(restarted.save(2, p));
+        assert_loads(restarted, 2, 4);
+
+        PresetStore again(*storage);
+        again.begin();
+        assert_loads(again, 2, 4);
+    }
+}
+
+// A slot whose log could not be read takes no save until a scan succeeds, so no record is overwritten
+static void test_unreadable_slot(void) {
+    Preset p;
+    {
+        PresetStore store(*storage);
+        store.begin();
+        for (int n = 0; n < 3; n++) {
+            make_preset(p, n);
+            TEST_ASSERT_TRUE(store.save(5, p));
+        }
+    }
+    const std::vector<uint8_t> before = storage->memory;
+
+    storage->fail_block = 5;
+    PresetStore store(*storage);
+    store.begin();
+    TEST_ASSERT_FALSE(store.is_used(5));
+    make_preset(p, 3);
+    TEST_ASSERT_FALSE(store.save(5, p));
+    TEST_ASSERT_GREATER_OR_EQUAL_UINT32(2, store.get_errors());
+    TEST_ASSERT_TRUE(storage->memory == before);
+
+    // The next save scans again and appends
+    storage->fail_block = -1;
+    TEST_ASSERT_TRUE(store.save(5, p));
+    assert_loads(store, 5, 3);
+    PresetStore restarted(*storage);
+    restarted.begin();
+    assert_loads(restarted, 5, 3);
+    TEST_ASSERT_EQUAL_INT(0, storage->erases);
+}
+
+void setUp(void) {
+    delete storage;
+    storage = new RamPresetStorage();
+}
+
+void tearDown(void) {
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_save_load);
+    RUN_TEST(test_wrap);
+    RUN_TEST(test_torn_write);
+    RUN_TEST(test_unreadable_slot);
+    return UNITY_END();
+}
@@ -0,0 +1,45 @@
+/*
+ * Renders patch.txt with sequence.txt through the offline renderer (tools/render.cpp) and compares
+ * the result with golden.wav. Compilers may round the float DSP code differently, e.g. fuse
+ * multiply-adds, which moves a few samples by an LSB, so a small difference is allowed.
+ *
+ * After an intended change of the sound, listen to test_render/rendered.wav and re-record the golden file:
+ *   pio run -e native && .pio/build/native/program -p test/test_render/patch.txt \
+ *     -s test/test_render/sequence.txt -t 240 -l 1.5 test/test_render/golden.wav
+ */
+
+#include <unity.h>
+#include <string>
+
+int render_main(int argc, char **argv); // tools/render.cpp
+
+// The test data lies next to this file; a relative __FILE__ is relative to the project, where the test runs
+static std::string test_file(const char *name) {
+    const std::string path = __FILE__;
+    const size_t slash = path.find_last_of("/\\");
+    return (slash == std::string::npos ? std::string() : path.substr(0, slash + 1)) + name;
+}
+
+static void test_golden_render(void) {
+    const std::string patch = test_file("patch.txt");
+    const std::string sequence = test_file("sequence.txt");
+    const std::string golden = test_file("golden.wav");
+    const std::string out = test_file("rendered.wav");
+    const char *argv[] = {
+        "render", "-p", patch.c_str(), "-s", sequence.c_str(), "-t", "240", "-l", "1.5",
+        "-g", golden.c_str(), "-e", "4", out.c_str()
+    };
+    TEST_ASSERT_EQUAL_INT(0, render_main(sizeof (argv) / sizeof (argv[0]), (char **)argv));
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_golden_render);
+    return UNITY_END();
+}
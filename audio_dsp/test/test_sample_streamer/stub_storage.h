@@ -0,0 +1,104 @@
+#ifndef _STUB_STORAGE_H
+#define _STUB_STORAGE_H
+
+#include <string.h>
+#include <vector>
+#include <sample_streamer.h>
+
+/*
+ * SampleStorage with WAV files in RAM and a settable latency per read, in audio samples.
+ * A read hands its latency to the wait handler before it returns, which plays the audio
+ * interrupts that fall into it, like a slow SD card blocking loop() on the Teensy.
+ */
+class StubStorage : public SampleStorage {
+    public:
+    typedef void (*WaitHandler)(uint32_t samples);
+
+    static const int MAX_FILES = 4;
+    static const int NUM_HANDLES = SampleStreamer::MAX_VOICES + 1;
+
+    StubStorage() {
+        num_files = 0;
+        latency = 0;
+        spike_read = -1;
+        spike_latency = 0;
+        num_reads = 0;
+        wait = NULL;
+        for (int h = 0; h < NUM_HANDLES; h++) {
+            open_files[h] = -1;
+        }
+    }
+
+    // 16 bit mono WAV with the given samples
+    void add_file(const char *path, const int16_t *data, uint32_t length) {
+        File &f = files[num_files++];
+        f.path = path;
+        const uint32_t data_bytes = length * 2;
+        const uint8_t header[44] = {
+            'R', 'I', 'F', 'F', le(36 + data_bytes, 0), le(36 + data_bytes, 1), le(36 + data_bytes, 2), le(36 + data_bytes, 3),
+            'W', 'A', 'V', 'E', 'f', 'm', 't', ' ', 16, 0, 0, 0,
+            1, 0, 1, 0, 0x44, 0xac, 0, 0, 0x88, 0x58, 0x01, 0, 2, 0, 16, 0, // PCM, mono, 44100 Hz, 16 bit
+            'd', 'a', 't', 'a', le(data_bytes, 0), le(data_bytes, 1), le(data_bytes, 2), le(data_bytes, 3)
+        };
+        f.bytes.assign(header, header + sizeof (header));
+        const uint8_t *pcm = (const uint8_t *)data;
+        f.bytes.insert(f.bytes.end(), pcm, pcm + data_bytes);
+    }
+
+    void set_wait_handler(WaitHandler handler) { wait = handler; }
+    void set_latency(uint32_t samples) { latency = samples; }
+
+    // Only read number n (counted from 0) takes this long
+    void set_spike(int n, uint32_t samples) {
+        spike_read = n;
+        spike_latency = samples;
+    }
+
+    int get_reads() const { return num_reads; }
+
+    virtual bool open(uint8_t handle, const char *path) {
+        for (int i = 0; i < num_files; i++) {
+            if (strcmp(files[i].path, path) == 0) {
+                open_files[handle] = i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    virtual int read(uint8_t handle, uint32_t pos, void *buf, int len) {
+        const uint32_t samples = num_reads == spike_read ? spike_latency : latency;
+        num_reads++;
+        if (wait && samples > 0) wait(samples);
+
+        if (open_files[handle] < 0) return -1;
+        const std::vector<uint8_t> &bytes = files[open_files[handle]].bytes;
+        if (pos >= bytes.size()) return 0;
+        if (pos + len > bytes.size()) len = bytes.size() - pos;
+        memcpy(buf, &bytes[pos], len);
+        return len;
+    }
+
+    virtual void close(uint8_t handle) {
+        open_files[handle] = -1;
+    }
+
+    private:
+    struct File {
+        const char *path;
+        std::vector<uint8_t> bytes;
+    };
+
+    static uint8_t le(uint32_t v, int byte) { return (v >> (8 * byte)) & 0xff; }
+
+    File files[MAX_FILES];
+    int num_files;
+    int open_files[NUM_HANDLES];
+    uint32_t latency;
+    int spike_read;
+    uint32_t spike_latency;
+    int num_reads;
+    WaitHandler wait;
+};
+
+#endif
@@ -0,0 +1,193 @@
+/*
+ * SampleStreamer against storage of a given read latency. The audio interrupt renders a block
+ * every BLOCK_SAMPLES, also while loop() waits for a read. Reads of up to the depth of a buffer
+ * must not cause an underrun, slower ones must, and every block lost to them is counted.
+ */
+
+#include <unity.h>
+#include <string.h>
+#include <sample_streamer.h>
+#include "stub_storage.h"
+
+static const int BLOCK_SAMPLES = 128;
+static const int BUFFER_SAMPLES = SampleStreamer::BUFFER_SAMPLES;
+static const uint32_t SAMPLE_LENGTH = 12 * BUFFER_SAMPLES + 100;
+
+static int16_t stream_memory[SampleStreamer::MAX_VOICES * 2 * SampleStreamer::BUFFER_SAMPLES];
+static int16_t head_memory[SampleStreamer::MAX_SAMPLES * SampleStreamer::HEAD_SAMPLES];
+static int16_t pcm[SAMPLE_LENGTH];
+
+static StubStorage *storage;
+static SampleStreamer *streamer;
+
+// Audio side: time in samples, the next interrupt and what the blocks of a single voice looked like
+static uint64_t now;
+static uint64_t next_block;
+static uint32_t play_pos;
+static uint32_t silent_blocks;
+static uint32_t wrong_blocks;
+static bool check_output;
+
+// Every sample is non-zero, so a skipped block shows up as silence
+static int16_t sample_value(uint32_t i) {
+    return 1000 + (i * 7) % 29000;
+}
+
+static void render_block(void) {
+    int16_t out[BLOCK_SAMPLES];
+    memset(out, 0, sizeof (out));
+    streamer->render(out, BLOCK_SAMPLES);
+    if (!check_output || play_pos == SAMPLE_LENGTH) return;
+
+    const uint32_t n = play_pos + BLOCK_SAMPLES <= SAMPLE_LENGTH ? BLOCK_SAMPLES : SAMPLE_LENGTH - play_pos;
+    bool silent = true, exact = true;
+    for (uint32_t i = 0; i < n; i++) {
+        if (out[i] != 0) silent = false;
+        if (out[i] != (sample_value(play_pos + i) * 32767) >> 15) exact = false;
+    }
+    if (silent) silent_blocks++;
+    else if (!exact) wrong_blocks++;
+    play_pos += n;
+}
+
+// Plays the audio interrupts up to the given time
+static void run_audio_until(uint64_t t) {
+    while (next_block <= t) {
+        render_block();
+        next_block += BLOCK_SAMPLES;
+    }
+    now = t;
+}
+
+static void wait_for_read(uint32_t samples) {
+    run_audio_until(now + samples);
+}
+
+// loop(): services the streamer whenever it has something to read, otherwise waits for the next block
+static void run_until_done(void) {
+    while (streamer->is_playing()) {
+        if (!streamer->service()) run_audio_until(next_block);
+    }
+}
+
+static void start(int num_voices, uint32_t latency) {
+    storage->set_latency(0);
+    TEST_ASSERT_EQUAL_INT(0, streamer->add_sample("kick.wav"));
+    storage->set_latency(latency);
+    for (int v = 0; v < num_voices; v++) {
+        streamer->play(0, 1.0f);
+    }
+    check_output = num_voices == 1;
+}
+
+static void assert_single_voice_output(void) {
+    TEST_ASSERT_EQUAL_UINT32(SAMPLE_LENGTH, play_pos);
+    TEST_ASSERT_EQUAL_UINT32(0, wrong_blocks);
+    TEST_ASSERT_EQUAL_UINT32(silent_blocks, streamer->get_underruns());
+    TEST_ASSERT_EQUAL_UINT32(silent_blocks, streamer->get_voice_underruns(0));
+    TEST_ASSERT_EQUAL_UINT32(0, streamer->get_read_errors());
+}
+
+static void test_fast_storage(void) {
+    start(1, 0);
+    run_until_done();
+    assert_single_voice_output();
+    TEST_ASSERT_EQUAL_UINT32(0, streamer->get_underruns());
+    TEST_ASSERT_EQUAL_INT(BUFFER_SAMPLES, streamer->get_min_buffered());
+}
+
+/*
+ * While one buffer plays the other one is read, so a read may take as long as a buffer plays,
+ * less the block the interrupt needs when the read ends.
+ */
+static void test_slow_reads_within_buffer_depth(void) {
+    static const uint32_t latencies[] = { BLOCK_SAMPLES, 1000, BUFFER_SAMPLES / 2, BUFFER_SAMPLES - BLOCK_SAMPLES };
+    for (int l = 0; l < 4; l++) {
+        setUp();
+        start(1, latencies[l]);
+        run_until_done();
+        assert_single_voice_output();
+        TEST_ASSERT_EQUAL_UINT32(0, streamer->get_underruns());
+        TEST_ASSERT_GREATER_OR_EQUAL_INT(latencies[l], streamer->get_min_buffered());
+    }
+}
+
+static void test_slow_reads_beyond_buffer_depth(void) {
+    static const uint32_t latencies[] = { BUFFER_SAMPLES + 2 * BLOCK_SAMPLES, 2 * BUFFER_SAMPLES, 5 * BUFFER_SAMPLES };
+    for (int l = 0; l < 3; l++) {
+        setUp();
+        start(1, latencies[l]);
+        run_until_done();
+        assert_single_voice_output();
+        TEST_ASSERT_GREATER_THAN_UINT32(0, streamer->get_underruns());
+    }
+}
+
+// A single stall: the blocks it costs are counted, then the voice plays on from where it should be
+static void test_single_stall(void) {
+    static const uint32_t stalls[] = { BUFFER_SAMPLES, BUFFER_SAMPLES + 2 * BLOCK_SAMPLES, 3 * BUFFER_SAMPLES };
+    for (int s = 0; s < 3; s++) {
+        setUp();
+        start(1, 0);
+        storage->set_spike(storage->get_reads() + 3, stalls[s]);
+        run_until_done();
+        assert_single_voice_output();
+        if (stalls[s] <= (uint32_t)BUFFER_SAMPLES) {
+            TEST_ASSERT_EQUAL_UINT32(0, streamer->get_underruns());
+        } else {
+            // Lost: the stall minus the read-ahead, in blocks, give or take the block being played
+            const uint32_t lost = (stalls[s] - BUFFER_SAMPLES) / BLOCK_SAMPLES;
+            TEST_ASSERT_UINT32_WITHIN(1, lost, streamer->get_underruns());
+        }
+    }
+}
+
+// Voices share loop(): with n voices a buffer has to last n reads
+static void test_voices_share_buffer_depth(void) {
+    static const int voices[] = { 2, 4, SampleStreamer::MAX_VOICES };
+    for (int i = 0; i < 3; i++) {
+        const int n = voices[i];
+        setUp();
+        start(n, BUFFER_SAMPLES / n - BLOCK_SAMPLES);
+        run_until_done();
+        TEST_ASSERT_EQUAL_UINT32(0, streamer->get_underruns());
+        TEST_ASSERT_EQUAL_UINT32(0, streamer->get_read_errors());
+
+        setUp();
+        start(n, 2 * BUFFER_SAMPLES / n);
+        run_until_done();
+        TEST_ASSERT_GREATER_THAN_UINT32(0, streamer->get_underruns());
+        uint32_t sum = 0;
+        for (int v = 0; v < n; v++) {
+            sum += streamer->get_voice_underruns(v);
+        }
+        TEST_ASSERT_EQUAL_UINT32(streamer->get_underruns(), sum);
+    }
+}
+
+void setUp(void) {
+    delete streamer;
+    delete storage;
+    storage = new StubStorage();
+    storage->add_file("kick.wav", pcm, SAMPLE_LENGTH);
+    storage->set_wait_handler(wait_for_read);
+    streamer = new SampleStreamer(*storage, stream_memory, head_memory);
+    now = next_block = 0;
+    play_pos = silent_blocks = wrong_blocks = 0;
+}
+
+void tearDown(void) {
+}
+
+int main(int, char **) {
+    for (uint32_t i = 0; i < SAMPLE_LENGTH; i++) {
+        pcm[i] = sample_value(i);
+    }
+    UNITY_BEGIN();
+    RUN_TEST(test_fast_storage);
+    RUN_TEST(test_slow_reads_within_buffer_depth);
+    RUN_TEST(test_slow_reads_beyond_buffer_depth);
+    RUN_TEST(test_single_stall);
+    RUN_TEST(test_voices_share_buffer_depth);
+    return UNITY_END();
+}
@@ -0,0 +1,156 @@
+/*
+ * SeqClock must not drift: after hours of blocks every tick still starts on the sample
+ * the exact tempo and swing put it on, and no tick is skipped or repeated.
+ */
+
+#include <unity.h>
+#include <seq_clock.h>
+
+static const uint32_t SAMPLE_RATE = 44100;
+static const uint16_t BLOCK_SAMPLES = 128;
+
+// Expected ticks, checked by the tick handler
+static uint32_t bpm_x2;       // tempo in 0.5 bpm, so e.g. 97.5 bpm is exact
+static uint32_t swing;
+static uint64_t block_start;  // sample position of the current block
+static uint32_t next_tick;
+static uint32_t errors;
+
+/*
+ * Exact sample position of a tick in 1/DEN samples. A straight tick lasts
+ * 60 * SAMPLE_RATE / (bpm * PPQN) = 5 * SAMPLE_RATE / (4 * bpm_x2) samples, a swing pair of two 16ths
+ * is first stretched to swing / 50 and then shortened to (100 - swing) / 50 of their straight length.
+ * All of it is scaled by 50 * 4 * bpm_x2 to stay in integers.
+ */
+static uint64_t exact_position(uint32_t tick, uint64_t &den) {
+    const uint32_t pair_ticks = 2 * SeqClock::TICKS_PER_16TH;
+    const uint64_t pair = tick / pair_ticks;
+    const uint64_t in_pair = tick % pair_ticks;
+    uint64_t units = pair * pair_ticks * 50; // in straight ticks * 50
+    if (in_pair < SeqClock::TICKS_PER_16TH) {
+        units += in_pair * swing;
+    } else {
+        units += SeqClock::TICKS_PER_16TH * swing + (in_pair - SeqClock::TICKS_PER_16TH) * (100 - swing);
+    }
+    den = 50 * 4 * (uint64_t)bpm_x2;
+    return units * 5 * SAMPLE_RATE;
+}
+
+// Sample the exact position falls into
+static uint64_t exact_sample(uint32_t tick) {
+    uint64_t den;
+    const uint64_t pos = exact_position(tick, den);
+    return pos / den;
+}
+
+/*
+ * Tick lengths are 32.32 fixed point rounded down, so the clock may run ahead of the exact
+ * position by up to 2^-32 samples per tick. That is the only error allowed: a tick starts on the
+ * sample its exact position falls into, or on the one before if its exact position is less than
+ * 1/MAX_AHEAD_INV samples past a whole sample. After 6 hours at 133 bpm the clock is at most
+ * 4.6M * 2^-32 = 0.001 samples ahead.
+ */
+static const uint64_t MAX_AHEAD_INV = 512; // 1/512 sample
+
+static bool tick_sample_ok(uint32_t tick, uint64_t sample) {
+    uint64_t den;
+    const uint64_t pos = exact_position(tick, den);
+    const uint64_t latest = pos / den;
+    const uint64_t earliest = pos * MAX_AHEAD_INV < den ? 0 : (pos * MAX_AHEAD_INV - den) / (den * MAX_AHEAD_INV);
+    return sample >= earliest && sample <= latest;
+}
+
+static void on_tick(uint32_t tick, uint16_t offset) {
+    if (tick != next_tick || offset >= BLOCK_SAMPLES || !tick_sample_ok(tick, block_start + offset)) {
+        if (errors++ == 0) {
+            TEST_ASSERT_EQUAL_UINT32(next_tick, tick);
+            TEST_ASSERT_LESS_THAN_UINT32(BLOCK_SAMPLES, offset);
+            TEST_ASSERT_EQUAL_UINT64(exact_sample(tick), block_start + offset);
+        }
+    }
+    next_tick = tick + 1;
+}
+
+static SeqClock *start_clock(uint32_t tempo_x2, uint32_t swing_percent) {
+    static SeqClock clock(SAMPLE_RATE);
+    bpm_x2 = tempo_x2;
+    swing = swing_percent;
+    block_start = 0;
+    next_tick = 0;
+    errors = 0;
+    clock.set_tempo(tempo_x2 / 2.0f);
+    clock.set_swing(swing_percent);
+    clock.set_tick_handler(on_tick);
+    clock.start();
+    return &clock;
+}
+
+// Advances by blocks of the given sizes in turn and checks the tick count at the end
+static void run_blocks(SeqClock *clock, uint64_t num_samples, const uint16_t *sizes, int num_sizes) {
+    int i = 0;
+    while (block_start < num_samples) {
+        const uint16_t n = sizes[i++ % num_sizes];
+        clock->advance(n);
+        block_start += n;
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, errors);
+    TEST_ASSERT_EQUAL_UINT64(block_start, clock->get_sample_pos());
+
+    // Every tick before the end of the last block was reported, and none after it (within MAX_AHEAD_INV)
+    TEST_ASSERT_TRUE(exact_sample(next_tick - 1) <= block_start);
+    TEST_ASSERT_TRUE(exact_sample(next_tick) + 1 >= block_start);
+}
+
+static void test_straight_tempos(void) {
+    static const uint32_t tempos_x2[] = { 40, 120, 195, 240, 266, 348, 600 }; // 20 .. 300 bpm
+    for (unsigned t = 0; t < sizeof (tempos_x2) / sizeof (tempos_x2[0]); t++) {
+        SeqClock *clock = start_clock(tempos_x2[t], 50);
+        run_blocks(clock, 10ull * 60 * SAMPLE_RATE, &BLOCK_SAMPLES, 1);
+    }
+}
+
+static void test_swing(void) {
+    static const uint32_t swings[] = { 50, 54, 58, 61, 66, 75 };
+    for (unsigned s = 0; s < sizeof (swings) / sizeof (swings[0]); s++) {
+        SeqClock *clock = start_clock(266, swings[s]);
+        run_blocks(clock, 10ull * 60 * SAMPLE_RATE, &BLOCK_SAMPLES, 1);
+    }
+}
+
+// The ticks do not depend on how the samples are split into blocks
+static void test_irregular_blocks(void) {
+    static const uint16_t sizes[] = { 1, 128, 7, 64, 127, 2, 100 };
+    SeqClock *clock = start_clock(348, 62);
+    run_blocks(clock, 10ull * 60 * SAMPLE_RATE, sizes, sizeof (sizes) / sizeof (sizes[0]));
+}
+
+static void test_no_drift_over_hours(void) {
+    SeqClock *clock = start_clock(266, 58);
+    run_blocks(clock, 6ull * 3600 * SAMPLE_RATE, &BLOCK_SAMPLES, 1);
+}
+
+// A restart begins again at tick 0 on the first sample of the next block
+static void test_restart(void) {
+    SeqClock *clock = start_clock(240, 50);
+    run_blocks(clock, 5 * SAMPLE_RATE, &BLOCK_SAMPLES, 1);
+    clock->start();
+    block_start = 0;
+    next_tick = 0;
+    run_blocks(clock, 5 * SAMPLE_RATE, &BLOCK_SAMPLES, 1);
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_straight_tempos);
+    RUN_TEST(test_swing);
+    RUN_TEST(test_irregular_blocks);
+    RUN_TEST(test_no_drift_over_hours);
+    RUN_TEST(test_restart);
+    return UNITY_END();
+}
@@ -0,0 +1,93 @@
+/*
+ * VoicePool in poly mode with unison: when it has to steal, every note still gets unison
+ * distinct voices, spread over the whole detune range, whatever the steal mode.
+ */
+
+#include <unity.h>
+#include <voice_pool.h>
+
+// Voices keep sounding after their release, so every note on beyond the pool steals
+class TestPool : public VoicePool {
+    public:
+    TestPool(uint8_t num_voices) : VoicePool(num_voices) {
+        for (uint8_t v = 0; v < MAX_VOICES; v++) {
+            detune[v] = 0.0f;
+            starts[v] = 0;
+        }
+    }
+
+    float detune[MAX_VOICES];
+    uint32_t starts[MAX_VOICES];
+
+    protected:
+    virtual void start_voice(uint8_t v, uint8_t, uint8_t, float detune_cents, bool) {
+        detune[v] = detune_cents;
+        starts[v]++;
+    }
+    virtual void release_voice(uint8_t) {}
+    virtual bool is_voice_sounding(uint8_t v) { return starts[v] > 0; }
+};
+
+static const uint8_t NUM_VOICES = 8;
+static const float DETUNE_CENTS = 10.0f;
+
+// Number of voices playing note, and their lowest and highest detune
+static int voices_of(TestPool &pool, uint8_t note, float &low, float &high) {
+    int n = 0;
+    low = 1e9f;
+    high = -1e9f;
+    for (uint8_t v = 0; v < NUM_VOICES; v++) {
+        if (pool.get_voice_note(v) != note) continue;
+        n++;
+        if (pool.detune[v] < low) low = pool.detune[v];
+        if (pool.detune[v] > high) high = pool.detune[v];
+    }
+    return n;
+}
+
+static void check_steal(VoicePool::StealMode mode, uint8_t unison, bool released) {
+    TestPool pool(NUM_VOICES);
+    pool.set_steal_mode(mode);
+    pool.set_unison(unison, DETUNE_CENTS);
+    for (uint8_t note = 0; note < NUM_VOICES / unison; note++) {
+        pool.note_on(60 + note, 100);
+        if (released) pool.note_off(60 + note);
+    }
+
+    // Quieter than any voice in the pool, so STEAL_QUIETEST looks at the voices just started first
+    pool.note_on(80, 10);
+    float low, high;
+    TEST_ASSERT_EQUAL_INT(unison, voices_of(pool, 80, low, high));
+    TEST_ASSERT_EQUAL_FLOAT(-DETUNE_CENTS, low);
+    TEST_ASSERT_EQUAL_FLOAT(DETUNE_CENTS, high);
+    TEST_ASSERT_EQUAL_UINT32(unison, pool.get_steal_count());
+}
+
+static void test_steal_held_voices(void) {
+    static const uint8_t unisons[] = { 2, 4, NUM_VOICES };
+    for (int u = 0; u < 3; u++) {
+        check_steal(VoicePool::STEAL_OLDEST, unisons[u], false);
+        check_steal(VoicePool::STEAL_QUIETEST, unisons[u], false);
+    }
+}
+
+static void test_steal_released_voices(void) {
+    static const uint8_t unisons[] = { 2, 4, NUM_VOICES };
+    for (int u = 0; u < 3; u++) {
+        check_steal(VoicePool::STEAL_OLDEST, unisons[u], true);
+        check_steal(VoicePool::STEAL_QUIETEST, unisons[u], true);
+    }
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_steal_held_voices);
+    RUN_TEST(test_steal_released_voices);
+    return UNITY_END();
+}
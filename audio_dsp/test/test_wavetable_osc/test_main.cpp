@@ -0,0 +1,167 @@
+/*
+ * WavetableOsc renders in Q15 fixed point from 16 bit tables. Its output is compared with
+ * the same band-limited waveforms summed in double precision, at the exact phase of every sample:
+ * interpolated linearly between the table points like render() does, which leaves only table
+ * quantization and the fixed-point math as differences, and as the ideal waveform, which adds
+ * the error of the linear interpolation itself.
+ */
+
+#include <unity.h>
+#include <math.h>
+#include <wavetable_osc.h>
+
+static const float SAMPLE_RATE = 44100.0f;
+static const int NUM_SAMPLES = 4096;
+
+// Harmonic amplitudes of the tables (see wavetable_osc.cpp)
+static double sine_amp(int h) {
+    return h == 1 ? 1.0 : 0.0;
+}
+
+static double triangle_amp(int h) {
+    if (h % 2 == 0) return 0.0;
+    return ((h / 2) % 2 ? -1.0 : 1.0) * 8.0 / (M_PI * M_PI * h * h);
+}
+
+static double saw_amp(int h) {
+    return (h % 2 ? 2.0 : -2.0) / (M_PI * h);
+}
+
+static double harmonic_sum(double phase, int harmonics, double (*amp)(int h)) {
+    double v = 0.0;
+    for (int h = 1; h <= harmonics; h++) {
+        const double a = amp(h);
+        if (a != 0.0) v += a * sin(2.0 * M_PI * h * phase);
+    }
+    return v;
+}
+
+// Table value of a full scale waveform: the peak of the fullest table is scaled to 32000
+static double table_scale(double (*amp)(int h)) {
+    double peak = 0.0;
+    for (int i = 0; i < WavetableOsc::TABLE_SIZE; i++) {
+        const double v = fabs(harmonic_sum((double)i / WavetableOsc::TABLE_SIZE, WavetableOsc::MAX_HARMONICS, amp));
+        if (v > peak) peak = v;
+    }
+    return 32000.0 / peak;
+}
+
+struct Reference {
+    int harmonics;
+    double (*amp)(int h);
+    double table[WavetableOsc::TABLE_SIZE + 1]; // unquantized, for the interpolated reference
+    bool interpolated;
+};
+
+static double reference_value(const Reference &ref, uint32_t phase) {
+    static const double two_32 = 4294967296.0;
+    if (!ref.interpolated) return harmonic_sum(phase / two_32, ref.harmonics, ref.amp);
+
+    const uint32_t index = phase >> (32 - WavetableOsc::TABLE_BITS);
+    const double frac = (phase & ((1u << (32 - WavetableOsc::TABLE_BITS)) - 1)) / (double)(1u << (32 - WavetableOsc::TABLE_BITS));
+    return ref.table[index] + frac * (ref.table[index + 1] - ref.table[index]);
+}
+
+struct Error {
+    double max;     // in output LSB
+    double snr_db;
+};
+
+static Error compare(OscShape shape, float hz, float width, float level, bool interpolated) {
+    static Reference ref;
+    ref.amp = shape == OSC_SINE ? sine_amp : (shape == OSC_TRIANGLE ? triangle_amp : saw_amp);
+    ref.harmonics = shape == OSC_SINE ? 1 : WavetableOsc::MAX_HARMONICS >> WavetableOsc::get_level(hz, SAMPLE_RATE);
+    ref.interpolated = interpolated;
+    for (int i = 0; i <= WavetableOsc::TABLE_SIZE; i++) {
+        ref.table[i] = harmonic_sum((double)i / WavetableOsc::TABLE_SIZE, ref.harmonics, ref.amp);
+    }
+    const double gain = table_scale(ref.amp) * (int16_t)(level * 32767.0f) / 32768.0;
+
+    WavetableOsc osc(SAMPLE_RATE);
+    osc.set_shape(shape);
+    osc.set_frequency(hz);
+    osc.set_pulse_width(width);
+    osc.set_amplitude(level);
+    static int16_t out[NUM_SAMPLES];
+    for (int i = 0; i < NUM_SAMPLES; i += 128) {
+        osc.render(out + i, 128);
+    }
+
+    // Same phase accumulator as the oscillator, so only the amplitude is compared
+    const uint32_t inc = (uint32_t)(hz / SAMPLE_RATE * 4294967296.0f);
+    const uint32_t offset = (uint32_t)(width * 4294967296.0f);
+    double signal = 0.0, noise = 0.0;
+    Error e = { 0.0, 0.0 };
+    uint32_t p = 0;
+    for (int i = 0; i < NUM_SAMPLES; i++, p += inc) {
+        double v = gain * reference_value(ref, p);
+        if (shape == OSC_PULSE) v = (v - gain * reference_value(ref, p + offset)) / 2.0;
+        const double d = out[i] - v;
+        if (fabs(d) > e.max) e.max = fabs(d);
+        signal += v * v;
+        noise += d * d;
+    }
+    e.snr_db = 10.0 * log10(signal / noise);
+    return e;
+}
+
+static const float freqs[] = { 55.0f, 261.63f, 440.0f, 1760.0f, 7040.0f, 15000.0f };
+static const int NUM_FREQS = sizeof (freqs) / sizeof (freqs[0]);
+
+static const OscShape shapes[] = { OSC_SINE, OSC_TRIANGLE, OSC_SAW, OSC_PULSE };
+static const float widths[] = { 0.05f, 0.25f, 0.5f, 0.8f, 0.95f };
+
+// Table rounding, the Q15 weights and the truncating shifts add up to a few LSB at most
+static void test_fixed_point_error(void) {
+    for (int s = 0; s < OSC_NUM_SHAPES; s++) {
+        for (int f = 0; f < NUM_FREQS; f++) {
+            for (int w = 0; w < (shapes[s] == OSC_PULSE ? 5 : 1); w++) {
+                const Error e = compare(shapes[s], freqs[f], widths[w], 1.0f, true);
+                TEST_ASSERT_LESS_THAN_FLOAT(3.0, e.max);
+            }
+        }
+    }
+}
+
+// Relative to the signal the error does not grow at low amplitudes, beyond the 16 bit floor
+static void test_fixed_point_error_amplitudes(void) {
+    static const float levels[] = { 0.01f, 0.1f, 0.5f };
+    for (int s = 0; s < OSC_NUM_SHAPES; s++) {
+        for (int l = 0; l < 3; l++) {
+            const Error e = compare(shapes[s], 440.0f, 0.5f, levels[l], true);
+            TEST_ASSERT_LESS_THAN_FLOAT(3.0, e.max);
+        }
+    }
+}
+
+/*
+ * Against the ideal waveform. Linear interpolation rounds off the top harmonics of the fullest
+ * tables, which have only 8 table points per cycle at 55 Hz; the saw and pulse of the lowest
+ * notes carry the most of them, so they get a lower bound.
+ */
+static void test_band_limited_snr(void) {
+    for (int s = 0; s < OSC_NUM_SHAPES; s++) {
+        for (int f = 0; f < NUM_FREQS; f++) {
+            for (int w = 0; w < (shapes[s] == OSC_PULSE ? 5 : 1); w++) {
+                const Error e = compare(shapes[s], freqs[f], widths[w], 1.0f, false);
+                const bool low_saw = (shapes[s] == OSC_SAW || shapes[s] == OSC_PULSE) && freqs[f] < 440.0f;
+                TEST_ASSERT_GREATER_THAN_FLOAT(shapes[s] == OSC_SINE || shapes[s] == OSC_TRIANGLE ? 80.0 : (low_saw ? 48.0 : 65.0), e.snr_db);
+            }
+        }
+    }
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+int main(int, char **) {
+    WavetableOsc::init_tables();
+    UNITY_BEGIN();
+    RUN_TEST(test_fixed_point_error);
+    RUN_TEST(test_fixed_point_error_amplitudes);
+    RUN_TEST(test_band_limited_snr);
+    return UNITY_END();
+}
@@ -0,0 +1,267 @@
+/*
+ * Micro-benchmarks of the audio MCU's DSP kernels and control paths on a PC, output as JSON lines (see bench.h).
+ * Audio objects run on the stand-in scheduler of the offline renderer (tools/native).
+ *
+ * Build and run: pio run -e bench && .pio/build/bench/program [filter] [--baseline old.json]
+ */
+
+#include <math.h>
+#include <vector>
+#include <bench.h>
+#include <Audio.h>
+#include <mcu_proto.h>
+#include <wavetable_osc.h>
+#include <ops_player.h>
+#include <param_store.h>
+#include <mod_matrix.h>
+#include <param_engine.h>
+#include <midi_scheduler.h>
+#include <audio_voice_pool.h>
+#include <preset_store.h>
+#include <pattern_seq.h>
+#include <param_sync.h>
+
+#define SAMPLE_RATE 44100.0
+#define BLOCK_SECONDS (AUDIO_BLOCK_SAMPLES / SAMPLE_RATE)
+
+/*
+ * Discards everything it receives, so the benchmarked graph has a consumer like on the device
+ */
+class AudioSink : public AudioStream {
+    public:
+    AudioSink() : AudioStream(1, inputQueueArray) {}
+
+    virtual void update(void) {
+        audio_block_t *block = receiveReadOnly(0);
+        if (block) {
+            bench_keep(block->data[0]);
+            release(block);
+        }
+    }
+
+    private:
+    audio_block_t *inputQueueArray[1];
+};
+
+// Voice pool graph as in main.cpp, up to the mixer
+AudioVoicePool voice_pool;
+AudioMixer4 mixer;
+AudioSink sink;
+AudioConnection cord1(voice_pool.output(), 0, mixer, 0);
+AudioConnection cord2(mixer, 0, sink, 0);
+
+/*
+ * Preset flash in RAM, erased flash reads 0xff
+ */
+class RamPresetStorage : public PresetStorage {
+    public:
+    RamPresetStorage() : memory(PresetStore::AREA_SIZE, 0xff) {}
+
+    virtual bool read(uint32_t addr, void *buf, uint32_t len) {
+        memcpy(buf, &memory[addr], len);
+        return true;
+    }
+
+    virtual bool write(uint32_t addr, const void *buf, uint32_t len) {
+        for (uint32_t i = 0; i < len; i++) {
+            memory[addr + i] &= ((const uint8_t *)buf)[i];
+        }
+        return true;
+    }
+
+    virtual bool erase_block(uint32_t addr) {
+        memset(&memory[addr], 0xff, PresetStore::BLOCK_SIZE);
+        return true;
+    }
+
+    private:
+    std::vector<uint8_t> memory;
+};
+
+static float applied_sum = 0.0f;
+
+static void apply_param(uint8_t id, float value) {
+    applied_sum += value;
+}
+
+static void handle_track_note(uint8_t track, uint8_t note, uint8_t velocity, uint16_t offset) {
+    bench_keep(note);
+}
+
+static void handle_midi_event(const MidiEvent &event, uint16_t offset) {
+    bench_keep(offset);
+}
+
+int main(int argc, char **argv) {
+    Bench bench("audio_dsp", argc, argv);
+    WavetableOsc::init_tables();
+    AudioMemory(256);
+
+    // Per sample of one block
+    int16_t block[AUDIO_BLOCK_SAMPLES];
+    static const char *const shape_names[OSC_NUM_SHAPES] = {
+        "wavetable_osc_sine", "wavetable_osc_triangle", "wavetable_osc_saw", "wavetable_osc_pulse"
+    };
+    WavetableOsc osc(SAMPLE_RATE);
+    osc.set_frequency(220.0f);
+    osc.set_amplitude(0.8f);
+    for (int shape = 0; shape < OSC_NUM_SHAPES; shape++) {
+        osc.set_shape((OscShape)shape);
+        bench.run(shape_names[shape], [&]() {
+            osc.render(block, AUDIO_BLOCK_SAMPLES);
+            bench_keep(block);
+        }, AUDIO_BLOCK_SAMPLES);
+    }
+
+    // All slicer voices playing a looped sample
+    const uint32_t ops_length = 44100;
+    std::vector<uint8_t> ops_data(sizeof (OpsHeader) + ops_length * 2);
+    OpsHeader *header = (OpsHeader *)ops_data.data();
+    memcpy(header->magic, OPS_MAGIC, 4);
+    header->version = OPS_VERSION;
+    header->header_size = sizeof (OpsHeader);
+    header->sample_rate = 44100;
+    header->length = ops_length;
+    header->loop_start = 0;
+    header->loop_end = ops_length;
+    header->root_note = 60;
+    header->flags = OPS_FLAG_LOOP;
+    header->num_slices = 0;
+    int16_t *pcm = (int16_t *)(ops_data.data() + sizeof (OpsHeader));
+    for (uint32_t i = 0; i < ops_length; i++) {
+        pcm[i] = (int16_t)(10000.0 * sin(i * 0.05));
+    }
+    OpsPlayer ops;
+    for (int v = 0; v < OpsPlayer::MAX_VOICES; v++) {
+        ops.play(header, -1, 0.5f);
+    }
+    bench.run("ops_player_render_4_voices", [&]() {
+        memset(block, 0, sizeof (block));
+        ops.render(block, AUDIO_BLOCK_SAMPLES);
+        bench_keep(block);
+    }, AUDIO_BLOCK_SAMPLES);
+
+    // Control rate: one call per audio block, with the default mod slots of main.cpp and a cutoff ramp
+    ParamStore params;
+    ModMatrix mod;
+    mod.set_slot(0, MOD_ENV, PARAM_FILTER_CUTOFF, 0.2f);
+    mod.set_slot(1, MOD_WHEEL, PARAM_FILTER_CUTOFF, 0.4f);
+    float offsets[NUM_PARAMS];
+    bench.run("mod_matrix_process", [&]() {
+        mod.process(params, BLOCK_SECONDS, offsets);
+        bench_keep(offsets);
+    });
+
+    ParamEngine engine(params, mod);
+    engine.set_handler(apply_param);
+    uint32_t blocks = 0;
+    bench.run("param_engine_process", [&]() {
+        if (blocks++ % 64 == 0) params.set(PARAM_FILTER_CUTOFF, blocks & 64 ? 500.0f : 5000.0f);
+        engine.process(BLOCK_SECONDS);
+    });
+    bench_keep(applied_sum);
+
+    bench.run("param_store_set", [&]() {
+        params.set(PARAM_OSC1_TUNE, (blocks++ & 15) - 8.0f);
+    });
+
+    // Program change: read the newest record of a slot and glide to it (without the SPI transfer)
+    RamPresetStorage preset_storage;
+    PresetStore presets(preset_storage);
+    presets.begin();
+    Preset preset;
+    preset.init();
+    for (uint8_t slot = 0; slot < PresetStore::NUM_SLOTS; slot++) {
+        preset.values[PARAM_FILTER_CUTOFF] = 200.0f * (slot + 1);
+        presets.save(slot, preset);
+    }
+    uint8_t slot = 0;
+    bench.run("preset_recall", [&]() {
+        presets.load(slot, preset);
+        preset.apply(params, mod, 35);
+        slot = (slot + 1) % PresetStore::NUM_SLOTS;
+    });
+
+    Preset other = preset;
+    other.values[PARAM_FILTER_CUTOFF] = 8000.0f;
+    float amount = 0.0f;
+    bench.run("preset_morph", [&]() {
+        amount = amount < 1.0f ? amount + 1.0f / 128 : 0.0f;
+        preset_morph(preset, other, amount, params, mod);
+    });
+
+    // Sequencer tick with a trig on every step of all tracks, every other one with two locks
+    static Pattern patterns[2];
+    for (int i = 0; i < 2; i++) {
+        patterns[i].clear();
+    }
+    for (uint8_t t = 0; t < Pattern::NUM_TRACKS; t++) {
+        patterns[0].set_length(t, 16 - t);
+        for (uint8_t step = 0; step < 16; step++) {
+            patterns[0].set_trig(t, step, 36 + step, 100, 12);
+            patterns[0].set_micro(t, step, (step % 3) - 1);
+            if (step % 2) continue;
+            patterns[0].set_lock(t, step, PARAM_FILTER_CUTOFF, 100.0f * step + 200.0f);
+            patterns[0].set_lock(t, step, PARAM_PULSE_WIDTH, 0.1f + 0.05f * step);
+        }
+    }
+    PatternSeq pattern_seq(patterns, 2, params);
+    pattern_seq.set_note_handler(handle_track_note);
+    uint32_t tick = 0;
+    bench.run("pattern_seq_tick", [&]() {
+        pattern_seq.tick(tick++, 0);
+    });
+
+    // MIDI path: a note on and off pushed from loop(), delivered by the next block
+    MidiScheduler scheduler(SAMPLE_RATE, AUDIO_BLOCK_SAMPLES);
+    scheduler.set_event_handler(handle_midi_event);
+    uint32_t now_us = 0;
+    bench.run("midi_scheduler_push_process", [&]() {
+        scheduler.push(0x90, 1, 60, 100, now_us);
+        scheduler.push(0x80, 1, 60, 0, now_us + 100);
+        now_us += 2902;
+        scheduler.process_block(now_us);
+    }, 2);
+
+    // Voice allocation with all voices busy, so every note on steals
+    voice_pool.begin();
+    uint8_t note = 36;
+    bench.run("voice_pool_note_on_off", [&]() {
+        voice_pool.note_on(note, 100);
+        voice_pool.note_off(note - 8 >= 36 ? note - 8 : note + 40);
+        note = note < 84 ? note + 1 : 36;
+    });
+
+    // One audio block of the voice pool with all voices sounding (per sample)
+    voice_pool.all_notes_off();
+    for (int i = 0; i < voice_pool.get_num_voices(); i++) {
+        voice_pool.note_on(48 + 3 * i, 100);
+    }
+    bench.run("voice_pool_block", [&]() {
+        AudioStream::update_all();
+    }, AUDIO_BLOCK_SAMPLES);
+
+    // Profiling report to the output MCU
+    McuFrameWriter writer;
+    uint8_t frame[MCU_MAX_WIRE_FRAME];
+    bench.run("mcu_frame_encode", [&]() {
+        for (int i = 0; i < MCU_MAX_MSGS_PER_FRAME; i++) {
+            writer.add(MSG_STAT, i, i * 10 + (blocks & 7));
+        }
+        blocks++;
+        bench_keep(writer.encode(frame));
+    });
+
+    // Parameter state for the output MCU: one interval of a CC sweep, and an interval without changes
+    ParamSync sync;
+    while (sync.write_frame(params, writer)) writer.encode(frame);
+    bench.run("param_sync_delta", [&]() {
+        params.set_normalized(PARAM_FILTER_CUTOFF, (blocks++ & 127) / 127.0f);
+        while (sync.write_frame(params, writer)) bench_keep(writer.encode(frame));
+    });
+    bench.run("param_sync_idle", [&]() {
+        bench_keep(sync.write_frame(params, writer));
+    });
+
+    return bench.finish();
+}
@@ -0,0 +1,49 @@
+#ifndef _NATIVE_ARDUINO_H
+#define _NATIVE_ARDUINO_H
+
+/*
+ * The parts of the Teensy core the audio_dsp sources use, for native (PC) builds.
+ * Time is the position of the offline renderer, not wall-clock time, see AudioStream.h.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+
+uint32_t micros();
+uint32_t millis();
+
+// Host nanoseconds, so cycle counts measured on the host read as nanoseconds
+uint32_t native_cycle_count();
+#define ARM_DWT_CYCCNT native_cycle_count()
+
+class Print {
+    public:
+    virtual ~Print() {}
+    virtual size_t write(const uint8_t *buf, size_t len) = 0;
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+        char buf[256];
+        va_list args;
+        va_start(args, format);
+        const int len = vsnprintf(buf, sizeof (buf), format, args);
+        va_end(args);
+        return len > 0 ? write((const uint8_t *)buf, len < (int)sizeof (buf) ? len : sizeof (buf) - 1) : 0;
+    }
+    size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+    size_t println(const char *s = "") { return print(s) + print("\n"); }
+};
+
+// Serial goes to stdout
+class NativeSerial : public Print {
+    public:
+    virtual size_t write(const uint8_t *buf, size_t len) { return fwrite(buf, 1, len, stdout); }
+};
+
+extern NativeSerial Serial;
+
+#endif
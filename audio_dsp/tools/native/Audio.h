@@ -0,0 +1,94 @@
+#ifndef _NATIVE_AUDIO_H
+#define _NATIVE_AUDIO_H
+
+#include <AudioStream.h>
+
+/*
+ * Float stand-ins for the stock Audio library objects used by the synth voices.
+ * They follow the behaviour and parameter ranges of the Teensy objects, but are not
+ * bit exact with them: renders are for comparing versions of our own code with each other.
+ */
+
+class AudioMixer4 : public AudioStream {
+    public:
+    AudioMixer4() : AudioStream(4, inputQueueArray) {
+        for (int i = 0; i < 4; i++) multiplier[i] = 1.0f;
+    }
+    virtual void update(void);
+    void gain(unsigned int channel, float gain) {
+        if (channel < 4) multiplier[channel] = gain;
+    }
+
+    private:
+    float multiplier[4];
+    audio_block_t *inputQueueArray[4];
+};
+
+/*
+ * Chamberlin state variable filter, twice oversampled like the Teensy one.
+ * Outputs: 0 = lowpass, 1 = bandpass, 2 = highpass. The control input is not supported.
+ */
+class AudioFilterStateVariable : public AudioStream {
+    public:
+    AudioFilterStateVariable() : AudioStream(2, inputQueueArray) {
+        frequency(1000.0f);
+        resonance(0.707f);
+        low = band = prev_input = 0.0f;
+    }
+    virtual void update(void);
+    void frequency(float freq);
+    void resonance(float q);
+    void octaveControl(float n) { (void)n; }
+
+    private:
+    float fmult;
+    float damp;
+    float low, band, prev_input;
+    audio_block_t *inputQueueArray[2];
+};
+
+/*
+ * Linear DAHDSR envelope with the same defaults and forced release on retrigger as the Teensy one
+ */
+class AudioEffectEnvelope : public AudioStream {
+    public:
+    AudioEffectEnvelope();
+    virtual void update(void);
+    void noteOn();
+    void noteOff();
+    void delay(float ms) { delay_samples = ms_to_samples(ms); }
+    void attack(float ms) { attack_samples = ms_to_samples(ms); }
+    void hold(float ms) { hold_samples = ms_to_samples(ms); }
+    void decay(float ms) { decay_samples = ms_to_samples(ms); }
+    void sustain(float level) { sustain_level = level < 0.0f ? 0.0f : (level > 1.0f ? 1.0f : level); }
+    void release(float ms) { release_samples = ms_to_samples(ms); }
+    using AudioStream::release;
+    void releaseNoteOn(float ms) { forced_samples = ms_to_samples(ms); }
+    bool isActive() const { return state != STATE_IDLE; }
+    bool isSustain() const { return state == STATE_SUSTAIN; }
+
+    private:
+    enum State {
+        STATE_IDLE = 0,
+        STATE_DELAY,
+        STATE_ATTACK,
+        STATE_HOLD,
+        STATE_DECAY,
+        STATE_SUSTAIN,
+        STATE_RELEASE,
+        STATE_FORCED
+    };
+
+    static uint32_t ms_to_samples(float ms);
+    void enter(State next);
+
+    State state;
+    float level;
+    float inc;
+    uint32_t count;
+    uint32_t delay_samples, attack_samples, hold_samples, decay_samples, release_samples, forced_samples;
+    float sustain_level;
+    audio_block_t *inputQueueArray[1];
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef _NATIVE_AUDIO_STREAM_H
+#define _NATIVE_AUDIO_STREAM_H
+
+#include <Arduino.h>
+
+/*
+ * Stand-in for the Teensy Audio library block scheduler (AudioStream.h of the Teensy core),
+ * for rendering the audio_dsp graph on a PC. Same interface and the same rules:
+ * objects update in construction order, blocks are reference counted and come from a
+ * fixed pool set up by AudioMemory(), and an object is only updated once connected
+ * (or when it sets active itself). Instead of the I2S interrupt, the renderer calls
+ * AudioStream::update_all() once per block.
+ */
+
+#define AUDIO_BLOCK_SAMPLES 128
+#define AUDIO_SAMPLE_RATE_EXACT 44117.64706f
+#define AUDIO_SAMPLE_RATE AUDIO_SAMPLE_RATE_EXACT
+
+typedef struct audio_block_struct {
+    uint8_t ref_count;
+    uint8_t reserved1;
+    uint16_t memory_pool_index;
+    int16_t data[AUDIO_BLOCK_SAMPLES];
+} audio_block_t;
+
+class AudioConnection;
+
+class AudioStream {
+    public:
+    AudioStream(unsigned char ninput, audio_block_t **iqueue);
+    virtual ~AudioStream() {}
+    virtual void update(void) = 0;
+
+    float processorUsage() const { return usage; }
+    float processorUsageMax() const { return usage_max; }
+    void processorUsageMaxReset() { usage_max = usage; }
+    bool isActive() const { return active; }
+
+    static void initialize_memory(unsigned int num);
+    static void update_all();              // renders one block
+    static uint64_t get_sample_pos() { return sample_pos; } // samples rendered so far
+
+    static float cpu_usage;
+    static float cpu_usage_max;
+    static uint16_t memory_used;
+    static uint16_t memory_used_max;
+
+    protected:
+    bool active;
+    unsigned char num_inputs;
+    static audio_block_t *allocate(void);
+    static void release(audio_block_t *block);
+    void transmit(audio_block_t *block, unsigned char index = 0);
+    audio_block_t *receiveReadOnly(unsigned int index = 0);
+    audio_block_t *receiveWritable(unsigned int index = 0);
+
+    private:
+    friend class AudioConnection;
+
+    AudioConnection *destination_list;
+    audio_block_t **inputQueue;
+    AudioStream *next_update;
+    float usage;
+    float usage_max;
+
+    static AudioStream *first_update;
+    static audio_block_t *memory_pool;
+    static uint16_t memory_size;
+    static uint16_t *free_list;
+    static uint16_t num_free;
+    static uint64_t sample_pos;
+};
+
+class AudioConnection {
+    public:
+    AudioConnection(AudioStream &source, AudioStream &destination);
+    AudioConnection(AudioStream &source, unsigned char sourceOutput,
+        AudioStream &destination, unsigned char destinationInput);
+
+    private:
+    friend class AudioStream;
+
+    AudioStream &src;
+    AudioStream &dst;
+    unsigned char src_index;
+    unsigned char dest_index;
+    AudioConnection *next_dest;
+};
+
+#define AudioMemory(num) AudioStream::initialize_memory(num)
+#define AudioProcessorUsage() (AudioStream::cpu_usage)
+#define AudioProcessorUsageMax() (AudioStream::cpu_usage_max)
+#define AudioProcessorUsageMaxReset() (AudioStream::cpu_usage_max = AudioStream::cpu_usage)
+#define AudioMemoryUsage() (AudioStream::memory_used)
+#define AudioMemoryUsageMax() (AudioStream::memory_used_max)
+#define AudioMemoryUsageMaxReset() (AudioStream::memory_used_max = AudioStream::memory_used)
+
+// There is no audio interrupt to hold off
+#define AudioNoInterrupts()
+#define AudioInterrupts()
+
+#endif
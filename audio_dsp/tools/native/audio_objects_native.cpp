@@ -0,0 +1,190 @@
+#include <Audio.h>
+
+static inline int16_t saturate16(float x) {
+    return x > 32767.0f ? 32767 : (x < -32768.0f ? -32768 : (int16_t)x);
+}
+
+void AudioMixer4::update(void) {
+    float sum[AUDIO_BLOCK_SAMPLES];
+    bool any = false;
+
+    for (int channel = 0; channel < 4; channel++) {
+        audio_block_t *in = receiveReadOnly(channel);
+        if (!in) continue;
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            sum[i] = (any ? sum[i] : 0.0f) + in->data[i] * multiplier[channel];
+        }
+        any = true;
+        release(in);
+    }
+    if (!any) return;
+
+    audio_block_t *out = allocate();
+    if (!out) return;
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        out->data[i] = saturate16(sum[i]);
+    }
+    transmit(out);
+    release(out);
+}
+
+void AudioFilterStateVariable::frequency(float freq) {
+    if (freq < 20.0f) freq = 20.0f;
+    else if (freq > AUDIO_SAMPLE_RATE_EXACT / 2.5f) freq = AUDIO_SAMPLE_RATE_EXACT / 2.5f;
+    fmult = 2.0f * sinf((float)M_PI * freq / (AUDIO_SAMPLE_RATE_EXACT * 2.0f));
+}
+
+void AudioFilterStateVariable::resonance(float q) {
+    if (q < 0.7f) q = 0.7f;
+    else if (q > 5.0f) q = 5.0f;
+    damp = 1.0f / q;
+}
+
+void AudioFilterStateVariable::update(void) {
+    audio_block_t *in = receiveReadOnly(0);
+    audio_block_t *control = receiveReadOnly(1);
+    if (control) release(control);
+    if (!in) return;
+
+    audio_block_t *lp = allocate();
+    audio_block_t *bp = allocate();
+    audio_block_t *hp = allocate();
+    if (!lp || !bp || !hp) {
+        if (lp) release(lp);
+        if (bp) release(bp);
+        if (hp) release(hp);
+        release(in);
+        return;
+    }
+
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        const float input = in->data[i];
+        float high_sum = 0.0f, low_sum = 0.0f, band_sum = 0.0f;
+
+        // First pass with the input interpolated half way, second pass with the input itself
+        low += fmult * band;
+        float high = (input + prev_input) * 0.5f - low - damp * band;
+        band += fmult * high;
+        low_sum += low; band_sum += band; high_sum += high;
+
+        low += fmult * band;
+        high = input - low - damp * band;
+        band += fmult * high;
+        low_sum += low; band_sum += band; high_sum += high;
+        prev_input = input;
+
+        lp->data[i] = saturate16(low_sum * 0.5f);
+        bp->data[i] = saturate16(band_sum * 0.5f);
+        hp->data[i] = saturate16(high_sum * 0.5f);
+    }
+    release(in);
+    transmit(lp, 0);
+    transmit(bp, 1);
+    transmit(hp, 2);
+    release(lp);
+    release(bp);
+    release(hp);
+}
+
+AudioEffectEnvelope::AudioEffectEnvelope() : AudioStream(1, inputQueueArray) {
+    state = STATE_IDLE;
+    level = inc = 0.0f;
+    count = 0;
+    delay(0.0f);
+    attack(10.5f);
+    hold(2.5f);
+    decay(35.0f);
+    sustain(0.5f);
+    release(300.0f);
+    releaseNoteOn(5.0f);
+}
+
+uint32_t AudioEffectEnvelope::ms_to_samples(float ms) {
+    if (ms < 0.0f) ms = 0.0f;
+    return (uint32_t)(ms * AUDIO_SAMPLE_RATE_EXACT / 1000.0f + 0.5f);
+}
+
+void AudioEffectEnvelope::enter(State next) {
+    state = next;
+    switch (next) {
+    case STATE_DELAY:
+        count = delay_samples;
+        inc = 0.0f;
+        break;
+    case STATE_ATTACK:
+        count = attack_samples ? attack_samples : 1;
+        inc = (1.0f - level) / count;
+        break;
+    case STATE_HOLD:
+        level = 1.0f;
+        count = hold_samples;
+        inc = 0.0f;
+        break;
+    case STATE_DECAY:
+        count = decay_samples ? decay_samples : 1;
+        inc = (sustain_level - level) / count;
+        break;
+    case STATE_SUSTAIN:
+        level = sustain_level;
+        inc = 0.0f;
+        break;
+    case STATE_RELEASE:
+        count = release_samples ? release_samples : 1;
+        inc = -level / count;
+        break;
+    case STATE_FORCED:
+        count = forced_samples ? forced_samples : 1;
+        inc = -level / count;
+        break;
+    case STATE_IDLE:
+        level = 0.0f;
+        inc = 0.0f;
+        break;
+    }
+}
+
+void AudioEffectEnvelope::noteOn() {
+    if (state == STATE_IDLE || state == STATE_DELAY || forced_samples == 0) {
+        level = 0.0f;
+        enter(delay_samples ? STATE_DELAY : STATE_ATTACK);
+    } else if (state != STATE_FORCED) {
+        enter(STATE_FORCED);
+    }
+}
+
+void AudioEffectEnvelope::noteOff() {
+    if (state != STATE_IDLE && state != STATE_FORCED) enter(STATE_RELEASE);
+}
+
+void AudioEffectEnvelope::update(void) {
+    audio_block_t *block = receiveWritable(0);
+    if (!block) return;
+    if (state == STATE_IDLE) {
+        release(block);
+        return;
+    }
+
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+        if (state != STATE_SUSTAIN && state != STATE_IDLE && count == 0) {
+            switch (state) {
+            case STATE_DELAY: enter(STATE_ATTACK); break;
+            case STATE_ATTACK: enter(hold_samples ? STATE_HOLD : STATE_DECAY); break;
+            case STATE_HOLD: enter(STATE_DECAY); break;
+            case STATE_DECAY: enter(STATE_SUSTAIN); break;
+            case STATE_RELEASE: enter(STATE_IDLE); break;
+            case STATE_FORCED: // retrigger after the quick fade out
+                level = 0.0f;
+                enter(delay_samples ? STATE_DELAY : STATE_ATTACK);
+                break;
+            default: break;
+            }
+        }
+        if (state != STATE_SUSTAIN && state != STATE_IDLE) {
+            level += inc;
+            count--;
+        }
+        block->data[i] = saturate16(block->data[i] * level);
+    }
+    transmit(block);
+    release(block);
+}
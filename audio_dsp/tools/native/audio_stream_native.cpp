@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <time.h>
+#include <AudioStream.h>
+
+NativeSerial Serial;
+
+AudioStream *AudioStream::first_update = NULL;
+audio_block_t *AudioStream::memory_pool = NULL;
+uint16_t AudioStream::memory_size = 0;
+uint16_t *AudioStream::free_list = NULL;
+uint16_t AudioStream::num_free = 0;
+uint64_t AudioStream::sample_pos = 0;
+float AudioStream::cpu_usage = 0.0f;
+float AudioStream::cpu_usage_max = 0.0f;
+uint16_t AudioStream::memory_used = 0;
+uint16_t AudioStream::memory_used_max = 0;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint32_t micros() {
+    return (uint32_t)(AudioStream::get_sample_pos() * 1000000.0 / AUDIO_SAMPLE_RATE_EXACT);
+}
+
+uint32_t millis() {
+    return micros() / 1000;
+}
+
+uint32_t native_cycle_count() {
+    return (uint32_t)now_ns();
+}
+
+AudioStream::AudioStream(unsigned char ninput, audio_block_t **iqueue) {
+    active = false;
+    num_inputs = ninput;
+    inputQueue = iqueue;
+    for (int i = 0; i < num_inputs; i++) {
+        inputQueue[i] = NULL;
+    }
+    destination_list = NULL;
+    usage = usage_max = 0.0f;
+
+    // Updates run in construction order
+    next_update = NULL;
+    if (!first_update) {
+        first_update = this;
+    } else {
+        AudioStream *p = first_update;
+        while (p->next_update) p = p->next_update;
+        p->next_update = this;
+    }
+}
+
+void AudioStream::initialize_memory(unsigned int num) {
+    free(memory_pool);
+    free(free_list);
+    memory_pool = (audio_block_t *)calloc(num, sizeof (audio_block_t));
+    free_list = (uint16_t *)malloc(num * sizeof (uint16_t));
+    memory_size = num;
+    num_free = num;
+    for (unsigned int i = 0; i < num; i++) {
+        memory_pool[i].memory_pool_index = i;
+        free_list[i] = num - 1 - i;
+    }
+    memory_used = memory_used_max = 0;
+}
+
+audio_block_t *AudioStream::allocate(void) {
+    if (num_free == 0) return NULL;
+    audio_block_t *block = &memory_pool[free_list[--num_free]];
+    block->ref_count = 1;
+    memory_used = memory_size - num_free;
+    if (memory_used > memory_used_max) memory_used_max = memory_used;
+    return block;
+}
+
+void AudioStream::release(audio_block_t *block) {
+    if (--block->ref_count == 0) {
+        free_list[num_free++] = block->memory_pool_index;
+        memory_used = memory_size - num_free;
+    }
+}
+
+void AudioStream::transmit(audio_block_t *block, unsigned char index) {
+    for (AudioConnection *c = destination_list; c; c = c->next_dest) {
+        if (c->src_index != index) continue;
+        if (c->dst.inputQueue[c->dest_index] == NULL) {
+            c->dst.inputQueue[c->dest_index] = block;
+            block->ref_count++;
+        }
+    }
+}
+
+audio_block_t *AudioStream::receiveReadOnly(unsigned int index) {
+    if (index >= num_inputs) return NULL;
+    audio_block_t *in = inputQueue[index];
+    inputQueue[index] = NULL;
+    return in;
+}
+
+audio_block_t *AudioStream::receiveWritable(unsigned int index) {
+    audio_block_t *in = receiveReadOnly(index);
+    if (in && in->ref_count > 1) {
+        audio_block_t *p = allocate();
+        if (p) memcpy(p->data, in->data, sizeof (p->data));
+        in->ref_count--;
+        in = p;
+    }
+    return in;
+}
+
+/*
+ * Usage is measured in host time against the duration of a block, like the Teensy measures
+ * CPU cycles against it, so the figures say how far from real time the host is.
+ */
+void AudioStream::update_all() {
+    const double block_ns = AUDIO_BLOCK_SAMPLES * 1e9 / AUDIO_SAMPLE_RATE_EXACT;
+    const uint64_t total_start = now_ns();
+
+    for (AudioStream *p = first_update; p; p = p->next_update) {
+        if (!p->active) continue;
+        const uint64_t start = now_ns();
+        p->update();
+        p->usage = (float)((now_ns() - start) * 100.0 / block_ns);
+        if (p->usage > p->usage_max) p->usage_max = p->usage;
+    }
+
+    cpu_usage = (float)((now_ns() - total_start) * 100.0 / block_ns);
+    if (cpu_usage > cpu_usage_max) cpu_usage_max = cpu_usage;
+    sample_pos += AUDIO_BLOCK_SAMPLES;
+}
+
+AudioConnection::AudioConnection(AudioStream &source, AudioStream &destination) :
+    AudioConnection(source, 0, destination, 0) {
+}
+
+AudioConnection::AudioConnection(AudioStream &source, unsigned char sourceOutput,
+    AudioStream &destination, unsigned char destinationInput) :
+    src(source), dst(destination), src_index(sourceOutput), dest_index(destinationInput) {
+    next_dest = NULL;
+    if (!src.destination_list) {
+        src.destination_list = this;
+    } else {
+        AudioConnection *p = src.destination_list;
+        while (p->next_dest) p = p->next_dest;
+        p->next_dest = this;
+    }
+    src.active = true;
+    dst.active = true;
+}
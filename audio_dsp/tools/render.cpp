@@ -0,0 +1,515 @@
+/*
+ * Renders the audio_dsp synth offline to a WAV file, on a PC and faster than real time.
+ *
+ * Build on a PC: pio run -e native (program in .pio/build/native/program), or
+ *   g++ -O2 -std=gnu++14 -Itools/native -Iinclude -I../common -o render tools/render.cpp tools/native/audio_*.cpp \
+ *     src/voice_pool.cpp src/audio_voice_pool.cpp src/wavetable_osc.cpp src/seq_clock.cpp src/midi_scheduler.cpp \
+ *     src/param_store.cpp src/mod_matrix.cpp src/param_engine.cpp src/ops_player.cpp src/audio_profiler.cpp
+ * Usage: render [-p patch] [-m song.mid | -s sequence] [-o sample.ops] [-t bpm] [-l seconds]
+ *               [-g golden.wav] [-e max_diff] out.wav
+ *
+ * The voices, parameter engine, MIDI scheduler and sequencer clock are the firmware's own code,
+ * running on a stand-in for the Audio library block scheduler (tools/native). Events go through
+ * the MidiScheduler exactly like USB MIDI does on the Teensy, so timing is rendered as played.
+ *
+ * Patch: text lines "<param> <value>" (names from param_desc.h, e.g. "filter_cutoff 800"),
+ *        and "mod <slot> <lfo1|lfo2|env|wheel> <param> <depth>"; # starts a comment.
+ * Sequence: text lines "note <beat> <channel> <note> <velocity> <length in beats>"
+ *        and "cc <beat> <channel> <control> <value>", at the tempo of -t.
+ * Without -m or -s a built-in arpeggio is played by the sequencer clock.
+ * Channel 11 plays the slices of the -o sample, like on the device.
+ *
+ * The render speed is reported as real-time factor (audio seconds per second of CPU time).
+ * With -g the output is compared sample by sample against a golden WAV; the exit code is 1
+ * if the lengths differ or any sample differs by more than max_diff (default 0).
+ * test/test_render runs such a comparison through render_main(), which renders once per process.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+#include <Audio.h>
+#include <audio_seq_clock.h>
+#include <audio_midi_scheduler.h>
+#include <audio_param_engine.h>
+#include <audio_voice_pool.h>
+#include <audio_play_ops.h>
+#include <audio_profiler.h>
+
+#define MOD_WHEEL_CC 1
+#define SLICER_MIDI_CHANNEL 11
+#define SLICER_FIRST_NOTE 36
+#define TAIL_SECONDS 2.0
+#define AUDIO_MEMORY_BLOCKS 512
+
+/*
+ * Collects everything it receives
+ */
+class AudioCapture : public AudioStream {
+    public:
+    AudioCapture() : AudioStream(1, inputQueueArray) {}
+
+    virtual void update(void) {
+        audio_block_t *block = receiveReadOnly(0);
+        if (block) {
+            samples.insert(samples.end(), block->data, block->data + AUDIO_BLOCK_SAMPLES);
+            release(block);
+        } else {
+            samples.insert(samples.end(), AUDIO_BLOCK_SAMPLES, 0);
+        }
+    }
+
+    std::vector<int16_t> samples;
+
+    private:
+    audio_block_t *inputQueueArray[1];
+};
+
+// Same order as in main.cpp, so the objects update in the same order as on the device
+AudioSeqClock seq_clock;
+AudioMidiScheduler midi_in;
+ParamStore params;
+ModMatrix mod_matrix;
+AudioParamEngine param_engine(params, mod_matrix);
+AudioVoicePool voice_pool;
+AudioPlayOps ops_player;
+AudioMixer4 mixer;
+AudioParamGain out_gain(param_engine, PARAM_VOLUME);
+AudioCapture capture;
+AudioConnection cord1(voice_pool.output(), 0, mixer, 0);
+AudioConnection cord2(ops_player, 0, mixer, 3);
+AudioConnection cord3(mixer, 0, out_gain, 0);
+AudioConnection cord4(out_gain, 0, capture, 0);
+AudioProfiler profiler;
+
+const OpsHeader *ops_sample = NULL;
+
+struct TimedEvent {
+    double time_us;
+    uint8_t type, channel, data1, data2;
+
+    bool operator<(const TimedEvent &other) const { return time_us < other.time_us; }
+};
+
+static int fail(const char *msg, const char *arg = "") {
+    fprintf(stderr, "render: %s%s\n", msg, arg);
+    return 2;
+}
+
+static bool read_file(const char *path, std::vector<uint8_t> &data) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    fseek(f, 0, SEEK_END);
+    data.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    const bool ok = fread(data.data(), 1, data.size(), f) == data.size();
+    fclose(f);
+    return ok;
+}
+
+static uint32_t le32(const uint8_t *b) {
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static uint16_t le16(const uint8_t *b) {
+    return b[0] | (b[1] << 8);
+}
+
+static uint32_t be32(const uint8_t *b) {
+    return ((uint32_t)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+static uint16_t be16(const uint8_t *b) {
+    return (b[0] << 8) | b[1];
+}
+
+// Called by the param engine from the audio block update
+static void apply_param(uint8_t id, float value) {
+    voice_pool.apply_param(param_engine, id, value);
+}
+
+static void play_midi_event(const MidiEvent &e, uint16_t offset) {
+    const bool note_on = e.type == MIDI_EVENT_NOTE_ON && e.data2 > 0;
+
+    if (e.type == MIDI_EVENT_CONTROL) {
+        if (e.data1 == MOD_WHEEL_CC) {
+            mod_matrix.set_wheel(e.data2 / 127.0f);
+        } else {
+            const int id = param_for_cc(e.data1);
+            if (id >= 0) params.set_normalized(id, e.data2 / 127.0f);
+        }
+    } else if (e.channel == SLICER_MIDI_CHANNEL) {
+        if (note_on && ops_sample && e.data1 >= SLICER_FIRST_NOTE) {
+            ops_player.play(ops_sample, e.data1 - SLICER_FIRST_NOTE, e.data2 / 127.0f, offset);
+        }
+    } else if (note_on) {
+        voice_pool.note_on(e.data1, e.data2);
+        mod_matrix.trigger_envelope();
+    } else {
+        voice_pool.note_off(e.data1);
+    }
+}
+
+// Built-in sequence: a two bar arpeggio in 16ths, played by the sequencer clock
+static void on_seq_tick(uint32_t tick, uint16_t offset) {
+    static const uint8_t notes[] = {45, 52, 57, 60, 64, 60, 57, 52, 43, 50, 55, 59, 62, 59, 55, 50};
+    if (tick % SeqClock::TICKS_PER_16TH != 0) return;
+
+    const uint32_t step = tick / SeqClock::TICKS_PER_16TH;
+    const uint8_t note = notes[step % sizeof (notes)];
+    if (step > 0) voice_pool.note_off(notes[(step - 1) % sizeof (notes)]);
+    voice_pool.note_on(note, step % 4 == 0 ? 120 : 90);
+    mod_matrix.trigger_envelope();
+}
+
+static const char *mod_source_names[NUM_MOD_SOURCES] = {"lfo1", "lfo2", "env", "wheel"};
+
+static bool load_patch(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof (line), f)) {
+        line_no++;
+        char *comment = strchr(line, '#');
+        if (comment) *comment = 0;
+
+        char name[64], source[16], dest[64];
+        int slot;
+        float value;
+        if (sscanf(line, " mod %d %15s %63s %f", &slot, source, dest, &value) == 4) {
+            int s = 0;
+            while (s < NUM_MOD_SOURCES && strcmp(mod_source_names[s], source) != 0) s++;
+            const int id = param_for_name(dest);
+            if (s < NUM_MOD_SOURCES && id >= 0) {
+                mod_matrix.set_slot(slot, s, id, value);
+                continue;
+            }
+        } else if (sscanf(line, " %63s %f", name, &value) == 2) {
+            const int id = param_for_name(name);
+            if (id >= 0) {
+                params.set(id, value);
+                continue;
+            }
+        } else if (sscanf(line, " %63s", name) != 1) {
+            continue; // empty line
+        }
+        fprintf(stderr, "render: %s:%d: not understood\n", path, line_no);
+    }
+    fclose(f);
+    return true;
+}
+
+static bool load_sequence(const char *path, double bpm, std::vector<TimedEvent> &events) {
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+
+    const double us_per_beat = 60000000.0 / bpm;
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof (line), f)) {
+        line_no++;
+        char *comment = strchr(line, '#');
+        if (comment) *comment = 0;
+
+        double beat, length;
+        int channel, a, b;
+        if (sscanf(line, " note %lf %d %d %d %lf", &beat, &channel, &a, &b, &length) == 5) {
+            const TimedEvent on = {beat * us_per_beat, MIDI_EVENT_NOTE_ON, (uint8_t)channel, (uint8_t)a, (uint8_t)b};
+            const TimedEvent off = {(beat + length) * us_per_beat, MIDI_EVENT_NOTE_OFF, (uint8_t)channel, (uint8_t)a, 0};
+            events.push_back(on);
+            events.push_back(off);
+        } else if (sscanf(line, " cc %lf %d %d %d", &beat, &channel, &a, &b) == 4) {
+            const TimedEvent cc = {beat * us_per_beat, MIDI_EVENT_CONTROL, (uint8_t)channel, (uint8_t)a, (uint8_t)b};
+            events.push_back(cc);
+        } else {
+            char word[8];
+            if (sscanf(line, " %7s", word) == 1) fprintf(stderr, "render: %s:%d: not understood\n", path, line_no);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+static uint32_t read_varlen(const uint8_t *&p, const uint8_t *end) {
+    uint32_t value = 0;
+    while (p < end) {
+        const uint8_t b = *p++;
+        value = (value << 7) | (b & 0x7f);
+        if (!(b & 0x80)) break;
+    }
+    return value;
+}
+
+/*
+ * Standard MIDI file, format 0 or 1: notes and controllers of all tracks, timed by the tempo map
+ */
+static bool load_midi_file(const char *path, std::vector<TimedEvent> &events) {
+    std::vector<uint8_t> data;
+    if (!read_file(path, data) || data.size() < 14 || memcmp(data.data(), "MThd", 4) != 0) return false;
+
+    const uint16_t num_tracks = be16(&data[10]);
+    const uint16_t division = be16(&data[12]);
+    if (division & 0x8000) return false; // SMPTE timing
+
+    struct TickEvent {
+        uint32_t tick;
+        uint32_t tempo; // us per quarter note for tempo changes, 0 otherwise
+        TimedEvent event;
+    };
+    std::vector<TickEvent> tick_events;
+
+    size_t pos = 8 + be32(&data[4]);
+    for (int t = 0; t < num_tracks && pos + 8 <= data.size(); t++) {
+        const uint32_t len = be32(&data[pos + 4]);
+        const bool is_track = memcmp(&data[pos], "MTrk", 4) == 0;
+        const uint8_t *p = &data[pos + 8];
+        const uint8_t *end = pos + 8 + len <= data.size() ? p + len : data.data() + data.size();
+        pos += 8 + len;
+        if (!is_track) continue;
+
+        uint32_t tick = 0;
+        uint8_t status = 0;
+        while (p < end) {
+            tick += read_varlen(p, end);
+            if (p >= end) break;
+            if (*p & 0x80) status = *p++;
+
+            if (status == 0xff) {
+                const uint8_t type = p < end ? *p++ : 0;
+                const uint32_t n = read_varlen(p, end);
+                if (type == 0x51 && n == 3 && p + 3 <= end) {
+                    const TickEvent e = {tick, (uint32_t)((p[0] << 16) | (p[1] << 8) | p[2]), {}};
+                    tick_events.push_back(e);
+                }
+                p += n;
+                status = 0; // meta events cancel running status
+            } else if (status == 0xf0 || status == 0xf7) {
+                p += read_varlen(p, end);
+                status = 0;
+            } else if (status >= 0x80) {
+                const uint8_t kind = status & 0xf0;
+                const int num_data = kind == 0xc0 || kind == 0xd0 ? 1 : 2;
+                if (p + num_data > end) break;
+                const uint8_t a = p[0], b = num_data > 1 ? p[1] : 0;
+                p += num_data;
+
+                TickEvent e = {tick, 0, {0, 0, (uint8_t)((status & 0x0f) + 1), a, b}};
+                if (kind == 0x90) e.event.type = MIDI_EVENT_NOTE_ON;
+                else if (kind == 0x80) e.event.type = MIDI_EVENT_NOTE_OFF;
+                else if (kind == 0xb0) e.event.type = MIDI_EVENT_CONTROL;
+                else continue;
+                tick_events.push_back(e);
+            } else {
+                break; // data byte without status
+            }
+        }
+    }
+
+    std::stable_sort(tick_events.begin(), tick_events.end(),
+        [](const TickEvent &a, const TickEvent &b) { return a.tick < b.tick; });
+
+    uint32_t tempo = 500000, last_tick = 0;
+    double time_us = 0.0;
+    for (const TickEvent &e : tick_events) {
+        time_us += (double)(e.tick - last_tick) * tempo / division;
+        last_tick = e.tick;
+        if (e.tempo) {
+            tempo = e.tempo;
+        } else {
+            TimedEvent timed = e.event;
+            timed.time_us = time_us;
+            events.push_back(timed);
+        }
+    }
+    return true;
+}
+
+static bool write_wav(const char *path, const std::vector<int16_t> &samples) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+
+    const uint32_t rate = (uint32_t)(AUDIO_SAMPLE_RATE_EXACT + 0.5f);
+    const uint32_t data_size = samples.size() * 2;
+    uint8_t h[44];
+    const uint32_t riff_size = 36 + data_size;
+    memcpy(h, "RIFF", 4);
+    memcpy(h + 4, &riff_size, 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    const uint32_t fmt_size = 16, byte_rate = rate * 2;
+    const uint16_t format = 1, channels = 1, block_align = 2, bits = 16;
+    memcpy(h + 16, &fmt_size, 4);
+    memcpy(h + 20, &format, 2);
+    memcpy(h + 22, &channels, 2);
+    memcpy(h + 24, &rate, 4);
+    memcpy(h + 28, &byte_rate, 4);
+    memcpy(h + 32, &block_align, 2);
+    memcpy(h + 34, &bits, 2);
+    memcpy(h + 36, "data", 4);
+    memcpy(h + 40, &data_size, 4);
+
+    const bool ok = fwrite(h, 1, sizeof (h), f) == sizeof (h)
+        && fwrite(samples.data(), 2, samples.size(), f) == samples.size();
+    fclose(f);
+    return ok;
+}
+
+// 16 bit mono PCM only, which is what write_wav() produces
+static bool read_wav(const char *path, std::vector<int16_t> &samples) {
+    std::vector<uint8_t> data;
+    if (!read_file(path, data) || data.size() < 12 || memcmp(&data[0], "RIFF", 4) != 0) return false;
+
+    bool format_ok = false;
+    for (size_t pos = 12; pos + 8 <= data.size();) {
+        const uint32_t size = le32(&data[pos + 4]);
+        const uint8_t *chunk = &data[pos + 8];
+        if (pos + 8 + size > data.size()) return false;
+        if (memcmp(&data[pos], "fmt ", 4) == 0 && size >= 16) {
+            format_ok = le16(chunk) == 1 && le16(chunk + 2) == 1 && le16(chunk + 14) == 16;
+        } else if (memcmp(&data[pos], "data", 4) == 0 && format_ok) {
+            samples.resize(size / 2);
+            for (size_t i = 0; i < samples.size(); i++) {
+                samples[i] = (int16_t)le16(chunk + 2 * i);
+            }
+            return true;
+        }
+        pos += 8 + size + (size & 1);
+    }
+    return false;
+}
+
+static int compare_golden(const char *path, const std::vector<int16_t> &samples, int max_diff) {
+    std::vector<int16_t> golden;
+    if (!read_wav(path, golden)) return fail("cannot read golden file ", path);
+
+    const size_t n = std::min(golden.size(), samples.size());
+    int worst = 0;
+    size_t worst_pos = 0, num_diff = 0;
+    double sum_sq = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        const int d = abs(samples[i] - golden[i]);
+        if (d > 0) num_diff++;
+        if (d > worst) {
+            worst = d;
+            worst_pos = i;
+        }
+        sum_sq += (double)d * d;
+    }
+    const double rms_db = n > 0 && sum_sq > 0.0 ? 20.0 * log10(sqrt(sum_sq / n) / 32768.0) : -INFINITY;
+
+    const bool ok = golden.size() == samples.size() && worst <= max_diff;
+    printf("golden %s: %s, %zu of %zu samples differ, max %d at %.3f s (allowed %d), difference %.1f dBFS rms\n",
+        path, ok ? "match" : "MISMATCH", num_diff, n, worst, worst_pos / AUDIO_SAMPLE_RATE_EXACT, max_diff, rms_db);
+    if (golden.size() != samples.size()) {
+        printf("length %zu samples, golden %zu\n", samples.size(), golden.size());
+    }
+    return ok ? 0 : 1;
+}
+
+int render_main(int argc, char **argv) {
+    const char *patch_path = NULL, *midi_path = NULL, *seq_path = NULL, *ops_path = NULL, *golden_path = NULL;
+    double bpm = 120.0, seconds = 0.0;
+    int max_diff = 0;
+
+    int i = 1;
+    for (; i < argc - 1 && argv[i][0] == '-'; i += 2) {
+        const char *arg = argv[i + 1];
+        switch (argv[i][1]) {
+        case 'p': patch_path = arg; break;
+        case 'm': midi_path = arg; break;
+        case 's': seq_path = arg; break;
+        case 'o': ops_path = arg; break;
+        case 't': bpm = atof(arg); break;
+        case 'l': seconds = atof(arg); break;
+        case 'g': golden_path = arg; break;
+        case 'e': max_diff = atoi(arg); break;
+        default: return fail("unknown option ", argv[i]);
+        }
+    }
+    if (i != argc - 1) {
+        fprintf(stderr, "usage: render [-p patch] [-m song.mid | -s sequence] [-o sample.ops] [-t bpm] [-l seconds] "
+            "[-g golden.wav] [-e max_diff] out.wav\n");
+        return 2;
+    }
+    const char *out_path = argv[i];
+
+    AudioMemory(AUDIO_MEMORY_BLOCKS);
+    voice_pool.begin();
+    voice_pool.set_steal_mode(VoicePool::STEAL_QUIETEST);
+    mixer.gain(0, 0.6f);
+    mixer.gain(3, 0.8f);
+    mod_matrix.set_slot(0, MOD_ENV, PARAM_FILTER_CUTOFF, 0.2f); // default patch of main.cpp
+    mod_matrix.set_slot(1, MOD_WHEEL, PARAM_FILTER_CUTOFF, 0.4f);
+    param_engine.set_handler(apply_param);
+    midi_in.set_event_handler(play_midi_event);
+    if (patch_path && !load_patch(patch_path)) return fail("cannot read patch ", patch_path);
+
+    std::vector<uint8_t> ops_data;
+    if (ops_path) {
+        if (!read_file(ops_path, ops_data)) return fail("cannot read ", ops_path);
+        ops_sample = ops_validate(ops_data.data(), ops_data.size());
+        if (!ops_sample) return fail("not an OPS sample: ", ops_path);
+    }
+
+    std::vector<TimedEvent> events;
+    if (midi_path && !load_midi_file(midi_path, events)) return fail("cannot read MIDI file ", midi_path);
+    if (seq_path && !load_sequence(seq_path, bpm, events)) return fail("cannot read sequence ", seq_path);
+    std::stable_sort(events.begin(), events.end());
+
+    if (!midi_path && !seq_path) {
+        seq_clock.set_tick_handler(on_seq_tick);
+        seq_clock.set_tempo(bpm);
+        seq_clock.start();
+        if (seconds <= 0.0) seconds = 8.0;
+    } else if (seconds <= 0.0) {
+        seconds = (events.empty() ? 0.0 : events.back().time_us / 1000000.0) + TAIL_SECONDS;
+    }
+
+    profiler.add_node(seq_clock, "seq clock", STAT_GROUP_CLOCK);
+    profiler.add_node(midi_in, "midi in", STAT_GROUP_CLOCK);
+    profiler.add_node(param_engine, "params", STAT_GROUP_CLOCK);
+    voice_pool.add_to_profiler(profiler, STAT_GROUP_VOICES);
+    profiler.add_node(ops_player, "ops player", STAT_GROUP_SLICER);
+    profiler.add_node(mixer, "mixer", STAT_GROUP_OUTPUT);
+    profiler.add_node(out_gain, "volume", STAT_GROUP_OUTPUT);
+
+    // Events are handed to the scheduler during the block before the one they fall into,
+    // like loop() does between two audio interrupts on the device
+    const uint64_t num_blocks = (uint64_t)(seconds * AUDIO_SAMPLE_RATE_EXACT / AUDIO_BLOCK_SAMPLES) + 1;
+    const double block_us = AUDIO_BLOCK_SAMPLES * 1000000.0 / AUDIO_SAMPLE_RATE_EXACT;
+    size_t next_event = 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+    for (uint64_t block = 0; block < num_blocks; block++) {
+        const double block_start_us = block * block_us;
+        while (next_event < events.size() && events[next_event].time_us < block_start_us) {
+            const TimedEvent &e = events[next_event++];
+            midi_in.push(e.type, e.channel, e.data1, e.data2, (uint32_t)e.time_us);
+        }
+        AudioStream::update_all();
+    }
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+
+    const double cpu_s = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    const double audio_s = capture.samples.size() / AUDIO_SAMPLE_RATE_EXACT;
+    printf("rendered %.2f s in %.3f s CPU: %.1fx real time, %zu events (%lu late, %lu dropped), peak %d audio blocks\n",
+        audio_s, cpu_s, cpu_s > 0.0 ? audio_s / cpu_s : 0.0, events.size(),
+        (unsigned long)midi_in.get_late(), (unsigned long)midi_in.get_dropped(),
+        AudioMemoryUsageMax());
+    profiler.print_nodes(Serial);
+
+    if (!write_wav(out_path, capture.samples)) return fail("cannot write ", out_path);
+    return golden_path ? compare_golden(golden_path, capture.samples, max_diff) : 0;
+}
+
+// The unit tests bring their own main()
+#ifndef UNIT_TEST
+int main(int argc, char **argv) {
+    return render_main(argc, argv);
+}
+#endif
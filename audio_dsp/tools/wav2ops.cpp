@@ -0,0 +1,171 @@
+/*
+ * Converts a WAV file into the OPS sample format (include/sample_format.h).
+ *
+ * Build on a PC: g++ -O2 -I../include -o wav2ops wav2ops.cpp
+ * Usage: wav2ops [-r root_note] [-s num_slices] [-l loop_start:loop_end] [-c array_name] in.wav out
+ *
+ * PCM with 8, 16 or 24 bits is converted to 16 bit, stereo is mixed down to mono.
+ * Loop points and root note are taken from a "smpl" chunk and slices from a "cue " chunk if the
+ * file has them, the options override them. -s cuts the sample into equal slices.
+ * With -c the output is a C header with the sample as a const array in program flash,
+ * which the Teensy can play directly because its flash is memory-mapped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <sample_format.h>
+
+static uint32_t le32(const uint8_t *b) {
+    return b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static uint16_t le16(const uint8_t *b) {
+    return b[0] | (b[1] << 8);
+}
+
+static bool read_file(const char *path, std::vector<uint8_t> &data) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    fseek(f, 0, SEEK_END);
+    data.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    const bool ok = fread(data.data(), 1, data.size(), f) == data.size();
+    fclose(f);
+    return ok;
+}
+
+static int fail(const char *msg) {
+    fprintf(stderr, "wav2ops: %s\n", msg);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    int root_note = -1;
+    int num_slices = 0;
+    long loop_start = -1, loop_end = -1;
+    const char *array_name = NULL;
+
+    int arg = 1;
+    for (; arg < argc - 2; arg++) {
+        if (!strcmp(argv[arg], "-r")) root_note = atoi(argv[++arg]);
+        else if (!strcmp(argv[arg], "-s")) num_slices = atoi(argv[++arg]);
+        else if (!strcmp(argv[arg], "-l")) sscanf(argv[++arg], "%ld:%ld", &loop_start, &loop_end);
+        else if (!strcmp(argv[arg], "-c")) array_name = argv[++arg];
+        else break;
+    }
+    if (arg != argc - 2) {
+        fprintf(stderr, "usage: wav2ops [-r root_note] [-s num_slices] [-l loop_start:loop_end] [-c array_name] in.wav out\n");
+        return 1;
+    }
+
+    std::vector<uint8_t> wav;
+    if (!read_file(argv[arg], wav)) return fail("cannot read input");
+    if (wav.size() < 12 || memcmp(&wav[0], "RIFF", 4) || memcmp(&wav[8], "WAVE", 4)) return fail("not a WAV file");
+
+    OpsHeader h;
+    memset(&h, 0, sizeof (h));
+    memcpy(h.magic, OPS_MAGIC, 4);
+    h.version = OPS_VERSION;
+    h.header_size = sizeof (OpsHeader);
+    h.root_note = 60;
+
+    int channels = 0, bits = 0;
+    const uint8_t *pcm = NULL;
+    uint32_t pcm_len = 0;
+    std::vector<uint32_t> cues;
+
+    for (size_t pos = 12; pos + 8 <= wav.size();) {
+        const uint8_t *c = &wav[pos];
+        const uint32_t len = le32(c + 4);
+        const uint8_t *d = c + 8;
+        if (pos + 8 + len > wav.size()) return fail("truncated chunk");
+
+        if (!memcmp(c, "fmt ", 4) && len >= 16) {
+            const uint16_t format = le16(d);
+            if (format != 1 && format != 0xfffe) return fail("only PCM is supported");
+            channels = le16(d + 2);
+            h.sample_rate = le32(d + 4);
+            bits = le16(d + 14);
+        } else if (!memcmp(c, "data", 4)) {
+            pcm = d;
+            pcm_len = len;
+        } else if (!memcmp(c, "smpl", 4) && len >= 36) {
+            h.root_note = le32(d + 12);
+            if (le32(d + 28) > 0 && len >= 60) {
+                h.flags |= OPS_FLAG_LOOP;
+                h.loop_start = le32(d + 36 + 8);
+                h.loop_end = le32(d + 36 + 12) + 1; // smpl loop ends are inclusive
+            }
+        } else if (!memcmp(c, "cue ", 4) && len >= 4) {
+            const uint32_t n = le32(d);
+            for (uint32_t i = 0; i < n && 4 + 24 * (i + 1) <= len; i++) {
+                cues.push_back(le32(d + 4 + 24 * i + 20));
+            }
+        }
+        pos += 8 + len + (len & 1);
+    }
+
+    if (!pcm || channels < 1 || channels > 2) return fail("no mono or stereo PCM data");
+    if (bits != 8 && bits != 16 && bits != 24) return fail("only 8, 16 and 24 bit PCM are supported");
+
+    const int frame_size = channels * bits / 8;
+    h.length = pcm_len / frame_size;
+    std::vector<int16_t> samples(h.length);
+    for (uint32_t i = 0; i < h.length; i++) {
+        int32_t sum = 0;
+        for (int ch = 0; ch < channels; ch++) {
+            const uint8_t *s = pcm + i * frame_size + ch * bits / 8;
+            if (bits == 8) sum += (s[0] - 128) << 8;
+            else if (bits == 16) sum += (int16_t)le16(s);
+            else sum += (int16_t)le16(s + 1); // top 16 of 24 bits
+        }
+        samples[i] = sum / channels;
+    }
+
+    if (root_note >= 0) h.root_note = root_note;
+    if (loop_start >= 0 && loop_end > loop_start) {
+        h.flags |= OPS_FLAG_LOOP;
+        h.loop_start = loop_start;
+        h.loop_end = loop_end;
+    }
+    if (h.loop_end > h.length) h.loop_end = h.length;
+    if (h.loop_start > h.loop_end) h.loop_start = h.loop_end;
+
+    if (num_slices > 0) {
+        cues.clear();
+        for (int i = 0; i < num_slices; i++) {
+            cues.push_back((uint64_t)h.length * i / num_slices);
+        }
+    }
+    for (size_t i = 0; i < cues.size() && h.num_slices < OPS_MAX_SLICES; i++) {
+        if (cues[i] < h.length && (h.num_slices == 0 || cues[i] > h.slices[h.num_slices - 1])) {
+            h.slices[h.num_slices++] = cues[i];
+        }
+    }
+
+    std::vector<uint8_t> out(sizeof (h) + samples.size() * 2);
+    memcpy(out.data(), &h, sizeof (h));
+    memcpy(out.data() + sizeof (h), samples.data(), samples.size() * 2);
+    if (!ops_validate(out.data(), out.size())) return fail("internal error, output does not validate");
+
+    FILE *f = fopen(argv[arg + 1], array_name ? "w" : "wb");
+    if (!f) return fail("cannot write output");
+    if (array_name) {
+        fprintf(f, "// Generated by wav2ops from %s\n#include <Arduino.h>\n\n", argv[arg]);
+        fprintf(f, "const uint32_t %s_size = %u;\n", array_name, (unsigned)out.size());
+        fprintf(f, "PROGMEM __attribute__((aligned(4))) const uint8_t %s[] = {", array_name);
+        for (size_t i = 0; i < out.size(); i++) {
+            fprintf(f, "%s0x%02x,", i % 16 ? " " : "\n    ", out[i]);
+        }
+        fprintf(f, "\n};\n");
+    } else {
+        fwrite(out.data(), 1, out.size(), f);
+    }
+    fclose(f);
+
+    printf("%s: %u samples at %u Hz, root note %d, %s, %d slices\n", argv[arg + 1], h.length, h.sample_rate,
+           h.root_note, (h.flags & OPS_FLAG_LOOP) ? "looping" : "one-shot", h.num_slices);
+    return 0;
+}
@@ -0,0 +1,138 @@
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+
+/*
+ * Micro-benchmark harness for the native (PC) "bench" builds of all MCU projects (header-only, host only).
+ *
+ * Every benchmark is a function that is called in batches. The batch size is raised until a batch
+ * takes BATCH_NS, then SAMPLES batches are timed and the median and minimum time per call are kept.
+ * Results are printed as one JSON object per line:
+ *   {"suite":"output_mcu","bench":"parse_uart","ns_per_call":812.4,"min_ns":790.1,"calls":131072}
+ * and with --baseline <file> compared against an earlier run; finish() returns 1 if any
+ * benchmark got slower than the allowed --threshold (percent, default 10).
+ *
+ * Host timings only show relative changes, they are no substitute for measuring on the device.
+ */
+
+// Keeps the compiler from optimising away a result
+template <typename T>
+inline void bench_keep(const T &value) {
+    __asm__ volatile("" : : "g"(&value) : "memory");
+}
+
+class Bench {
+    public:
+    static const int SAMPLES = 7;
+    static const uint64_t BATCH_NS = 20000000;
+    static const int MAX_BASELINE = 64;
+
+    Bench(const char *suite, int argc, char **argv) : suite(suite), threshold(10.0), num_baseline(0), regressions(0) {
+        filter = NULL;
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) load_baseline(argv[++i]);
+            else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) threshold = atof(argv[++i]);
+            else filter = argv[i]; // only benchmarks whose name contains this
+        }
+    }
+
+    // fn() is one call. If it does several units of work (e.g. samples), times are per unit of work_per_call.
+    template <typename F>
+    void run(const char *name, F fn, uint32_t work_per_call = 1) {
+        if (filter && !strstr(name, filter)) return;
+
+        uint64_t batch = 1;
+        while (time_batch(fn, batch) < BATCH_NS / 8 && batch < (1ULL << 40)) batch *= 2;
+        batch *= 8;
+
+        double per_call[SAMPLES];
+        for (int s = 0; s < SAMPLES; s++) {
+            per_call[s] = (double)time_batch(fn, batch) / batch / work_per_call;
+        }
+        for (int i = 1; i < SAMPLES; i++) {
+            for (int j = i; j > 0 && per_call[j] < per_call[j - 1]; j--) {
+                const double t = per_call[j]; per_call[j] = per_call[j - 1]; per_call[j - 1] = t;
+            }
+        }
+        const double median = per_call[SAMPLES / 2];
+
+        printf("{\"suite\":\"%s\",\"bench\":\"%s\",\"ns_per_call\":%.2f,\"min_ns\":%.2f,\"calls\":%llu",
+            suite, name, median, per_call[0], (unsigned long long)(batch * work_per_call));
+        const double base = baseline_for(name);
+        if (base > 0.0) {
+            const double change = (median / base - 1.0) * 100.0;
+            const bool regressed = change > threshold;
+            if (regressed) regressions++;
+            printf(",\"baseline_ns\":%.2f,\"change_percent\":%.1f,\"regression\":%s", base, change, regressed ? "true" : "false");
+        }
+        printf("}\n");
+        fflush(stdout);
+    }
+
+    int finish() {
+        if (regressions > 0) fprintf(stderr, "%s: %d benchmark(s) slower than the baseline by more than %.0f%%\n",
+            suite, regressions, threshold);
+        return regressions > 0 ? 1 : 0;
+    }
+
+    private:
+    static uint64_t now_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    template <typename F>
+    static uint64_t time_batch(F &fn, uint64_t batch) {
+        const uint64_t start = now_ns();
+        for (uint64_t i = 0; i < batch; i++) {
+            fn();
+        }
+        return now_ns() - start;
+    }
+
+    // Reads the output of an earlier run, only the lines of this suite
+    void load_baseline(const char *path) {
+        FILE *f = fopen(path, "r");
+        if (!f) {
+            fprintf(stderr, "%s: cannot read baseline %s\n", suite, path);
+            return;
+        }
+        char line[512];
+        while (num_baseline < MAX_BASELINE && fgets(line, sizeof (line), f)) {
+            char suite_name[64];
+            BaselineEntry &e = baseline[num_baseline];
+            if (sscanf(line, "{\"suite\":\"%63[^\"]\",\"bench\":\"%63[^\"]\",\"ns_per_call\":%lf", suite_name, e.name, &e.ns) == 3
+                && strcmp(suite_name, suite) == 0) {
+                num_baseline++;
+            }
+        }
+        fclose(f);
+    }
+
+    double baseline_for(const char *name) const {
+        for (int i = 0; i < num_baseline; i++) {
+            if (strcmp(baseline[i].name, name) == 0) return baseline[i].ns;
+        }
+        return 0.0;
+    }
+
+    struct BaselineEntry {
+        char name[64];
+        double ns;
+    };
+
+    const char *suite;
+    const char *filter;
+    double threshold;
+    BaselineEntry baseline[MAX_BASELINE];
+    int num_baseline;
+    int regressions;
+};
+
+#endif
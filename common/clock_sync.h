@@ -0,0 +1,53 @@
+#ifndef _CLOCK_SYNC_H
+#define _CLOCK_SYNC_H
+
+#include <stdint.h>
+
+/*
+ * Offset of another MCU's micros() to the local one, estimated from ping round trips like NTP:
+ * sent at local t0, received at remote time rx, answered delay us later, answer received at local t3.
+ * The network time is (t3 - t0) - delay and the remote clock is assumed to have received the ping
+ * half of it after t0. Queueing on the link or in a busy loop only ever adds time, so of every WINDOW
+ * round trips the one with the shortest network time is used. Its error is at most half that time.
+ */
+class ClockSync {
+    public:
+    static const int WINDOW = 8;
+
+    ClockSync() : offset(0), rtt(0), valid(false), best_offset(0), best_rtt(0), samples(0) {}
+
+    void add_sample(uint32_t t0, uint32_t remote_rx, uint32_t delay, uint32_t t3) {
+        const uint32_t round_trip = t3 - t0;
+        if (delay > round_trip) return; // answer to an older ping
+        const uint32_t network = round_trip - delay;
+        const int32_t sample_offset = (int32_t)(remote_rx - t0) - (int32_t)(network / 2);
+
+        if (samples == 0 || network < best_rtt) {
+            best_offset = sample_offset;
+            best_rtt = network;
+        }
+        if (++samples >= WINDOW || !valid) {
+            offset = best_offset;
+            rtt = best_rtt;
+            valid = true;
+            samples = 0;
+        }
+    }
+
+    bool is_valid() const { return valid; }
+    int32_t get_offset_us() const { return offset; } // remote time = local time + offset
+    uint32_t get_rtt_us() const { return rtt; }      // network time of the round trip the offset is from
+    uint32_t to_remote(uint32_t local_us) const { return local_us + offset; }
+
+    private:
+    int32_t offset;
+    uint32_t rtt;
+    bool valid;
+
+    // Best round trip of the current window
+    int32_t best_offset;
+    uint32_t best_rtt;
+    int samples;
+};
+
+#endif
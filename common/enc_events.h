@@ -0,0 +1,95 @@
+#ifndef _ENC_EVENTS_H
+#define _ENC_EVENTS_H
+
+#include <stdint.h>
+
+/*
+ * I2C protocol of the encoder board (shared by the encoder board and its masters, header-only).
+ *
+ * The board queues an event for every encoder or button change and pulls its "data ready" line
+ * low while events are pending. A master only talks to the board when that line is low:
+ *   1. write ENC_REG_COUNT, read 1 byte:  number of events n (at most ENC_MAX_BURST) of the next burst
+ *   2. write ENC_REG_EVENTS, read n * ENC_EVENT_SIZE + ENC_TIME_SIZE bytes: the events, which the board
+ *      then removes, and the board time when the read started
+ * Every event carries a sequence number. A gap means the board's queue overflowed, and the master
+ * reads ENC_REG_SNAPSHOT (all positions and the button bitmap) to resynchronise.
+ *
+ * Times are the board's micros() in units of ENC_TIME_UNIT_US, 16 bit. The board runs on its RC
+ * oscillator, so masters do not convert its times to their clock but take the age of each event
+ * from the board time of the burst (enc_event_age_us()): that is when the master issued the read.
+ */
+
+#define ENC_BOARD_I2C_ADDR 0x08
+
+enum EncBoardReg {
+    ENC_REG_COUNT = 1,
+    ENC_REG_EVENTS,
+    ENC_REG_SNAPSHOT
+};
+
+enum EncEventType {
+    ENC_EVENT_ENCODER = 0, // value = encoder position
+    ENC_EVENT_BUTTON       // value = EncButtonEvent
+};
+
+enum EncButtonEvent {
+    ENC_BUTTON_RELEASED = 0,
+    ENC_BUTTON_PRESSED,
+    ENC_BUTTON_LONG_PRESS // still held after the long press time, follows ENC_BUTTON_PRESSED
+};
+
+struct EncEvent {
+    uint8_t seq;
+    uint8_t type;
+    uint8_t index;
+    int16_t value;
+    uint16_t timestamp; // board time when the change was detected
+};
+
+static const int ENC_NUM_ENCODERS = 4;
+static const int ENC_EVENT_SIZE = 6;
+static const int ENC_TIME_SIZE = 2;
+static const int ENC_MAX_BURST = 5; // with the time, fits the 32 byte Wire buffers
+static const uint32_t ENC_TIME_UNIT_US = 16; // about 1 s range
+static const int ENC_SNAPSHOT_SIZE = ENC_NUM_ENCODERS * 2 + 1;
+
+/*
+ * Wire format: | seq | type << 4 | index | value hi | value lo | timestamp hi | timestamp lo |
+ */
+inline void enc_event_encode(const EncEvent &e, uint8_t *b) {
+    b[0] = e.seq;
+    b[1] = (e.type << 4) | (e.index & 0x0f);
+    b[2] = (uint16_t)e.value >> 8;
+    b[3] = (uint16_t)e.value & 0xff;
+    b[4] = e.timestamp >> 8;
+    b[5] = e.timestamp & 0xff;
+}
+
+inline void enc_event_decode(const uint8_t *b, EncEvent &e) {
+    e.seq = b[0];
+    e.type = b[1] >> 4;
+    e.index = b[1] & 0x0f;
+    e.value = (int16_t)((b[2] << 8) | b[3]);
+    e.timestamp = (b[4] << 8) | b[5];
+}
+
+inline uint16_t enc_time(uint32_t micros) {
+    return micros / ENC_TIME_UNIT_US;
+}
+
+// Board time after the events of a burst
+inline void enc_time_encode(uint16_t time, uint8_t *b) {
+    b[0] = time >> 8;
+    b[1] = time & 0xff;
+}
+
+inline uint16_t enc_time_decode(const uint8_t *b) {
+    return (b[0] << 8) | b[1];
+}
+
+// Time from an event until the board time of its burst, in us of the board clock
+inline uint32_t enc_event_age_us(const EncEvent &e, uint16_t burst_time) {
+    return (uint16_t)(burst_time - e.timestamp) * ENC_TIME_UNIT_US;
+}
+
+#endif
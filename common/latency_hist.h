@@ -0,0 +1,90 @@
+#ifndef _LATENCY_HIST_H
+#define _LATENCY_HIST_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Latency from an input on the encoder board to each stage of its processing, measured by the MCU
+ * of the stage. The origin time travels with the input (see enc_events.h and MSG_TIME in mcu_proto.h).
+ */
+enum LatencyStage {
+    LATENCY_ENC_I2C = 0, // output MCU: events read from the encoder board
+    LATENCY_ENC_PIXEL,   // output MCU: the changed display pushed to the TFT
+    LATENCY_ENC_UART,    // audio MCU: parameter change received from the output MCU
+    LATENCY_ENC_AUDIO,   // audio MCU: start of the audio block that applies it, the I2S output adds 2 blocks
+    NUM_LATENCY_STAGES
+};
+
+inline const char *latency_stage_name(int stage) {
+    static const char *const names[NUM_LATENCY_STAGES] = { "I2C", "Pixel", "UART", "Audio" };
+    return stage >= 0 && stage < NUM_LATENCY_STAGES ? names[stage] : "?";
+}
+
+/*
+ * Histogram of latencies in us with log-spaced buckets: exact below 8 us, then 4 buckets per
+ * power of two (at most 25 % wide), up to about 2 s. add() is a few instructions, so it can be used
+ * in interrupts. One writer; another context may read the figures, they are only a snapshot then.
+ * Counts accumulate from startup, so a summary covers everything since then.
+ */
+class LatencyHistogram {
+    public:
+    static const int SUB_BUCKETS = 4;
+    static const int NUM_BUCKETS = 80;
+
+    LatencyHistogram() { reset(); }
+
+    void reset() {
+        memset(counts, 0, sizeof (counts));
+        count = 0;
+        max_us = 0;
+    }
+
+    void add(uint32_t us) {
+        int i = bucket(us);
+        if (i >= NUM_BUCKETS) i = NUM_BUCKETS - 1;
+        counts[i]++;
+        count++;
+        if (us > max_us) max_us = us;
+    }
+
+    uint32_t get_count() const { return count; }
+    uint32_t get_max_us() const { return max_us; }
+
+    // Upper end of the bucket holding the given percentile, at most the largest latency; 0 if empty
+    uint32_t get_percentile_us(int percent) const {
+        const uint32_t n = count;
+        if (n == 0) return 0;
+        const uint32_t rank = (uint32_t)(((uint64_t)n * percent + 99) / 100);
+        uint32_t seen = 0;
+        for (int i = 0; i < NUM_BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= rank && seen > 0) {
+                if (i == NUM_BUCKETS - 1) return max_us; // holds everything longer, too
+                const uint32_t upper = bucket_end(i) - 1;
+                return upper < max_us ? upper : max_us;
+            }
+        }
+        return max_us;
+    }
+
+    // Bucket of a latency, and the first latency of the next bucket
+    static int bucket(uint32_t us) {
+        if (us < 2 * SUB_BUCKETS) return us;
+        const int e = 31 - __builtin_clz(us); // power of two, at least 3
+        return SUB_BUCKETS * (e - 1) + ((us >> (e - 2)) & (SUB_BUCKETS - 1));
+    }
+
+    static uint32_t bucket_end(int i) {
+        if (i < 2 * SUB_BUCKETS) return i + 1;
+        const int e = i / SUB_BUCKETS + 1;
+        return (uint32_t)(SUB_BUCKETS + i % SUB_BUCKETS + 1) << (e - 2);
+    }
+
+    private:
+    uint32_t counts[NUM_BUCKETS];
+    uint32_t count;
+    uint32_t max_us;
+};
+
+#endif
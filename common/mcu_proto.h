@@ -0,0 +1,301 @@
+#ifndef _MCU_PROTO_H
+#define _MCU_PROTO_H
+
+#include <stdint.h>
+#include <string.h>
+#include <latency_hist.h>
+
+/*
+ * Binary protocol between the MCUs (shared by all firmwares, header-only).
+ *
+ * A frame carries a batch of fixed-size messages followed by a CRC-16 (CCITT) over the messages.
+ * The whole frame is COBS encoded, so it contains no zero bytes, and terminated by a single 0x00.
+ * A receiver can therefore always resynchronise on the next zero byte after line noise or a lost byte.
+ *
+ *   raw:     | msg 0 (4 bytes) | msg 1 | ... | crc lo | crc hi |
+ *   on wire: | COBS(raw) | 0x00 |
+ */
+
+#define MCU_PROTO_BAUD 460800
+
+enum McuMsgType {
+    MSG_ENCODER = 1, // id = encoder index, value = position
+    MSG_BUTTON,      // id = button index, value = 1 pressed, 0 released
+    MSG_PARAM,       // id = ParamId, value = position in its range, 0 .. MCU_PARAM_MAX
+    MSG_STATE,       // id = McuStateId, parameter state sync (see below)
+    MSG_STAT,        // id = McuStatId, value = statistic, sent periodically by the audio MCU
+    MSG_TIME         // id = McuTimeId, clock sync and input timing (see below)
+};
+
+/*
+ * Parameter state sync. The audio MCU owns the parameter values and the output MCU mirrors them.
+ *
+ * The audio MCU sends state frames: STATE_DELTA or STATE_SNAPSHOT first, with the frame's version
+ * (+1 per state frame), then MSG_PARAM for every parameter which changed since the previous state frame.
+ * Changes are collected for a while and only the latest value is sent, however fast they come in.
+ * A snapshot is a run of consecutive state frames with all parameters: the first one starts with
+ * STATE_SNAPSHOT, the following ones with STATE_DELTA and the last one carries STATE_SNAPSHOT_END.
+ * A snapshot is sent at startup and for every STATE_SYNC_REQUEST.
+ *
+ * The output MCU asks for a snapshot with STATE_SYNC_REQUEST while it has none, and whenever it
+ * receives a version out of order or a corrupt frame. STATE_VERSION (version of the last state frame)
+ * is sent along with the profiling figures, so a lost last frame is noticed as well.
+ * To change a parameter it sends MSG_PARAM; the new value comes back in a state frame like any other change.
+ */
+enum McuStateId {
+    STATE_DELTA = 0,
+    STATE_SNAPSHOT,
+    STATE_SNAPSHOT_END,
+    STATE_VERSION,
+    STATE_SYNC_REQUEST
+};
+
+static const int16_t MCU_PARAM_MAX = 16383; // 14 bit, like a MIDI controller pair
+
+/*
+ * Clock sync and input timing. The output MCU estimates the offset of the audio MCU's micros()
+ * to its own (see clock_sync.h): it sends TIME_PING, and the audio MCU answers at once with one frame
+ * of TIME_PONG, TIME_RX_LO and TIME_RX_HI (its micros() when the ping frame arrived) and
+ * TIME_REPLY_DELAY (us from then until the answer was sent, at most 32767).
+ * A frame with MSG_PARAM changes caused by an input on the encoder board also carries TIME_ORIGIN_LO
+ * and TIME_ORIGIN_HI: when the input happened, in the audio MCU's micros(); of several pairs the last
+ * one counts. 32 bit times are sent as two 16 bit halves.
+ */
+enum McuTimeId {
+    TIME_PING = 0,   // value = sequence number
+    TIME_PONG,       // value = sequence number of the ping
+    TIME_RX_LO,
+    TIME_RX_HI,
+    TIME_REPLY_DELAY,
+    TIME_ORIGIN_LO,
+    TIME_ORIGIN_HI
+};
+
+/*
+ * Profiling figures of the audio MCU. CPU loads are in 0.1 %, peaks since the previous report.
+ */
+enum McuStatId {
+    STAT_CPU = 0,
+    STAT_CPU_MAX,
+    STAT_MEM_USED,       // audio blocks
+    STAT_MEM_MAX,
+    STAT_MEM_TOTAL,      // audio blocks reserved with AudioMemory()
+    STAT_LOOP_MAX_US,    // slowest loop() pass
+    STAT_LOOP_USB_US,    // slowest pass of each section of loop()
+    STAT_LOOP_MIDI_US,
+    STAT_LOOP_INPUT_US,
+    STAT_LOOP_SAMPLER_US,
+    STAT_UNDERRUNS,      // sample streaming underruns since startup
+    STAT_GROUP_CPU,      // + McuStatGroup: sum of the peak CPU loads of the audio nodes of a group
+    STAT_LATENCY_P50 = STAT_GROUP_CPU + 6, // + LatencyStage: median input latency in 0.1 ms (latency_hist.h)
+    STAT_LATENCY_P99 = STAT_LATENCY_P50 + NUM_LATENCY_STAGES, // + LatencyStage: 99th percentile
+    STAT_NUM_IDS = STAT_LATENCY_P99 + NUM_LATENCY_STAGES
+};
+
+enum McuStatGroup {
+    STAT_GROUP_CLOCK = 0,
+    STAT_GROUP_VOICES,
+    STAT_GROUP_SAMPLER,
+    STAT_GROUP_SLICER,
+    STAT_GROUP_DRUMS,
+    STAT_GROUP_OUTPUT,
+    STAT_NUM_GROUPS
+};
+
+static_assert(STAT_LATENCY_P50 == STAT_GROUP_CPU + STAT_NUM_GROUPS, "one STAT_GROUP_CPU id per group");
+
+// Latency in us as a STAT_LATENCY_* value
+inline int16_t mcu_latency_stat(uint32_t us) {
+    const uint32_t tenths_ms = (us + 50) / 100;
+    return tenths_ms > 32767 ? 32767 : tenths_ms;
+}
+
+inline const char *mcu_stat_group_name(int group) {
+    static const char *const names[STAT_NUM_GROUPS] = { "Clock", "Voices", "Sampler", "Slicer", "Drums", "Output" };
+    return group >= 0 && group < STAT_NUM_GROUPS ? names[group] : "?";
+}
+
+struct McuMsg {
+    uint8_t type;
+    uint8_t id;
+    int16_t value;
+};
+
+static const int MCU_MSG_SIZE = 4;
+static const int MCU_MAX_MSGS_PER_FRAME = 16;
+static const int MCU_MAX_RAW_FRAME = MCU_MAX_MSGS_PER_FRAME * MCU_MSG_SIZE + 2;
+// COBS adds at most one byte per 254 bytes, plus the delimiter
+static const int MCU_MAX_WIRE_FRAME = MCU_MAX_RAW_FRAME + MCU_MAX_RAW_FRAME / 254 + 2;
+
+inline uint16_t mcu_crc16(const uint8_t *data, int len) {
+    uint16_t crc = 0xffff;
+    for (int i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+/*
+ * COBS encode len bytes from src into dst (no delimiter). Returns the encoded length.
+ */
+inline int mcu_cobs_encode(const uint8_t *src, int len, uint8_t *dst) {
+    int code_idx = 0;
+    int out = 1;
+    uint8_t code = 1;
+
+    for (int i = 0; i < len; i++) {
+        if (src[i] == 0) {
+            dst[code_idx] = code;
+            code_idx = out++;
+            code = 1;
+        } else {
+            dst[out++] = src[i];
+            if (++code == 0xff) {
+                dst[code_idx] = code;
+                code_idx = out++;
+                code = 1;
+            }
+        }
+    }
+    dst[code_idx] = code;
+    return out;
+}
+
+/*
+ * COBS decode len bytes (without delimiter) from src into dst. Returns the decoded length or -1 if malformed.
+ */
+inline int mcu_cobs_decode(const uint8_t *src, int len, uint8_t *dst) {
+    int in = 0;
+    int out = 0;
+
+    while (in < len) {
+        const uint8_t code = src[in++];
+        if (code == 0 || in + code - 1 > len) return -1;
+        for (int i = 1; i < code; i++) {
+            if (src[in] == 0) return -1;
+            dst[out++] = src[in++];
+        }
+        if (code != 0xff && in < len) dst[out++] = 0;
+    }
+    return out;
+}
+
+/*
+ * Collects messages and encodes them into one wire frame.
+ * MSG_ENCODER, MSG_PARAM and MSG_STAT carry a current value: one with the same type and id as
+ * a pending message replaces its value, so only the last value of a burst is sent. All other types
+ * are events, e.g. a press and release of a button, and are sent one by one in the order added.
+ */
+class McuFrameWriter {
+    public:
+    McuFrameWriter() : num_msgs(0) {}
+
+    bool add(uint8_t type, uint8_t id, int16_t value) {
+        const bool coalesce = type == MSG_ENCODER || type == MSG_PARAM || type == MSG_STAT;
+        for (int i = 0; coalesce && i < num_msgs; i++) {
+            if (msgs[i].type == type && msgs[i].id == id) {
+                msgs[i].value = value;
+                return true;
+            }
+        }
+        if (num_msgs >= MCU_MAX_MSGS_PER_FRAME) return false;
+        msgs[num_msgs].type = type;
+        msgs[num_msgs].id = id;
+        msgs[num_msgs].value = value;
+        num_msgs++;
+        return true;
+    }
+
+    bool is_empty() const { return num_msgs == 0; }
+    bool is_full() const { return num_msgs >= MCU_MAX_MSGS_PER_FRAME; }
+    bool has_room(int n) const { return num_msgs + n <= MCU_MAX_MSGS_PER_FRAME; }
+
+    /*
+     * Encodes all pending messages into out (at least MCU_MAX_WIRE_FRAME bytes), including the delimiter.
+     * Returns the number of bytes to send and starts a new batch.
+     */
+    int encode(uint8_t *out) {
+        uint8_t raw[MCU_MAX_RAW_FRAME];
+        int len = 0;
+        for (int i = 0; i < num_msgs; i++) {
+            raw[len++] = msgs[i].type;
+            raw[len++] = msgs[i].id;
+            raw[len++] = (uint16_t)msgs[i].value & 0xff;
+            raw[len++] = (uint16_t)msgs[i].value >> 8;
+        }
+        const uint16_t crc = mcu_crc16(raw, len);
+        raw[len++] = crc & 0xff;
+        raw[len++] = crc >> 8;
+
+        int n = mcu_cobs_encode(raw, len, out);
+        out[n++] = 0;
+        num_msgs = 0;
+        return n;
+    }
+
+    private:
+    McuMsg msgs[MCU_MAX_MSGS_PER_FRAME];
+    int num_msgs;
+};
+
+/*
+ * Assembles received bytes into frames for mcu_decode_frame().
+ */
+class McuFrameReader {
+    public:
+    McuFrameReader() : len(0), too_long(false) {}
+
+    /*
+     * Returns the length of the frame which c completes, which get_frame() then holds until the next call;
+     * 0 if there is none yet and -1 if it was too long and has been dropped.
+     */
+    int feed(uint8_t c) {
+        if (c != 0) {
+            if (len < (int)sizeof (data)) data[len++] = c;
+            else too_long = true;
+            return 0;
+        }
+        const int n = too_long ? -1 : len;
+        len = 0;
+        too_long = false;
+        return n;
+    }
+
+    const uint8_t *get_frame() const { return data; }
+
+    private:
+    uint8_t data[MCU_MAX_WIRE_FRAME];
+    int len;
+    bool too_long;
+};
+
+/*
+ * Decodes one received frame (COBS data without the delimiter) into msgs.
+ * Returns the number of messages or -1 if the frame is malformed or fails the CRC check.
+ */
+inline int mcu_decode_frame(const uint8_t *frame, int len, McuMsg *msgs, int max_msgs) {
+    uint8_t raw[MCU_MAX_RAW_FRAME];
+    if (len > MCU_MAX_WIRE_FRAME - 1) return -1;
+
+    const int raw_len = mcu_cobs_decode(frame, len, raw);
+    if (raw_len < 2 || (raw_len - 2) % MCU_MSG_SIZE != 0) return -1;
+
+    const int payload_len = raw_len - 2;
+    const uint16_t crc = raw[payload_len] | (raw[payload_len + 1] << 8);
+    if (mcu_crc16(raw, payload_len) != crc) return -1;
+
+    const int n = payload_len / MCU_MSG_SIZE;
+    if (n > max_msgs) return -1;
+    for (int i = 0; i < n; i++) {
+        const uint8_t *m = raw + i * MCU_MSG_SIZE;
+        msgs[i].type = m[0];
+        msgs[i].id = m[1];
+        msgs[i].value = (int16_t)(m[2] | (m[3] << 8));
+    }
+    return n;
+}
+
+#endif
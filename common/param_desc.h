@@ -0,0 +1,262 @@
+#ifndef _PARAM_DESC_H
+#define _PARAM_DESC_H
+
+#include <stdint.h>
+#include <param_ids.h>
+#include <mcu_proto.h>
+
+/*
+ * What every synth parameter means, for all firmwares (header-only): range, curve, unit, label and
+ * default. The audio MCU maps MIDI CCs, wire positions and presets with it, the output MCU labels,
+ * steps and formats its bars with it, so both always agree.
+ *
+ * The curve of each parameter is sampled into PARAM_LUT_SIZE points at compile time, so converting
+ * between a position in the range and a value is a table lookup instead of powf() / logf(), and the
+ * display values are precomputed integers. The tables are constexpr data members of class templates,
+ * which gives one copy per firmware without a .cpp and works with the gnu++11 of the ESP32 and AVR cores.
+ */
+
+enum ParamCurve {
+    CURVE_LINEAR = 0, // equal steps
+    CURVE_EXP,        // equal ratios, e.g. frequencies (min must be > 0)
+    CURVE_DISCRETE    // whole numbers, e.g. OscShape
+};
+
+enum ParamUnit {
+    UNIT_NONE = 0,
+    UNIT_SEMITONES,
+    UNIT_HZ,
+    UNIT_MS,
+    UNIT_PERCENT      // value 0 .. 1 shown as 0 .. 100
+};
+
+struct ParamDesc {
+    const char *name;      // identifier, e.g. in patch files of the offline renderer
+    const char *label;     // on the display, at most 8 chars
+    float min;
+    float max;
+    float init;
+    uint8_t curve;         // ParamCurve
+    uint8_t unit;          // ParamUnit
+    uint8_t decimals;      // of the displayed value, 0 .. 2
+    uint8_t smooth_blocks; // length of the ramp to a new value, 0 = jumps
+    uint8_t cc;            // MIDI controller covering the whole range, 0 = none
+    uint8_t steps;         // encoder steps over the whole range
+};
+
+// Ramps of 6 blocks are ~17 ms at 44.1 kHz. The CCs follow the General MIDI sound controller numbers.
+template <typename T = void>
+struct ParamTables {
+    static constexpr ParamDesc descs[NUM_PARAMS] = {
+        //  name                label      min     max       init     curve           unit            dec smooth cc steps
+        { "osc1_tune",        "Tune 1",  -24.0f, 24.0f,    0.0f,    CURVE_DISCRETE, UNIT_SEMITONES, 0, 6, 0,  48 },  // PARAM_OSC1_TUNE
+        { "osc2_tune",        "Tune 2",  -24.0f, 24.0f,    0.0f,    CURVE_DISCRETE, UNIT_SEMITONES, 0, 6, 0,  48 },  // PARAM_OSC2_TUNE
+        { "osc1_shape",       "Shape 1", 0.0f,   3.0f,     2.0f,    CURVE_DISCRETE, UNIT_NONE,      0, 0, 0,  3 },   // PARAM_OSC1_SHAPE
+        { "osc2_shape",       "Shape 2", 0.0f,   3.0f,     3.0f,    CURVE_DISCRETE, UNIT_NONE,      0, 0, 0,  3 },   // PARAM_OSC2_SHAPE
+        { "pulse_width",      "PWM",     0.05f,  0.95f,    0.5f,    CURVE_LINEAR,   UNIT_PERCENT,   0, 6, 77, 90 },  // PARAM_PULSE_WIDTH
+        { "filter_cutoff",    "Cutoff",  20.0f,  12000.0f, 2000.0f, CURVE_EXP,      UNIT_HZ,        0, 6, 74, 127 }, // PARAM_FILTER_CUTOFF
+        { "filter_resonance", "Reso",    0.7f,   5.0f,     0.7f,    CURVE_LINEAR,   UNIT_NONE,      1, 6, 71, 43 },  // PARAM_FILTER_RESONANCE
+        { "env_attack",       "Attack",  0.0f,   5000.0f,  5.0f,    CURVE_LINEAR,   UNIT_MS,        0, 0, 73, 127 }, // PARAM_ENV_ATTACK
+        { "env_decay",        "Decay",   0.0f,   5000.0f,  100.0f,  CURVE_LINEAR,   UNIT_MS,        0, 0, 75, 127 }, // PARAM_ENV_DECAY
+        { "env_sustain",      "Sustain", 0.0f,   1.0f,     0.7f,    CURVE_LINEAR,   UNIT_PERCENT,   0, 0, 0,  100 }, // PARAM_ENV_SUSTAIN
+        { "env_release",      "Release", 0.0f,   5000.0f,  300.0f,  CURVE_LINEAR,   UNIT_MS,        0, 0, 72, 127 }, // PARAM_ENV_RELEASE
+        { "lfo1_rate",        "LFO 1",   0.05f,  20.0f,    5.0f,    CURVE_EXP,      UNIT_HZ,        2, 0, 76, 127 }, // PARAM_LFO1_RATE
+        { "lfo2_rate",        "LFO 2",   0.05f,  20.0f,    0.3f,    CURVE_EXP,      UNIT_HZ,        2, 0, 0,  127 }, // PARAM_LFO2_RATE
+        { "mod_attack",       "Mod att", 0.0f,   5000.0f,  2.0f,    CURVE_LINEAR,   UNIT_MS,        0, 0, 0,  127 }, // PARAM_MOD_ATTACK
+        { "mod_decay",        "Mod dec", 0.0f,   5000.0f,  400.0f,  CURVE_LINEAR,   UNIT_MS,        0, 0, 0,  127 }, // PARAM_MOD_DECAY
+        { "volume",           "Volume",  0.0f,   1.0f,     0.8f,    CURVE_LINEAR,   UNIT_PERCENT,   0, 6, 7,  100 }  // PARAM_VOLUME
+    };
+};
+
+template <typename T>
+constexpr ParamDesc ParamTables<T>::descs[NUM_PARAMS];
+
+inline const ParamDesc &param_desc(uint8_t id) { return ParamTables<>::descs[id]; }
+
+/*
+ * Compile-time math for the tables. C++11 constexpr functions are a single return statement,
+ * hence the recursion. Accurate to about 1e-12 over the ranges of the table.
+ */
+constexpr double param_cx_square(double y) { return y * y; }
+
+constexpr double param_cx_exp_series(double x, int n, double term) {
+    return n > 24 ? term : term + param_cx_exp_series(x, n + 1, term * x / (n + 1));
+}
+
+// Halving until |x| <= 0.5 keeps the series short, exp(x) = exp(x / 2)^2
+constexpr double param_cx_exp(double x) {
+    return x > 0.5 || x < -0.5 ? param_cx_square(param_cx_exp(x / 2)) : param_cx_exp_series(x, 0, 1.0);
+}
+
+constexpr double param_cx_atanh_series(double z2, double power, int n) {
+    return n > 41 ? 0.0 : power / n + param_cx_atanh_series(z2, power * z2, n + 2);
+}
+
+// ln(v) = k ln(2) + ln(m) with m in [1, 2), and ln(m) = 2 atanh((m - 1) / (m + 1))
+constexpr double param_cx_ln(double v) {
+    return v >= 2.0 ? param_cx_ln(v / 2.0) + 0.69314718055994530942
+         : v < 1.0 ? param_cx_ln(v * 2.0) - 0.69314718055994530942
+         : 2.0 * param_cx_atanh_series(((v - 1.0) / (v + 1.0)) * ((v - 1.0) / (v + 1.0)), (v - 1.0) / (v + 1.0), 1);
+}
+
+constexpr double param_cx_round(double v) {
+    return v >= 0.0 ? (double)(int32_t)(v + 0.5) : (double)(int32_t)(v - 0.5);
+}
+
+// Value at x = 0 .. 1 of the range, without the rounding of discrete parameters
+constexpr double param_cx_curve(const ParamDesc &d, double x) {
+    return d.curve == CURVE_EXP ? d.min * param_cx_exp(x * param_cx_ln((double)d.max / d.min))
+                                : d.min + x * ((double)d.max - d.min);
+}
+
+constexpr double param_cx_unit_scale(const ParamDesc &d) {
+    return (d.unit == UNIT_PERCENT ? 100.0 : 1.0) * (d.decimals == 2 ? 100.0 : d.decimals == 1 ? 10.0 : 1.0);
+}
+
+// Displayed value as an integer in units of 10^-decimals
+constexpr int32_t param_cx_display(const ParamDesc &d, double value) {
+    return (int32_t)param_cx_round((d.curve == CURVE_DISCRETE ? param_cx_round(value) : value) * param_cx_unit_scale(d));
+}
+
+constexpr bool param_cx_descs_valid(int id) {
+    return id >= NUM_PARAMS ? true
+         : ParamTables<>::descs[id].min < ParamTables<>::descs[id].max
+           && (ParamTables<>::descs[id].curve != CURVE_EXP || ParamTables<>::descs[id].min > 0.0f)
+           && ParamTables<>::descs[id].steps > 0 && ParamTables<>::descs[id].decimals <= 2
+           && param_cx_descs_valid(id + 1);
+}
+
+static_assert(param_cx_descs_valid(0), "every parameter needs min < max, min > 0 for CURVE_EXP, steps and at most 2 decimals");
+
+/*
+ * Curve points at 0, 1/128, .. 1 of each range: values for the audio MCU, display values for the output MCU.
+ */
+static const int PARAM_LUT_SIZE = 129;
+
+struct ParamCurveLut {
+    float values[PARAM_LUT_SIZE];
+};
+
+struct ParamDisplayLut {
+    int32_t values[PARAM_LUT_SIZE];
+};
+
+struct ParamCurveLuts {
+    ParamCurveLut params[NUM_PARAMS];
+};
+
+struct ParamDisplayLuts {
+    ParamDisplayLut params[NUM_PARAMS];
+};
+
+template <int... I> struct ParamIndexList {};
+template <int N, int... I> struct ParamIndexRange : ParamIndexRange<N - 1, N - 1, I...> {};
+template <int... I> struct ParamIndexRange<0, I...> { typedef ParamIndexList<I...> type; };
+
+template <int... I>
+constexpr ParamCurveLut param_cx_curve_lut(const ParamDesc &d, ParamIndexList<I...>) {
+    return ParamCurveLut{ { (float)param_cx_curve(d, (double)I / (PARAM_LUT_SIZE - 1))... } };
+}
+
+template <int... I>
+constexpr ParamDisplayLut param_cx_display_lut(const ParamDesc &d, ParamIndexList<I...>) {
+    return ParamDisplayLut{ { param_cx_display(d, param_cx_curve(d, (double)I / (PARAM_LUT_SIZE - 1)))... } };
+}
+
+template <int... P>
+constexpr ParamCurveLuts param_cx_curve_luts(ParamIndexList<P...>) {
+    return ParamCurveLuts{ { param_cx_curve_lut(ParamTables<>::descs[P], typename ParamIndexRange<PARAM_LUT_SIZE>::type())... } };
+}
+
+template <int... P>
+constexpr ParamDisplayLuts param_cx_display_luts(ParamIndexList<P...>) {
+    return ParamDisplayLuts{ { param_cx_display_lut(ParamTables<>::descs[P], typename ParamIndexRange<PARAM_LUT_SIZE>::type())... } };
+}
+
+template <typename T = void>
+struct ParamLuts {
+    static constexpr ParamCurveLuts curves = param_cx_curve_luts(typename ParamIndexRange<NUM_PARAMS>::type());
+    static constexpr ParamDisplayLuts display = param_cx_display_luts(typename ParamIndexRange<NUM_PARAMS>::type());
+};
+
+template <typename T>
+constexpr ParamCurveLuts ParamLuts<T>::curves;
+
+template <typename T>
+constexpr ParamDisplayLuts ParamLuts<T>::display;
+
+/*
+ * Value at x = 0 .. 1 of the range: MIDI CCs, wire positions, morphing.
+ * Interpolates between the curve points; discrete parameters are rounded to whole numbers.
+ */
+inline float param_denormalize(uint8_t id, float x) {
+    const float *lut = ParamLuts<>::curves.params[id].values;
+    float v;
+    if (x <= 0.0f) {
+        v = lut[0];
+    } else if (x >= 1.0f) {
+        v = lut[PARAM_LUT_SIZE - 1];
+    } else {
+        const float f = x * (PARAM_LUT_SIZE - 1);
+        const int i = (int)f;
+        v = lut[i] + (f - i) * (lut[i + 1] - lut[i]);
+    }
+    if (param_desc(id).curve == CURVE_DISCRETE) v = (float)(int32_t)(v >= 0.0f ? v + 0.5f : v - 0.5f);
+    return v;
+}
+
+// 0 .. 1 over the range, inverse of param_denormalize() (for CURVE_EXP a binary search of the curve points)
+inline float param_normalize(uint8_t id, float value) {
+    const float *lut = ParamLuts<>::curves.params[id].values;
+    if (value <= lut[0]) return 0.0f;
+    if (value >= lut[PARAM_LUT_SIZE - 1]) return 1.0f;
+    if (param_desc(id).curve != CURVE_EXP) return (value - lut[0]) / (lut[PARAM_LUT_SIZE - 1] - lut[0]);
+
+    int lo = 0, hi = PARAM_LUT_SIZE - 1; // lut[lo] <= value < lut[hi]
+    while (hi - lo > 1) {
+        const int mid = (lo + hi) / 2;
+        if (lut[mid] <= value) lo = mid;
+        else hi = mid;
+    }
+    return (lo + (value - lut[lo]) / (lut[hi] - lut[lo])) / (PARAM_LUT_SIZE - 1);
+}
+
+// Wire positions, 0 .. MCU_PARAM_MAX (see MSG_PARAM)
+inline int16_t param_to_position(uint8_t id, float value) {
+    return (int16_t)(param_normalize(id, value) * MCU_PARAM_MAX + 0.5f);
+}
+
+inline float param_from_position(uint8_t id, int16_t position) {
+    return param_denormalize(id, (float)position / MCU_PARAM_MAX);
+}
+
+// Encoder steps: the position of step i of desc.steps, and the step nearest to a position
+inline int16_t param_step_position(uint8_t id, int step) {
+    const int steps = param_desc(id).steps;
+    if (step <= 0) return 0;
+    if (step >= steps) return MCU_PARAM_MAX;
+    return (int16_t)((step * (int32_t)MCU_PARAM_MAX + steps / 2) / steps);
+}
+
+inline int param_position_step(uint8_t id, int16_t position) {
+    const int steps = param_desc(id).steps;
+    return (int)((position * (int32_t)steps + MCU_PARAM_MAX / 2) / MCU_PARAM_MAX);
+}
+
+/*
+ * Displayed value at a wire position, in units of 10^-decimals (e.g. 125 = "12.5" with one decimal).
+ * Integer only: the nearest precomputed curve point.
+ */
+inline int32_t param_display_value(uint8_t id, int16_t position) {
+    if (position < 0) position = 0;
+    else if (position > MCU_PARAM_MAX) position = MCU_PARAM_MAX;
+    const int i = (position * (int32_t)(PARAM_LUT_SIZE - 1) + MCU_PARAM_MAX / 2) / MCU_PARAM_MAX;
+    return ParamLuts<>::display.params[id].values[i];
+}
+
+inline const char *param_unit_suffix(uint8_t unit) {
+    static const char *const suffixes[] = { "", "st", "Hz", "ms", "%" };
+    return unit <= UNIT_PERCENT ? suffixes[unit] : "";
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _PARAM_IDS_H
+#define _PARAM_IDS_H
+
+/*
+ * Synth parameters of the audio MCU, in their natural units (shared by all firmwares, header-only).
+ * The output MCU addresses them by id over the UART (see MSG_PARAM in mcu_proto.h).
+ */
+enum ParamId { // only ever append, presets store values by id (see preset_format.h)
+    PARAM_OSC1_TUNE = 0,    // semitones
+    PARAM_OSC2_TUNE,
+    PARAM_OSC1_SHAPE,       // OscShape
+    PARAM_OSC2_SHAPE,
+    PARAM_PULSE_WIDTH,      // 0.05 .. 0.95
+    PARAM_FILTER_CUTOFF,    // Hz
+    PARAM_FILTER_RESONANCE,
+    PARAM_ENV_ATTACK,       // ms
+    PARAM_ENV_DECAY,        // ms
+    PARAM_ENV_SUSTAIN,      // 0 .. 1
+    PARAM_ENV_RELEASE,      // ms
+    PARAM_LFO1_RATE,        // Hz
+    PARAM_LFO2_RATE,        // Hz
+    PARAM_MOD_ATTACK,       // ms, modulation envelope
+    PARAM_MOD_DECAY,        // ms
+    PARAM_VOLUME,           // 0 .. 1
+    NUM_PARAMS
+};
+
+#endif
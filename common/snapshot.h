@@ -0,0 +1,42 @@
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include <stdint.h>
+
+/*
+ * Lock-free latest-value exchange between one writer and one reader (triple buffering).
+ * The writer publishes complete values, the reader takes the newest one published so far.
+ * Neither side ever waits, and the reader never sees a half written value; values published
+ * between two reads are skipped, so this is for state (use SpscQueue for events).
+ */
+template <typename T>
+class Snapshot {
+    public:
+    Snapshot() : back(0), middle(1), front(2) {}
+
+    // Writer side
+    void publish(const T &value) {
+        buffers[back] = value;
+        back = __atomic_exchange_n(&middle, back | FRESH, __ATOMIC_ACQ_REL) & INDEX_MASK;
+    }
+
+    // Reader side: true if a newer value than the last one got is available, it is then returned by get()
+    bool update() {
+        if (!(__atomic_load_n(&middle, __ATOMIC_ACQUIRE) & FRESH)) return false;
+        front = __atomic_exchange_n(&middle, front, __ATOMIC_ACQ_REL) & INDEX_MASK;
+        return true;
+    }
+
+    const T &get() const { return buffers[front]; }
+
+    private:
+    static const uint8_t INDEX_MASK = 3;
+    static const uint8_t FRESH = 4;
+
+    T buffers[3];
+    uint8_t back;   // only used by the writer
+    uint8_t middle; // last published buffer, | FRESH until the reader takes it
+    uint8_t front;  // only used by the reader
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef _SPSC_QUEUE_H
+#define _SPSC_QUEUE_H
+
+#include <stdint.h>
+
+/*
+ * Lock-free single producer, single consumer queue with a fixed capacity.
+ * One side (e.g. an interrupt, driver task or the other core) may only push, the other may only pop.
+ * N must be a power of two; the queue holds up to N elements.
+ */
+template <typename T, uint32_t N>
+class SpscQueue {
+    public:
+    SpscQueue() : head(0), tail(0) {}
+
+    // Producer side
+    bool push(const T &item) {
+        const uint32_t h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        if (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= N) return false;
+        items[h & (N - 1)] = item;
+        __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T &item) {
+        const uint32_t t = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+        if (t == __atomic_load_n(&head, __ATOMIC_ACQUIRE)) return false;
+        item = items[t & (N - 1)];
+        __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // Consumer side: oldest element without removing it, or NULL if empty
+    const T *peek() const {
+        const uint32_t t = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+        if (t == __atomic_load_n(&head, __ATOMIC_ACQUIRE)) return 0;
+        return &items[t & (N - 1)];
+    }
+
+    // Either side; only a snapshot since the other side keeps running
+    uint32_t size() const {
+        return __atomic_load_n(&head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    }
+
+    static uint32_t capacity() { return N; }
+
+    private:
+    T items[N];
+    uint32_t head; // next slot to write, only modified by the producer
+    uint32_t tail; // next slot to read, only modified by the consumer
+};
+
+#endif
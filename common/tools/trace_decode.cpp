@@ -0,0 +1,172 @@
+/*
+ * Decodes the debug serial output of the firmwares (binary trace records, see trace.h, mixed with text)
+ * into readable lines, and merges the output of several MCUs into one time-ordered log.
+ *
+ * Build on a PC: g++ -O2 -I.. -o trace_decode trace_decode.cpp
+ * Capture:       stty -F /dev/ttyACM0 raw && cat /dev/ttyACM0 > audio.trace
+ * Usage:         trace_decode [-l max_level] [-t] name=file[@offset_us] ...
+ *
+ * name labels the lines of a file, e.g. audio=audio.trace output=output.trace@-1250. The offset is
+ * added to the timestamps of that file to line up the clocks of the MCUs. Text lines get the time
+ * of the record after them. -l hides records less severe than max_level (1 = error .. 4 = debug),
+ * -t hides the text lines.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <trace.h>
+
+struct Line {
+    int64_t time_us;
+    int source;
+    bool is_text;
+    TraceRecord record;
+    std::string text;
+};
+
+struct Source {
+    std::string name;
+    int64_t offset_us;
+    uint32_t records;
+    uint32_t boots;
+};
+
+static bool read_file(const char *path, std::vector<uint8_t> &data) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return false;
+    fseek(f, 0, SEEK_END);
+    data.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    const bool ok = fread(data.data(), 1, data.size(), f) == data.size();
+    fclose(f);
+    return ok;
+}
+
+static void add_text(std::vector<Line> &lines, int source, int64_t time_us, std::string &text) {
+    size_t start = 0, end;
+    while ((end = text.find('\n', start)) != std::string::npos) {
+        std::string s = text.substr(start, end - start);
+        if (!s.empty() && s[s.size() - 1] == '\r') s.erase(s.size() - 1);
+        for (size_t i = 0; i < s.size(); i++) {
+            if ((unsigned char)s[i] < ' ' || (unsigned char)s[i] > '~') s[i] = '.'; // e.g. a corrupt record
+        }
+        if (!s.empty()) {
+            Line l = { time_us, source, true, TraceRecord(), s };
+            lines.push_back(l);
+        }
+        start = end + 1;
+    }
+    text.erase(0, start); // an incomplete line waits for the rest
+}
+
+/*
+ * A frame is the TRACE_WIRE_FRAME - 1 bytes before a zero byte, everything else is text.
+ * Timestamps are extended to 64 bit; a boot restarts the clock, so it continues from the last record.
+ */
+static void decode(const std::vector<uint8_t> &data, int source, Source &src, std::vector<Line> &lines) {
+    std::string text;
+    size_t chunk_start = 0;
+    bool have_time = false;
+    uint32_t last_us = 0;
+    int64_t time_us = 0;
+
+    for (size_t i = 0; i < data.size(); i++) {
+        if (data[i] != 0) continue;
+
+        TraceRecord r;
+        const size_t frame_len = TRACE_WIRE_FRAME - 1;
+        const bool is_frame = i - chunk_start >= frame_len && trace_frame_decode(&data[i - frame_len], r);
+        const size_t text_end = is_frame ? i - frame_len : i;
+        text.append((const char *)&data[chunk_start], text_end - chunk_start);
+        chunk_start = i + 1;
+        if (!is_frame) continue;
+
+        if (have_time && r.event != TRACE_BOOT) time_us += (int32_t)(r.time_us - last_us);
+        else if (!have_time) time_us = r.time_us;
+        if (r.event == TRACE_BOOT) src.boots++;
+        last_us = r.time_us;
+        have_time = true;
+
+        add_text(lines, source, time_us + src.offset_us, text);
+        Line l = { time_us + src.offset_us, source, false, r, std::string() };
+        lines.push_back(l);
+        src.records++;
+    }
+    text.append((const char *)&data[chunk_start], data.size() - chunk_start);
+    text += '\n';
+    add_text(lines, source, time_us + src.offset_us, text);
+}
+
+static bool earlier(const Line &a, const Line &b) {
+    return a.time_us < b.time_us;
+}
+
+int main(int argc, char **argv) {
+    int max_level = TRACE_LEVEL_DEBUG;
+    bool show_text = true;
+    std::vector<Source> sources;
+    std::vector<Line> lines;
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (!strcmp(argv[arg], "-l") && arg + 1 < argc) {
+            max_level = atoi(argv[++arg]);
+            continue;
+        }
+        if (!strcmp(argv[arg], "-t")) {
+            show_text = false;
+            continue;
+        }
+
+        std::string spec = argv[arg];
+        Source src = { "", 0, 0, 0 };
+        const size_t eq = spec.find('=');
+        if (eq != std::string::npos) {
+            src.name = spec.substr(0, eq);
+            spec.erase(0, eq + 1);
+        }
+        const size_t at = spec.rfind('@');
+        if (at != std::string::npos) {
+            src.offset_us = atoll(spec.c_str() + at + 1);
+            spec.erase(at);
+        }
+        if (src.name.empty()) src.name = spec;
+
+        std::vector<uint8_t> data;
+        if (!read_file(spec.c_str(), data)) {
+            fprintf(stderr, "trace_decode: cannot read %s\n", spec.c_str());
+            return 1;
+        }
+        sources.push_back(src);
+        decode(data, sources.size() - 1, sources.back(), lines);
+    }
+    if (sources.empty()) {
+        fprintf(stderr, "usage: trace_decode [-l max_level] [-t] name=file[@offset_us] ...\n");
+        return 1;
+    }
+
+    std::stable_sort(lines.begin(), lines.end(), earlier);
+    for (size_t i = 0; i < lines.size(); i++) {
+        const Line &l = lines[i];
+        const char *name = sources[l.source].name.c_str();
+        const double t = l.time_us / 1e6;
+        if (l.is_text) {
+            if (show_text) printf("%12.6f %-8s | %s\n", t, name, l.text.c_str());
+            continue;
+        }
+        const TraceRecord &r = l.record;
+        if (r.get_level() > max_level) continue;
+        const TraceEventInfo &info = trace_event_info(r.event);
+        printf("%12.6f %-8s %2d %-5s %-18s ", t, name, r.get_context(), trace_level_name(r.get_level()), info.name);
+        printf(info.format, (int)r.a, (long)r.b);
+        printf("\n");
+    }
+
+    for (size_t i = 0; i < sources.size(); i++) {
+        fprintf(stderr, "%s: %u records, %u boots\n", sources[i].name.c_str(), sources[i].records, sources[i].boots);
+    }
+    return 0;
+}
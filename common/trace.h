@@ -0,0 +1,210 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+#include <spsc_queue.h>
+#include <mcu_proto.h>
+#include <trace_events.h>
+
+/*
+ * Deferred binary tracing (shared by the firmwares, header-only).
+ *
+ * A trace point only stores a 12 byte record (timestamp, event, two arguments) in a RAM buffer,
+ * so it can be used in interrupts and the audio path. loop() drains the buffers to the debug serial
+ * port when the port has room, without ever waiting for it. A host tool turns the output
+ * back into text (common/tools/trace_decode.cpp).
+ *
+ * Every context that traces (e.g. loop(), the audio interrupt, a FreeRTOS task) has its own
+ * TraceBuffer, since a buffer has a single producer like SpscQueue. The drain merges them in time order.
+ * A full buffer drops the new record and counts it; the drain reports the count as TRACE_DROPPED.
+ *
+ * Trace points less severe than TRACE_LEVEL are not compiled at all, arguments included:
+ *   TRACE_INFO(trace_loop, TRACE_MIDI_CC, control, value);
+ *
+ * On the wire a record is a frame like in mcu_proto.h: COBS(record | crc16) followed by 0x00,
+ * always TRACE_WIRE_FRAME bytes. The text the firmware prints on the same port passes through the decoder.
+ */
+
+#define TRACE_LEVEL_OFF 0
+#define TRACE_LEVEL_ERROR 1
+#define TRACE_LEVEL_WARN 2
+#define TRACE_LEVEL_INFO 3
+#define TRACE_LEVEL_DEBUG 4
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_LEVEL_INFO // override with -D TRACE_LEVEL=... in build_flags
+#endif
+
+#if TRACE_LEVEL >= TRACE_LEVEL_ERROR
+#define TRACE_ERROR(buf, event, a, b) (buf).record(TRACE_LEVEL_ERROR, event, a, b, micros())
+#else
+#define TRACE_ERROR(buf, event, a, b) ((void)0)
+#endif
+#if TRACE_LEVEL >= TRACE_LEVEL_WARN
+#define TRACE_WARN(buf, event, a, b) (buf).record(TRACE_LEVEL_WARN, event, a, b, micros())
+#else
+#define TRACE_WARN(buf, event, a, b) ((void)0)
+#endif
+#if TRACE_LEVEL >= TRACE_LEVEL_INFO
+#define TRACE_INFO(buf, event, a, b) (buf).record(TRACE_LEVEL_INFO, event, a, b, micros())
+#else
+#define TRACE_INFO(buf, event, a, b) ((void)0)
+#endif
+#if TRACE_LEVEL >= TRACE_LEVEL_DEBUG
+#define TRACE_DEBUG(buf, event, a, b) (buf).record(TRACE_LEVEL_DEBUG, event, a, b, micros())
+#else
+#define TRACE_DEBUG(buf, event, a, b) ((void)0)
+#endif
+
+struct TraceRecord {
+    uint32_t time_us; // micros() of the MCU that traced it
+    uint8_t event;    // TraceEventId
+    uint8_t flags;    // context << 4 | level
+    int16_t a;
+    int32_t b;
+
+    uint8_t get_level() const { return flags & 0x0f; }
+    uint8_t get_context() const { return flags >> 4; }
+};
+
+static const int TRACE_RECORD_SIZE = 12;
+static const int TRACE_RAW_FRAME = TRACE_RECORD_SIZE + 2;
+static const int TRACE_WIRE_FRAME = TRACE_RAW_FRAME + 2; // COBS code byte and delimiter
+
+// Little endian, independent of the MCU
+inline void trace_record_encode(const TraceRecord &r, uint8_t *b) {
+    b[0] = r.time_us;
+    b[1] = r.time_us >> 8;
+    b[2] = r.time_us >> 16;
+    b[3] = r.time_us >> 24;
+    b[4] = r.event;
+    b[5] = r.flags;
+    b[6] = (uint16_t)r.a;
+    b[7] = (uint16_t)r.a >> 8;
+    b[8] = (uint32_t)r.b;
+    b[9] = (uint32_t)r.b >> 8;
+    b[10] = (uint32_t)r.b >> 16;
+    b[11] = (uint32_t)r.b >> 24;
+}
+
+inline void trace_record_decode(const uint8_t *b, TraceRecord &r) {
+    r.time_us = b[0] | (b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+    r.event = b[4];
+    r.flags = b[5];
+    r.a = (int16_t)(b[6] | (b[7] << 8));
+    r.b = (int32_t)(b[8] | (b[9] << 8) | ((uint32_t)b[10] << 16) | ((uint32_t)b[11] << 24));
+}
+
+/*
+ * Encodes a record into a complete wire frame of TRACE_WIRE_FRAME bytes, delimiter included.
+ */
+inline int trace_frame_encode(const TraceRecord &r, uint8_t *dst) {
+    uint8_t raw[TRACE_RAW_FRAME];
+    trace_record_encode(r, raw);
+    const uint16_t crc = mcu_crc16(raw, TRACE_RECORD_SIZE);
+    raw[TRACE_RECORD_SIZE] = crc & 0xff;
+    raw[TRACE_RECORD_SIZE + 1] = crc >> 8;
+    const int len = mcu_cobs_encode(raw, TRACE_RAW_FRAME, dst);
+    dst[len] = 0;
+    return len + 1;
+}
+
+/*
+ * Decodes the TRACE_WIRE_FRAME - 1 bytes before a delimiter. Returns false if they are no valid frame,
+ * e.g. the end of a text line.
+ */
+inline bool trace_frame_decode(const uint8_t *src, TraceRecord &r) {
+    uint8_t raw[TRACE_RAW_FRAME + 1];
+    if (mcu_cobs_decode(src, TRACE_WIRE_FRAME - 1, raw) != TRACE_RAW_FRAME) return false;
+    const uint16_t crc = raw[TRACE_RECORD_SIZE] | (raw[TRACE_RECORD_SIZE + 1] << 8);
+    if (crc != mcu_crc16(raw, TRACE_RECORD_SIZE)) return false;
+    trace_record_decode(raw, r);
+    return true;
+}
+
+/*
+ * Records of one context. N must be a power of two.
+ */
+template <uint32_t N>
+class TraceBuffer {
+    public:
+    TraceBuffer(uint8_t context) : context(context), dropped(0), drop_time_us(0), reported_dropped(0), reporting(false) {}
+
+    // Producer side, use the TRACE_* macros
+    void record(uint8_t level, uint8_t event, int16_t a, int32_t b, uint32_t time_us) {
+        TraceRecord r;
+        r.time_us = time_us;
+        r.event = event;
+        r.flags = context << 4 | level;
+        r.a = a;
+        r.b = b;
+        if (records.push(r)) return;
+        if (dropped == __atomic_load_n(&reported_dropped, __ATOMIC_ACQUIRE)) drop_time_us = time_us;
+        __atomic_store_n(&dropped, dropped + 1, __ATOMIC_RELEASE);
+    }
+
+    /*
+     * Consumer side: oldest record, or NULL if empty. Records dropped since the last report are
+     * reported by a TRACE_DROPPED record at the time of the first drop, after the records before it.
+     */
+    const TraceRecord *peek() {
+        const uint32_t d = __atomic_load_n(&dropped, __ATOMIC_ACQUIRE);
+        const TraceRecord *next = records.peek();
+        reporting = d != reported_dropped && (!next || (int32_t)(next->time_us - drop_time_us) > 0);
+        if (!reporting) return next;
+
+        pending.time_us = drop_time_us;
+        pending.event = TRACE_DROPPED;
+        pending.flags = context << 4 | TRACE_LEVEL_WARN;
+        pending.a = context;
+        pending.b = d - reported_dropped;
+        return &pending;
+    }
+
+    // Consumer side: removes what peek() returned
+    void pop() {
+        if (reporting) {
+            __atomic_store_n(&reported_dropped, reported_dropped + pending.b, __ATOMIC_RELEASE);
+            reporting = false;
+            return;
+        }
+        TraceRecord r;
+        records.pop(r);
+    }
+
+    uint32_t get_dropped() const { return __atomic_load_n(&dropped, __ATOMIC_RELAXED); }
+    uint8_t get_context() const { return context; }
+
+    private:
+    SpscQueue<TraceRecord, N> records;
+    const uint8_t context;
+    uint32_t dropped;      // only written by the producer
+    uint32_t drop_time_us; // of the first drop since the last report, only written by the producer
+    uint32_t reported_dropped; // only written by the consumer
+
+    // Only used by the consumer
+    TraceRecord pending;
+    bool reporting; // peek() returned pending
+};
+
+/*
+ * Takes the oldest record of all buffers (consumer side). Timestamps may wrap around.
+ */
+template <uint32_t N>
+bool trace_take(TraceBuffer<N> *const *buffers, int num_buffers, TraceRecord &r) {
+    int oldest = -1;
+    const TraceRecord *oldest_record = 0;
+    for (int i = 0; i < num_buffers; i++) {
+        const TraceRecord *p = buffers[i]->peek();
+        if (p && (!oldest_record || (int32_t)(p->time_us - oldest_record->time_us) < 0)) {
+            oldest = i;
+            oldest_record = p;
+        }
+    }
+    if (oldest < 0) return false;
+    r = *oldest_record;
+    buffers[oldest]->pop();
+    return true;
+}
+
+#endif
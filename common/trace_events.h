@@ -0,0 +1,101 @@
+#ifndef _TRACE_EVENTS_H
+#define _TRACE_EVENTS_H
+
+#include <stdint.h>
+
+/*
+ * Trace events of all firmwares (see trace.h). Append only, the decoder relies on the numbers.
+ * The comment of each event names its two arguments a and b; trace_event_format() is the text
+ * the decoder prints, it is never linked into a firmware.
+ */
+enum TraceEventId {
+    TRACE_DROPPED = 0,       // a = context, b = records dropped because its buffer was full
+    TRACE_BOOT,              // a = TraceSource, b = TRACE_LEVEL
+
+    // Audio MCU
+    TRACE_KEY_PRESS,         // a = key of the USB keyboard
+    TRACE_KEY_RAW,           // a = keycode, b = 1 pressed, 0 released
+    TRACE_MIDI_NOTE_ON,      // a = channel << 8 | note, b = velocity; when played, in the audio interrupt
+    TRACE_MIDI_NOTE_OFF,     // a = channel << 8 | note
+    TRACE_MIDI_CC,           // a = channel << 8 | controller, b = value
+    TRACE_MIDI_PROGRAM,      // a = program
+    TRACE_OSC_TUNE,          // a = oscillator, b = semitones
+    TRACE_PRESET_SAVE_FAILED, // a = slot
+    TRACE_ENC_RESYNC,        // a = expected sequence number, b = received one (encoder board events)
+
+    // Output MCU
+    TRACE_ENC_BURST,         // a = events read from the encoder board at once, b = sequence number of the first
+    TRACE_UART_DECODE_ERROR, // a = frame length
+    TRACE_PARAM_RESYNC,      // a = resyncs so far, b = version of the mirror; when a snapshot is requested
+    TRACE_GUI_PAGE,          // a = page
+    TRACE_RENDER,            // a = input events applied, b = 1 if the parameters changed; per redraw
+    TRACE_INPUT_DROPPED,     // a = InputEventType, b = index
+
+    // Output MCU, once per second, while tracing replaces the text reports
+    TRACE_LOOP_AVG,          // a = TraceContext of the task, b = average loop time in us
+    TRACE_LOOP_MAX,          // a = TraceContext of the task, b = longest loop in us
+    TRACE_LOOP_COUNT,        // a = TraceContext of the task, b = loops
+    TRACE_INPUT_QUEUE,       // a = peak depth of the input queue, b = input events dropped so far
+    TRACE_PARAM_SYNC,        // a = 1 if the parameter mirror is synced, b = its version
+    TRACE_LATENCY,           // a = LatencyStage << 8 | percentile (100 the maximum, 0 the count), b = us or count
+    TRACE_CLOCK_SYNC,        // a = round trip of the audio MCU pings in us, b = offset of its clock in us
+
+    TRACE_NUM_EVENTS
+};
+
+// The MCU a trace comes from, logged with TRACE_BOOT
+enum TraceSource {
+    TRACE_SOURCE_AUDIO = 0,
+    TRACE_SOURCE_OUTPUT
+};
+
+// Tracing contexts of each MCU, one TraceBuffer each (at most 16)
+enum TraceContext {
+    TRACE_CTX_LOOP = 0,  // loop() and the callbacks it calls
+    TRACE_CTX_AUDIO,     // audio MCU: audio interrupt
+    TRACE_CTX_INPUT,     // output MCU: input task
+    TRACE_CTX_RENDER     // output MCU: render task
+};
+
+struct TraceEventInfo {
+    const char *name;
+    const char *format; // printf format of a (int) and b (long), either may be unused
+};
+
+inline const TraceEventInfo &trace_event_info(int event) {
+    static const TraceEventInfo infos[TRACE_NUM_EVENTS + 1] = {
+        { "dropped",            "context %d: %ld records dropped" },
+        { "boot",               "source %d started, trace level %ld" },
+        { "key_press",          "key %d" },
+        { "key_raw",            "keycode %d, pressed %ld" },
+        { "midi_note_on",       "channel/note 0x%04x, velocity %ld" },
+        { "midi_note_off",      "channel/note 0x%04x" },
+        { "midi_cc",            "channel/controller 0x%04x, value %ld" },
+        { "midi_program",       "program %d" },
+        { "osc_tune",           "oscillator %d, %ld semitones" },
+        { "preset_save_failed", "slot %d" },
+        { "enc_resync",         "expected sequence %d, received %ld" },
+        { "enc_burst",          "%d events from sequence %ld" },
+        { "uart_decode_error",  "frame of %d bytes" },
+        { "param_resync",       "resync %d, version %ld" },
+        { "gui_page",           "page %d" },
+        { "render",             "%d input events, parameters changed %ld" },
+        { "input_dropped",      "type %d, index %ld" },
+        { "loop_avg",           "context %d: %ld us" },
+        { "loop_max",           "context %d: %ld us" },
+        { "loop_count",         "context %d: %ld loops" },
+        { "input_queue",        "peak %d, %ld dropped" },
+        { "param_sync",         "synced %d, version %ld" },
+        { "latency",            "stage/percentile 0x%04x: %ld" },
+        { "clock_sync",         "rtt %d us, offset %ld us" },
+        { "?",                  "a %d, b %ld" }
+    };
+    return infos[event >= 0 && event < TRACE_NUM_EVENTS ? event : TRACE_NUM_EVENTS];
+}
+
+inline const char *trace_level_name(int level) {
+    static const char *const names[] = { "OFF", "ERROR", "WARN", "INFO", "DEBUG" };
+    return level >= 0 && level <= 4 ? names[level] : "?";
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef _INPUT_FILTERS_H
+#define _INPUT_FILTERS_H
+
+#include <stdint.h>
+
+/*
+ * Integrator debouncing for 8 buttons, called at a fixed rate (1 kHz on the encoder board).
+ * A button changes state once its input has been stable for INTEGRATOR_MAX calls, so a clean
+ * press is reported after a few ms instead of after a fixed debounce delay.
+ * Input and state bits use the shift register polarity: 1 = not pressed, 0 = pressed.
+ */
+class ButtonDebouncer {
+    public:
+    static const uint8_t INTEGRATOR_MAX = 4;
+    static const uint16_t LONG_PRESS_TICKS = 500;
+
+    ButtonDebouncer() : state(0xff), pressed(0), released(0), long_pressed(0) {
+        for (uint8_t i = 0; i < 8; i++) {
+            integrator[i] = INTEGRATOR_MAX;
+            held[i] = 0;
+        }
+    }
+
+    void update(uint8_t raw) {
+        pressed = released = long_pressed = 0;
+
+        for (uint8_t i = 0; i < 8; i++) {
+            const uint8_t mask = 1 << i;
+
+            if (raw & mask) {
+                if (integrator[i] < INTEGRATOR_MAX && ++integrator[i] == INTEGRATOR_MAX && !(state & mask)) {
+                    state |= mask;
+                    released |= mask;
+                }
+            } else if (integrator[i] > 0 && --integrator[i] == 0 && (state & mask)) {
+                state &= ~mask;
+                pressed |= mask;
+                held[i] = 0;
+            }
+
+            if (!(state & mask) && held[i] < LONG_PRESS_TICKS && ++held[i] == LONG_PRESS_TICKS) {
+                long_pressed |= mask;
+            }
+        }
+    }
+
+    uint8_t get_state() const { return state; }
+
+    // Buttons which changed in the last update() call
+    uint8_t get_pressed() const { return pressed; }
+    uint8_t get_released() const { return released; }
+    uint8_t get_long_pressed() const { return long_pressed; }
+
+    private:
+    uint8_t integrator[8];
+    uint16_t held[8];
+    uint8_t state;
+    uint8_t pressed, released, long_pressed;
+};
+
+/*
+ * Velocity-sensitive encoder acceleration.
+ * Detents that follow each other quickly in the same direction are multiplied,
+ * so a fast spin sweeps a 0..127 parameter in about one turn while slow turns keep single steps.
+ */
+class EncoderAccel {
+    public:
+    EncoderAccel() : last_ms(0), last_dir(0) {}
+
+    // detents = detents since the last call, now_ms = current time. Returns the accelerated steps.
+    int16_t apply(int16_t detents, uint16_t now_ms) {
+        if (detents == 0) return 0;
+
+        const int8_t dir = detents > 0 ? 1 : -1;
+        const uint16_t dt = now_ms - last_ms;
+        uint8_t factor = 1;
+        if (dir == last_dir) {
+            if (dt < 12) factor = 8;
+            else if (dt < 25) factor = 4;
+            else if (dt < 50) factor = 2;
+        }
+
+        last_ms = now_ms;
+        last_dir = dir;
+        return detents * factor;
+    }
+
+    private:
+    uint16_t last_ms;
+    int8_t last_dir;
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef _QUAD_DECODER_H
+#define _QUAD_DECODER_H
+
+#include <stdint.h>
+
+// Steps indexed by (previous state << 2) | new state, with state = A | (B << 1)
+static const int8_t quad_transitions[16] = {
+     0, -1,  1,  0,
+     1,  0,  0, -1,
+    -1,  0,  0,  1,
+     0,  1, -1,  0
+};
+
+/*
+ * Table-driven quadrature decoder for up to 8 encoders on the GPIO ports of the ATmega.
+ * update() gets the raw port input registers, which the pin change interrupt reads once,
+ * and only decodes the encoders whose pins actually changed.
+ * Positions are latched like RotaryEncoder::LatchMode::TWO03 (2 counts per cycle, on states 0 and 3).
+ * Plain C++ without AVR dependencies, so recorded pin sequences can be replayed on a PC.
+ */
+class QuadDecoder {
+    public:
+    static const uint8_t MAX_ENCODERS = 8;
+    static const uint8_t NUM_PORTS = 3; // PINB, PINC, PIND
+
+    QuadDecoder() : num_encoders(0) {}
+
+    // port = index into the ports array passed to update(), mask = bit of the pin
+    void add_encoder(uint8_t port_a, uint8_t mask_a, uint8_t port_b, uint8_t mask_b) {
+        if (num_encoders >= MAX_ENCODERS) return;
+        Pins &p = pins[num_encoders++];
+        p.port_a = port_a;
+        p.mask_a = mask_a;
+        p.port_b = port_b;
+        p.mask_b = mask_b;
+    }
+
+    // Takes over the current pin levels without counting steps
+    void init_state(const uint8_t *ports) {
+        for (uint8_t i = 0; i < NUM_PORTS; i++) {
+            last_ports[i] = ports[i];
+        }
+        for (uint8_t i = 0; i < num_encoders; i++) {
+            state[i] = read_state(pins[i], ports);
+            raw[i] = 0;
+            position[i] = 0;
+            errors[i] = 0;
+        }
+    }
+
+    void update(const uint8_t *ports) {
+        uint8_t changed[NUM_PORTS];
+        for (uint8_t i = 0; i < NUM_PORTS; i++) {
+            changed[i] = ports[i] ^ last_ports[i];
+            last_ports[i] = ports[i];
+        }
+
+        for (uint8_t i = 0; i < num_encoders; i++) {
+            const Pins &p = pins[i];
+            if (!(changed[p.port_a] & p.mask_a) && !(changed[p.port_b] & p.mask_b)) continue;
+
+            const uint8_t s = read_state(p, ports);
+            const int8_t step = quad_transitions[(state[i] << 2) | s];
+            if (step == 0 && s != state[i]) {
+                errors[i]++; // both pins changed at once: at least one step was missed
+            }
+            raw[i] += step;
+            state[i] = s;
+            if (s == 0 || s == 3) position[i] = raw[i] >> 1;
+        }
+    }
+
+    uint8_t get_num_encoders() const { return num_encoders; }
+    int16_t get_position(uint8_t i) const { return position[i]; }
+    uint16_t get_errors(uint8_t i) const { return errors[i]; }
+
+    private:
+    struct Pins {
+        uint8_t port_a, mask_a;
+        uint8_t port_b, mask_b;
+    };
+
+    static uint8_t read_state(const Pins &p, const uint8_t *ports) {
+        return ((ports[p.port_a] & p.mask_a) ? 1 : 0) | ((ports[p.port_b] & p.mask_b) ? 2 : 0);
+    }
+
+    Pins pins[MAX_ENCODERS];
+    uint8_t num_encoders;
+    uint8_t last_ports[NUM_PORTS];
+    uint8_t state[MAX_ENCODERS];
+    int16_t raw[MAX_ENCODERS];      // quarter steps
+    int16_t position[MAX_ENCODERS]; // latched position
+    uint16_t errors[MAX_ENCODERS];
+};
+
+/*
+ * Quadrature position to detents, the encoders have one detent per two positions
+ * (inline so the bench build can use it without main.cpp).
+ */
+inline int process_pos(int p) {
+    if (p % 2 == 1) p += p < 0 ? 1 : -1;
+    p >>= 1;
+    return p;
+}
+
+#endif
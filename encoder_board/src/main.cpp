@@ -1,18 +1,29 @@
 #include <Arduino.h>
-#include <RotaryEncoder.h>
 #include <Wire.h>
+#include <util/atomic.h>
+#include <util/delay.h>
+#include <enc_events.h>
+#include <quad_decoder.h>
+#include <input_filters.h>
 
-const int16_t I2C_SLAVE = 0x08;
+const int16_t I2C_SLAVE = ENC_BOARD_I2C_ADDR;
 
+#define PIN_DATA_READY 8 // active low while events are queued
 #define PIN_SR_Q 9
 #define PIN_SR_CLK 10
 #define PIN_SR_PSCTRL 11
 
+// Direct port access for the pins above (all on port B)
+#define DATA_READY_BIT (1 << PB0)
+#define SR_Q_BIT (1 << PB1)
+#define SR_CLK_BIT (1 << PB2)
+#define SR_PSCTRL_BIT (1 << PB3)
+
 // Encoders (left to right)
-// 1: A3, 5 => PC5, PD5
-// 2: A2, 6 => PC4, PD6
-// 3: A1, 7 => PC3, PD7
-// 4: A0, 4 => PC2, PD4
+// 1: A3, 5 => PC3, PD5
+// 2: A2, 6 => PC2, PD6
+// 3: A1, 7 => PC1, PD7
+// 4: A0, 4 => PC0, PD4
 
 #define PIN_ENC_1A A3
 #define PIN_ENC_2A A2
@@ -23,60 +34,160 @@ const int16_t I2C_SLAVE = 0x08;
 #define PIN_ENC_3B 7
 #define PIN_ENC_4B 4
 
-const int enc_pins[] = {PIN_ENC_1A, PIN_ENC_2A, PIN_ENC_3A, PIN_ENC_4A,
-                        PIN_ENC_1B, PIN_ENC_2B, PIN_ENC_3B, PIN_ENC_4B};
+// A and B pin of each encoder, up to QuadDecoder::MAX_ENCODERS
+const uint8_t enc_pins[][2] = {{PIN_ENC_1A, PIN_ENC_1B}, {PIN_ENC_2A, PIN_ENC_2B},
+                               {PIN_ENC_3A, PIN_ENC_3B}, {PIN_ENC_4A, PIN_ENC_4B}};
+const int num_encoders = sizeof (enc_pins) / sizeof (enc_pins[0]);
+
+QuadDecoder decoder;
+EncoderAccel accel[QuadDecoder::MAX_ENCODERS];
+ButtonDebouncer debouncer; // only used by the 1 kHz timer interrupt
 
-RotaryEncoder enc1(PIN_ENC_1A, PIN_ENC_1B, RotaryEncoder::LatchMode::TWO03);
-RotaryEncoder enc2(PIN_ENC_2A, PIN_ENC_2B, RotaryEncoder::LatchMode::TWO03);
-RotaryEncoder enc3(PIN_ENC_3A, PIN_ENC_3B, RotaryEncoder::LatchMode::TWO03);
-RotaryEncoder enc4(PIN_ENC_4A, PIN_ENC_4B, RotaryEncoder::LatchMode::TWO03);
+int pos[QuadDecoder::MAX_ENCODERS]; // accelerated positions reported to the master
+int last_detents[QuadDecoder::MAX_ENCODERS];
+volatile uint8_t btn = 0xff; // debounced bitmap for 8 buttons: 1 = not pressed, 0 = pressed (LOW)
+const uint8_t btn_index[8] = {3, 2, 1, 0, 7, 6, 5, 4}; // button number of each btn bit (bits 3..0 = encoders 1..4)
 
-RotaryEncoder *enc[] = {&enc1, &enc2, &enc3, &enc4};
+/*
+ * Queue of input events for the I2C master.
+ * Written by loop(), read by the I2C request handler (TWI interrupt).
+ */
+#define EVENT_QUEUE_SIZE 32
+EncEvent event_queue[EVENT_QUEUE_SIZE];
+volatile uint8_t event_head = 0; // next slot to write
+volatile uint8_t event_tail = 0; // next slot to read
+volatile uint8_t event_count = 0;
+uint8_t event_seq = 0;
+uint8_t i2c_reg = ENC_REG_SNAPSHOT;
+uint8_t burst_size = 0; // number of events announced by the last ENC_REG_COUNT read
 
-int pos[4];
-uint8_t btn; // bitmap for 8 buttons: 1 = not pressed, 0 = pressed (LOW)
-int last_pos[4] = {0, 0, 0, 0};
-uint8_t last_btn = 0xff;
+void update_data_ready() {
+  if (event_count > 0) PORTB &= ~DATA_READY_BIT;
+  else PORTB |= DATA_READY_BIT;
+}
+
+void push_event(uint8_t type, uint8_t index, int16_t value) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    // The sequence number advances even if the event is dropped, so the master notices the gap
+    const uint8_t seq = event_seq++;
+    if (event_count < EVENT_QUEUE_SIZE) {
+      EncEvent &e = event_queue[event_head];
+      e.seq = seq;
+      e.type = type;
+      e.index = index;
+      e.value = value;
+      e.timestamp = enc_time(micros());
+      event_head = (event_head + 1) % EVENT_QUEUE_SIZE;
+      event_count++;
+    }
+    update_data_ready();
+  }
+}
+
+/*
+ * Pin changes on any encoder: sample all encoder ports once and let the decoder
+ * work out which encoders moved.
+ */
+static inline void decode_encoders()
+{
+  const uint8_t ports[QuadDecoder::NUM_PORTS] = {PINB, PINC, PIND};
+  decoder.update(ports);
+}
+
+ISR(PCINT0_vect)
+{
+  decode_encoders();
+}
 
 ISR(PCINT1_vect)
 {
-  enc1.tick();
-  enc2.tick();
-  enc3.tick();
-  enc4.tick();
+  decode_encoders();
 }
 
 ISR(PCINT2_vect)
 {
-  enc1.tick();
-  enc2.tick();
-  enc3.tick();
-  enc4.tick();
+  decode_encoders();
+}
+
+/*
+ * Registers each encoder pin with the decoder and enables its pin change interrupt.
+ * Port and bit are taken from the Arduino pin mapping so the table above is the only wiring description.
+ */
+void setup_encoders()
+{
+  uint8_t pcicr = 0;
+
+  for (int i = 0; i < num_encoders; i++) {
+    uint8_t port[2], mask[2];
+    for (int j = 0; j < 2; j++) {
+      const uint8_t pin = enc_pins[i][j];
+      pinMode(pin, INPUT);
+      port[j] = digitalPinToPort(pin) - PB; // PINB, PINC, PIND => 0, 1, 2
+      mask[j] = digitalPinToBitMask(pin);
+      *digitalPinToPCMSK(pin) |= 1 << digitalPinToPCMSKbit(pin);
+      pcicr |= 1 << digitalPinToPCICRbit(pin);
+    }
+    decoder.add_encoder(port[0], mask[0], port[1], mask[1]);
+  }
+
+  const uint8_t ports[QuadDecoder::NUM_PORTS] = {PINB, PINC, PIND};
+  decoder.init_state(ports);
+  PCICR |= pcicr; // activate PCI on the ports in use
 }
 
 /*
- * Reply to MIDI fighter brain requesting rotary positions
+ * Master selects the register to read next
+ */
+void on_i2c_receive(int num_bytes) {
+  if (num_bytes > 0) i2c_reg = Wire.read();
+  while (Wire.available()) Wire.read();
+}
+
+/*
+ * Reply to the master reading the selected register (runs in the TWI interrupt)
  */
 void on_i2c_request() {
-  for (int i = 0; i < 4; i++) {
-    Wire.write((pos[i] & 0xff00) >> 8);
-    Wire.write(pos[i] & 0x00ff);
+  const uint16_t now = enc_time(micros()); // lets the master work out the age of the events
+  uint8_t buf[ENC_MAX_BURST * ENC_EVENT_SIZE + ENC_TIME_SIZE];
+
+  if (i2c_reg == ENC_REG_COUNT) {
+    burst_size = event_count < ENC_MAX_BURST ? event_count : ENC_MAX_BURST;
+    Wire.write(burst_size);
+  } else if (i2c_reg == ENC_REG_EVENTS) {
+    int n = 0;
+    for (; n < burst_size; n++) {
+      enc_event_encode(event_queue[event_tail], buf + n * ENC_EVENT_SIZE);
+      event_tail = (event_tail + 1) % EVENT_QUEUE_SIZE;
+      event_count--;
+    }
+    burst_size = 0;
+    enc_time_encode(now, buf + n * ENC_EVENT_SIZE);
+    Wire.write(buf, n * ENC_EVENT_SIZE + ENC_TIME_SIZE);
+    update_data_ready();
+  } else {
+    for (int i = 0; i < 4; i++) {
+      buf[2 * i] = (pos[i] & 0xff00) >> 8;
+      buf[2 * i + 1] = pos[i] & 0x00ff;
+    }
+    buf[8] = btn ^ 0xff; // flip bits so that 0 means not pressed, 1 means pressed
+    Wire.write(buf, ENC_SNAPSHOT_SIZE);
   }
-  Wire.write(btn ^ 0xff); // flip bits so that 0 means not pressed, 1 means pressed
 }
 
 void setup() {
+  pinMode(PIN_DATA_READY, OUTPUT);
+  digitalWrite(PIN_DATA_READY, HIGH);
   pinMode(PIN_SR_Q, INPUT);
   pinMode(PIN_SR_CLK, OUTPUT);
   pinMode(PIN_SR_PSCTRL, OUTPUT);
   digitalWrite(PIN_SR_CLK, LOW);
   digitalWrite(PIN_SR_PSCTRL, LOW);
   
-  PCICR |= (1 << 1) | (1 << 2); // activate PCI on PC and PD ports
-  PCMSK1 = (1 << 5) | (1 << 4) | (1 << 3) | (1 << 2);
-  PCMSK2 = (1 << 5) | (1 << 6) | (1 << 7) | (1 << 4);
+  setup_encoders();
+  setup_button_timer();
 
   Wire.begin(I2C_SLAVE);
+  Wire.onReceive(on_i2c_receive);
   Wire.onRequest(on_i2c_request);
   
   Serial.begin(9600);
@@ -85,35 +196,68 @@ void setup() {
 
 uint8_t read_shift_register()
 {
-  // P/S set to Parallel to jam-in P1-P8
-  digitalWrite(PIN_SR_PSCTRL, HIGH);
-  delayMicroseconds(20);
-  digitalWrite(PIN_SR_PSCTRL, LOW);
-  digitalWrite(PIN_SR_CLK, LOW);
+  // P/S set to Parallel to jam-in P1-P8, the pulse only needs a few hundred ns
+  PORTB |= SR_PSCTRL_BIT;
+  _delay_us(1);
+  PORTB &= ~(SR_PSCTRL_BIT | SR_CLK_BIT);
 
-  uint8_t first = digitalRead(PIN_SR_Q);
-  uint8_t r = shiftIn(PIN_SR_Q, PIN_SR_CLK, MSBFIRST);
-  r >>= 1;
-  r |= first << 7;
+  // First bit is available right after the load, the remaining 7 are clocked in
+  uint8_t r = (PINB & SR_Q_BIT) ? 1 : 0;
+  for (uint8_t i = 0; i < 7; i++) {
+    PORTB |= SR_CLK_BIT;
+    r = (r << 1) | ((PINB & SR_Q_BIT) ? 1 : 0);
+    PORTB &= ~SR_CLK_BIT;
+  }
   return r;
 }
 
-int process_pos(int p)
+/*
+ * 1 kHz timer: poll and debounce the buttons
+ */
+ISR(TIMER2_COMPA_vect)
+{
+  debouncer.update(read_shift_register());
+  btn = debouncer.get_state();
+
+  const uint8_t pressed = debouncer.get_pressed();
+  const uint8_t released = debouncer.get_released();
+  const uint8_t long_pressed = debouncer.get_long_pressed();
+  if (!(pressed | released | long_pressed)) return;
+
+  for (uint8_t i = 0; i < 8; i++) {
+    const uint8_t mask = 1 << i;
+    if (pressed & mask) push_event(ENC_EVENT_BUTTON, btn_index[i], ENC_BUTTON_PRESSED);
+    if (released & mask) push_event(ENC_EVENT_BUTTON, btn_index[i], ENC_BUTTON_RELEASED);
+    if (long_pressed & mask) push_event(ENC_EVENT_BUTTON, btn_index[i], ENC_BUTTON_LONG_PRESS);
+  }
+}
+
+void setup_button_timer()
 {
-  if (p % 2 == 1) p += p < 0 ? 1 : -1;
-  p >>= 1;
-  return p;
+  // Timer2 in CTC mode: 8 MHz / 64 / 125 = 1 kHz
+  TCCR2A = 1 << WGM21;
+  TCCR2B = 1 << CS22;
+  OCR2A = 124;
+  TIMSK2 = 1 << OCIE2A;
 }
 
 void loop() {
-  int i;
-  
-  for (i = 0; i < 4; i++) {
-    pos[i] = process_pos(enc[i]->getPosition());
+  for (int i = 0; i < num_encoders; i++) {
+    int16_t p;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      p = decoder.get_position(i);
+    }
+
+    const int detents = process_pos(p);
+    const int16_t steps = accel[i].apply(detents - last_detents[i], millis());
+    last_detents[i] = detents;
+    if (steps != 0) {
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        pos[i] += steps;
+      }
+      push_event(ENC_EVENT_ENCODER, i, pos[i]);
+    }
   }
-  btn = read_shift_register();
 
-  // Interrupts for the encoders will still get triggered and encoder objects updated
-  // delay here helps to debounce buttons
-  delay(40);
+  // Buttons are polled and debounced by the timer interrupt, so there is nothing to wait for here
 }
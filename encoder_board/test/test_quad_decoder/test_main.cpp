@@ -0,0 +1,271 @@
+/*
+ * Replays A/B pin sequences through QuadDecoder the way the board's pin change interrupts see them:
+ * a change sets the interrupt flag, the ISR reads all ports a few us later and is then busy
+ * for a while, so changes faster than that arrive merged. Checks the step counts of clean, bouncing
+ * and fast turns, and that every step lost to merged changes is counted as an error.
+ */
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <quad_decoder.h>
+
+// ATmega328p at 8 MHz: ISR entry until the port read, then the rest of decode_encoders()
+static const uint32_t ISR_READ_US = 5;
+static const uint32_t ISR_BUSY_US = 20;
+
+// Ports PINB, PINC, PIND = 0, 1, 2
+enum { PORT_B = 0, PORT_C, PORT_D };
+
+struct Pins {
+    uint8_t port_a, mask_a;
+    uint8_t port_b, mask_b;
+};
+
+// The four encoders of the board (see main.cpp), then four more on free pins up to MAX_ENCODERS
+static const Pins board_pins[QuadDecoder::MAX_ENCODERS] = {
+    { PORT_C, 1 << 3, PORT_D, 1 << 5 },
+    { PORT_C, 1 << 2, PORT_D, 1 << 6 },
+    { PORT_C, 1 << 1, PORT_D, 1 << 7 },
+    { PORT_C, 1 << 0, PORT_D, 1 << 4 },
+    { PORT_C, 1 << 4, PORT_C, 1 << 5 },
+    { PORT_D, 1 << 2, PORT_D, 1 << 3 },
+    { PORT_B, 1 << 4, PORT_B, 1 << 5 },
+    { PORT_D, 1 << 0, PORT_B, 1 << 6 }
+};
+
+struct PinChange {
+    uint32_t time_us;
+    uint8_t encoder;
+    uint8_t state; // A | (B << 1)
+};
+
+static bool earlier(const PinChange &a, const PinChange &b) {
+    return a.time_us < b.time_us;
+}
+
+static QuadDecoder decoder;
+static uint8_t ports[QuadDecoder::NUM_PORTS];
+
+static void set_state(int encoder, uint8_t state) {
+    const Pins &p = board_pins[encoder];
+    ports[p.port_a] = (state & 1) ? ports[p.port_a] | p.mask_a : ports[p.port_a] & ~p.mask_a;
+    ports[p.port_b] = (state & 2) ? ports[p.port_b] | p.mask_b : ports[p.port_b] & ~p.mask_b;
+}
+
+static void setup_decoder(int n) {
+    decoder = QuadDecoder();
+    memset(ports, 0, sizeof (ports));
+    for (int i = 0; i < n; i++) {
+        const Pins &p = board_pins[i];
+        decoder.add_encoder(p.port_a, p.mask_a, p.port_b, p.mask_b);
+    }
+    decoder.init_state(ports);
+}
+
+/*
+ * Applies the changes in time order. Returns the number of ISR runs.
+ */
+static int replay(std::vector<PinChange> changes) {
+    std::stable_sort(changes.begin(), changes.end(), earlier);
+    size_t i = 0;
+    bool pending = false;
+    uint32_t flag_us = 0;
+    uint32_t busy_until_us = 0;
+    int isr_runs = 0;
+
+    while (i < changes.size() || pending) {
+        if (!pending) {
+            set_state(changes[i].encoder, changes[i].state);
+            flag_us = changes[i++].time_us;
+            pending = true;
+            continue;
+        }
+        const uint32_t read_us = std::max(flag_us, busy_until_us) + ISR_READ_US;
+        if (i < changes.size() && changes[i].time_us <= read_us) {
+            set_state(changes[i].encoder, changes[i].state); // the flag is already set
+            i++;
+            continue;
+        }
+        decoder.update(ports);
+        isr_runs++;
+        pending = false;
+        busy_until_us = read_us + ISR_BUSY_US;
+    }
+    return isr_runs;
+}
+
+/*
+ * Generates a turn by whole detents (4 pin changes each, direction like the decoder's table),
+ * each change interval_us after the previous one. With bounces > 0 the changing pin chatters
+ * that many times, bounce_us apart, before it settles.
+ */
+struct Turn {
+    uint8_t state;
+    uint32_t time_us;
+};
+
+static void add_turn(std::vector<PinChange> &changes, int encoder, Turn &t, int detents, uint32_t interval_us,
+        int bounces = 0, uint32_t bounce_us = 0) {
+    static const uint8_t forward[4] = { 2, 3, 1, 0 };  // from 0: +1 quarter step each
+    static const uint8_t backward[4] = { 1, 3, 2, 0 }; // from 0: -1 quarter step each
+    const uint8_t *seq = detents > 0 ? forward : backward;
+    for (int d = 0; d < abs(detents); d++) {
+        for (int s = 0; s < 4; s++) {
+            t.time_us += interval_us;
+            const uint8_t next = seq[s];
+            for (int b = 0; b < bounces; b++) {
+                const PinChange c1 = { t.time_us, (uint8_t)encoder, next };
+                const PinChange c2 = { t.time_us + bounce_us, (uint8_t)encoder, t.state };
+                changes.push_back(c1);
+                changes.push_back(c2);
+                t.time_us += 2 * bounce_us;
+            }
+            const PinChange c = { t.time_us, (uint8_t)encoder, next };
+            changes.push_back(c);
+            t.state = next;
+        }
+    }
+}
+
+// Latched position after whole detents: 2 counts per detent
+static void assert_position(int encoder, int detents) {
+    TEST_ASSERT_EQUAL_UINT16(0, decoder.get_errors(encoder));
+    TEST_ASSERT_EQUAL_INT16(2 * detents, decoder.get_position(encoder));
+    TEST_ASSERT_EQUAL_INT(detents, process_pos(decoder.get_position(encoder)));
+}
+
+static void test_slow_turns(void) {
+    setup_decoder(4);
+    std::vector<PinChange> changes;
+    static const int detents[4] = { 24, -24, 7, -3 };
+    for (int e = 0; e < 4; e++) {
+        Turn t = { 0, (uint32_t)e * 1000 };
+        add_turn(changes, e, t, detents[e], 5000);
+        add_turn(changes, e, t, -detents[e] / 2, 5000);
+    }
+    replay(changes);
+    for (int e = 0; e < 4; e++) {
+        assert_position(e, detents[e] - detents[e] / 2);
+    }
+}
+
+/*
+ * A trace in the format of a logic analyser export ("time_us encoder BA", one change per line),
+ * here a slow turn of encoder 2 by two detents forward and one back, with contact bounce
+ * on most edges. Captures from the board can be replayed the same way.
+ */
+static const char *const bounce_trace =
+    "0     1 00\n"
+    "1000  1 10\n" "1004  1 00\n" "1009  1 10\n"
+    "2400  1 11\n" "2402  1 10\n" "2403  1 11\n" "2411  1 10\n" "2415  1 11\n"
+    "3900  1 01\n"
+    "5100  1 00\n" "5101  1 01\n" "5106  1 00\n"
+    "9000  1 10\n" "9003  1 00\n" "9004  1 10\n"
+    "10200 1 11\n"
+    "11300 1 01\n" "11301 1 11\n" "11302 1 01\n" "11390 1 11\n" "11391 1 01\n"
+    "12800 1 00\n"
+    "30000 1 01\n" "30006 1 00\n" "30007 1 01\n"
+    "31000 1 11\n"
+    "32500 1 10\n" "32502 1 11\n" "32510 1 10\n"
+    "34000 1 00\n" "34001 1 10\n" "34002 1 00\n";
+
+static std::vector<PinChange> parse_trace(const char *trace) {
+    std::vector<PinChange> changes;
+    unsigned time_us, encoder, b, a;
+    int used;
+    while (sscanf(trace, " %u %u %1u%1u%n", &time_us, &encoder, &b, &a, &used) == 4) {
+        const PinChange c = { time_us, (uint8_t)encoder, (uint8_t)(a | (b << 1)) };
+        changes.push_back(c);
+        trace += used;
+    }
+    return changes;
+}
+
+static void test_bounce_trace(void) {
+    setup_decoder(4);
+    const std::vector<PinChange> changes = parse_trace(bounce_trace);
+    TEST_ASSERT_EQUAL_INT(33, (int)changes.size());
+    replay(changes);
+    assert_position(1, 1);
+    assert_position(0, 0);
+}
+
+// Chatter faster than the ISR and slower than it both cancel out
+static void test_synthetic_bounce(void) {
+    static const uint32_t bounce_us[] = { 1, 3, 8, 40, 150 };
+    for (unsigned b = 0; b < sizeof (bounce_us) / sizeof (bounce_us[0]); b++) {
+        setup_decoder(4);
+        std::vector<PinChange> changes;
+        for (int e = 0; e < 4; e++) {
+            Turn t = { 0, (uint32_t)e * 37 };
+            add_turn(changes, e, t, e % 2 ? -20 : 20, 2000, 1 + e, bounce_us[b]);
+        }
+        replay(changes);
+        for (int e = 0; e < 4; e++) {
+            assert_position(e, e % 2 ? -20 : 20);
+        }
+    }
+}
+
+/*
+ * All encoders spun at once, far faster than by hand (a change every 100 us is 2500 detents/s),
+ * partly with changes at the same instant on the same port: one port read serves them all.
+ */
+static void test_fast_spin_all_encoders(void) {
+    for (int n = 4; n <= QuadDecoder::MAX_ENCODERS; n += 4) {
+        setup_decoder(n);
+        std::vector<PinChange> changes;
+        for (int e = 0; e < n; e++) {
+            Turn t = { 0, (uint32_t)(e % 2) * 50 };
+            add_turn(changes, e, t, e % 3 ? 500 : -500, 100);
+        }
+        const int isr_runs = replay(changes);
+        TEST_ASSERT_LESS_THAN_INT((int)changes.size(), isr_runs); // simultaneous changes were merged
+        for (int e = 0; e < n; e++) {
+            assert_position(e, e % 3 ? 500 : -500);
+        }
+    }
+}
+
+/*
+ * Changes 15 us apart come faster than the ISR runs, so two of them can arrive as one jump of both
+ * pins. The decoder cannot tell the direction of such a jump and drops it, but counts it: every
+ * error is one lost position count, nothing else is lost.
+ */
+static void test_too_fast_counts_missed_steps(void) {
+    setup_decoder(4);
+    std::vector<PinChange> changes;
+    Turn t = { 0, 0 };
+    add_turn(changes, 0, t, 200, 15);
+    replay(changes);
+    const int forward_errors = decoder.get_errors(0);
+    TEST_ASSERT_GREATER_THAN_INT(0, forward_errors);
+    TEST_ASSERT_EQUAL_INT16(2 * 200 - forward_errors, decoder.get_position(0));
+
+    changes.clear();
+    t.time_us += 1000;
+    add_turn(changes, 0, t, -100, 15);
+    replay(changes);
+    const int backward_errors = decoder.get_errors(0) - forward_errors;
+    TEST_ASSERT_GREATER_THAN_INT(0, backward_errors);
+    TEST_ASSERT_EQUAL_INT16(2 * 100 - forward_errors + backward_errors, decoder.get_position(0));
+}
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+int main(int, char **) {
+    UNITY_BEGIN();
+    RUN_TEST(test_slow_turns);
+    RUN_TEST(test_bounce_trace);
+    RUN_TEST(test_synthetic_bounce);
+    RUN_TEST(test_fast_spin_all_encoders);
+    RUN_TEST(test_too_fast_counts_missed_steps);
+    return UNITY_END();
+}
@@ -0,0 +1,80 @@
+/*
+ * Micro-benchmarks of the encoder board's input processing on a PC, output as JSON lines (see bench.h).
+ *
+ * Build and run: pio run -e bench && .pio/build/bench/program [filter] [--baseline old.json]
+ * or: g++ -O2 -std=gnu++14 -Iinclude -I../common -o bench tools/bench.cpp
+ */
+
+#include <bench.h>
+#include <quad_decoder.h>
+#include <input_filters.h>
+#include <enc_events.h>
+
+// Port bits of encoder 1 like on the board: A on PC3, B on PD5 (ports PINB, PINC, PIND = 0, 1, 2)
+#define PORT_A 1
+#define MASK_A (1 << 3)
+#define PORT_B 2
+#define MASK_B (1 << 5)
+
+int main(int argc, char **argv) {
+    Bench bench("encoder_board", argc, argv);
+
+    // One full quadrature cycle (4 pin changes) per call, on one of four encoders
+    QuadDecoder decoder;
+    for (int i = 0; i < 4; i++) {
+        decoder.add_encoder(PORT_A, MASK_A >> i, PORT_B, MASK_B >> i);
+    }
+    uint8_t ports[QuadDecoder::NUM_PORTS] = {0, 0, 0};
+    decoder.init_state(ports);
+    static const uint8_t cycle[4] = {1, 3, 2, 0}; // A | (B << 1)
+    bench.run("quad_decoder_update", [&]() {
+        for (int s = 0; s < 4; s++) {
+            ports[PORT_A] = cycle[s] & 1 ? MASK_A : 0;
+            ports[PORT_B] = cycle[s] & 2 ? MASK_B : 0;
+            decoder.update(ports);
+        }
+        bench_keep(decoder.get_position(0));
+    }, 4);
+
+    int p = -1000;
+    bench.run("process_pos", [&]() {
+        bench_keep(process_pos(p));
+        p = p < 1000 ? p + 1 : -1000;
+    });
+
+    EncoderAccel accel;
+    uint16_t now = 0;
+    bench.run("encoder_accel_apply", [&]() {
+        now += 7;
+        bench_keep(accel.apply((now & 64) ? 1 : -1, now));
+    });
+
+    // 1 kHz debouncer tick with a bouncing button 0 and a held button 3
+    ButtonDebouncer debouncer;
+    uint32_t tick = 0;
+    bench.run("button_debouncer_update", [&]() {
+        tick++;
+        const uint8_t bounce = (tick & 0x40) ? ((tick & 3) == 0 ? 0 : 1) : 1;
+        debouncer.update(0xff & ~(((tick >> 8) & 1) << 3) & ~(bounce ? 0 : 1));
+        bench_keep(debouncer.get_pressed());
+    });
+
+    // A full burst as sent to the master
+    EncEvent events[ENC_MAX_BURST];
+    for (int i = 0; i < ENC_MAX_BURST; i++) {
+        events[i].seq = i;
+        events[i].type = ENC_EVENT_ENCODER;
+        events[i].index = i % ENC_NUM_ENCODERS;
+        events[i].value = 100 * i - 200;
+        events[i].timestamp = 1000 + i;
+    }
+    uint8_t wire[ENC_MAX_BURST * ENC_EVENT_SIZE];
+    bench.run("enc_event_encode_burst", [&]() {
+        for (int i = 0; i < ENC_MAX_BURST; i++) {
+            enc_event_encode(events[i], wire + i * ENC_EVENT_SIZE);
+        }
+        bench_keep(wire);
+    }, ENC_MAX_BURST);
+
+    return bench.finish();
+}
@@ -0,0 +1,49 @@
+#ifndef _GLYPH_ATLAS_H
+#define _GLYPH_ATLAS_H
+
+#include <stdint.h>
+
+/*
+ * Glyphs of a TFT_22_ILI9225 font pre-rendered as RGB565 blocks, one set per foreground/background
+ * color pair. Drawing text then only copies rows of ready pixels instead of testing font bits.
+ *
+ * Every glyph is a cell of get_cell_width() x get_height() pixels including the blank column after
+ * the char, of which get_width() columns are used. Sets are rendered on first use, and when all
+ * MAX_COLOR_PAIRS slots are taken the least recently used set is replaced.
+ */
+class GlyphAtlas {
+    public:
+    static const int MAX_COLOR_PAIRS = 4;
+
+    GlyphAtlas();
+
+    void set_font(const uint8_t *font);
+    bool has_glyph(char c) const;
+    int get_width(char c) const; // advance including the blank column, 0 if the font lacks c
+    int get_cell_width() const { return cell_width; }
+    int get_height() const { return height; }
+
+    // Glyph cell of c, row by row with a stride of get_cell_width(). c must be a char of the font.
+    // NULL if there is no memory for another color set.
+    const uint16_t *get_glyph(char c, uint16_t color, uint16_t bg_color);
+
+    private:
+    struct Slot {
+        uint16_t color;
+        uint16_t bg_color;
+        uint32_t last_used;
+        uint16_t *pixels; // num_chars cells
+    };
+
+    Slot *find_slot(uint16_t color, uint16_t bg_color);
+    void render(Slot &slot);
+
+    const uint8_t *font;
+    uint8_t first_char, num_chars;
+    int cell_width, height;
+    int glyph_pixels; // per cell
+    Slot slots[MAX_COLOR_PAIRS];
+    uint32_t use_counter;
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef _GUI_PAGES_H
+#define _GUI_PAGES_H
+
+#include <tft_gui.h>
+#include <gui_widgets.h>
+#include <mcu_proto.h>
+#include <param_desc.h>
+
+#define NUM_ENCODERS 4
+
+// GUI constants
+const int BARS_X_START = 15;
+const int BARS_WIDTH = 50;
+const int BARS_Y = 50;
+
+// Asks the audio MCU to change a parameter, value 0 .. MCU_PARAM_MAX
+typedef void (*GuiParamHandler)(uint8_t id, int16_t value);
+
+/*
+ * A GuiPage is one screen with various Gui elements such as graphics and text.
+ * Each page stores all the necessary data which has to be kept in the background
+ * if the user switches to a different page.
+ * Elements are retained widgets, so calling render() only pushes what changed to the display.
+ *
+ * A bar can be bound to a parameter of the audio MCU. It then shows the audio MCU's value
+ * (the mirror owned by Gui), whoever changed it, and turning its encoder asks for a relative change.
+ * While the encoder turns the bar shows the value asked for, until the echoes have caught up.
+ * Label, unit and encoder steps of such a bar come from the parameter's descriptor (param_desc.h).
+ */
+class GuiPage {
+    public:
+    GuiPage();
+    virtual void render() = 0;
+    virtual void update_data(int *enc_values, int *enc_deltas, bool *button_states) = 0;
+    void draw_bar(int i, int value, int color, const char *text);
+    virtual void invalidate(); // redraw everything on the next render(), e.g. when the page becomes visible
+    void set_params(const int16_t *params, GuiParamHandler handler);
+
+    static const uint8_t NO_PARAM = 0xff;
+    static const uint32_t EDIT_HOLD_MS = 300;
+
+    protected:
+    void bind_param(int i, uint8_t id);
+    void turn_param(int i, int delta);
+    void draw_param_bar(int i, int color);
+
+    BarWidget bars[NUM_ENCODERS];
+    bool button_states[NUM_ENCODERS];
+
+    private:
+    int16_t param_value(int i) const;
+
+    const int16_t *params;
+    GuiParamHandler param_handler;
+    uint8_t param_ids[NUM_ENCODERS];
+    int16_t edit_values[NUM_ENCODERS];
+    uint32_t edit_ms[NUM_ENCODERS];
+    bool edited[NUM_ENCODERS];
+};
+
+class MixerGuiPage : public GuiPage {
+    public:
+    MixerGuiPage();
+    void render();
+    void update_data(int *enc_values, int *enc_deltas, bool *button_states);
+
+    private:
+    int volume_osc1, volume_osc2, volume_noise;
+};
+
+class OscillatorGuiPage : public GuiPage {
+    public:
+    OscillatorGuiPage();
+    void render();
+    void update_data(int *enc_values, int *enc_deltas, bool *button_states);
+};
+
+class FilterGuiPage : public GuiPage {
+    public:
+    FilterGuiPage();
+    void render();
+    void update_data(int *enc_values, int *enc_deltas, bool *button_states);
+
+    private:
+    int attenuation, filter_type;
+};
+
+class EnvelopeGuiPage : public GuiPage {
+    public:
+    EnvelopeGuiPage();
+    void render();
+    void update_data(int *enc_values, int *enc_deltas, bool *button_states);
+};
+
+/*
+ * Profiling figures of the audio MCU (see McuStatId): audio memory use, to right-size AudioMemory(),
+ * CPU load per group of audio nodes and the slowest sections of its loop(), and the latency of
+ * encoder input at each stage (the output MCU fills in its own stages). Only changed figures are redrawn.
+ */
+class DiagnosticsGuiPage : public GuiPage {
+    public:
+    DiagnosticsGuiPage();
+    void render();
+    void update_data(int *enc_values, int *enc_deltas, bool *button_states);
+    void invalidate();
+    void set_stats(const int16_t *stats);
+
+    private:
+    struct Row {
+        const char *label;
+        uint8_t id;
+        bool tenths; // value is in 0.1 units
+    };
+
+    void draw_value(int x, int y, const Row &row);
+
+    static const int NUM_ROWS = 11;
+    static const Row rows[NUM_ROWS];
+    static const int ROW_HEIGHT = 12;
+    static const int FIRST_ROW_Y = 20;
+
+    int16_t stats[STAT_NUM_IDS];
+    int16_t drawn[STAT_NUM_IDS];
+    bool labels_drawn;
+    bool values_drawn;
+};
+
+/*
+ * The Gui object manages the various pages. Each page can render itself.
+ */
+class Gui {
+    public:
+        Gui();
+        void switch_page(int i);
+        void previous_page();
+        void next_page();
+        void render(); // render the whole GUI
+        void update_encoder(int i); // redraw only a specific encoder area (bar, text, maybe graphics if affected)
+        void update_button(int i); // redraw only a specific button area (bar, text, maybe graphics if affected)
+        void update_data(int *enc_values, bool *button_states);
+        void update_stats(const int16_t *stats); // profiling figures from the audio MCU
+        void update_params(const int16_t *values); // parameter state of the audio MCU, NUM_PARAMS values
+        void set_param_handler(GuiParamHandler handler);
+
+        enum gui_pages_enum {
+            PAGE_MIXER = 0,
+            PAGE_SYNTH,
+            PAGE_FILTER,
+            PAGE_ENVELOPE,
+            PAGE_DIAGNOSTICS,
+            PAGE_SAMPLER,
+            PAGE_SEQUENCER
+        };
+
+    private:
+        static const int num_pages = 5;
+        GuiPage *pages[num_pages];
+        DiagnosticsGuiPage *diagnostics_page;
+        int current_page_idx;
+        GuiPage *current_page;
+        int16_t params[NUM_PARAMS]; // mirror of the audio MCU's parameters, shown by the pages
+        int last_enc_values[NUM_ENCODERS];
+        bool enc_values_known;
+        bool page_button_down; // button 4 state of the last update_data(), pages switch on its press
+};
+
+extern TftGui tft; // the display all pages draw to, defined in main.cpp
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef _GUI_WIDGETS_H
+#define _GUI_WIDGETS_H
+
+#include <tft_gui.h>
+
+/*
+ * Retained GUI elements: each widget remembers what it has drawn and only redraws
+ * the parts (bar, value text, label) that changed since the last draw().
+ */
+class BarWidget {
+    public:
+    BarWidget();
+    void set_position(int x, int y);
+    void set_color(int color);
+    void set_label(const char *label);
+    void set_value(int value);
+    void set_text(const char *text); // shown instead of the value, e.g. with a unit (copied)
+    void invalidate(); // next draw() redraws everything, e.g. after the screen has been cleared
+    bool is_dirty() const;
+    void draw(TftGui &tft);
+
+    static const int LABEL_OFFSET_Y = 24;
+    static const int TEXT_SIZE = TftGui::BAR_TEXT_CHARS + 1;
+
+    private:
+    int x, y;
+    int color;
+    const char *label;
+    int value;
+    char text[TEXT_SIZE];
+
+    int drawn_value;
+    const char *drawn_label;
+    bool bar_dirty;   // outline or color changed: full bar redraw
+    bool value_dirty; // only the value changed: partial bar and value text redraw
+    bool text_dirty;
+    bool label_dirty;
+};
+
+#endif
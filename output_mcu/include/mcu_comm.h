@@ -1,6 +1,22 @@
 #ifndef _MCU_COMM_H
 #define _MCU_COMM_H
 
+#include <mcu_proto.h>
+#include <spsc_queue.h>
+#include <enc_events.h>
+#include <param_mirror.h>
+#include <clock_sync.h>
+#include <latency_hist.h>
+
+/*
+ * One complete frame as received (COBS data without the delimiter).
+ */
+struct McuRxFrame {
+    uint32_t time_us; // when the delimiter arrived
+    uint8_t len;
+    uint8_t data[MCU_MAX_WIRE_FRAME];
+};
+
 class McuCommUart {
     public:
     McuCommUart();
@@ -8,26 +24,90 @@ class McuCommUart {
     void receive_uart();
     void parse_uart(int *enc_values, bool *enc_updated, bool *button_states, bool *button_updated, int num_inputs);
 
+    // Profiling figures of the audio MCU (MSG_STAT), see McuStatId
+    const int16_t *get_stats() const { return stats; }
+    bool stats_changed(); // true once after new figures arrived
+
+    // Parameter state of the audio MCU (see McuStateId), updated by parse_uart()
+    const ParamMirror &get_params() const { return params; }
+    uint32_t take_param_changes() { return params.take_changes(); }
+    void send_param(uint8_t id, int16_t value); // asks the audio MCU to change a parameter
+    void send_input_param(uint8_t id, int16_t value, uint32_t origin_us); // the same, caused by an input at origin_us
+    void send_pending(); // sends the queued changes, a snapshot request and a clock ping if needed, non-blocking
+
+    // Offset of the audio MCU's clock, see McuTimeId
+    const ClockSync &get_clock() const { return clock; }
+
+    // Diagnostics
+    uint32_t get_rx_overflows() const { return rx_overflows; }
+    uint32_t get_frame_errors() const { return rx_frame_errors + decode_errors; }
+    uint32_t get_frames_pending() const { return rx_frames.size(); }
+
+    static const int RX_FRAME_SLOTS = 16;
+    static const uint32_t SYNC_RETRY_MS = 200; // between two snapshot requests without an answer
+    static const uint32_t PING_INTERVAL_MS = 500;
+
     private:
-    void flush_rx_buffer();
+    void send_frame();
+    void handle_time(const McuMsg &msg, uint32_t rx_us);
 
-    char rx_buf[32];
-    int rx_buf_idx;
-    bool receiving;
-    bool msg_received;
+    // Only used by receive_uart() in the UART driver's context
+    McuRxFrame rx_frame;
+    bool rx_frame_too_long;
+
+    int16_t stats[STAT_NUM_IDS];
+    bool stats_updated;
+
+    ParamMirror params;
+    McuFrameWriter tx_frame; // parameter changes coalesced until send_pending()
+    uint32_t last_sync_request_ms;
+    bool sync_requested;
+
+    ClockSync clock;
+    uint16_t ping_seq;
+    uint32_t ping_us; // when the last ping was sent
+    uint32_t last_ping_ms;
+    uint32_t pong_rx_us; // audio MCU time of the answer being received
+    bool pong_valid;
+
+    SpscQueue<McuRxFrame, RX_FRAME_SLOTS> rx_frames;
+    volatile uint32_t rx_overflows;    // complete frames dropped because rx_frames was full
+    volatile uint32_t rx_frame_errors; // frames longer than the maximum frame size
+    volatile uint32_t decode_errors;   // frames which were malformed or failed the CRC check
 };
 
+/*
+ * Reads input events from the encoder board (see enc_events.h).
+ * The bus is only used while the board signals pending events on its data ready line.
+ */
 class McuCommI2c {
     public:
     McuCommI2c();
     void begin();
     void request_encoders_buttons(int *enc_values, bool *enc_updated, bool *button_states, bool *button_updated, int num_inputs);
 
-    static const int I2C_SLAVE_ENCODERS = 0x8;
+    // When the last change of encoder i read by request_encoders_buttons() happened, false if not known
+    bool get_origin(int i, uint32_t &origin_us) const;
+
+    // Diagnostics
+    uint32_t get_seq_gaps() const { return seq_gaps; }
+    const LatencyHistogram &get_latency() const { return latency; } // LATENCY_ENC_I2C
+
+    static const int I2C_SLAVE_ENCODERS = ENC_BOARD_I2C_ADDR;
+    static const int PIN_DATA_READY = 27;
 
     private:
-    int prev_enc_values[8];
-    bool prev_button_states[8];
+    bool read_register(uint8_t reg, uint8_t *buf, int len, uint32_t *read_us = NULL);
+    void request_snapshot(int *enc_values, bool *enc_updated, bool *button_states, bool *button_updated, int num_inputs);
+
+    bool synced;
+    bool seq_valid;
+    uint8_t next_seq;
+    uint32_t seq_gaps;
+
+    uint32_t origins[ENC_NUM_ENCODERS];
+    uint8_t origins_valid; // bit per encoder
+    LatencyHistogram latency;
 };
 
 #endif
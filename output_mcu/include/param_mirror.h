@@ -0,0 +1,43 @@
+#ifndef _PARAM_MIRROR_H
+#define _PARAM_MIRROR_H
+
+#include <stdint.h>
+#include <mcu_proto.h>
+#include <param_ids.h>
+
+/*
+ * Copy of the audio MCU's parameter state, kept up to date by its state frames (see McuStateId).
+ * Values are positions in the parameter's range, 0 .. MCU_PARAM_MAX.
+ *
+ * The copy is complete once a snapshot has arrived and stays in sync as long as every state frame
+ * follows its predecessor. A version gap, a corrupt frame or a heartbeat with a different version
+ * clears the sync and needs_snapshot() then asks for a new snapshot. Deltas are applied in the
+ * meantime too: values are absolute, so they are still the newest ones.
+ */
+class ParamMirror {
+    public:
+    ParamMirror();
+    void handle(const McuMsg &msg); // MSG_PARAM and MSG_STATE in the order received
+    void frame_lost();              // a frame failed the CRC check, it may have been a state frame
+
+    bool is_synced() const { return synced; }
+    bool needs_snapshot() const { return !synced && !in_snapshot; }
+    int16_t get(uint8_t id) const { return values[id]; }
+    uint32_t take_changes(); // bit per parameter changed since the previous call
+
+    // Diagnostics
+    uint16_t get_version() const { return version; }
+    uint32_t get_resyncs() const { return resyncs; }
+
+    private:
+    void lose_sync();
+
+    int16_t values[NUM_PARAMS];
+    uint32_t changed;
+    uint16_t version;  // of the last state frame
+    bool synced;
+    bool in_snapshot;
+    uint32_t resyncs;  // times the sync was lost
+};
+
+#endif
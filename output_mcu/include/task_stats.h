@@ -0,0 +1,51 @@
+#ifndef _TASK_STATS_H
+#define _TASK_STATS_H
+
+#include <Arduino.h>
+
+/*
+ * Loop time and queue depth of one task, updated by the task itself and read by another one.
+ * Every field has a single writer; the reader asks for a reset of the peaks, which the task
+ * then does at the start of its next loop.
+ */
+class TaskStats {
+    public:
+    TaskStats() : loop_max_us(0), loop_total_us(0), loops(0), queue_max(0), reset_requested(false) {}
+
+    // Task side
+    void begin_loop() {
+        if (reset_requested) {
+            loop_max_us = loop_total_us = loops = queue_max = 0;
+            reset_requested = false;
+        }
+        start_us = micros();
+    }
+
+    void end_loop() {
+        const uint32_t us = micros() - start_us;
+        if (us > loop_max_us) loop_max_us = us;
+        loop_total_us += us;
+        loops++;
+    }
+
+    void note_queue_depth(uint32_t depth) {
+        if (depth > queue_max) queue_max = depth;
+    }
+
+    // Reader side, figures since the last reset
+    uint32_t get_loop_max_us() const { return loop_max_us; }
+    uint32_t get_loop_avg_us() const { return loops > 0 ? loop_total_us / loops : 0; }
+    uint32_t get_loops() const { return loops; }
+    uint32_t get_queue_max() const { return queue_max; }
+    void reset_peaks() { reset_requested = true; }
+
+    private:
+    uint32_t start_us;
+    volatile uint32_t loop_max_us;
+    volatile uint32_t loop_total_us;
+    volatile uint32_t loops;
+    volatile uint32_t queue_max;
+    volatile bool reset_requested;
+};
+
+#endif
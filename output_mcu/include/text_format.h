@@ -0,0 +1,71 @@
+#ifndef _TEXT_FORMAT_H
+#define _TEXT_FORMAT_H
+
+#include <param_desc.h>
+
+/*
+ * Allocation-free number formatting for the display, replacing sprintf() in the draw paths.
+ * The caller provides the buffer, INT_TEXT_SIZE chars always suffice.
+ */
+
+static const int INT_TEXT_SIZE = 12; // "-2147483648" + terminator
+
+/*
+ * Writes value right-aligned in at least min_width chars (padded with spaces) and terminates buf.
+ * Returns the number of chars written without the terminator.
+ */
+inline int format_int(char *buf, int value, int min_width = 0) {
+    char digits[INT_TEXT_SIZE];
+    int n = 0;
+
+    // Work on the negative value, so INT_MIN does not overflow
+    const bool negative = value < 0;
+    int v = negative ? value : -value;
+    do {
+        digits[n++] = '0' - v % 10;
+        v /= 10;
+    } while (v != 0);
+    if (negative) digits[n++] = '-';
+
+    if (min_width > INT_TEXT_SIZE - 1) min_width = INT_TEXT_SIZE - 1;
+    int len = 0;
+    for (int i = n; i < min_width; i++) {
+        buf[len++] = ' ';
+    }
+    while (n > 0) {
+        buf[len++] = digits[--n];
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+/*
+ * A parameter of the audio MCU at a wire position with its unit, e.g. "12.5ms" (see param_desc.h).
+ * Integer only, the display values are precomputed. Returns the number of chars written, at most PARAM_TEXT_SIZE - 1.
+ */
+static const int PARAM_TEXT_SIZE = INT_TEXT_SIZE + 4;
+
+inline int format_param(char *buf, uint8_t id, int16_t position) {
+    const ParamDesc &desc = param_desc(id);
+    const int32_t value = param_display_value(id, position);
+    int len;
+    if (desc.decimals == 0) {
+        len = format_int(buf, value);
+    } else {
+        const int32_t scale = desc.decimals == 2 ? 100 : 10;
+        const int32_t magnitude = value < 0 ? -value : value;
+        len = 0;
+        if (value < 0) buf[len++] = '-';
+        len += format_int(buf + len, magnitude / scale);
+        buf[len++] = '.';
+        if (desc.decimals == 2) buf[len++] = '0' + magnitude % 100 / 10;
+        buf[len++] = '0' + magnitude % 10;
+    }
+    for (const char *s = param_unit_suffix(desc.unit); *s; s++) {
+        buf[len++] = *s;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+#endif
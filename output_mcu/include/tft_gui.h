@@ -1,21 +1,101 @@
 #ifndef _TFT_GUI_H
 #define _TFT_GUI_H
 
+#include <stdint.h>
+#include <stddef.h>
+#include <glyph_atlas.h>
+
+#ifdef ARDUINO
 #include "TFT_22_ILI9225.h"
+#else
+// Host builds only push to a RAM framebuffer (see tft_gui_framebuffer.cpp) and only need the colors
+#define COLOR_BLACK  0x0000
+#define COLOR_WHITE  0xFFFF
+#define COLOR_BLUE   0x001F
+#define COLOR_RED    0xF800
+#define COLOR_GREEN  0x07E0
+#define COLOR_YELLOW 0xFFE0
+#define COLOR_GREY   0x8410
+#endif
+
+/*
+ * Cost of what has been pushed to the display since begin_frame().
+ * Every address window costs WINDOW_SPI_BYTES and every pixel 2 bytes.
+ */
+struct TftFrameStats {
+    uint32_t pixels;
+    uint32_t windows;
+    uint32_t spi_bytes;
+    uint32_t flush_us;  // time spent in the last flush()
+    uint16_t fps;       // flushes during the last full second
+};
+
+struct TftRect {
+    int16_t x1, y1, x2, y2; // corners inclusive
+};
 
 /*
  * Wrapper for external TFT library.
  * Makes drawing common OP2001 elements easier.
+ *
+ * All drawing goes into an off-screen RGB565 framebuffer and only marks the touched area dirty.
+ * flush() then sends the dirty rectangles to the panel in bands of BAND_LINES lines.
+ * On the ESP32 a band is byte-swapped into one of two DMA buffers while the other one is
+ * still being transferred over VSPI, so the CPU does not wait for the SPI bus.
  */
 class TftGui {
     public:
     void begin();
     void clear();
-    void draw_bar(int x, int y, int value, int color);
-    void draw_text(int x, int y, const char *s);
+    void draw_bar(int x, int y, int value, int color, const char *text = NULL); // text replaces the value below the bar
+    void update_bar(int x, int y, int old_value, int value, int color);
+    void draw_bar_value(int x, int y, int value, int old_value); // old_value: the value drawn there before
+    void draw_bar_text(int x, int y, const char *s);
+    void draw_text(int x, int y, const char *s, uint16_t color = COLOR_WHITE, uint16_t bg_color = COLOR_BLACK);
+    void draw_number(int x, int y, int value, int min_width, uint16_t color = COLOR_WHITE, uint16_t bg_color = COLOR_BLACK);
+    int text_width(const char *s) const;
+    void fill_rect(int x1, int y1, int x2, int y2, uint16_t color); // corners inclusive
+    void draw_rect(int x1, int y1, int x2, int y2, uint16_t color);
+    void flush(); // send everything drawn since the last flush() to the panel
+
+    void begin_frame();
+    const TftFrameStats &get_frame_stats() const { return stats; }
+    uint16_t get_pixel(int x, int y) const { return framebuffer[y * WIDTH + x]; }
+
+    static const int WIDTH = 220;
+    static const int HEIGHT = 176;
+    static const int BAND_LINES = 16;
+    static const int MAX_DIRTY_RECTS = 16;
+    static const int BAR_WIDTH = 40;
+    static const int BAR_HEIGHT = 10;
+    static const int BAR_MAX = 127;      // value of a full bar
+    static const int BAR_TEXT_CHARS = 7; // below a bar, e.g. "12000Hz"
+    static const int FONT_WIDTH = 6;
+    static const int FONT_HEIGHT = 8;
+    static const int WINDOW_SPI_BYTES = 30; // 7 register writes (16 bit index + 16 bit data) + GRAM write command
 
     protected:
+    // Backend specific (tft_gui.cpp on the ESP32, tft_gui_framebuffer.cpp on a PC)
+    void begin_panel();
+    void push_rect(const TftRect &r);
+    void wait_push_done();
+    uint32_t now_us() const;
+
+    void init_framebuffer();
+    void mark_dirty(int x1, int y1, int x2, int y2);
+    void count_pixels(uint32_t windows, uint32_t pixels);
+    int bar_width(int value) const;
+    void draw_glyph_bits(int x, int y, char c, uint16_t color, uint16_t bg_color);
+
     int maxX, maxY;
+    uint16_t *framebuffer; // WIDTH * HEIGHT pixels, row by row
+    const uint8_t *font;   // font in the TFT_22_ILI9225 format, or NULL to draw plain character cells
+    GlyphAtlas atlas;      // pre-rendered glyphs of font
+    TftRect dirty[MAX_DIRTY_RECTS];
+    int num_dirty;
+    TftFrameStats stats;
+    uint32_t fps_start_us;
+    uint16_t fps_frames;
 };
 
 #endif
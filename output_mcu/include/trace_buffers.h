@@ -0,0 +1,19 @@
+#ifndef _TRACE_BUFFERS_H
+#define _TRACE_BUFFERS_H
+
+#include <Arduino.h>
+#include <trace.h>
+
+/*
+ * Trace records of each task (see trace.h), drained to Serial by loop() in main.cpp.
+ * A task only traces into its own buffer.
+ */
+#define TRACE_BUFFER_SIZE 128
+
+typedef TraceBuffer<TRACE_BUFFER_SIZE> TaskTraceBuffer;
+
+extern TaskTraceBuffer trace_loop;   // setup() and loop()
+extern TaskTraceBuffer trace_input;  // input task, including McuCommUart and McuCommI2c
+extern TaskTraceBuffer trace_render; // render task, including the GUI
+
+#endif
@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include <glyph_atlas.h>
+
+GlyphAtlas::GlyphAtlas() {
+    font = 0;
+    first_char = num_chars = 0;
+    cell_width = height = glyph_pixels = 0;
+    use_counter = 0;
+    for (int i = 0; i < MAX_COLOR_PAIRS; i++) {
+        slots[i].pixels = 0;
+        slots[i].last_used = 0;
+    }
+}
+
+/*
+ * Font format: 4 byte header (width, height, first char, number of chars),
+ * then per char its width and one byte per 8 rows for every column (LSB = top row).
+ */
+void GlyphAtlas::set_font(const uint8_t *font) {
+    for (int i = 0; i < MAX_COLOR_PAIRS; i++) {
+        free(slots[i].pixels);
+        slots[i].pixels = 0;
+    }
+
+    this->font = font;
+    if (!font) return;
+    cell_width = font[0] + 1;
+    height = font[1];
+    first_char = font[2];
+    num_chars = font[3];
+    glyph_pixels = cell_width * height;
+}
+
+bool GlyphAtlas::has_glyph(char c) const {
+    const uint8_t u = c;
+    return font && u >= first_char && u < first_char + num_chars;
+}
+
+int GlyphAtlas::get_width(char c) const {
+    if (!has_glyph(c)) return 0;
+    const int nbrows = (height + 7) / 8;
+    return font[4 + ((uint8_t)c - first_char) * ((cell_width - 1) * nbrows + 1)] + 1;
+}
+
+const uint16_t *GlyphAtlas::get_glyph(char c, uint16_t color, uint16_t bg_color) {
+    Slot *slot = find_slot(color, bg_color);
+    if (!slot->pixels) return 0;
+    return slot->pixels + ((uint8_t)c - first_char) * glyph_pixels;
+}
+
+GlyphAtlas::Slot *GlyphAtlas::find_slot(uint16_t color, uint16_t bg_color) {
+    Slot *oldest = &slots[0];
+    for (int i = 0; i < MAX_COLOR_PAIRS; i++) {
+        Slot &s = slots[i];
+        if (s.pixels && s.color == color && s.bg_color == bg_color) {
+            s.last_used = ++use_counter;
+            return &s;
+        }
+        if (!s.pixels || (oldest->pixels && s.last_used < oldest->last_used)) oldest = &s;
+    }
+
+    oldest->color = color;
+    oldest->bg_color = bg_color;
+    oldest->last_used = ++use_counter;
+    render(*oldest);
+    return oldest;
+}
+
+void GlyphAtlas::render(Slot &slot) {
+    if (!slot.pixels) {
+        slot.pixels = (uint16_t *)malloc(num_chars * glyph_pixels * sizeof (uint16_t));
+        if (!slot.pixels) return;
+    }
+
+    const int nbrows = (height + 7) / 8;
+    for (int c = 0; c < num_chars; c++) {
+        const uint8_t *glyph = font + 4 + c * ((cell_width - 1) * nbrows + 1);
+        const int char_width = glyph[0];
+        uint16_t *cell = slot.pixels + c * glyph_pixels;
+
+        for (int row = 0; row < height; row++) {
+            for (int i = 0; i < cell_width; i++) {
+                const bool set = i < char_width && ((glyph[1 + i * nbrows + row / 8] >> (row % 8)) & 1);
+                cell[row * cell_width + i] = set ? slot.color : slot.bg_color;
+            }
+        }
+    }
+}
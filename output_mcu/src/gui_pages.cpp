@@ -0,0 +1,325 @@
+#include <Arduino.h>
+#include <string.h>
+#include <gui_pages.h>
+#include <text_format.h>
+#include <trace_buffers.h>
+
+GuiPage::GuiPage() {
+    params = NULL;
+    param_handler = NULL;
+    for (int i = 0; i < NUM_ENCODERS; i++) {
+        button_states[i] = false;
+        param_ids[i] = NO_PARAM;
+        edit_values[i] = 0;
+        edit_ms[i] = 0;
+        edited[i] = false;
+    }
+}
+
+void GuiPage::draw_bar(int i, int value, int color, const char *text) {
+    BarWidget &bar = bars[i];
+    bar.set_position(BARS_X_START + i * BARS_WIDTH, BARS_Y);
+    bar.set_color(color);
+    bar.set_label(text);
+    bar.set_value(value);
+    if (bar.is_dirty()) bar.draw(tft);
+}
+
+void GuiPage::invalidate() {
+    for (int i = 0; i < NUM_ENCODERS; i++) {
+        bars[i].invalidate();
+    }
+}
+
+void GuiPage::set_params(const int16_t *params, GuiParamHandler handler) {
+    this->params = params;
+    param_handler = handler;
+}
+
+void GuiPage::bind_param(int i, uint8_t id) {
+    param_ids[i] = id;
+}
+
+// The value asked for while the encoder turns, afterwards the audio MCU's value
+int16_t GuiPage::param_value(int i) const {
+    if (edited[i] && millis() - edit_ms[i] < EDIT_HOLD_MS) return edit_values[i];
+    return params ? params[param_ids[i]] : 0;
+}
+
+// Moves by encoder steps of the parameter, e.g. one semitone or one oscillator shape per detent
+void GuiPage::turn_param(int i, int delta) {
+    if (delta == 0 || param_ids[i] == NO_PARAM) return;
+    const uint8_t id = param_ids[i];
+    const int16_t value = param_step_position(id, param_position_step(id, param_value(i)) + delta);
+
+    edit_values[i] = value;
+    edit_ms[i] = millis();
+    edited[i] = true;
+    if (param_handler) param_handler(id, value);
+}
+
+void GuiPage::draw_param_bar(int i, int color) {
+    const uint8_t id = param_ids[i];
+    const int16_t value = param_value(i);
+    char text[PARAM_TEXT_SIZE];
+    format_param(text, id, value);
+    bars[i].set_text(text);
+    draw_bar(i, value * TftGui::BAR_MAX / MCU_PARAM_MAX, color, param_desc(id).label);
+}
+
+MixerGuiPage::MixerGuiPage() {
+    volume_osc1 = volume_osc2 = volume_noise = 0;
+    bind_param(3, PARAM_VOLUME);
+}
+
+void MixerGuiPage::render() {
+    draw_bar(0, volume_osc1, COLOR_RED, "Osc1");
+    draw_bar(1, volume_osc2, COLOR_GREEN, "Osc2");
+    draw_bar(2, volume_noise, COLOR_BLUE, "Noise");
+    draw_param_bar(3, COLOR_GREY);
+}
+
+/*
+ * Called when encoders/buttons manipulate the current screen.
+ * This translates to updated data in the model (e.g. encoder1 -> volume osc1)
+ * or to a change of a parameter of the audio MCU.
+ */
+    
+void MixerGuiPage::update_data(int *enc_values, int *enc_deltas, bool *button_states) {
+    volume_osc1 = enc_values[0];
+    volume_osc2 = enc_values[1];
+    volume_noise = enc_values[2];
+    turn_param(3, enc_deltas[3]);
+}
+
+OscillatorGuiPage::OscillatorGuiPage() {
+    bind_param(0, PARAM_OSC1_TUNE);
+    bind_param(1, PARAM_OSC1_SHAPE);
+    bind_param(2, PARAM_PULSE_WIDTH);
+}
+
+void OscillatorGuiPage::render() {
+    draw_param_bar(0, COLOR_RED);
+    draw_param_bar(1, COLOR_YELLOW);
+    draw_param_bar(2, COLOR_BLUE);
+    draw_bar(3, 0, COLOR_GREY, "...");
+}
+
+void OscillatorGuiPage::update_data(int *enc_values, int *enc_deltas, bool *button_states) {
+    for (int i = 0; i < 3; i++) {
+        turn_param(i, enc_deltas[i]);
+    }
+}
+
+FilterGuiPage::FilterGuiPage() {
+    attenuation = filter_type = 0;
+    bind_param(0, PARAM_FILTER_CUTOFF);
+    bind_param(1, PARAM_FILTER_RESONANCE);
+}
+
+void FilterGuiPage::render() {
+    draw_param_bar(0, COLOR_RED);
+    draw_param_bar(1, COLOR_YELLOW);
+    draw_bar(2, attenuation, COLOR_BLUE, "Attenuation");
+    draw_bar(3, filter_type, COLOR_GREEN, "Type");
+}
+
+void FilterGuiPage::update_data(int *enc_values, int *enc_deltas, bool *button_states) {
+    turn_param(0, enc_deltas[0]);
+    turn_param(1, enc_deltas[1]);
+    attenuation = enc_values[2];
+    filter_type = enc_values[3];
+}
+
+EnvelopeGuiPage::EnvelopeGuiPage() {
+    bind_param(0, PARAM_ENV_ATTACK);
+    bind_param(1, PARAM_ENV_DECAY);
+    bind_param(2, PARAM_ENV_SUSTAIN);
+    bind_param(3, PARAM_ENV_RELEASE);
+}
+
+void EnvelopeGuiPage::render() {
+    draw_param_bar(0, COLOR_RED);
+    draw_param_bar(1, COLOR_YELLOW);
+    draw_param_bar(2, COLOR_BLUE);
+    draw_param_bar(3, COLOR_GREEN);
+}
+
+void EnvelopeGuiPage::update_data(int *enc_values, int *enc_deltas, bool *button_states) {
+    for (int i = 0; i < NUM_ENCODERS; i++) {
+        turn_param(i, enc_deltas[i]);
+    }
+}
+
+const DiagnosticsGuiPage::Row DiagnosticsGuiPage::rows[NUM_ROWS] = {
+    { "CPU %", STAT_CPU, true },
+    { "CPU max", STAT_CPU_MAX, true },
+    { "Blocks", STAT_MEM_USED, false },
+    { "Blk max", STAT_MEM_MAX, false },
+    { "Blk total", STAT_MEM_TOTAL, false },
+    { "Loop us", STAT_LOOP_MAX_US, false },
+    { "USB us", STAT_LOOP_USB_US, false },
+    { "MIDI us", STAT_LOOP_MIDI_US, false },
+    { "Input us", STAT_LOOP_INPUT_US, false },
+    { "SD us", STAT_LOOP_SAMPLER_US, false },
+    { "Underruns", STAT_UNDERRUNS, false }
+};
+
+DiagnosticsGuiPage::DiagnosticsGuiPage() {
+    memset(stats, 0, sizeof (stats));
+    invalidate();
+}
+
+void DiagnosticsGuiPage::invalidate() {
+    GuiPage::invalidate();
+    labels_drawn = false;
+    values_drawn = false;
+}
+
+void DiagnosticsGuiPage::set_stats(const int16_t *stats) {
+    memcpy(this->stats, stats, sizeof (this->stats));
+}
+
+void DiagnosticsGuiPage::update_data(int *enc_values, int *enc_deltas, bool *button_states) {
+}
+
+void DiagnosticsGuiPage::draw_value(int x, int y, const Row &row) {
+    const int16_t value = stats[row.id];
+    if (values_drawn && drawn[row.id] == value) return;
+    drawn[row.id] = value;
+
+    if (!row.tenths) {
+        tft.draw_number(x, y, value, 6);
+        return;
+    }
+    char buf[INT_TEXT_SIZE + 2];
+    int len = format_int(buf, value / 10, 4);
+    buf[len++] = '.';
+    buf[len++] = '0' + (value < 0 ? -value : value) % 10;
+    buf[len] = '\0';
+    tft.draw_text(x, y, buf);
+}
+
+void DiagnosticsGuiPage::render() {
+    // Left: system figures, right: CPU load per group of audio nodes (the sum of their peaks) and input latency
+    const int latency_y = FIRST_ROW_Y + (STAT_NUM_GROUPS + 1) * ROW_HEIGHT;
+    if (!labels_drawn) {
+        tft.draw_text(4, 4, "Audio DSP diagnostics", COLOR_YELLOW);
+        for (int i = 0; i < NUM_ROWS; i++) {
+            tft.draw_text(4, FIRST_ROW_Y + i * ROW_HEIGHT, rows[i].label, COLOR_GREY);
+        }
+        tft.draw_text(118, FIRST_ROW_Y, "Group CPU %", COLOR_GREY);
+        for (int g = 0; g < STAT_NUM_GROUPS; g++) {
+            tft.draw_text(118, FIRST_ROW_Y + (g + 1) * ROW_HEIGHT, mcu_stat_group_name(g), COLOR_GREY);
+        }
+        tft.draw_text(118, latency_y, "Lat ms", COLOR_GREY);
+        tft.draw_text(166, latency_y, "p50", COLOR_GREY);
+        tft.draw_text(202, latency_y, "p99", COLOR_GREY);
+        for (int s = 0; s < NUM_LATENCY_STAGES; s++) {
+            tft.draw_text(118, latency_y + (s + 1) * ROW_HEIGHT, latency_stage_name(s), COLOR_GREY);
+        }
+        labels_drawn = true;
+    }
+
+    for (int i = 0; i < NUM_ROWS; i++) {
+        draw_value(70, FIRST_ROW_Y + i * ROW_HEIGHT, rows[i]);
+    }
+    for (int g = 0; g < STAT_NUM_GROUPS; g++) {
+        const Row row = { "", (uint8_t)(STAT_GROUP_CPU + g), true };
+        draw_value(172, FIRST_ROW_Y + (g + 1) * ROW_HEIGHT, row);
+    }
+    for (int s = 0; s < NUM_LATENCY_STAGES; s++) {
+        const Row p50 = { "", (uint8_t)(STAT_LATENCY_P50 + s), true };
+        const Row p99 = { "", (uint8_t)(STAT_LATENCY_P99 + s), true };
+        draw_value(148, latency_y + (s + 1) * ROW_HEIGHT, p50);
+        draw_value(184, latency_y + (s + 1) * ROW_HEIGHT, p99);
+    }
+    values_drawn = true;
+}
+
+Gui::Gui() {
+    pages[PAGE_MIXER] = new MixerGuiPage();
+    pages[PAGE_SYNTH] = new OscillatorGuiPage();
+    pages[PAGE_FILTER] = new FilterGuiPage();
+    pages[PAGE_ENVELOPE] = new EnvelopeGuiPage();
+    pages[PAGE_DIAGNOSTICS] = diagnostics_page = new DiagnosticsGuiPage();
+    //pages[PAGE_SAMPLER] = new SamplerGuiPage();
+    //pages[PAGE_SEQUENCER] = new SequencerGuiPage();
+    current_page_idx = PAGE_MIXER;
+    current_page = pages[current_page_idx];
+
+    memset(params, 0, sizeof (params));
+    set_param_handler(NULL);
+    enc_values_known = false;
+    page_button_down = false;
+}
+
+void Gui::set_param_handler(GuiParamHandler handler) {
+    for (int i = 0; i < num_pages; i++) {
+        pages[i]->set_params(params, handler);
+    }
+}
+
+void Gui::switch_page(int i) {
+    if (i < 0) i = Gui::num_pages - 1;
+    else if (i >= Gui::num_pages) i = 0;
+    current_page_idx = i;
+    current_page = pages[current_page_idx];
+    TRACE_INFO(trace_render, TRACE_GUI_PAGE, i, 0);
+
+    tft.clear();
+    current_page->invalidate();
+}
+
+void Gui::previous_page() {
+    switch_page(current_page_idx - 1);
+}
+
+void Gui::next_page() {
+    switch_page(current_page_idx + 1);
+}
+
+void Gui::render() {
+    pages[current_page_idx]->render();
+}
+
+// Widgets track their own changes, so rendering the page only redraws the affected area
+void Gui::update_encoder(int i) {
+    pages[current_page_idx]->render();
+}
+
+void Gui::update_button(int i) {
+    pages[current_page_idx]->render();
+}
+
+void Gui::update_data(int *enc_values, bool *button_states) {
+    // Do GUI-wide stuff first like switching pages or something else "global".
+    // update_data() also runs for encoder changes while the button is held, so only its press counts.
+    if (button_states[3] && !page_button_down) {
+        next_page();
+    }
+    page_button_down = button_states[3];
+
+    // Pages bound to parameters of the audio MCU change them by the encoder steps
+    int enc_deltas[NUM_ENCODERS];
+    for (int i = 0; i < NUM_ENCODERS; i++) {
+        enc_deltas[i] = enc_values_known ? enc_values[i] - last_enc_values[i] : 0;
+        last_enc_values[i] = enc_values[i];
+    }
+    enc_values_known = true;
+
+    // Now pass updated data to the current page
+    current_page->update_data(enc_values, enc_deltas, button_states);
+}
+
+// Only stores the values, the next render() shows them
+void Gui::update_params(const int16_t *values) {
+    memcpy(params, values, sizeof (params));
+}
+
+void Gui::update_stats(const int16_t *stats) {
+    diagnostics_page->set_stats(stats);
+    if (current_page == diagnostics_page) {
+        current_page->render();
+    }
+}
@@ -0,0 +1,83 @@
+#include <string.h>
+#include <gui_widgets.h>
+
+BarWidget::BarWidget() {
+    x = y = 0;
+    color = COLOR_WHITE;
+    label = drawn_label = "";
+    value = drawn_value = 0;
+    text[0] = '\0';
+    invalidate();
+}
+
+void BarWidget::set_position(int x, int y) {
+    if (x == this->x && y == this->y) return;
+    this->x = x;
+    this->y = y;
+    invalidate();
+}
+
+void BarWidget::set_color(int color) {
+    if (color == this->color) return;
+    this->color = color;
+    bar_dirty = true;
+}
+
+void BarWidget::set_label(const char *label) {
+    if (label == this->label || strcmp(label, this->label) == 0) return;
+    this->label = label;
+    label_dirty = true;
+}
+
+void BarWidget::set_value(int value) {
+    if (value == this->value) return;
+    this->value = value;
+    value_dirty = true;
+}
+
+void BarWidget::set_text(const char *text) {
+    if (strncmp(text, this->text, TEXT_SIZE - 1) == 0) return;
+    int len = 0;
+    while (len < TEXT_SIZE - 1 && text[len]) {
+        this->text[len] = text[len];
+        len++;
+    }
+    this->text[len] = '\0';
+    text_dirty = true;
+}
+
+void BarWidget::invalidate() {
+    bar_dirty = value_dirty = label_dirty = text_dirty = true;
+}
+
+bool BarWidget::is_dirty() const {
+    return bar_dirty || value_dirty || label_dirty || text_dirty;
+}
+
+void BarWidget::draw(TftGui &tft) {
+    const bool has_text = text[0] != '\0';
+    if (bar_dirty) {
+        tft.draw_bar(x, y, value, color, has_text ? text : NULL);
+    } else {
+        if (value_dirty) {
+            tft.update_bar(x, y, drawn_value, value, color);
+            if (!has_text) tft.draw_bar_value(x, y, value, drawn_value);
+        }
+        if (text_dirty && has_text) tft.draw_bar_text(x, y, text);
+    }
+
+    if (label_dirty) {
+        // Clear the rest of a longer old label
+        const int old_width = tft.text_width(drawn_label);
+        const int width = tft.text_width(label);
+        if (old_width > width) {
+            tft.fill_rect(x + width, y + LABEL_OFFSET_Y,
+                          x + old_width - 1, y + LABEL_OFFSET_Y + TftGui::FONT_HEIGHT - 1, COLOR_BLACK);
+        }
+        tft.draw_text(x, y + LABEL_OFFSET_Y, label);
+        drawn_label = label;
+    }
+
+    drawn_value = value;
+    bar_dirty = value_dirty = label_dirty = text_dirty = false;
+}
@@ -1,7 +1,13 @@
 #include <Arduino.h>
 
 #include <tft_gui.h>
+#include <gui_pages.h>
 #include <mcu_comm.h>
+#include <spsc_queue.h>
+#include <snapshot.h>
+#include <task_stats.h>
+#include <trace_buffers.h>
+#include <latency_hist.h>
 
 // Interface to the hardware TFT display
 TftGui tft;
@@ -9,259 +15,354 @@ TftGui tft;
 McuCommUart mcu_comm_dsp; // Interface to the UART communication with the Audio DSP MCU
 McuCommI2c mcu_comm_encboard; // Interface to the I2C communication with the Encoder and button input board
 
-void setup() {
-  Serial.begin(9600);
-  mcu_comm_dsp.begin();
-  mcu_comm_encboard.begin();
-  tft.begin();
-  Serial.println("Setup done");
-}
-
 /*
- * These arrays are used to move user input via encoders and buttons to the currently active GUI page.
+ * The work is split into two tasks on separate cores, so input latency does not depend on how
+ * long a redraw takes and a burst of input does not stall the display:
+ * - the input task polls the UART frames and the encoder board and passes every change on
+ *   through input_events, and the latest profiling figures and parameter state of the audio MCU
+ *   through dsp_stats and dsp_params
+ * - the render task applies them to the GUI and redraws; it sleeps until the input task wakes it.
+ *   Parameter changes the GUI asks for go back through param_requests, the input task sends them.
+ * Nothing else is shared between them. loop() only reports the statistics of both tasks
+ * and drains their trace buffers (see trace_buffers.h).
+ *
+ * Encoder changes read from the encoder board carry the time they happened (their origin) through
+ * both queues, so the latency until the display shows them and until the audio MCU applies them
+ * can be measured (see latency_hist.h).
  */
-#define NUM_ENCODERS 4
-int enc_values[NUM_ENCODERS] = { 33, 10, 50, 75 };
-bool button_states[NUM_ENCODERS] = { false, false, false, false };
-
-// GUI constants
-const int BARS_X_START = 15;
-const int BARS_WIDTH = 50;
-const int BARS_Y = 50;
+#define INPUT_CORE 0
+#define RENDER_CORE 1
+#define INPUT_TASK_PRIORITY 3
+#define RENDER_TASK_PRIORITY 2
+#define INPUT_POLL_TICKS 1  // FreeRTOS ticks (1 ms) between two input polls
+#define RENDER_IDLE_MS 50   // longest sleep of the render task without input
+#define TRACE_DRAIN_MS 10   // loop() sends the trace records this often
+
+enum InputEventType {
+    INPUT_ENCODER = 0,
+    INPUT_BUTTON
+};
 
-/*
- * A GuiPage is one screen with various Gui elements such as graphics and text.
- * Each page stores all the necessary data which has to be kept in the background
- * if the user switches to a different page.
- */
-class GuiPage {
-    public:
-    virtual void render();
-    virtual void update_data(int *enc_values, bool *button_states);
-    void draw_bar(int i, int value, int color, const char *text);
-
-    protected:
-    int enc_values[NUM_ENCODERS];
-    int colors[NUM_ENCODERS];
-    char *enc_text[NUM_ENCODERS];
-    bool button_states[NUM_ENCODERS];
+struct InputEvent {
+    uint8_t type;
+    uint8_t index;
+    int16_t value;
+    bool timed; // origin_us is known
+    uint32_t origin_us;
 };
 
-void GuiPage::draw_bar(int i, int value, int color, const char *text) {
-    const int x = BARS_X_START + i * BARS_WIDTH;
-    tft.draw_bar(x, BARS_Y, value, color);
-    tft.draw_text(x, BARS_Y + 24, text);
-}
+// A parameter change the GUI asks for
+struct ParamRequest {
+    uint8_t id;
+    int16_t value;
+    bool timed; // caused by an encoder change at origin_us
+    uint32_t origin_us;
+};
 
-class MixerGuiPage : public GuiPage {
-    public:
-    void render();
-    void update_data(int *enc_values, bool *button_states);
+struct DspStats {
+    int16_t values[STAT_NUM_IDS];
+};
 
-    private:
-    int volume_osc1, volume_osc2, volume_noise;
+struct DspParams {
+    int16_t values[NUM_PARAMS];
 };
 
-void MixerGuiPage::render() {
-    Serial.println("Mixer render");
-    draw_bar(0, volume_osc1, COLOR_RED, "Osc1");
-    draw_bar(1, volume_osc2, COLOR_GREEN, "Osc2");
-    draw_bar(2, volume_noise, COLOR_BLUE, "Noise");
-    draw_bar(3, 0, COLOR_GREY, "...");
-}
+SpscQueue<InputEvent, 64> input_events;
+Snapshot<DspStats> dsp_stats;
+Snapshot<DspParams> dsp_params;
+SpscQueue<ParamRequest, 32> param_requests;
+volatile uint32_t input_events_dropped = 0;
+LatencyHistogram pixel_latency; // LATENCY_ENC_PIXEL, written by the render task
+
+TaskStats input_task_stats, render_task_stats;
+TaskHandle_t render_task_handle = NULL;
 
 /*
- * Called when encoders/buttons manipulate the current screen.
- * This translates to updated data in the model (e.g. encoder1 -> volume osc1)
+ * These arrays are used to move user input via encoders and buttons to the currently active GUI page.
+ * Only used by the render task, the input task keeps its own copy.
  */
-    
-void MixerGuiPage::update_data(int *enc_values, bool *button_states) {
-    Serial.println("Mixer update_data");
-    volume_osc1 = enc_values[0];
-    volume_osc2 = enc_values[1];
-    volume_noise = enc_values[2];
-}
-
-class OscillatorGuiPage : public GuiPage {
-    public:
-    void render();
-    void update_data(int *enc_values, bool *button_states);
+int enc_values[NUM_ENCODERS] = { 33, 10, 50, 75 };
+bool button_states[NUM_ENCODERS] = { false, false, false, false };
 
-    private:
-    int osc_frequency, osc_shape, pwm;
-};
+Gui gui;
 
-void OscillatorGuiPage::render() {
-    draw_bar(0, osc_frequency, COLOR_RED, "Freq");
-    draw_bar(1, osc_shape, COLOR_YELLOW, "Shape");
-    draw_bar(2, pwm, COLOR_BLUE, "PWM");
-    draw_bar(3, 0, COLOR_GREY, "...");
-}
+// Origin of the encoder change the GUI is handling, for request_param(). Only used by the render task.
+bool gui_input_timed = false;
+uint32_t gui_input_origin_us = 0;
 
-void OscillatorGuiPage::update_data(int *enc_values, bool *button_states) {
-    osc_frequency = enc_values[0];
-    osc_shape = enc_values[1];
-    pwm = enc_values[2];
+bool push_input_event(uint8_t type, uint8_t index, int16_t value, bool timed = false, uint32_t origin_us = 0) {
+    const InputEvent e = { type, index, value, timed, origin_us };
+    if (input_events.push(e)) return true;
+    // Encoder values are absolute, so the next change of a dropped one repairs it
+    TRACE_WARN(trace_input, TRACE_INPUT_DROPPED, type, index);
+    input_events_dropped++;
+    return false;
 }
 
-class FilterGuiPage : public GuiPage {
-    public:
-    void render();
-    void update_data(int *enc_values, bool *button_states);
+void input_task(void *arg) {
+    int values[NUM_ENCODERS];
+    bool states[NUM_ENCODERS];
+    memcpy(values, enc_values, sizeof (values));
+    memcpy(states, button_states, sizeof (states));
+    uint32_t last_stats_ms = 0;
+
+    for (;;) {
+        input_task_stats.begin_loop();
+        bool enc_updated[NUM_ENCODERS] = { false, false, false, false };
+        bool button_updated[NUM_ENCODERS] = { false, false, false, false };
+        mcu_comm_dsp.parse_uart(values, enc_updated, states, button_updated, NUM_ENCODERS); // get data from Teensy via UART
+        mcu_comm_encboard.request_encoders_buttons(values, enc_updated, states, button_updated, NUM_ENCODERS); // get data from encoder board via I2C
+
+        bool wake = false;
+        for (int i = 0; i < NUM_ENCODERS; i++) {
+            uint32_t origin_us = 0;
+            const bool timed = mcu_comm_encboard.get_origin(i, origin_us);
+            if (enc_updated[i]) wake |= push_input_event(INPUT_ENCODER, i, values[i], timed, origin_us);
+            if (button_updated[i]) wake |= push_input_event(INPUT_BUTTON, i, states[i]);
+        }
+        input_task_stats.note_queue_depth(input_events.size());
+
+        // The audio MCU echoes every change, so a dropped request only loses that step
+        ParamRequest request;
+        while (param_requests.pop(request)) {
+            if (request.timed) {
+                mcu_comm_dsp.send_input_param(request.id, request.value, request.origin_us);
+            } else {
+                mcu_comm_dsp.send_param(request.id, request.value);
+            }
+        }
+        mcu_comm_dsp.send_pending();
+
+        // However many updates arrived, the render task only gets the newest state
+        if (mcu_comm_dsp.take_param_changes()) {
+            DspParams state;
+            for (int i = 0; i < NUM_PARAMS; i++) {
+                state.values[i] = mcu_comm_dsp.get_params().get(i);
+            }
+            dsp_params.publish(state);
+            wake = true;
+        }
 
-    private:
-    int cutoff_frequency, resonance, attenuation, filter_type;
-};
+        // The latency of the local stages is filled in, so it is also published without the audio MCU
+        if (mcu_comm_dsp.stats_changed() || millis() - last_stats_ms >= 1000) {
+            DspStats stats;
+            memcpy(stats.values, mcu_comm_dsp.get_stats(), sizeof (stats.values));
+            const LatencyHistogram &i2c_latency = mcu_comm_encboard.get_latency();
+            stats.values[STAT_LATENCY_P50 + LATENCY_ENC_I2C] = mcu_latency_stat(i2c_latency.get_percentile_us(50));
+            stats.values[STAT_LATENCY_P99 + LATENCY_ENC_I2C] = mcu_latency_stat(i2c_latency.get_percentile_us(99));
+            stats.values[STAT_LATENCY_P50 + LATENCY_ENC_PIXEL] = mcu_latency_stat(pixel_latency.get_percentile_us(50));
+            stats.values[STAT_LATENCY_P99 + LATENCY_ENC_PIXEL] = mcu_latency_stat(pixel_latency.get_percentile_us(99));
+            dsp_stats.publish(stats);
+            last_stats_ms = millis();
+            wake = true;
+        }
 
-void FilterGuiPage::render() {
-    draw_bar(0, cutoff_frequency, COLOR_RED, "Freq");
-    draw_bar(1, resonance, COLOR_YELLOW, "Resonance");
-    draw_bar(2, attenuation, COLOR_BLUE, "Attenuation");
-    draw_bar(3, filter_type, COLOR_GREEN, "Type");
+        if (wake) xTaskNotifyGive(render_task_handle);
+        input_task_stats.end_loop();
+        vTaskDelay(INPUT_POLL_TICKS);
+    }
 }
 
-void FilterGuiPage::update_data(int *enc_values, bool *button_states) {
-    cutoff_frequency = enc_values[0];
-    resonance = enc_values[1];
-    attenuation = enc_values[2];
-    filter_type = enc_values[3];
+// Called by the GUI in the render task
+void request_param(uint8_t id, int16_t value) {
+    const ParamRequest request = { id, value, gui_input_timed, gui_input_origin_us };
+    param_requests.push(request);
 }
 
-class EnvelopeGuiPage : public GuiPage {
-    public:
-    void render();
-    void update_data(int *enc_values, bool *button_states);
+#ifdef TFT_FPS_BENCHMARK
+/*
+ * Build with -D TFT_FPS_BENCHMARK to sweep all bars continuously and print the display throughput.
+ */
+void run_fps_benchmark() {
+    static uint32_t last_print = 0;
+    for (int i = 0; i < NUM_ENCODERS; i++) {
+        enc_values[i] = (enc_values[i] + 1 + i) % 128;
+    }
+    tft.begin_frame();
+    gui.update_data(enc_values, button_states);
+    gui.render();
+    tft.flush();
+
+    if (millis() - last_print >= 1000) {
+        last_print = millis();
+        const TftFrameStats &stats = tft.get_frame_stats();
+        Serial.printf("fps %u, flush %u us, %u px, %u bytes\n", stats.fps, stats.flush_us, stats.pixels, stats.spi_bytes);
+    }
+}
+#endif
 
-    private:
-    int attack, decay, sustain, release;
-};
+// This is basically the controller: get updates, move it into the data mode, and update presentation.
+void render_task(void *arg) {
+    for (;;) {
+#ifdef TFT_FPS_BENCHMARK
+        taskYIELD();
+#else
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RENDER_IDLE_MS));
+#endif
+        render_task_stats.begin_loop();
+        render_task_stats.note_queue_depth(input_events.size());
+
+        // Encoder changes are coalesced into one update, buttons are passed on one by one so no press is missed.
+        // The coalesced update carries the origin of the newest change, the display that of the oldest.
+        bool update_pending = false;
+        bool frame_started = false;
+        int num_events = 0;
+        bool frame_timed = false;
+        uint32_t oldest_origin_us = 0;
+        gui_input_timed = false;
+        InputEvent e;
+        while (input_events.pop(e)) {
+            num_events++;
+            if (!frame_started) {
+                tft.begin_frame();
+                frame_started = true;
+            }
+            if (e.type == INPUT_ENCODER) {
+                enc_values[e.index] = e.value;
+                update_pending = true;
+                if (e.timed) {
+                    if (!frame_timed) oldest_origin_us = e.origin_us;
+                    frame_timed = true;
+                    gui_input_timed = true;
+                    gui_input_origin_us = e.origin_us;
+                }
+            } else {
+                button_states[e.index] = e.value;
+                gui.update_data(enc_values, button_states); // also applies the encoder changes before it
+                gui_input_timed = false;
+                update_pending = false;
+            }
+        }
+        if (update_pending) gui.update_data(enc_values, button_states);
+        gui_input_timed = false;
+        const bool params_changed = dsp_params.update();
+        if (params_changed) {
+            if (!frame_started) {
+                tft.begin_frame();
+                frame_started = true;
+            }
+            gui.update_params(dsp_params.get().values);
+        }
+        if (frame_started) {
+            TRACE_DEBUG(trace_render, TRACE_RENDER, num_events, params_changed);
+            gui.render(); // only marks the changed regions dirty
+            tft.flush();  // streams them to the display via DMA
+            // flush() returns with at most the last band still on the SPI bus
+            if (frame_timed) pixel_latency.add(micros() - oldest_origin_us);
+        }
 
-void EnvelopeGuiPage::render() {
-    draw_bar(0, attack, COLOR_RED, "Attack");
-    draw_bar(1, decay, COLOR_YELLOW, "Decay");
-    draw_bar(2, sustain, COLOR_BLUE, "Sustain");
-    draw_bar(3, release, COLOR_GREEN, "Release");
-}
+        if (dsp_stats.update()) {
+            gui.update_stats(dsp_stats.get().values);
+            tft.flush();
+        }
 
-void EnvelopeGuiPage::update_data(int *enc_values, bool *button_states) {
-    attack = enc_values[0];
-    decay = enc_values[1];
-    sustain = enc_values[2];
-    release = enc_values[3];
+#ifdef TFT_FPS_BENCHMARK
+        run_fps_benchmark();
+#endif
+        render_task_stats.end_loop();
+    }
 }
 
-/*
- * The Gui object manages the various pages. Each page can render itself.
- */
-class Gui {
-    public:
-        Gui();
-        void switch_page(int i);
-        void previous_page();
-        void next_page();
-        void render(); // render the whole GUI
-        void update_encoder(int i); // redraw only a specific encoder area (bar, text, maybe graphics if affected)
-        void update_button(int i); // redraw only a specific button area (bar, text, maybe graphics if affected)
-        void update_data(int *enc_values, bool *button_states);
-
-        enum gui_pages_enum {
-            PAGE_MIXER = 0,
-            PAGE_SYNTH,
-            PAGE_FILTER,
-            PAGE_ENVELOPE,
-            PAGE_SAMPLER,
-            PAGE_SEQUENCER
-        };
-
-    private:
-        static const int max_page = 4;
-        GuiPage *pages[max_page];
-        int current_page_idx;
-        GuiPage *current_page;
-} gui;
-
-Gui::Gui() {
-    pages[PAGE_MIXER] = new MixerGuiPage();
-    pages[PAGE_SYNTH] = new OscillatorGuiPage();
-    pages[PAGE_FILTER] = new FilterGuiPage();
-    pages[PAGE_ENVELOPE] = new EnvelopeGuiPage();
-    //pages[4] = new SamplerGuiPage();
-    //pages[5] = new SequencerGuiPage();
-    current_page_idx = PAGE_MIXER;
-    current_page = pages[current_page_idx];
-}
+void setup() {
+  Serial.begin(115200);
+  mcu_comm_dsp.begin();
+  mcu_comm_encboard.begin();
+  tft.begin();
+  gui.set_param_handler(request_param);
+  TRACE_INFO(trace_loop, TRACE_BOOT, TRACE_SOURCE_OUTPUT, TRACE_LEVEL);
 
-void Gui::switch_page(int i) {
-    if (i < 0) i = Gui::max_page;
-    else if (i > Gui::max_page) i = 0;
-    current_page_idx = i;
-    current_page = pages[current_page_idx];
+  xTaskCreatePinnedToCore(render_task, "render", 8192, NULL, RENDER_TASK_PRIORITY, &render_task_handle, RENDER_CORE);
+  xTaskCreatePinnedToCore(input_task, "input", 4096, NULL, INPUT_TASK_PRIORITY, NULL, INPUT_CORE);
+  Serial.println("Setup done");
 }
 
-void Gui::previous_page() {
-    switch_page(current_page_idx - 1);
+// Sends trace records while the UART has room for them, so the loop task never waits for the port
+void drain_trace() {
+    static TaskTraceBuffer *const buffers[] = { &trace_loop, &trace_input, &trace_render };
+    uint8_t frame[TRACE_WIRE_FRAME];
+    TraceRecord r;
+    while (Serial.availableForWrite() >= TRACE_WIRE_FRAME && trace_take(buffers, 3, r)) {
+        Serial.write(frame, trace_frame_encode(r, frame));
+    }
 }
 
-void Gui::next_page() {
-    switch_page(current_page_idx + 1);
+#if TRACE_LEVEL >= TRACE_LEVEL_INFO
+/*
+ * With tracing the figures go out as records: text lines would crowd them out of the port
+ * and arrive untimed between them.
+ */
+void trace_task_stats(int context, const TaskStats &stats) {
+    TRACE_INFO(trace_loop, TRACE_LOOP_AVG, context, stats.get_loop_avg_us());
+    TRACE_INFO(trace_loop, TRACE_LOOP_MAX, context, stats.get_loop_max_us());
+    TRACE_INFO(trace_loop, TRACE_LOOP_COUNT, context, stats.get_loops());
 }
 
-void Gui::render() {
-    pages[current_page_idx]->render();
+void trace_latency(int stage, const LatencyHistogram &hist) {
+    static const uint8_t percentiles[] = { 50, 90, 99 };
+    for (int i = 0; i < 3; i++) {
+        TRACE_INFO(trace_loop, TRACE_LATENCY, stage << 8 | percentiles[i], hist.get_percentile_us(percentiles[i]));
+    }
+    TRACE_INFO(trace_loop, TRACE_LATENCY, stage << 8 | 100, hist.get_max_us());
+    TRACE_INFO(trace_loop, TRACE_LATENCY, stage << 8, hist.get_count());
 }
 
-void Gui::update_encoder(int i) {
-    //tft.draw_bar(BARS_X_START + i * BARS_WIDTH, BARS_Y, enc_values[i], bar_colors[i]); // TODO: model
-    pages[current_page_idx]->render();
+void report_figures() {
+    trace_task_stats(TRACE_CTX_INPUT, input_task_stats);
+    trace_task_stats(TRACE_CTX_RENDER, render_task_stats);
+    TRACE_INFO(trace_loop, TRACE_INPUT_QUEUE, input_task_stats.get_queue_max(), input_events_dropped);
+    const ParamMirror &params = mcu_comm_dsp.get_params();
+    TRACE_INFO(trace_loop, TRACE_PARAM_SYNC, params.is_synced(), params.get_version());
+
+    // Cumulative since startup; the audio MCU reports its stages itself
+    trace_latency(LATENCY_ENC_I2C, mcu_comm_encboard.get_latency());
+    trace_latency(LATENCY_ENC_PIXEL, pixel_latency);
+    const ClockSync &clock = mcu_comm_dsp.get_clock();
+    if (clock.is_valid()) {
+        const uint32_t rtt_us = clock.get_rtt_us();
+        TRACE_INFO(trace_loop, TRACE_CLOCK_SYNC, rtt_us < 32767 ? rtt_us : 32767, clock.get_offset_us());
+    }
 }
-
-void Gui::update_button(int i) {
-    // TODO
-    pages[current_page_idx]->render();
+#else
+void print_latency(int stage, const LatencyHistogram &hist) {
+    Serial.printf(" %s %u/%u/%u/%u (%u)", latency_stage_name(stage), hist.get_percentile_us(50),
+        hist.get_percentile_us(90), hist.get_percentile_us(99), hist.get_max_us(), hist.get_count());
 }
 
-void Gui::update_data(int *enc_values, bool *button_states) {
-    // Do GUI-wide stuff first like switching pages or something else "global"
-    // ...
-    if (button_states[3]) {
-        next_page();
+void report_figures() {
+    Serial.printf("input: loop avg %u us, max %u us, queue max %u/%u, %u dropped; render: loop avg %u us, max %u us, %u loops\n",
+        input_task_stats.get_loop_avg_us(), input_task_stats.get_loop_max_us(), input_task_stats.get_queue_max(),
+        input_events.capacity(), input_events_dropped, render_task_stats.get_loop_avg_us(),
+        render_task_stats.get_loop_max_us(), render_task_stats.get_loops());
+    const ParamMirror &params = mcu_comm_dsp.get_params();
+    Serial.printf("params: %s, version %u, %u resyncs\n", params.is_synced() ? "synced" : "not synced",
+        params.get_version(), params.get_resyncs());
+
+    // Cumulative since startup; the audio MCU prints its stages itself
+    Serial.printf("latency us p50/p90/p99/max (count):");
+    print_latency(LATENCY_ENC_I2C, mcu_comm_encboard.get_latency());
+    print_latency(LATENCY_ENC_PIXEL, pixel_latency);
+    const ClockSync &clock = mcu_comm_dsp.get_clock();
+    if (clock.is_valid()) {
+        Serial.printf("; audio clock offset %d us, rtt %u us\n", clock.get_offset_us(), clock.get_rtt_us());
+    } else {
+        Serial.printf("; audio clock not synced\n");
     }
-
-    // Now pass updated data to the current page
-    current_page->update_data(enc_values, button_states);
 }
+#endif
 
-bool data_update_required(bool *enc_updated, bool *button_updated) {
-    for (int i = 0; i < NUM_ENCODERS; i++) {
-        if (enc_updated[i] || button_updated[i]) {
-            return true;
-        }
-    }
-    return false;
+// Loop times of both tasks, the peak depth of the input queue, the parameter sync and the input latency, once per second
+void report_stats() {
+    static uint32_t last_report_ms = 0;
+    if (millis() - last_report_ms < 1000) return;
+    last_report_ms = millis();
+
+    report_figures();
+    input_task_stats.reset_peaks();
+    render_task_stats.reset_peaks();
 }
 
-// This is basically the controller: get updates, move it into the data mode, and update presentation.
 void loop() {
-    bool enc_updated[NUM_ENCODERS] = { false, false, false, false };
-    bool button_updated[NUM_ENCODERS] = { false, false, false, false };
-    //mcu_comm_dsp.parse_uart(enc_values, enc_updated, button_states, button_updated, NUM_ENCODERS); // get data from Teensy via UART
-    mcu_comm_encboard.request_encoders_buttons(enc_values, enc_updated, button_states, button_updated, NUM_ENCODERS); // get data from encoder board via I2C
-
-    if (data_update_required(enc_updated, button_updated)) {
-        //Serial.println("Calling GUI update_data");
-        //gui.update_data(enc_values, button_states);
-        //gui.render();
-    }
-
-    // TODO: optimisation to only redraw part that requires an update (e.g. one bar or button)
-    /*for (int i = 0; i < NUM_ENCODERS; i++) {
-        if (enc_updated[i]) {
-            enc_updated[i] = false;
-            gui.update_encoder(i);
-        }
-        if (button_updated[i]) {
-            button_updated[i] = false;
-            gui.update_button(i);
-        }
-    }*/
+    delay(TRACE_DRAIN_MS);
+    drain_trace();
+    report_stats();
 }
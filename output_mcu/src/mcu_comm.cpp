@@ -1,143 +1,297 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include <mcu_comm.h>
+#include <trace_buffers.h>
 
 #define MCU_UART Serial2
 
 McuCommUart::McuCommUart() {
-    rx_buf_idx = 0;
-    receiving = false;
-    msg_received = false;
+    rx_frame.len = 0;
+    rx_frame_too_long = false;
+    rx_overflows = 0;
+    rx_frame_errors = 0;
+    decode_errors = 0;
+    memset(stats, 0, sizeof (stats));
+    stats_updated = false;
+    last_sync_request_ms = 0;
+    sync_requested = false;
+    ping_seq = 0;
+    ping_us = 0;
+    last_ping_ms = 0;
+    pong_rx_us = 0;
+    pong_valid = false;
 }
 
 void McuCommUart::begin() {
-    Serial2.begin(9600);
+    MCU_UART.setRxBufferSize(1024); // must be set before begin()
+    MCU_UART.begin(MCU_PROTO_BAUD);
+    MCU_UART.onReceive([this]() { receive_uart(); });
 }
 
+/*
+ * Called by the UART driver whenever bytes arrive (producer side of rx_frames).
+ * Assembles bytes into frames and only hands complete frames to parse_uart(), so no
+ * data is discarded while loop() is busy as long as the frame slots do not run out.
+ */
 void McuCommUart::receive_uart() {
-  if (rx_buf_idx > 30) {
-    //Serial.println("rx_buf overflow!");
-    // Clear UART buffer, lose current message
-    flush_rx_buffer();
-    rx_buf_idx = 0;
-    receiving = false;
-  }
-  
-  if (MCU_UART.available() > 0) {
-    char c = MCU_UART.read();
-    if (c != '\n' && c != '\r' && c != '\0') {
-      rx_buf[rx_buf_idx] = c;
-      //Serial.print(rx_buf_idx); Serial.print(">");
-      //Serial.println(rx_buf[rx_buf_idx]);
-    } else {
-      return;
+    while (MCU_UART.available() > 0) {
+        const uint8_t c = MCU_UART.read();
+        if (c != 0) {
+            if (rx_frame.len < (int)sizeof (rx_frame.data)) {
+                rx_frame.data[rx_frame.len++] = c;
+            } else {
+                rx_frame_too_long = true;
+            }
+            continue;
+        }
+
+        // Delimiter: publish the frame, or drop it and resynchronise here
+        rx_frame.time_us = micros();
+        if (rx_frame_too_long) {
+            rx_frame_errors++;
+        } else if (rx_frame.len > 0 && !rx_frames.push(rx_frame)) {
+            rx_overflows++;
+        }
+        rx_frame.len = 0;
+        rx_frame_too_long = false;
     }
-    
-    if (!receiving) {
-      receiving = true;
-    } else {
-      if (rx_buf[rx_buf_idx] == ';') { // stop receiving when newline hit
-        delay(1);
-        flush_rx_buffer(); // might require delay in while loop
-        receiving = false;
-        msg_received = true;
-        rx_buf[rx_buf_idx+1] = '\0';
-      }
+}
+
+/*
+ * non-blocking, i.e. decodes all frames received so far (consumer side of rx_frames) and returns,
+ * rather than waiting for more data.
+ */
+void McuCommUart::parse_uart(int *enc_values, bool *enc_updated, bool *button_states, bool *button_updated, int num_inputs) {
+    McuRxFrame frame;
+    McuMsg msgs[MCU_MAX_MSGS_PER_FRAME];
+
+    while (rx_frames.pop(frame)) {
+        const int n = mcu_decode_frame(frame.data, frame.len, msgs, MCU_MAX_MSGS_PER_FRAME);
+        if (n < 0) {
+            TRACE_WARN(trace_input, TRACE_UART_DECODE_ERROR, frame.len, 0);
+            decode_errors++;
+            params.frame_lost();
+            continue;
+        }
+
+        for (int i = 0; i < n; i++) {
+            const int idx = msgs[i].id;
+            if (msgs[i].type == MSG_PARAM || msgs[i].type == MSG_STATE) {
+                params.handle(msgs[i]);
+                continue;
+            }
+            if (msgs[i].type == MSG_TIME) {
+                handle_time(msgs[i], frame.time_us);
+                continue;
+            }
+            if (msgs[i].type == MSG_STAT) {
+                if (idx < STAT_NUM_IDS && stats[idx] != msgs[i].value) {
+                    stats[idx] = msgs[i].value;
+                    stats_updated = true;
+                }
+                continue;
+            }
+            if (idx >= num_inputs) continue;
+
+            if (msgs[i].type == MSG_ENCODER) {
+                enc_values[idx] = msgs[i].value;
+                enc_updated[idx] = true;
+            } else if (msgs[i].type == MSG_BUTTON) {
+                button_states[idx] = msgs[i].value;
+                button_updated[idx] = true;
+            }
+        }
     }
+}
 
-    rx_buf_idx = receiving ? (rx_buf_idx + 1) : 0;
-  }
+/*
+ * The parts of a pong arrive in one frame, TIME_REPLY_DELAY last.
+ */
+void McuCommUart::handle_time(const McuMsg &msg, uint32_t rx_us) {
+    switch (msg.id) {
+    case TIME_PONG:
+        pong_valid = (uint16_t)msg.value == ping_seq; // an answer to an older ping is ignored
+        break;
+    case TIME_RX_LO:
+        pong_rx_us = (pong_rx_us & 0xffff0000) | (uint16_t)msg.value;
+        break;
+    case TIME_RX_HI:
+        pong_rx_us = (pong_rx_us & 0xffff) | ((uint32_t)(uint16_t)msg.value << 16);
+        break;
+    case TIME_REPLY_DELAY:
+        if (pong_valid) clock.add_sample(ping_us, pong_rx_us, (uint16_t)msg.value, rx_us);
+        pong_valid = false;
+        break;
+    }
 }
 
+bool McuCommUart::stats_changed() {
+    const bool changed = stats_updated;
+    stats_updated = false;
+    return changed;
+}
 
-void debug_print_received_msg(const char *type, int a, int b) {
-    Serial.print("Received: ");
-    Serial.print(type);
-    Serial.print(a);
-    Serial.print(" value ");
-    Serial.println(b);
+void McuCommUart::send_param(uint8_t id, int16_t value) {
+    if (!tx_frame.add(MSG_PARAM, id, value)) {
+        send_frame();
+        tx_frame.add(MSG_PARAM, id, value);
+    }
 }
 
 /*
- * non-blocking, i.e. will process one character per call and only parse the message if a full message has been buffered,
- * rather than looping and receiving the full message in one call.
+ * The origin is sent with the frame, once the clock offset is known. The audio MCU takes the last
+ * origin of a frame, so of several inputs in it the latest counts, like the latest value of a parameter.
  */
-void McuCommUart::parse_uart(int *enc_values, bool *enc_updated, bool *button_states, bool *button_updated, int num_inputs) {
-    receive_uart();
-    if (!msg_received) return;
-
-    if (rx_buf[0] == 'e') {
-        msg_received = false;
-        int enc, enc_value;
-        sscanf(rx_buf, "e%d:%d;", &enc, &enc_value);
-        debug_print_received_msg("enc", enc, enc_value);
-
-        if (enc >= 0 && enc < num_inputs) {
-            enc_values[enc] = enc_value <= 127 ? enc_value : 127;
-            enc_updated[enc] = true;
-            Serial.print("enc updated: ");
-            Serial.println(enc);
-        }
-    } else if (rx_buf[0] == 'b') {
-        msg_received = false;
-        int btn, btn_state;
-        sscanf(rx_buf, "b%d:%d;", &btn, &btn_state);
-        debug_print_received_msg("btn", btn, btn_state);
-
-        if (btn >= 0 && btn <= num_inputs) {
-            button_states[btn] = btn_state;
-            button_updated[btn] = true;
-        }
+void McuCommUart::send_input_param(uint8_t id, int16_t value, uint32_t origin_us) {
+    if (clock.is_valid()) {
+        const uint32_t origin = clock.to_remote(origin_us);
+        if (!tx_frame.has_room(3)) send_frame();
+        tx_frame.add(MSG_TIME, TIME_ORIGIN_LO, (int16_t)(origin & 0xffff));
+        tx_frame.add(MSG_TIME, TIME_ORIGIN_HI, (int16_t)(origin >> 16));
+    }
+    send_param(id, value);
+}
+
+/*
+ * Only the latest value of each parameter queued since the last call is sent.
+ * The UART driver buffers the frame, so this does not wait for the transfer.
+ */
+void McuCommUart::send_pending() {
+    if (params.needs_snapshot() && (!sync_requested || millis() - last_sync_request_ms >= SYNC_RETRY_MS)) {
+        if (tx_frame.is_full()) send_frame();
+        tx_frame.add(MSG_STATE, STATE_SYNC_REQUEST, 0);
+        TRACE_INFO(trace_input, TRACE_PARAM_RESYNC, params.get_resyncs(), params.get_version());
+        last_sync_request_ms = millis();
+        sync_requested = true;
     }
+    if (millis() - last_ping_ms >= PING_INTERVAL_MS) {
+        // In a frame of its own, so the audio MCU answers before handling any changes
+        send_frame();
+        tx_frame.add(MSG_TIME, TIME_PING, ++ping_seq);
+        ping_us = micros();
+        last_ping_ms = millis();
+    }
+    send_frame();
 }
 
-void McuCommUart::flush_rx_buffer() {
-    //while (MCU_UART.available() > 0) { Serial.print("$"); Serial.print(MCU_UART.read()); delay(1); }
-    while (MCU_UART.available() > 0) { MCU_UART.read(); }
+void McuCommUart::send_frame() {
+    if (tx_frame.is_empty()) return;
+    uint8_t buf[MCU_MAX_WIRE_FRAME];
+    const int len = tx_frame.encode(buf);
+    MCU_UART.write(buf, len);
 }
 
 
 
 McuCommI2c::McuCommI2c() {
-    memset(prev_enc_values, 0, sizeof (int) * 8);
-    memset(prev_button_states, 0, sizeof (bool) * 8);
+    synced = false;
+    seq_valid = false;
+    next_seq = 0;
+    seq_gaps = 0;
+    origins_valid = 0;
 }
 
 void McuCommI2c::begin() {
     Wire.begin(); // default I2C pins: 21, 22
+    pinMode(PIN_DATA_READY, INPUT_PULLUP);
 }
 
-void McuCommI2c::request_encoders_buttons(int *enc_values, bool *enc_updated, bool *button_states, bool *button_updated, int num_inputs) {
-    Wire.requestFrom(McuCommI2c::I2C_SLAVE_ENCODERS, 9);
-
-    byte b[9] = {};
-    int i = 0;
+/*
+ * read_us, if given, is set to when the read started, i.e. about when the board prepares its reply.
+ */
+bool McuCommI2c::read_register(uint8_t reg, uint8_t *buf, int len, uint32_t *read_us) {
+    Wire.beginTransmission(I2C_SLAVE_ENCODERS);
+    Wire.write(reg);
+    if (Wire.endTransmission(false) != 0) return false;
+    if (read_us) *read_us = micros();
+    if (Wire.requestFrom((int)I2C_SLAVE_ENCODERS, len) != len) return false;
 
-    while (Wire.available()) {
-        b[i++] = Wire.read();
-        Serial.println(b[i-1]);
+    for (int i = 0; i < len; i++) {
+        buf[i] = Wire.read();
     }
+    return true;
+}
 
-    enc_values[0] = (b[0] << 8) | b[1];
-    enc_values[1] = (b[2] << 8) | b[3];
-    enc_values[2] = (b[4] << 8) | b[5];
-    enc_values[3] = (b[6] << 8) | b[7];
-    enc_values[4] = enc_values[5] = enc_values[6] = enc_values[7] = 0;
+void McuCommI2c::request_snapshot(int *enc_values, bool *enc_updated, bool *button_states, bool *button_updated, int num_inputs) {
+    uint8_t b[ENC_SNAPSHOT_SIZE];
+    if (!read_register(ENC_REG_SNAPSHOT, b, sizeof (b))) return;
 
-    for (int i = 0; i < num_inputs; i++) {
-        if (enc_values[i] != prev_enc_values[i]) {
+    for (int i = 0; i < num_inputs && i < ENC_NUM_ENCODERS; i++) {
+        const int value = (int16_t)((b[2 * i] << 8) | b[2 * i + 1]);
+        if (enc_values[i] != value) {
+            enc_values[i] = value;
             enc_updated[i] = true;
-            prev_enc_values[i] = enc_values[i];
         }
-        if (button_states[i] != prev_button_states[i]) {
+
+        const bool pressed = (b[8] >> (3 - i)) & 1;
+        if (button_states[i] != pressed) {
+            button_states[i] = pressed;
             button_updated[i] = true;
-            prev_button_states[i] = button_states[i];
         }
     }
+    synced = true;
+    seq_valid = false;
+}
+
+/*
+ * Non-blocking unless the board has pending events, which are then read in one burst.
+ * The burst ends with the board time of the read, so the age of each event gives its local time
+ * (to within the time the board takes to start its reply) without syncing the clocks.
+ */
+void McuCommI2c::request_encoders_buttons(int *enc_values, bool *enc_updated, bool *button_states, bool *button_updated, int num_inputs) {
+    origins_valid = 0;
+    if (!synced) {
+        request_snapshot(enc_values, enc_updated, button_states, button_updated, num_inputs);
+    }
+
+    if (digitalRead(PIN_DATA_READY) == HIGH) return;
+
+    uint8_t n = 0;
+    if (!read_register(ENC_REG_COUNT, &n, 1) || n == 0 || n > ENC_MAX_BURST) return;
+
+    uint8_t b[ENC_MAX_BURST * ENC_EVENT_SIZE + ENC_TIME_SIZE];
+    uint32_t read_us = 0;
+    if (!read_register(ENC_REG_EVENTS, b, n * ENC_EVENT_SIZE + ENC_TIME_SIZE, &read_us)) return;
+    const uint32_t done_us = micros();
+    const uint16_t burst_time = enc_time_decode(b + n * ENC_EVENT_SIZE);
+    TRACE_DEBUG(trace_input, TRACE_ENC_BURST, n, b[0]);
+
+    for (int i = 0; i < n; i++) {
+        EncEvent e;
+        enc_event_decode(b + i * ENC_EVENT_SIZE, e);
+
+        if (seq_valid && e.seq != next_seq) {
+            // Board dropped events: values are absolute, so a snapshot brings everything up to date
+            TRACE_WARN(trace_input, TRACE_ENC_RESYNC, next_seq, e.seq);
+            seq_gaps++;
+            synced = false;
+        }
+        next_seq = e.seq + 1;
+        seq_valid = true;
+
+        if (e.index >= num_inputs) continue;
+        if (e.type == ENC_EVENT_ENCODER) {
+            enc_values[e.index] = e.value;
+            enc_updated[e.index] = true;
+            if (e.index < ENC_NUM_ENCODERS) {
+                origins[e.index] = read_us - enc_event_age_us(e, burst_time);
+                origins_valid |= 1 << e.index;
+                latency.add(done_us - origins[e.index]);
+            }
+        } else if (e.type == ENC_EVENT_BUTTON && e.value != ENC_BUTTON_LONG_PRESS) {
+            // A long press comes while the button is still held after its press; the GUI has no action for it
+            button_states[e.index] = e.value == ENC_BUTTON_PRESSED;
+            button_updated[e.index] = true;
+        }
+    }
+
+    if (!synced) {
+        request_snapshot(enc_values, enc_updated, button_states, button_updated, num_inputs);
+    }
+}
 
-    button_states[0] = (b[8] & 8) >> 3;
-    button_states[1] = (b[8] & 4) >> 2;
-    button_states[2] = (b[8] & 2) >> 1;
-    button_states[3] = b[8] & 1;
-    button_states[4] = button_states[5] = button_states[6] = button_states[7] = 1; // HIGH = not pressed
+bool McuCommI2c::get_origin(int i, uint32_t &origin_us) const {
+    if (i < 0 || i >= ENC_NUM_ENCODERS || !(origins_valid >> i & 1)) return false;
+    origin_us = origins[i];
+    return true;
 }
@@ -0,0 +1,62 @@
+#include <param_mirror.h>
+
+static_assert(NUM_PARAMS <= 32, "changed has one bit per parameter");
+
+ParamMirror::ParamMirror() {
+    for (int i = 0; i < NUM_PARAMS; i++) {
+        values[i] = 0;
+    }
+    changed = 0;
+    version = 0;
+    synced = false;
+    in_snapshot = false;
+    resyncs = 0;
+}
+
+void ParamMirror::lose_sync() {
+    if (synced) resyncs++;
+    synced = false;
+    in_snapshot = false;
+}
+
+void ParamMirror::handle(const McuMsg &msg) {
+    if (msg.type == MSG_PARAM) {
+        if (msg.id < NUM_PARAMS && values[msg.id] != msg.value) {
+            values[msg.id] = msg.value;
+            changed |= 1UL << msg.id;
+        }
+        return;
+    }
+    if (msg.type != MSG_STATE) return;
+
+    const uint16_t v = msg.value;
+    switch (msg.id) {
+    case STATE_SNAPSHOT:
+        // Always accepted, e.g. after the audio MCU restarted with a new count
+        version = v;
+        synced = false;
+        in_snapshot = true;
+        break;
+    case STATE_DELTA:
+        if (v != (uint16_t)(version + 1)) lose_sync();
+        version = v;
+        break;
+    case STATE_SNAPSHOT_END:
+        if (in_snapshot && v == version) synced = true;
+        in_snapshot = false;
+        break;
+    case STATE_VERSION:
+        if (v != version) lose_sync();
+        break;
+    }
+}
+
+void ParamMirror::frame_lost() {
+    lose_sync();
+}
+
+uint32_t ParamMirror::take_changes() {
+    const uint32_t c = changed;
+    changed = 0;
+    return c;
+}
@@ -1,4 +1,9 @@
+#ifdef ARDUINO
+
 #include "SPI.h"
+#include <driver/spi_master.h>
+#include <driver/gpio.h>
+#include <esp_heap_caps.h>
 #include <tft_gui.h>
 
 #define TFT_RST 4
@@ -8,40 +13,157 @@
 #define TFT_CS  5 // VSPI-SS0
 #define TFT_LED 0 // 0 if wired to +5V directly
 #define TFT_BRIGHTNESS 200
+#define TFT_SPI_HZ 40000000
+#define TFT_PANEL_WIDTH 176 // physical (portrait) width of the ILI9225
+
+// ILI9225 registers used to stream pixels
+#define ILI9225_ENTRY_MODE 0x03
+#define ILI9225_RAM_ADDR_SET1 0x20
+#define ILI9225_RAM_ADDR_SET2 0x21
+#define ILI9225_GRAM_DATA_REG 0x22
+#define ILI9225_HORIZONTAL_WINDOW_ADDR1 0x36
+#define ILI9225_HORIZONTAL_WINDOW_ADDR2 0x37
+#define ILI9225_VERTICAL_WINDOW_ADDR1 0x38
+#define ILI9225_VERTICAL_WINDOW_ADDR2 0x39
 
 SPIClass vspi(VSPI);
 TFT_22_ILI9225 spi_tft = TFT_22_ILI9225(TFT_RST, TFT_RS, TFT_CS, TFT_LED, TFT_BRIGHTNESS);
 
-void TftGui::begin() {
+static spi_device_handle_t spi_dev;
+static uint16_t *band_buf[2];             // DMA capable, big-endian pixels
+static spi_transaction_t band_trans[2];
+static bool band_busy[2];
+static int next_band;
+
+// Drives the RS (data/command) line before each transaction, t->user = 1 for data
+static void IRAM_ATTR tft_pre_transfer(spi_transaction_t *t) {
+    gpio_set_level((gpio_num_t)TFT_RS, (int)t->user);
+}
+
+static void tft_write16(bool data, uint16_t value) {
+    spi_transaction_t t;
+    memset(&t, 0, sizeof (t));
+    t.flags = SPI_TRANS_USE_TXDATA;
+    t.length = 16;
+    t.user = (void *)(data ? 1 : 0);
+    t.tx_data[0] = value >> 8;
+    t.tx_data[1] = value & 0xff;
+    spi_device_polling_transmit(spi_dev, &t);
+}
+
+static void tft_write_register(uint16_t reg, uint16_t value) {
+    tft_write16(false, reg);
+    tft_write16(true, value);
+}
+
+/*
+ * The library powers up and configures the panel, then VSPI is handed over to the
+ * ESP-IDF SPI master driver which can queue DMA transfers.
+ */
+void TftGui::begin_panel() {
     vspi.begin();
     spi_tft.begin(vspi);
     spi_tft.setOrientation(1);
-    spi_tft.clear();
-
     maxX = spi_tft.maxX();
     maxY = spi_tft.maxY();
+    vspi.end();
 
-    spi_tft.setFont(Terminal6x8);
+    spi_bus_config_t bus;
+    memset(&bus, 0, sizeof (bus));
+    bus.mosi_io_num = TFT_SDI;
+    bus.miso_io_num = -1;
+    bus.sclk_io_num = TFT_CLK;
+    bus.quadwp_io_num = -1;
+    bus.quadhd_io_num = -1;
+    bus.max_transfer_sz = WIDTH * BAND_LINES * sizeof (uint16_t);
+    spi_bus_initialize(VSPI_HOST, &bus, 2);
+
+    spi_device_interface_config_t dev;
+    memset(&dev, 0, sizeof (dev));
+    dev.clock_speed_hz = TFT_SPI_HZ;
+    dev.mode = 0;
+    dev.spics_io_num = TFT_CS;
+    dev.queue_size = 2;
+    dev.pre_cb = tft_pre_transfer;
+    spi_bus_add_device(VSPI_HOST, &dev, &spi_dev);
+
+    for (int i = 0; i < 2; i++) {
+        band_buf[i] = (uint16_t *)heap_caps_malloc(WIDTH * BAND_LINES * sizeof (uint16_t), MALLOC_CAP_DMA);
+        if (!band_buf[i]) {
+            printf("TftGui: no DMA memory for band buffer %d\n", i);
+            abort();
+        }
+        band_busy[i] = false;
+    }
+    next_band = 0;
+
+    font = Terminal6x8;
 }
 
-void TftGui::clear() {
-    spi_tft.clear();
+/*
+ * Bands complete in the order they were queued, so the oldest busy band is returned first.
+ */
+void TftGui::wait_push_done() {
+    for (int i = 0; i < 2; i++) {
+        const int b = next_band ^ i; // oldest first
+        if (!band_busy[b]) continue;
+        spi_transaction_t *done;
+        spi_device_get_trans_result(spi_dev, &done, portMAX_DELAY);
+        band_busy[b] = false;
+    }
 }
 
-void TftGui::draw_bar(int x, int y, int value, int color) {
-  const int area_top = maxY - y;
-  const int area_bottom = maxY;
-  const int text_y = maxY - y + 16;
-  const int bar_width = 40;
-  spi_tft.fillRectangle(x, area_top, x + bar_width, area_bottom, COLOR_BLACK); // clear
-  spi_tft.drawRectangle(x, area_top, x + bar_width, area_top + 10, color);
-  spi_tft.fillRectangle(x, area_top, x + map(value, 0, 127, 0, bar_width), area_top + 10, color);
-
-  static char buf[6];
-  sprintf(buf, "%02d", value);
-  spi_tft.drawText(x + 8, text_y, buf);
+void TftGui::push_rect(const TftRect &r) {
+    // Register writes must not overtake pixels still queued for the previous window
+    wait_push_done();
+
+    // Landscape: logical x runs along the panel's vertical axis, logical y against its horizontal axis.
+    // Entry mode: BGR, address counter moves vertically first, vertical increment, horizontal decrement.
+    tft_write_register(ILI9225_ENTRY_MODE, 0x1028);
+    tft_write_register(ILI9225_HORIZONTAL_WINDOW_ADDR1, TFT_PANEL_WIDTH - 1 - r.y1);
+    tft_write_register(ILI9225_HORIZONTAL_WINDOW_ADDR2, TFT_PANEL_WIDTH - 1 - r.y2);
+    tft_write_register(ILI9225_VERTICAL_WINDOW_ADDR1, r.x2);
+    tft_write_register(ILI9225_VERTICAL_WINDOW_ADDR2, r.x1);
+    tft_write_register(ILI9225_RAM_ADDR_SET1, TFT_PANEL_WIDTH - 1 - r.y1);
+    tft_write_register(ILI9225_RAM_ADDR_SET2, r.x1);
+    tft_write16(false, ILI9225_GRAM_DATA_REG);
+
+    const int w = r.x2 - r.x1 + 1;
+    for (int y = r.y1; y <= r.y2; y += BAND_LINES) {
+        const int lines = r.y2 - y + 1 < BAND_LINES ? r.y2 - y + 1 : BAND_LINES;
+        const int b = next_band;
+        next_band ^= 1;
+
+        if (band_busy[b]) {
+            // b is the oldest transfer in flight
+            spi_transaction_t *done;
+            spi_device_get_trans_result(spi_dev, &done, portMAX_DELAY);
+            band_busy[b] = false;
+        }
+
+        // Render the band while the other one is still being sent
+        uint16_t *dst = band_buf[b];
+        for (int l = 0; l < lines; l++) {
+            const uint16_t *src = framebuffer + (y + l) * WIDTH + r.x1;
+            for (int i = 0; i < w; i++) {
+                *dst++ = __builtin_bswap16(src[i]);
+            }
+        }
+
+        spi_transaction_t &t = band_trans[b];
+        memset(&t, 0, sizeof (t));
+        t.length = w * lines * 16;
+        t.tx_buffer = band_buf[b];
+        t.user = (void *)1;
+        spi_device_queue_trans(spi_dev, &t, portMAX_DELAY);
+        band_busy[b] = true;
+    }
+
+    count_pixels(1, (uint32_t)w * (r.y2 - r.y1 + 1));
 }
 
-void TftGui::draw_text(int x, int y, const char *s) {
-    spi_tft.drawText(x, y, s);
+uint32_t TftGui::now_us() const {
+    return micros();
 }
+
+#endif
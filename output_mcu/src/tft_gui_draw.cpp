@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tft_gui.h>
+#include <text_format.h>
+
+/*
+ * Off-screen drawing and dirty area tracking, shared by all TftGui backends.
+ * The backends only differ in how flush() gets the dirty rectangles to the panel.
+ */
+
+void TftGui::begin() {
+    init_framebuffer();
+    begin_panel();
+    atlas.set_font(font);
+    clear();
+    flush();
+    begin_frame();
+}
+
+void TftGui::init_framebuffer() {
+    framebuffer = (uint16_t *)malloc(WIDTH * HEIGHT * sizeof (uint16_t));
+    if (!framebuffer) {
+        // Every drawing call writes to it, there is no way to go on without the display
+        printf("TftGui: no memory for the %u byte framebuffer\n", (unsigned)(WIDTH * HEIGHT * sizeof (uint16_t)));
+        abort();
+    }
+    font = NULL;
+    num_dirty = 0;
+    memset(&stats, 0, sizeof (stats));
+    fps_start_us = 0;
+    fps_frames = 0;
+}
+
+void TftGui::begin_frame() {
+    stats.pixels = 0;
+    stats.windows = 0;
+    stats.spi_bytes = 0;
+}
+
+void TftGui::count_pixels(uint32_t windows, uint32_t pixels) {
+    stats.windows += windows;
+    stats.pixels += pixels;
+    stats.spi_bytes += windows * WINDOW_SPI_BYTES + pixels * 2;
+}
+
+/*
+ * Adds an area to the dirty list. Touching or overlapping areas are merged, and when the list
+ * is full the area is merged into the last entry, so flush() never sends a pixel more than needed
+ * by much but never misses one either.
+ */
+void TftGui::mark_dirty(int x1, int y1, int x2, int y2) {
+    for (int i = 0; i < num_dirty; i++) {
+        TftRect &d = dirty[i];
+        if (x1 <= d.x2 + 1 && x2 >= d.x1 - 1 && y1 <= d.y2 + 1 && y2 >= d.y1 - 1) {
+            if (x1 < d.x1) d.x1 = x1;
+            if (y1 < d.y1) d.y1 = y1;
+            if (x2 > d.x2) d.x2 = x2;
+            if (y2 > d.y2) d.y2 = y2;
+            return;
+        }
+    }
+
+    if (num_dirty == MAX_DIRTY_RECTS) {
+        TftRect &d = dirty[num_dirty - 1];
+        if (x1 < d.x1) d.x1 = x1;
+        if (y1 < d.y1) d.y1 = y1;
+        if (x2 > d.x2) d.x2 = x2;
+        if (y2 > d.y2) d.y2 = y2;
+        return;
+    }
+
+    TftRect &d = dirty[num_dirty++];
+    d.x1 = x1;
+    d.y1 = y1;
+    d.x2 = x2;
+    d.y2 = y2;
+}
+
+void TftGui::clear() {
+    fill_rect(0, 0, WIDTH - 1, HEIGHT - 1, COLOR_BLACK);
+}
+
+void TftGui::fill_rect(int x1, int y1, int x2, int y2, uint16_t color) {
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 >= WIDTH) x2 = WIDTH - 1;
+    if (y2 >= HEIGHT) y2 = HEIGHT - 1;
+    if (x1 > x2 || y1 > y2) return;
+
+    for (int y = y1; y <= y2; y++) {
+        uint16_t *p = framebuffer + y * WIDTH + x1;
+        for (int x = x1; x <= x2; x++) {
+            *p++ = color;
+        }
+    }
+    mark_dirty(x1, y1, x2, y2);
+}
+
+void TftGui::draw_rect(int x1, int y1, int x2, int y2, uint16_t color) {
+    fill_rect(x1, y1, x2, y1, color);
+    fill_rect(x1, y2, x2, y2, color);
+    fill_rect(x1, y1, x1, y2, color);
+    fill_rect(x2, y1, x2, y2, color);
+}
+
+/*
+ * Text is copied row by row from the glyph atlas, so a whole string is a single dirty rectangle
+ * and costs no per-pixel font decoding. Chars the font lacks are skipped.
+ */
+void TftGui::draw_text(int x, int y, const char *s, uint16_t color, uint16_t bg_color) {
+    if (!font) {
+        for (; *s; s++, x += FONT_WIDTH) {
+            fill_rect(x, y, x + FONT_WIDTH - 1, y + FONT_HEIGHT - 1, *s == ' ' ? bg_color : color);
+        }
+        return;
+    }
+
+    const int x_start = x;
+    const int height = atlas.get_height();
+    const int stride = atlas.get_cell_width();
+    const int rows = y + height <= HEIGHT ? height : HEIGHT - y;
+    if (y < 0 || rows <= 0) return;
+
+    for (; *s && x < WIDTH; s++) {
+        const int width = atlas.get_width(*s);
+        if (width == 0) continue;
+        const int cols = x + width <= WIDTH ? width : WIDTH - x;
+
+        const uint16_t *glyph = atlas.get_glyph(*s, color, bg_color);
+        if (!glyph) {
+            draw_glyph_bits(x, y, *s, color, bg_color);
+        } else {
+            uint16_t *dst = framebuffer + y * WIDTH + x;
+            for (int row = 0; row < rows; row++) {
+                memcpy(dst, glyph, cols * sizeof (uint16_t));
+                dst += WIDTH;
+                glyph += stride;
+            }
+        }
+        x += width;
+    }
+
+    if (x > x_start) {
+        mark_dirty(x_start, y, x - 1 < WIDTH ? x - 1 : WIDTH - 1, y + rows - 1);
+    }
+}
+
+/*
+ * Fallback when the atlas has no memory for another color pair: decodes the font bits directly.
+ * Font format: 4 byte header (width, height, first char, number of chars),
+ * then per char its width and one byte per 8 rows for every column (LSB = top row).
+ */
+void TftGui::draw_glyph_bits(int x, int y, char c, uint16_t color, uint16_t bg_color) {
+    const int height = font[1];
+    const int nbrows = (height + 7) / 8;
+    const uint8_t *glyph = font + 4 + ((uint8_t)c - font[2]) * (font[0] * nbrows + 1);
+    const int char_width = glyph[0];
+
+    for (int i = 0; i <= char_width && x + i < WIDTH; i++) {
+        for (int row = 0; row < height && y + row < HEIGHT; row++) {
+            const bool set = i < char_width && ((glyph[1 + i * nbrows + row / 8] >> (row % 8)) & 1);
+            framebuffer[(y + row) * WIDTH + x + i] = set ? color : bg_color;
+        }
+    }
+}
+
+void TftGui::draw_number(int x, int y, int value, int min_width, uint16_t color, uint16_t bg_color) {
+    char buf[INT_TEXT_SIZE];
+    format_int(buf, value, min_width);
+    draw_text(x, y, buf, color, bg_color);
+}
+
+int TftGui::text_width(const char *s) const {
+    int width = 0;
+    for (; *s; s++) {
+        width += font ? atlas.get_width(*s) : FONT_WIDTH;
+    }
+    return width;
+}
+
+void TftGui::flush() {
+    if (num_dirty == 0) return;
+
+    const uint32_t start = now_us();
+    for (int i = 0; i < num_dirty; i++) {
+        push_rect(dirty[i]);
+    }
+    num_dirty = 0;
+
+    const uint32_t end = now_us();
+    stats.flush_us = end - start;
+    fps_frames++;
+    if (end - fps_start_us >= 1000000) {
+        stats.fps = fps_frames;
+        fps_frames = 0;
+        fps_start_us = end;
+    }
+}
@@ -0,0 +1,78 @@
+#include <tft_gui.h>
+#include <text_format.h>
+
+/*
+ * OP2001 elements built from the display primitives, shared by all TftGui backends.
+ */
+
+int TftGui::bar_width(int value) const {
+    if (value < 0) value = 0;
+    else if (value > BAR_MAX) value = BAR_MAX;
+    return value * BAR_WIDTH / BAR_MAX;
+}
+
+/*
+ * Full redraw of a bar: clears the area, then draws the outline, the filled part and the value.
+ */
+void TftGui::draw_bar(int x, int y, int value, int color, const char *text) {
+    const int area_top = maxY - y;
+    const int area_bottom = maxY;
+    fill_rect(x, area_top, x + BAR_WIDTH, area_bottom, COLOR_BLACK); // clear
+    draw_rect(x, area_top, x + BAR_WIDTH, area_top + BAR_HEIGHT, color);
+    fill_rect(x, area_top, x + bar_width(value), area_top + BAR_HEIGHT, color);
+    if (text) draw_bar_text(x, y, text);
+    else draw_bar_value(x, y, value, value);
+}
+
+/*
+ * Redraws only the part of a bar that differs between old_value and value.
+ * The value text is not touched, see draw_bar_value().
+ */
+void TftGui::update_bar(int x, int y, int old_value, int value, int color) {
+    const int area_top = maxY - y;
+    const int old_w = bar_width(old_value);
+    const int new_w = bar_width(value);
+
+    if (new_w > old_w) {
+        fill_rect(x + old_w + 1, area_top, x + new_w, area_top + BAR_HEIGHT, color);
+    } else if (new_w < old_w) {
+        // Keep the outline: only clear the inside of the bar
+        const int right = old_w < BAR_WIDTH ? x + old_w : x + BAR_WIDTH - 1;
+        fill_rect(x + new_w + 1, area_top + 1, right, area_top + BAR_HEIGHT - 1, COLOR_BLACK);
+    }
+}
+
+/*
+ * Value below a bar, at least 3 chars wide. Without text the value is an unbounded encoder
+ * position, so the rest of a longer old number is cleared.
+ */
+void TftGui::draw_bar_value(int x, int y, int value, int old_value) {
+    char buf[INT_TEXT_SIZE], old_buf[INT_TEXT_SIZE];
+    format_int(buf, value, 3);
+    format_int(old_buf, old_value, 3);
+    const int text_x = x + 8;
+    const int text_y = maxY - y + 16;
+    const int width = text_width(buf);
+    const int old_width = text_width(old_buf);
+    if (old_width > width) {
+        fill_rect(text_x + width, text_y, text_x + old_width - 1, text_y + FONT_HEIGHT - 1, COLOR_BLACK);
+    }
+    draw_text(text_x, text_y, buf);
+}
+
+/*
+ * Text below a bar instead of the value, padded to BAR_TEXT_CHARS so it overwrites a longer one.
+ */
+void TftGui::draw_bar_text(int x, int y, const char *s) {
+    char buf[BAR_TEXT_CHARS + 1];
+    int len = 0;
+    while (len < BAR_TEXT_CHARS && s[len]) {
+        buf[len] = s[len];
+        len++;
+    }
+    while (len < BAR_TEXT_CHARS) {
+        buf[len++] = ' ';
+    }
+    buf[len] = '\0';
+    draw_text(x, maxY - y + 16, buf);
+}
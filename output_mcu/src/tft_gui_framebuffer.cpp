@@ -0,0 +1,30 @@
+#ifndef ARDUINO
+
+#include <time.h>
+#include <tft_gui.h>
+
+/*
+ * Host backend of TftGui: the framebuffer is the result, so rendering can be run and measured
+ * on a PC (see get_pixel() and get_frame_stats()). Pushes are counted like on the hardware.
+ * There is no font data on the host, so text is drawn as plain character cells.
+ */
+
+void TftGui::begin_panel() {
+    maxX = WIDTH;
+    maxY = HEIGHT;
+}
+
+void TftGui::push_rect(const TftRect &r) {
+    count_pixels(1, (uint32_t)(r.x2 - r.x1 + 1) * (r.y2 - r.y1 + 1));
+}
+
+void TftGui::wait_push_done() {
+}
+
+uint32_t TftGui::now_us() const {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#endif
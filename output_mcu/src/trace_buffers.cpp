@@ -0,0 +1,5 @@
+#include <trace_buffers.h>
+
+TaskTraceBuffer trace_loop(TRACE_CTX_LOOP);
+TaskTraceBuffer trace_input(TRACE_CTX_INPUT);
+TaskTraceBuffer trace_render(TRACE_CTX_RENDER);
@@ -0,0 +1,164 @@
+/*
+ * Redraw cost of the GUI on the host framebuffer backend: after a full render, turning one
+ * encoder must only push the pixels of its bar and value, and an unchanged page nothing at all.
+ */
+
+#include <unity.h>
+#include <string.h>
+#include <gui_pages.h>
+#include <text_format.h>
+
+TftGui tft;
+
+static Gui *gui;
+static int enc_values[NUM_ENCODERS];
+static bool button_states[NUM_ENCODERS];
+static uint16_t before[TftGui::HEIGHT][TftGui::WIDTH];
+
+// Bar 0 of the mixer page and the value below it, see GuiPage::draw_bar() and TftGui::draw_bar()
+static const int BAR_X = BARS_X_START;
+static const int BAR_TOP = TftGui::HEIGHT - BARS_Y;
+static const int VALUE_Y = BAR_TOP + 16;
+
+static void save_framebuffer(void) {
+    for (int y = 0; y < TftGui::HEIGHT; y++) {
+        for (int x = 0; x < TftGui::WIDTH; x++) {
+            before[y][x] = tft.get_pixel(x, y);
+        }
+    }
+}
+
+// Bounding box of the pixels that differ from the saved framebuffer, false if none do
+static bool changed_area(TftRect &r) {
+    r.x1 = TftGui::WIDTH;
+    r.y1 = TftGui::HEIGHT;
+    r.x2 = r.y2 = -1;
+    for (int y = 0; y < TftGui::HEIGHT; y++) {
+        for (int x = 0; x < TftGui::WIDTH; x++) {
+            if (tft.get_pixel(x, y) == before[y][x]) continue;
+            if (x < r.x1) r.x1 = x;
+            if (y < r.y1) r.y1 = y;
+            if (x > r.x2) r.x2 = x;
+            if (y > r.y2) r.y2 = y;
+        }
+    }
+    return r.x2 >= 0;
+}
+
+// One pass of the render task: apply the input, render and flush, return what was pushed
+static const TftFrameStats &frame(void) {
+    save_framebuffer();
+    tft.begin_frame();
+    gui->update_data(enc_values, button_states);
+    gui->render();
+    tft.flush();
+    return tft.get_frame_stats();
+}
+
+static void assert_spi_bytes(const TftFrameStats &stats) {
+    TEST_ASSERT_EQUAL_UINT32(stats.pixels * 2 + stats.windows * TftGui::WINDOW_SPI_BYTES, stats.spi_bytes);
+}
+
+static void test_unchanged_page_pushes_nothing(void) {
+    const TftFrameStats &stats = frame();
+    TEST_ASSERT_EQUAL_UINT32(0, stats.pixels);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.windows);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.spi_bytes);
+}
+
+static void test_one_encoder_redraws_its_bar(void) {
+    enc_values[0] = 64;
+    const TftFrameStats &stats = frame();
+
+    // The grown part of the bar (its outline stays) and the 3 digit cells of the value
+    const int grown_w = 64 * TftGui::BAR_WIDTH / TftGui::BAR_MAX;
+    const uint32_t bar_pixels = grown_w * (TftGui::BAR_HEIGHT + 1);
+    const uint32_t value_pixels = 3 * TftGui::FONT_WIDTH * TftGui::FONT_HEIGHT;
+    TEST_ASSERT_EQUAL_UINT32(2, stats.windows);
+    TEST_ASSERT_EQUAL_UINT32(bar_pixels + value_pixels, stats.pixels);
+    assert_spi_bytes(stats);
+
+    TftRect r;
+    TEST_ASSERT_TRUE(changed_area(r));
+    TEST_ASSERT_GREATER_OR_EQUAL_INT(BAR_X + 1, r.x1);
+    TEST_ASSERT_LESS_OR_EQUAL_INT(BAR_X + TftGui::BAR_WIDTH, r.x2);
+    TEST_ASSERT_GREATER_OR_EQUAL_INT(BAR_TOP, r.y1);
+    TEST_ASSERT_LESS_OR_EQUAL_INT(VALUE_Y + TftGui::FONT_HEIGHT - 1, r.y2);
+    TEST_ASSERT_EQUAL_UINT16(COLOR_RED, tft.get_pixel(BAR_X + grown_w, BAR_TOP + TftGui::BAR_HEIGHT / 2));
+
+    // Shrinking clears only the inside of the bar
+    enc_values[0] = 32;
+    const TftFrameStats &shrink = frame();
+    const int shrunk_w = 32 * TftGui::BAR_WIDTH / TftGui::BAR_MAX;
+    TEST_ASSERT_EQUAL_UINT32(2, shrink.windows);
+    TEST_ASSERT_EQUAL_UINT32((grown_w - shrunk_w) * (TftGui::BAR_HEIGHT - 1) + value_pixels, shrink.pixels);
+    assert_spi_bytes(shrink);
+    TEST_ASSERT_TRUE(changed_area(r));
+    TEST_ASSERT_EQUAL_INT(BAR_X + shrunk_w + 1, r.x1);
+    TEST_ASSERT_EQUAL_INT(BAR_X + grown_w, r.x2);
+    TEST_ASSERT_EQUAL_INT(BAR_TOP + 1, r.y1);
+    TEST_ASSERT_EQUAL_INT(BAR_TOP + TftGui::BAR_HEIGHT - 1, r.y2);
+
+    test_unchanged_page_pushes_nothing();
+}
+
+// Encoder positions are not limited to the bar, and a shorter number leaves nothing of a longer one
+static void test_value_gets_shorter(void) {
+    static const int values[] = { 1234, 123, -45, 7, 100000, 0 };
+    const int value_x = BAR_X + 8;
+    int old_width = tft.text_width("  0");
+    for (int i = 0; i < 6; i++) {
+        char buf[INT_TEXT_SIZE];
+        format_int(buf, values[i], 3);
+        const int width = tft.text_width(buf);
+
+        enc_values[0] = values[i];
+        frame();
+        for (int y = VALUE_Y; y < VALUE_Y + TftGui::FONT_HEIGHT; y++) {
+            for (int x = value_x + width; x < value_x + old_width; x++) {
+                TEST_ASSERT_EQUAL_UINT16(COLOR_BLACK, tft.get_pixel(x, y));
+            }
+        }
+        old_width = width;
+    }
+}
+
+// The page switches once on the press of button 4 and redraws the whole screen, not while it is held
+static void test_page_button(void) {
+    button_states[3] = true;
+    const TftFrameStats &stats = frame();
+    TEST_ASSERT_EQUAL_UINT32(1, stats.windows);
+    TEST_ASSERT_EQUAL_UINT32(TftGui::WIDTH * TftGui::HEIGHT, stats.pixels);
+    assert_spi_bytes(stats);
+
+    test_unchanged_page_pushes_nothing();
+    enc_values[3] = 100; // the oscillator page has no action for encoder 4
+    test_unchanged_page_pushes_nothing();
+
+    button_states[3] = false;
+    test_unchanged_page_pushes_nothing();
+}
+
+void setUp(void) {
+    memset(enc_values, 0, sizeof (enc_values));
+    memset(button_states, 0, sizeof (button_states));
+    tft.clear();
+    gui = new Gui();
+    gui->update_data(enc_values, button_states);
+    gui->render();
+    tft.flush();
+}
+
+void tearDown(void) {
+    delete gui;
+}
+
+int main(int, char **) {
+    tft.begin();
+    UNITY_BEGIN();
+    RUN_TEST(test_unchanged_page_pushes_nothing);
+    RUN_TEST(test_one_encoder_redraws_its_bar);
+    RUN_TEST(test_value_gets_shorter);
+    RUN_TEST(test_page_button);
+    return UNITY_END();
+}
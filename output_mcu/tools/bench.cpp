@@ -0,0 +1,174 @@
+/*
+ * Micro-benchmarks of the output MCU's hot paths on a PC, output as JSON lines (see bench.h).
+ * The UART, I2C bus and display are host fakes (tools/native, tft_gui_framebuffer.cpp), so the
+ * figures cover the firmware's own processing and not the time spent on the buses.
+ *
+ * Build and run: pio run -e bench && .pio/build/bench/program [filter] [--baseline old.json]
+ */
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <bench.h>
+#include <tft_gui.h>
+#include <gui_pages.h>
+#include <mcu_comm.h>
+#include <trace_buffers.h>
+
+TftGui tft;
+
+// Encoder board with a full burst of events pending on every read
+static uint8_t board_seq = 0;
+
+static int encoder_board_read(uint8_t address, uint8_t reg, uint8_t *buf, int len) {
+    if (reg == ENC_REG_COUNT) {
+        buf[0] = ENC_MAX_BURST;
+    } else if (reg == ENC_REG_EVENTS) {
+        const int n = (len - ENC_TIME_SIZE) / ENC_EVENT_SIZE;
+        for (int i = 0; i < n; i++) {
+            EncEvent e;
+            e.seq = board_seq++;
+            e.type = i == ENC_MAX_BURST - 1 ? ENC_EVENT_BUTTON : ENC_EVENT_ENCODER;
+            e.index = i % ENC_NUM_ENCODERS;
+            e.value = e.type == ENC_EVENT_BUTTON ? ENC_BUTTON_RELEASED : (board_seq & 127);
+            e.timestamp = board_seq;
+            enc_event_encode(e, buf + i * ENC_EVENT_SIZE);
+        }
+        enc_time_encode(board_seq + 2, buf + n * ENC_EVENT_SIZE);
+    } else {
+        memset(buf, 0, len);
+    }
+    return len;
+}
+
+int main(int argc, char **argv) {
+    Bench bench("output_mcu", argc, argv);
+    tft.begin();
+
+    int enc_values[NUM_ENCODERS] = { 33, 10, 50, 75 };
+    bool button_states[NUM_ENCODERS] = { false, false, false, false };
+    bool enc_updated[NUM_ENCODERS];
+    bool button_updated[NUM_ENCODERS];
+
+    // A frame from the audio MCU with all four encoders, as sent while turning them quickly
+    McuCommUart uart;
+    uart.begin();
+    uint8_t frame[MCU_MAX_WIRE_FRAME];
+    McuFrameWriter writer;
+    for (int i = 0; i < NUM_ENCODERS; i++) {
+        writer.add(MSG_ENCODER, i, 20 * i + 5);
+    }
+    const int frame_len = writer.encode(frame);
+    bench.run("uart_receive_parse_frame", [&]() {
+        Serial2.feed(frame, frame_len);
+        uart.parse_uart(enc_values, enc_updated, button_states, button_updated, NUM_ENCODERS);
+        bench_keep(enc_values);
+    });
+
+    // Profiling report: a full frame of MSG_STAT
+    for (int i = 0; i < MCU_MAX_MSGS_PER_FRAME; i++) {
+        writer.add(MSG_STAT, i % STAT_NUM_IDS, i);
+    }
+    const int stat_frame_len = writer.encode(frame);
+    bench.run("uart_receive_parse_stats", [&]() {
+        Serial2.feed(frame, stat_frame_len);
+        uart.parse_uart(enc_values, enc_updated, button_states, button_updated, NUM_ENCODERS);
+        bench_keep(uart.stats_changed());
+    });
+
+    // Parameter state: a delta frame with four changes, and a GUI request sent back.
+    // Every frame needs the next version, so this includes encoding it.
+    uint16_t version = 0;
+    bench.run("uart_receive_parse_state", [&]() {
+        writer.add(MSG_STATE, STATE_DELTA, ++version);
+        for (int id = 0; id < 4; id++) {
+            writer.add(MSG_PARAM, id, (version * 64 + id) & MCU_PARAM_MAX);
+        }
+        const int len = writer.encode(frame);
+        Serial2.feed(frame, len);
+        uart.parse_uart(enc_values, enc_updated, button_states, button_updated, NUM_ENCODERS);
+        uart.send_param(PARAM_FILTER_CUTOFF, version & MCU_PARAM_MAX);
+        uart.send_pending();
+        bench_keep(uart.take_param_changes());
+    });
+
+    McuCommI2c i2c;
+    i2c.begin();
+    Wire.on_read(encoder_board_read);
+    native_set_pin(McuCommI2c::PIN_DATA_READY, HIGH);
+    bench.run("i2c_request_idle", [&]() {
+        i2c.request_encoders_buttons(enc_values, enc_updated, button_states, button_updated, NUM_ENCODERS);
+        bench_keep(enc_values);
+    });
+    native_set_pin(McuCommI2c::PIN_DATA_READY, LOW);
+    bench.run("i2c_request_burst", [&]() {
+        i2c.request_encoders_buttons(enc_values, enc_updated, button_states, button_updated, NUM_ENCODERS);
+        bench_keep(enc_values);
+    }, ENC_MAX_BURST);
+
+    // One latency sample, as recorded per encoder event and per redraw
+    LatencyHistogram latency;
+    uint32_t latency_us = 0;
+    bench.run("latency_histogram_add", [&]() {
+        latency_us = (latency_us * 13 + 7) & 0xffff;
+        latency.add(latency_us);
+        bench_keep(latency.get_count());
+    });
+
+    int value = 0;
+    bench.run("tft_draw_bar", [&]() {
+        value = (value + 1) & 127;
+        tft.draw_bar(15, 50, value, COLOR_RED);
+        tft.begin_frame();
+    });
+    bench.run("tft_update_bar", [&]() {
+        const int old_value = value;
+        value = (value + 1) & 127;
+        tft.update_bar(15, 50, old_value, value, COLOR_RED);
+        tft.begin_frame();
+    });
+    bench.run("tft_flush_bar", [&]() {
+        value = (value + 1) & 127;
+        tft.begin_frame();
+        tft.draw_bar(15, 50, value, COLOR_RED);
+        tft.flush();
+    });
+
+    // One loop() pass with all encoders turned: update the page model and redraw what changed
+    Gui gui;
+    gui.render();
+    button_states[3] = false;
+    bench.run("gui_page_render", [&]() {
+        for (int i = 0; i < NUM_ENCODERS; i++) {
+            enc_values[i] = (enc_values[i] + 1 + i) & 127;
+        }
+        tft.begin_frame();
+        gui.update_data(enc_values, button_states);
+        gui.render();
+        tft.flush();
+    });
+
+    gui.switch_page(Gui::PAGE_DIAGNOSTICS);
+    int16_t stats[STAT_NUM_IDS];
+    memset(stats, 0, sizeof (stats));
+    bench.run("gui_diagnostics_render", [&]() {
+        for (int i = 0; i < STAT_NUM_IDS; i++) {
+            stats[i] += i + 1;
+        }
+        tft.begin_frame();
+        gui.update_stats(stats);
+        tft.flush();
+    });
+
+    // One trace point and what loop() later does with it: merge, encode and send
+    TaskTraceBuffer *const trace_buffers[] = { &trace_loop, &trace_input, &trace_render };
+    bench.run("trace_record_drain", [&]() {
+        trace_input.record(TRACE_LEVEL_INFO, TRACE_ENC_BURST, 2, 17, micros());
+        uint8_t frame[TRACE_WIRE_FRAME];
+        TraceRecord r;
+        while (trace_take(trace_buffers, 3, r)) {
+            Serial.write(frame, trace_frame_encode(r, frame));
+        }
+    });
+
+    return bench.finish();
+}
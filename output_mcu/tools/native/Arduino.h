@@ -0,0 +1,73 @@
+#ifndef _NATIVE_ARDUINO_H
+#define _NATIVE_ARDUINO_H
+
+/*
+ * The parts of the ESP32 Arduino core the output_mcu sources use, for native (PC) builds.
+ * Serial2 replays bytes queued with feed() instead of reading a UART and only counts what is written.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <functional>
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define INPUT_PULLUP 0x05
+
+uint32_t micros();
+uint32_t millis();
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void native_set_pin(uint8_t pin, int level); // level digitalRead() returns, HIGH by default
+
+class NativeSerial {
+    public:
+    static const int RX_BUFFER_SIZE = 4096;
+
+    NativeSerial() : rx_head(0), rx_tail(0), tx_bytes(0) {}
+
+    void begin(unsigned long baud) {}
+    void setRxBufferSize(size_t size) {}
+    void onReceive(std::function<void()> callback) { on_receive = callback; }
+    int available() const { return rx_tail - rx_head; }
+    int read() { return rx_head < rx_tail ? rx_buffer[rx_head++] : -1; }
+
+    // Queues bytes as if they had been received and calls the onReceive() callback like the UART driver
+    void feed(const uint8_t *data, int len) {
+        if (rx_head == rx_tail) rx_head = rx_tail = 0;
+        if (len > RX_BUFFER_SIZE - rx_tail) len = RX_BUFFER_SIZE - rx_tail;
+        memcpy(rx_buffer + rx_tail, data, len);
+        rx_tail += len;
+        if (on_receive) on_receive();
+    }
+
+    size_t write(const uint8_t *data, size_t len) {
+        tx_bytes += len;
+        return len;
+    }
+    uint32_t get_tx_bytes() const { return tx_bytes; }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+        va_list args;
+        va_start(args, format);
+        const int len = vprintf(format, args);
+        va_end(args);
+        return len > 0 ? len : 0;
+    }
+    size_t print(const char *s) { return fputs(s, stdout) >= 0 ? strlen(s) : 0; }
+    size_t println(const char *s = "") { return print(s) + print("\n"); }
+
+    private:
+    uint8_t rx_buffer[RX_BUFFER_SIZE];
+    int rx_head, rx_tail;
+    uint32_t tx_bytes;
+    std::function<void()> on_receive;
+};
+
+extern NativeSerial Serial, Serial2;
+
+#endif
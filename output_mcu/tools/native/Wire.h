@@ -0,0 +1,43 @@
+#ifndef _NATIVE_WIRE_H
+#define _NATIVE_WIRE_H
+
+#include <stdint.h>
+#include <functional>
+
+/*
+ * I2C master for native (PC) builds. Reads are answered by the device function set with
+ * on_read(), which gets the register written before the repeated start, e.g. to emulate
+ * the encoder board (see enc_events.h).
+ */
+class NativeWire {
+    public:
+    typedef std::function<int(uint8_t address, uint8_t reg, uint8_t *buf, int len)> ReadFunction;
+
+    NativeWire() : address(0), reg(0), rx_len(0), rx_pos(0) {}
+
+    void begin() {}
+    void on_read(ReadFunction device) { this->device = device; }
+
+    void beginTransmission(int address) { this->address = address; }
+    size_t write(uint8_t value) { reg = value; return 1; }
+    uint8_t endTransmission(bool stop = true) { return device ? 0 : 2; } // 2: address not acknowledged
+
+    uint8_t requestFrom(int address, int len) {
+        if (!device || len > (int)sizeof (rx_buffer)) return 0;
+        rx_len = device(address, reg, rx_buffer, len);
+        rx_pos = 0;
+        return rx_len;
+    }
+    int read() { return rx_pos < rx_len ? rx_buffer[rx_pos++] : -1; }
+
+    private:
+    uint8_t address;
+    uint8_t reg;
+    uint8_t rx_buffer[128];
+    int rx_len, rx_pos;
+    ReadFunction device;
+};
+
+extern NativeWire Wire;
+
+#endif
@@ -0,0 +1,39 @@
+#include <time.h>
+#include <Arduino.h>
+#include <Wire.h>
+
+NativeSerial Serial, Serial2;
+NativeWire Wire;
+
+static uint8_t pin_levels[40];
+static bool pin_levels_set = false;
+
+static uint64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint32_t micros() {
+    return now_us();
+}
+
+uint32_t millis() {
+    return now_us() / 1000;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+void native_set_pin(uint8_t pin, int level) {
+    if (!pin_levels_set) {
+        memset(pin_levels, HIGH, sizeof (pin_levels));
+        pin_levels_set = true;
+    }
+    if (pin < sizeof (pin_levels)) pin_levels[pin] = level;
+}
+
+int digitalRead(uint8_t pin) {
+    if (!pin_levels_set || pin >= sizeof (pin_levels)) return HIGH;
+    return pin_levels[pin];
+}